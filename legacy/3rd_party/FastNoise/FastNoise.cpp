@@ -29,8 +29,16 @@
 #include "FastNoise.h"
 #include <math.h>
 #include <assert.h>
+#include <stddef.h>
 #include <random>
 
+// The batch kernels rely on SSE float arithmetic for bit-identical results,
+// which x86-64 always uses for scalar code too
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FN_BATCH_X86
+#include <immintrin.h>
+#endif
+
 const float GRAD_X[] =
 {
 	1, -1, 1, -1,
@@ -1941,3 +1949,190 @@ void FastNoise::SinglePositionWarp(unsigned char offset, float warpAmp, float fr
 	x += Lerp(lx0x, lx1x, ys) * warpAmp;
 	y += Lerp(ly0x, ly1x, ys) * warpAmp;
 }
+
+// Batch evaluation
+
+struct BatchParams
+{
+	int perm[512];
+	int perm12[512];
+	float frequency;
+	float lacunarity;
+	float gain;
+	float fractalBounding;
+	unsigned int octaves;
+	int interp;
+	bool simplex;
+	bool fractal;
+};
+
+#ifdef FN_BATCH_X86
+namespace FastNoiseSSE2
+{
+typedef __m128 Float;
+typedef __m128i Int;
+static const int Lanes = 4;
+static const bool ComputeGradients = false;
+
+static inline Float Set(float a) { return _mm_set1_ps(a); }
+static inline Int SetI(int a) { return _mm_set1_epi32(a); }
+static inline Int LaneRamp() { return _mm_setr_epi32(0, 1, 2, 3); }
+static inline Float Add(Float a, Float b) { return _mm_add_ps(a, b); }
+static inline Float Sub(Float a, Float b) { return _mm_sub_ps(a, b); }
+static inline Float Mul(Float a, Float b) { return _mm_mul_ps(a, b); }
+static inline Int AddI(Int a, Int b) { return _mm_add_epi32(a, b); }
+static inline Int SubI(Int a, Int b) { return _mm_sub_epi32(a, b); }
+static inline Int AndI(Int a, Int b) { return _mm_and_si128(a, b); }
+static inline Int AndNotI(Int mask, Int a) { return _mm_andnot_si128(mask, a); }
+static inline Int LessI(Int a, Int b) { return _mm_cmplt_epi32(a, b); }
+static inline Int SelectI(Int mask, Int a, Int b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); }
+static inline Float ToFloat(Int a) { return _mm_cvtepi32_ps(a); }
+static inline Int Truncate(Float a) { return _mm_cvttps_epi32(a); }
+static inline Float Less(Float a, Float b) { return _mm_cmplt_ps(a, b); }
+static inline Float Greater(Float a, Float b) { return _mm_cmpgt_ps(a, b); }
+static inline Int MaskI(Float mask) { return _mm_castps_si128(mask); }
+static inline Float Select(Float mask, Float a, Float b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline void Store(float* out, Float a) { _mm_storeu_ps(out, a); }
+
+// SSE2 has no gather, so look the lanes up one at a time
+static inline Int Gather(const int* table, Int index)
+{
+	alignas(16) int i[4];
+	_mm_store_si128((__m128i*)i, index);
+	return _mm_setr_epi32(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+}
+static inline Float GatherF(const float* table, Int index)
+{
+	alignas(16) int i[4];
+	_mm_store_si128((__m128i*)i, index);
+	return _mm_setr_ps(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+}
+
+#include "FastNoiseBatch.inl"
+}
+
+#if defined(__clang__)
+#pragma clang attribute push (__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+
+namespace FastNoiseAVX2
+{
+typedef __m256 Float;
+typedef __m256i Int;
+static const int Lanes = 8;
+static const bool ComputeGradients = true;
+
+static inline Float Set(float a) { return _mm256_set1_ps(a); }
+static inline Int SetI(int a) { return _mm256_set1_epi32(a); }
+static inline Int LaneRamp() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+static inline Float Add(Float a, Float b) { return _mm256_add_ps(a, b); }
+static inline Float Sub(Float a, Float b) { return _mm256_sub_ps(a, b); }
+static inline Float Mul(Float a, Float b) { return _mm256_mul_ps(a, b); }
+static inline Int AddI(Int a, Int b) { return _mm256_add_epi32(a, b); }
+static inline Int SubI(Int a, Int b) { return _mm256_sub_epi32(a, b); }
+static inline Int AndI(Int a, Int b) { return _mm256_and_si256(a, b); }
+static inline Int AndNotI(Int mask, Int a) { return _mm256_andnot_si256(mask, a); }
+static inline Int LessI(Int a, Int b) { return _mm256_cmpgt_epi32(b, a); }
+static inline Int SelectI(Int mask, Int a, Int b) { return _mm256_blendv_epi8(b, a, mask); }
+static inline Float ToFloat(Int a) { return _mm256_cvtepi32_ps(a); }
+static inline Int Truncate(Float a) { return _mm256_cvttps_epi32(a); }
+static inline Float Less(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline Float Greater(Float a, Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline Int MaskI(Float mask) { return _mm256_castps_si256(mask); }
+static inline Float Select(Float mask, Float a, Float b) { return _mm256_blendv_ps(b, a, mask); }
+static inline void Store(float* out, Float a) { _mm256_storeu_ps(out, a); }
+static inline Int Gather(const int* table, Int index) { return _mm256_i32gather_epi32(table, index, 4); }
+static inline Float GatherF(const float* table, Int index) { return _mm256_i32gather_ps(table, index, 4); }
+
+#include "FastNoiseBatch.inl"
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif // FN_BATCH_X86
+
+FastNoise::BatchKernel FastNoise::GetBatchKernel()
+{
+#ifdef FN_BATCH_X86
+	static const BatchKernel best = []
+	{
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") ? BatchAVX2 : BatchSSE2;
+	}();
+	return best;
+#else
+	return BatchScalar;
+#endif
+}
+
+void FastNoise::FillNoiseSet(float* out, int x0, int y0, int w, int h)
+{
+	FillNoiseSet(out, x0, y0, w, h, GetBatchKernel());
+}
+
+void FastNoise::FillNoiseSet(float* out, int x0, int y0, int w, int h, BatchKernel kernel)
+{
+	if (w <= 0 || h <= 0)
+		return;
+
+	BatchParams p;
+	switch (m_noiseType)
+	{
+	case Gradient:
+		p.simplex = false;
+		p.fractal = false;
+		break;
+	case GradientFractal:
+		p.simplex = false;
+		p.fractal = true;
+		break;
+	case Simplex:
+		p.simplex = true;
+		p.fractal = false;
+		break;
+	case SimplexFractal:
+		p.simplex = true;
+		p.fractal = true;
+		break;
+	default:
+		kernel = BatchScalar;
+		break;
+	}
+	if (kernel != BatchScalar && p.fractal && m_fractalType != FBM)
+		kernel = BatchScalar;
+	if (kernel > GetBatchKernel())
+		kernel = GetBatchKernel();
+
+	if (kernel == BatchScalar)
+	{
+		for (int j = 0; j < h; j++)
+			for (int i = 0; i < w; i++)
+				out[(size_t)j * w + i] = GetNoise((float)(x0 + i), (float)(y0 + j));
+		return;
+	}
+
+#ifdef FN_BATCH_X86
+	for (int i = 0; i < 512; i++)
+	{
+		p.perm[i] = m_perm[i];
+		p.perm12[i] = m_perm12[i];
+	}
+	p.frequency = m_frequency;
+	p.lacunarity = m_lacunarity;
+	p.gain = m_gain;
+	p.fractalBounding = m_fractalBounding;
+	p.octaves = m_octaves;
+	p.interp = m_interp;
+
+	if (kernel == BatchAVX2)
+		FastNoiseAVX2::BatchFill(p, out, x0, y0, w, h);
+	else
+		FastNoiseSSE2::BatchFill(p, out, x0, y0, w, h);
+#endif
+}
@@ -40,6 +40,7 @@ public:
 	enum FractalType { FBM, Billow, RigidMulti };
 	enum CellularDistanceFunction { Euclidean, Manhattan, Natural };
 	enum CellularReturnType { CellValue, NoiseLookup, Distance, Distance2, Distance2Add, Distance2Sub, Distance2Mul, Distance2Div };
+	enum BatchKernel { BatchScalar, BatchSSE2, BatchAVX2 };
 
 	// Returns seed used for all noise types
 	void SetSeed(int seed);
@@ -115,6 +116,18 @@ public:
 
 	float GetNoise(float x, float y);
 
+	// Fills out[j * w + i] with GetNoise(x0 + i, y0 + j) for a w by h grid of integer coordinates
+	// Gradient and Simplex noise, single or FBM fractal, are evaluated several points at a time with
+	// the widest SIMD kernel the CPU supports; the results are bit-identical to GetNoise()
+	// Other noise types fall back to calling GetNoise() for each point
+	void FillNoiseSet(float* out, int x0, int y0, int w, int h);
+
+	// As above, using at most the given kernel (for testing and benchmarking)
+	void FillNoiseSet(float* out, int x0, int y0, int w, int h, BatchKernel kernel);
+
+	// Returns the widest batch kernel supported by this build and CPU
+	static BatchKernel GetBatchKernel();
+
 	void PositionWarp(float& x, float& y);
 	void PositionWarpFractal(float& x, float& y);
 
@@ -0,0 +1,211 @@
+// FastNoiseBatch.inl
+//
+// Batch evaluation of 2D gradient and simplex noise, written once against a
+// small set of vector primitives and included by FastNoise.cpp once for each
+// instruction set.  The including namespace provides:
+//
+//   Float, Int                      vector types
+//   Lanes                           the number of lanes
+//   ComputeGradients                whether gradients are computed or looked up
+//   Set(float), SetI(int), LaneRamp()
+//   Add, Sub, Mul                   float arithmetic
+//   AddI, SubI, AndI, AndNotI       int arithmetic
+//   LessI(a, b), SelectI(mask, a, b)
+//   ToFloat(Int), Truncate(Float)
+//   Less(a, b), Greater(a, b)       comparisons returning a lane mask
+//   MaskI(mask)                     a mask as an int vector (-1 or 0)
+//   Select(mask, a, b)              a where mask is set, b elsewhere
+//   Gather(int const*, Int), GatherF(float const*, Int)
+//   Store(float*, Float)
+//
+// Every operation is performed in the same order and at the same precision
+// as the scalar code in FastNoise.cpp so the results are bit-identical.
+
+static inline Int BatchFastFloor(Float f)
+{
+	// (int)f, less one where f is negative
+	return AddI(Truncate(f), MaskI(Less(f, Set(0.0f))));
+}
+
+static inline Float BatchInterp(int interp, Float t)
+{
+	switch (interp)
+	{
+	case FastNoise::Hermite:
+		return Mul(Mul(t, t), Sub(Set(3.0f), Mul(Set(2.0f), t)));
+	case FastNoise::Quintic:
+		return Mul(Mul(Mul(t, t), t), Add(Mul(t, Sub(Mul(t, Set(6.0f)), Set(15.0f))), Set(10.0f)));
+	default:
+		return t;
+	}
+}
+
+static inline float BatchInterp(int interp, float t)
+{
+	switch (interp)
+	{
+	case FastNoise::Hermite:
+		return InterpHermiteFunc(t);
+	case FastNoise::Quintic:
+		return InterpQuinticFunc(t);
+	default:
+		return t;
+	}
+}
+
+static inline Float BatchLerp(Float a, Float b, Float t)
+{
+	return Add(a, Mul(t, Sub(b, a)));
+}
+
+// The gradient of each lattice point, dotted with the offset (xd, yd)
+static inline Float BatchGradDot(Int lutPos, Float xd, Float yd)
+{
+	if (!ComputeGradients)
+		return Add(Mul(xd, GatherF(GRAD_X, lutPos)), Mul(yd, GatherF(GRAD_Y, lutPos)));
+
+	// Worked out from the bits of lutPos rather than looked up: entries 0-7
+	// have GRAD_X = +-1 (the sign from bit 0), entries 0-3 GRAD_Y = +-1 (the
+	// sign from bit 1) and entries 8-11 GRAD_Y = +-1 (the sign from bit 0);
+	// the rest are 0
+	Int one = SetI(1);
+	Int sign0 = SubI(one, AddI(AndI(lutPos, one), AndI(lutPos, one)));
+	Int sign1 = SubI(one, AndI(lutPos, SetI(2)));
+	Int lowX = LessI(lutPos, SetI(8));
+	Int lowY = LessI(lutPos, SetI(4));
+	Int gradX = AndI(lowX, sign0);
+	Int gradY = SelectI(lowY, sign1, AndNotI(lowX, sign0));
+
+	return Add(Mul(xd, ToFloat(gradX)), Mul(yd, ToFloat(gradY)));
+}
+
+static inline Float BatchGradCoord2D(const BatchParams& p, int offset, Int x, Int y, Float xd, Float yd)
+{
+	Int lutPos = Gather(p.perm12, AddI(AndI(x, SetI(0xff)), Gather(p.perm, AddI(AndI(y, SetI(0xff)), SetI(offset)))));
+
+	return BatchGradDot(lutPos, xd, yd);
+}
+
+// A row of points shares its y coordinate, so the y half of the lookup is done once
+static inline Float BatchGradCoord2D(const BatchParams& p, int rowPerm, Int x, Float xd, Float yd)
+{
+	Int lutPos = Gather(p.perm12, AddI(AndI(x, SetI(0xff)), SetI(rowPerm)));
+
+	return BatchGradDot(lutPos, xd, yd);
+}
+
+static inline Float BatchSingleGradient(const BatchParams& p, int offset, Float x, float y)
+{
+	Int x0 = BatchFastFloor(x);
+	int y0 = FastFloor(y);
+	Int x1 = AddI(x0, SetI(1));
+	int y1 = y0 + 1;
+
+	Float xd0 = Sub(x, ToFloat(x0));
+	float yd0 = y - (float)y0;
+	Float xd1 = Sub(xd0, Set(1.0f));
+	float yd1 = yd0 - 1.0f;
+
+	Float xs = BatchInterp(p.interp, xd0);
+	Float ys = Set(BatchInterp(p.interp, yd0));
+
+	int row0 = p.perm[(y0 & 0xff) + offset];
+	int row1 = p.perm[(y1 & 0xff) + offset];
+
+	Float xf0 = BatchLerp(BatchGradCoord2D(p, row0, x0, xd0, Set(yd0)), BatchGradCoord2D(p, row0, x1, xd1, Set(yd0)), xs);
+	Float xf1 = BatchLerp(BatchGradCoord2D(p, row1, x0, xd0, Set(yd1)), BatchGradCoord2D(p, row1, x1, xd1, Set(yd1)), xs);
+
+	return BatchLerp(xf0, xf1, ys);
+}
+
+static inline Float BatchSimplexCorner(const BatchParams& p, int offset, Int i, Int j, Float x, Float y)
+{
+	Float t = Sub(Sub(Set(0.5f), Mul(x, x)), Mul(y, y));
+	Float outside = Less(t, Set(0.0f));
+	t = Mul(t, t);
+	Float n = Mul(Mul(t, t), BatchGradCoord2D(p, offset, i, j, x, y));
+	return Select(outside, Set(0.0f), n);
+}
+
+static inline Float BatchSingleSimplex(const BatchParams& p, int offset, Float x, Float y)
+{
+	Float t = Mul(Add(x, y), Set(F2));
+	Int i = BatchFastFloor(Add(x, t));
+	Int j = BatchFastFloor(Add(y, t));
+
+	t = Mul(ToFloat(AddI(i, j)), Set(G2));
+	Float X0 = Sub(ToFloat(i), t);
+	Float Y0 = Sub(ToFloat(j), t);
+
+	Float x0 = Sub(x, X0);
+	Float y0 = Sub(y, Y0);
+
+	Int i1 = AndI(MaskI(Greater(x0, y0)), SetI(1));
+	Int j1 = SubI(SetI(1), i1);
+
+	Float x1 = Add(Sub(x0, ToFloat(i1)), Set(G2));
+	Float y1 = Add(Sub(y0, ToFloat(j1)), Set(G2));
+	Float x2 = Add(Sub(x0, Set(1.0f)), Set(2.0f * G2));
+	Float y2 = Add(Sub(y0, Set(1.0f)), Set(2.0f * G2));
+
+	Float n0 = BatchSimplexCorner(p, offset, i, j, x0, y0);
+	Float n1 = BatchSimplexCorner(p, offset, AddI(i, i1), AddI(j, j1), x1, y1);
+	Float n2 = BatchSimplexCorner(p, offset, AddI(i, SetI(1)), AddI(j, SetI(1)), x2, y2);
+
+	return Mul(Set(50.0f), Add(Add(n0, n1), n2));
+}
+
+static inline Float BatchSingle(const BatchParams& p, int offset, Float x, float y)
+{
+	return p.simplex ? BatchSingleSimplex(p, offset, x, Set(y)) : BatchSingleGradient(p, offset, x, y);
+}
+
+static inline Float BatchNoise(const BatchParams& p, Float x, float y)
+{
+	if (!p.fractal)
+		return BatchSingle(p, 0, x, y);
+
+	// FBM
+	Float sum = BatchSingle(p, p.perm[0], x, y);
+	float amp = 1.0f;
+	unsigned int i = 0;
+
+	while (++i < p.octaves)
+	{
+		x = Mul(x, Set(p.lacunarity));
+		y *= p.lacunarity;
+
+		amp *= p.gain;
+		sum = Add(sum, Mul(BatchSingle(p, p.perm[i], x, y), Set(amp)));
+	}
+
+	return Mul(sum, Set(p.fractalBounding));
+}
+
+static void BatchFill(const BatchParams& p, float* out, int x0, int y0, int w, int h)
+{
+	Float frequency = Set(p.frequency);
+	for (int j = 0; j < h; j++)
+	{
+		float y = (float)(y0 + j) * p.frequency;
+		float* row = out + (size_t)j * w;
+
+		int i = 0;
+		for (; i + Lanes <= w; i += Lanes)
+		{
+			Float x = Mul(ToFloat(AddI(SetI(x0 + i), LaneRamp())), frequency);
+			Store(row + i, BatchNoise(p, x, y));
+		}
+
+		// The last partial vector is evaluated in full and only the points
+		// inside the row are kept
+		if (i < w)
+		{
+			float tail[Lanes];
+			Float x = Mul(ToFloat(AddI(SetI(x0 + i), LaneRamp())), frequency);
+			Store(tail, BatchNoise(p, x, y));
+			for (int k = 0; i + k < w; k++)
+				row[i + k] = tail[k];
+		}
+	}
+}
@@ -57,3 +57,42 @@ choose_sexuality()
   return Sexuality::generate(config_, rng_);
 }
 
+
+void Legacy::Character::BasicCharacterBuilder::
+choose_sexualities(std::size_t count, std::vector<Legacy::Character::Sexuality>& out)
+{
+  Sexuality::generate(config_, rng_, count, out);
+}
+
+
+void Legacy::Character::BasicCharacterBuilder::
+choose_given_names(Legacy::Character::Sexuality::Gender         gender,
+                   std::size_t                                  count,
+                   Legacy::Character::NameGenerator::NameIndex* out)
+{
+  givenname_generator_->pick_names(gender, rng_, count, out);
+}
+
+
+void Legacy::Character::BasicCharacterBuilder::
+choose_surnames(Legacy::Character::Sexuality::Gender         gender,
+                std::size_t                                  count,
+                Legacy::Character::NameGenerator::NameIndex* out)
+{
+  surname_generator_->pick_names(gender, rng_, count, out);
+}
+
+
+char const* Legacy::Character::BasicCharacterBuilder::
+given_name(Legacy::Character::NameGenerator::NameIndex index) const
+{
+  return givenname_generator_->name(index);
+}
+
+
+char const* Legacy::Character::BasicCharacterBuilder::
+surname(Legacy::Character::NameGenerator::NameIndex index) const
+{
+  return surname_generator_->name(index);
+}
+
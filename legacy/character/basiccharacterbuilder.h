@@ -55,11 +55,48 @@ public:
   Sexuality
   choose_sexuality() override;
 
+  /**
+   * Chooses given names for a whole batch of characters of one gender.
+   *
+   * The names are written to @p out as name indexes, resolved using
+   * given_name().  No memory is allocated per name.
+   */
+  void
+  choose_given_names(Sexuality::Gender         gender,
+                     std::size_t               count,
+                     NameGenerator::NameIndex* out);
+
+  /**
+   * Chooses surnames for a whole batch of characters of one gender.
+   *
+   * The names are written to @p out as name indexes, resolved using
+   * surname().  No memory is allocated per name.
+   */
+  void
+  choose_surnames(Sexuality::Gender         gender,
+                  std::size_t               count,
+                  NameGenerator::NameIndex* out);
+
+  /**
+   * Chooses the sexualities of a whole batch of characters, drawing all their
+   * random values in one pass, and appends them to @p out.
+   */
+  void
+  choose_sexualities(std::size_t count, std::vector<Sexuality>& out);
+
+  /** Resolves a given name chosen by choose_given_names(). */
+  char const*
+  given_name(NameGenerator::NameIndex index) const;
+
+  /** Resolves a surname chosen by choose_surnames(). */
+  char const*
+  surname(NameGenerator::NameIndex index) const;
+
 private:
   Core::Config const&         config_;
   Core::RandomNumberGenerator rng_;
-  NameGenerator::OwningPtr    givenname_generator_;
-  NameGenerator::OwningPtr    surname_generator_;
+  NameGenerator::SharedPtr    givenname_generator_;
+  NameGenerator::SharedPtr    surname_generator_;
 };
 
 
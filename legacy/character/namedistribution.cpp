@@ -0,0 +1,208 @@
+/**
+ * @file legacy/character/namedistribution.cpp
+ * @brief part of the Legacy character name submodule.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/character/namedistribution.h"
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+
+namespace
+{
+
+//
+// The compiled format is a fixed header followed by four sections: the alias
+// table probabilities (double), the alias table aliases (uint32), the name
+// offsets (uint32) and the NUL-terminated name pool.  Each section starts on an
+// 8-byte boundary.  Everything is in host byte order; the byte_order field
+// lets a reader detect a file compiled on a foreign-endian host.
+//
+const char          compiled_magic[8] = { 'L', 'G', 'C', 'Y', 'N', 'A', 'M', 'E' };
+const std::uint32_t compiled_byte_order = 0x01020304;
+const std::uint32_t compiled_version = 1;
+
+struct CompiledHeader
+{
+  char          magic[8];
+  std::uint32_t byte_order;
+  std::uint32_t version;
+  std::uint32_t count;
+  std::uint32_t reserved;
+  std::uint64_t pool_size;
+  std::uint64_t probability_offset;
+  std::uint64_t alias_offset;
+  std::uint64_t offsets_offset;
+  std::uint64_t pool_offset;
+};
+
+
+std::uint64_t
+align8(std::uint64_t offset)
+{ return (offset + 7) & ~std::uint64_t(7); }
+
+
+/**
+ * Confirms a section of @p count elements of @p element_size bytes at
+ * @p offset lies entirely within a file of @p file_size bytes.
+ */
+bool
+section_fits(std::uint64_t offset, std::uint64_t count, std::uint64_t element_size, std::uint64_t file_size)
+{
+  if (offset % 8 != 0 || offset > file_size)
+    return false;
+  return count <= (file_size - offset) / element_size;
+}
+
+
+void
+write_padding(std::ostream& ostr, std::uint64_t& offset)
+{
+  static const char zeros[8] = { };
+  std::uint64_t aligned = align8(offset);
+  ostr.write(zeros, aligned - offset);
+  offset = aligned;
+}
+
+} // anonymous namespace
+
+
+const std::string Legacy::Character::NameDistribution::compiled_suffix = ".cdist";
+
+
+Legacy::Character::NameDistribution::
+NameDistribution(Core::MappedFileOwningPtr mapping, NameTable&& names, Core::AliasTable&& chooser)
+: mapping_(std::move(mapping))
+, names_(std::move(names))
+, chooser_(std::move(chooser))
+{ }
+
+
+Legacy::Character::NameDistribution Legacy::Character::NameDistribution::
+parse(std::istream& istr)
+{
+  NameTable                 names;
+  Core::AliasTable::Weights weights;
+
+  std::string name;
+  double      weight;
+  double      cum_weight;
+  int         index;
+  while (istr >> name >> weight >> cum_weight >> index)
+  {
+    weights.push_back(weight);
+    names.add(name);
+  }
+  if (names.size() == 0)
+    throw std::runtime_error("no names found in dist file");
+
+  Core::AliasTable chooser(weights);
+  return NameDistribution(Core::MappedFileOwningPtr(), std::move(names), std::move(chooser));
+}
+
+
+Legacy::Character::NameDistribution Legacy::Character::NameDistribution::
+from_compiled(Core::MappedFileOwningPtr mapping)
+{
+  if (!mapping)
+    throw std::runtime_error("no compiled dist file");
+
+  char const* data = mapping->data();
+  std::uint64_t size = mapping->size();
+
+  CompiledHeader header;
+  if (size < sizeof(header))
+    throw std::runtime_error("compiled dist file is truncated");
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.magic, compiled_magic, sizeof(compiled_magic)) != 0)
+    throw std::runtime_error("not a compiled dist file");
+  if (header.byte_order != compiled_byte_order)
+    throw std::runtime_error("compiled dist file has the wrong byte order");
+  if (header.version != compiled_version)
+    throw std::runtime_error("unsupported compiled dist file version");
+  if (header.count == 0
+   || !section_fits(header.probability_offset, header.count, sizeof(double), size)
+   || !section_fits(header.alias_offset, header.count, sizeof(std::uint32_t), size)
+   || !section_fits(header.offsets_offset, header.count, sizeof(std::uint32_t), size)
+   || !section_fits(header.pool_offset, header.pool_size, 1, size)
+   || header.pool_size == 0)
+    throw std::runtime_error("compiled dist file is corrupt");
+
+  auto probabilities = reinterpret_cast<double const*>(data + header.probability_offset);
+  auto aliases = reinterpret_cast<std::uint32_t const*>(data + header.alias_offset);
+  auto offsets = reinterpret_cast<std::uint32_t const*>(data + header.offsets_offset);
+  auto pool = data + header.pool_offset;
+
+  // Make sure nothing can index outside the mapping later.
+  if (pool[header.pool_size - 1] != '\0')
+    throw std::runtime_error("compiled dist file is corrupt");
+  for (std::uint32_t i = 0; i < header.count; ++i)
+  {
+    if (aliases[i] >= header.count || offsets[i] >= header.pool_size)
+      throw std::runtime_error("compiled dist file is corrupt");
+  }
+
+  NameTable names(header.count, offsets, pool, header.pool_size);
+  Core::AliasTable chooser(header.count, probabilities, aliases);
+  return NameDistribution(std::move(mapping), std::move(names), std::move(chooser));
+}
+
+
+void Legacy::Character::NameDistribution::
+write_compiled(std::ostream& ostr) const
+{
+  std::uint64_t count = names_.size();
+
+  CompiledHeader header;
+  std::memset(&header, 0, sizeof(header));
+  std::memcpy(header.magic, compiled_magic, sizeof(compiled_magic));
+  header.byte_order         = compiled_byte_order;
+  header.version            = compiled_version;
+  header.count              = static_cast<std::uint32_t>(count);
+  header.pool_size          = names_.pool_size();
+  header.probability_offset = align8(sizeof(header));
+  header.alias_offset       = align8(header.probability_offset + count * sizeof(double));
+  header.offsets_offset     = align8(header.alias_offset + count * sizeof(std::uint32_t));
+  header.pool_offset        = align8(header.offsets_offset + count * sizeof(std::uint32_t));
+
+  std::uint64_t offset = 0;
+  ostr.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  offset += sizeof(header);
+
+  write_padding(ostr, offset);
+  ostr.write(reinterpret_cast<char const*>(chooser_.probabilities()), count * sizeof(double));
+  offset += count * sizeof(double);
+
+  write_padding(ostr, offset);
+  ostr.write(reinterpret_cast<char const*>(chooser_.aliases()), count * sizeof(std::uint32_t));
+  offset += count * sizeof(std::uint32_t);
+
+  write_padding(ostr, offset);
+  ostr.write(reinterpret_cast<char const*>(names_.offsets()), count * sizeof(std::uint32_t));
+  offset += count * sizeof(std::uint32_t);
+
+  write_padding(ostr, offset);
+  ostr.write(names_.pool(), names_.pool_size());
+
+  if (!ostr)
+    throw std::runtime_error("error writing compiled dist file");
+}
+
@@ -0,0 +1,104 @@
+/**
+ * @file legacy/character/namedistribution.h
+ * @brief part of the Legacy character name submodule.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_CHARACTER_NAMEDISTRIBUTION_H
+#define LEGACY_CHARACTER_NAMEDISTRIBUTION_H
+
+#include "legacy/character/nametable.h"
+#include "legacy/core/alias_table.h"
+#include "legacy/core/filesystem.h"
+#include <iosfwd>
+#include <string>
+
+
+namespace Legacy
+{
+namespace Character
+{
+
+/**
+ * A frequency distribution of names: a table of names and the alias table
+ * used to sample from it.
+ *
+ * A distribution is either parsed from the census-style text format (one
+ * "NAME frequency cumulative-frequency rank" entry per line) or loaded from
+ * the compiled binary format, which holds the string pool, name offsets and
+ * the prebuilt alias table laid out so they can be used directly from a
+ * memory-mapped file without any parsing or copying.
+ */
+class NameDistribution
+{
+public:
+  /** The file name suffix for compiled distributions. */
+  static const std::string compiled_suffix;
+
+public:
+  /**
+   * Parses a distribution in the text format.
+   * @throws std::runtime_error if the stream holds no valid entries.
+   */
+  static NameDistribution
+  parse(std::istream& istr);
+
+  /**
+   * Uses a distribution in the compiled format.
+   *
+   * The names and alias table are used in place and the distribution takes
+   * ownership of the mapping.
+   *
+   * @throws std::runtime_error if the mapped file is not a valid compiled
+   * distribution.
+   */
+  static NameDistribution
+  from_compiled(Core::MappedFileOwningPtr mapping);
+
+  NameDistribution(NameDistribution&&) = default;
+
+  NameDistribution&
+  operator=(NameDistribution&&) = default;
+
+  /** Writes the distribution in the compiled format. */
+  void
+  write_compiled(std::ostream& ostr) const;
+
+  /** The names in the distribution. */
+  NameTable const&
+  names() const
+  { return names_; }
+
+  /** The sampler for indexes into names(). */
+  Core::AliasTable const&
+  chooser() const
+  { return chooser_; }
+
+private:
+  NameDistribution(Core::MappedFileOwningPtr mapping, NameTable&& names, Core::AliasTable&& chooser);
+
+private:
+  Core::MappedFileOwningPtr mapping_;
+  NameTable                 names_;
+  Core::AliasTable          chooser_;
+};
+
+
+} // namespace Character
+} // namespace Legacy
+
+#endif /* LEGACY_CHARACTER_NAMEDISTRIBUTION_H */
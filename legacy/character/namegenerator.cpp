@@ -22,7 +22,11 @@
 #include "legacy/character/statisticalnamegenerator.h"
 #include "legacy/core/posix_filesystem.h"
 
+#include <algorithm>
+#include <map>
+#include <mutex>
 #include <stdexcept>
+#include <utility>
 
 
 /**
@@ -36,7 +40,22 @@ public:
 
   std::string
   pick_name(Legacy::Character::Sexuality::Gender,
-            Legacy::Core::RandomNumberGenerator&)
+            Legacy::Core::RandomNumberGenerator&) const
+  {
+    return "Moon";
+  }
+
+  void
+  pick_names(Legacy::Character::Sexuality::Gender,
+             Legacy::Core::RandomNumberGenerator&,
+             std::size_t count,
+             NameIndex*  out) const
+  {
+    std::fill(out, out + count, 0);
+  }
+
+  char const*
+  name(NameIndex) const
   {
     return "Moon";
   }
@@ -51,22 +70,62 @@ Legacy::Character::NameGenerator::
 { }
 
 
-Legacy::Character::NameGenerator::OwningPtr Legacy::Character::
+Legacy::Character::NameGenerator::SharedPtr Legacy::Character::
 get_name_generator(Core::Config const& config,
                    NameGenerator::Part part)
 {
+  Core::PosixFileSystem fs;
+  return get_name_generator(config, fs, part);
+}
+
+
+Legacy::Character::NameGenerator::SharedPtr Legacy::Character::
+get_name_generator(Core::Config const&     config,
+                   Core::FileSystem const& fs,
+                   NameGenerator::Part     part)
+{
+  using Key = std::pair<std::string, std::string>;
+  static std::mutex                              registry_mutex;
+  static std::map<Key, NameGenerator::SharedPtr> registry;
+
   std::string generator_type = config.get<std::string>("name-generator", "statistical");
 
+  std::string data_path;
+  if (generator_type == "statistical")
+  {
+    for (auto gender: { Sexuality::Gender::masculine, Sexuality::Gender::feminine })
+    {
+      std::string file_name = StatisticalNameGenerator::data_file_name(config, part, gender);
+      std::string path = config.find_data_file(fs, file_name + NameDistribution::compiled_suffix);
+      if (path.empty())
+        path = config.find_data_file(fs, file_name);
+      data_path += path + ":";
+    }
+  }
+  else if (generator_type != "static")
+  {
+    throw std::out_of_range("invalid name generator type specified");
+  }
+
+  Key key(generator_type, data_path);
+  std::lock_guard<std::mutex> lock(registry_mutex);
+  auto it = registry.find(key);
+  if (it != registry.end())
+  {
+    return it->second;
+  }
+
+  NameGenerator::SharedPtr generator;
   if (generator_type == "static")
   {
-    return NameGenerator::OwningPtr(new StaticNameGenerator());
+    generator = std::make_shared<StaticNameGenerator>();
   }
-  else if (generator_type == "statistical")
+  else
   {
-    Core::PosixFileSystem fs;
-    return NameGenerator::OwningPtr(new StatisticalNameGenerator(config, fs, part));
+    generator = std::make_shared<StatisticalNameGenerator>(config, fs, part);
   }
-  throw std::out_of_range("invalid name generator type specified");
+  registry.emplace(key, generator);
+  return generator;
 }
 
 
@@ -21,9 +21,12 @@
 #ifndef LEGACY_CHARACTER_NAMEGENERATOR_H
 #define LEGACY_CHARACTER_NAMEGENERATOR_H
 
+#include "legacy/character/nametable.h"
 #include "legacy/character/sexuality.h"
 #include "legacy/core/config.h"
+#include "legacy/core/filesystem.h"
 #include "legacy/core/random.h"
+#include <cstddef>
 #include <memory>
 #include <string>
 
@@ -35,11 +38,17 @@ namespace Character
 
 /**
  * Abstract base class for various kinds of character name generators.
+ *
+ * A name generator holds no state that changes when names are picked (the
+ * random number generator is supplied by the caller) so a single instance can
+ * be shared by any number of users, including across threads.
  */
 class NameGenerator
 {
 public:
   using OwningPtr = std::unique_ptr<NameGenerator>;
+  using SharedPtr = std::shared_ptr<NameGenerator const>;
+  using NameIndex = Character::NameIndex;
 
   enum class Part { forename, surname };
 
@@ -49,13 +58,58 @@ public:
 
   virtual std::string
   pick_name(Sexuality::Gender            gender,
-            Core::RandomNumberGenerator& rng) = 0;
+            Core::RandomNumberGenerator& rng) const = 0;
+
+  /**
+   * Picks a batch of names in one call.
+   * @param[in]  gender  The gender the names are picked for.
+   * @param[in]  rng     The random number generator to use.
+   * @param[in]  count   The number of names to pick.
+   * @param[out] out     A caller-provided buffer of at least @p count elements
+   *                     that receives the indexes of the picked names.
+   *
+   * The picked names can be retrieved using name().
+   */
+  virtual void
+  pick_names(Sexuality::Gender            gender,
+             Core::RandomNumberGenerator& rng,
+             std::size_t                  count,
+             NameIndex*                   out) const = 0;
+
+  /**
+   * Gets a name from the generator's name table by index.
+   *
+   * The returned string is owned by the generator and lives as long as it
+   * does.
+   */
+  virtual char const*
+  name(NameIndex index) const = 0;
 };
 
-NameGenerator::OwningPtr
+/**
+ * Gets the name generator configured for a name part.
+ *
+ * Generators are cached process-wide, keyed by the generator type and the
+ * resolved path of the data file it was loaded from, so asking for the same
+ * generator again returns the already-loaded instance without touching its
+ * data file.  This function may be called concurrently from multiple threads.
+ *
+ * @throws std::out_of_range if the configured generator type is unknown.
+ * @throws std::runtime_error if the generator can not be loaded.
+ */
+NameGenerator::SharedPtr
 get_name_generator(Core::Config const& config,
                    NameGenerator::Part part);
 
+/**
+ * Gets the name generator configured for a name part, loading its data files
+ * through @p fs.
+ */
+NameGenerator::SharedPtr
+get_name_generator(Core::Config const&     config,
+                   Core::FileSystem const& fs,
+                   NameGenerator::Part     part);
+
 
 } // namespace Character
 } // namespace Legacy
@@ -0,0 +1,62 @@
+/**
+ * @file legacy/character/nametable.cpp
+ * @brief part of the Legacy character name submodule.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/character/nametable.h"
+
+#include <stdexcept>
+
+
+Legacy::Character::NameTable::
+NameTable()
+: owned_(true)
+, count_(0)
+, offsets_(nullptr)
+, pool_(nullptr)
+, pool_size_(0)
+{ }
+
+
+Legacy::Character::NameTable::
+NameTable(std::size_t count, std::uint32_t const* offsets, char const* pool, std::size_t pool_size)
+: owned_(false)
+, count_(count)
+, offsets_(offsets)
+, pool_(pool)
+, pool_size_(pool_size)
+{ }
+
+
+Legacy::Character::NameIndex Legacy::Character::NameTable::
+add(std::string const& name)
+{
+  if (!owned_)
+    throw std::logic_error("can not add a name to a borrowed name table");
+
+  owned_offsets_.push_back(static_cast<std::uint32_t>(owned_pool_.size()));
+  owned_pool_.insert(owned_pool_.end(), name.begin(), name.end());
+  owned_pool_.push_back('\0');
+
+  count_     = owned_offsets_.size();
+  offsets_   = owned_offsets_.data();
+  pool_      = owned_pool_.data();
+  pool_size_ = owned_pool_.size();
+  return static_cast<NameIndex>(count_ - 1);
+}
+
@@ -0,0 +1,119 @@
+/**
+ * @file legacy/character/nametable.h
+ * @brief part of the Legacy character name submodule.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_CHARACTER_NAMETABLE_H
+#define LEGACY_CHARACTER_NAMETABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+namespace Legacy
+{
+namespace Character
+{
+
+/**
+ * The index of a name in a name generator's name table.
+ */
+using NameIndex = std::uint32_t;
+
+
+/**
+ * An interned table of names.
+ *
+ * All the names are packed end-to-end, NUL-terminated, in a single character
+ * pool and are referred to by index, so handing out a name never allocates.
+ *
+ * A table either owns its pool or borrows one from storage that outlives it,
+ * such as a precompiled name distribution in a memory-mapped file.
+ */
+class NameTable
+{
+public:
+  /** Constructs an empty table that owns its pool. */
+  NameTable();
+
+  /**
+   * Uses an existing pool without copying it.
+   * @param[in] count      The number of names.
+   * @param[in] offsets    The @p count offsets of each name in the pool.
+   * @param[in] pool       The NUL-terminated names.
+   * @param[in] pool_size  The size of the pool in bytes.
+   */
+  NameTable(std::size_t count, std::uint32_t const* offsets, char const* pool, std::size_t pool_size);
+
+  NameTable(NameTable&&) = default;
+
+  NameTable&
+  operator=(NameTable&&) = default;
+
+  /**
+   * Appends a name to the table and returns its index.
+   * @throws std::logic_error if the pool is borrowed.
+   */
+  NameIndex
+  add(std::string const& name);
+
+  /** The number of names in the table. */
+  std::size_t
+  size() const
+  { return count_; }
+
+  /** Gets the name at an index.  The index is not checked. */
+  char const*
+  operator[](NameIndex index) const
+  { return pool_ + offsets_[index]; }
+
+  /** The offset of each name in the pool. */
+  std::uint32_t const*
+  offsets() const
+  { return offsets_; }
+
+  /** The pool of NUL-terminated names. */
+  char const*
+  pool() const
+  { return pool_; }
+
+  /** The size of the pool in bytes. */
+  std::size_t
+  pool_size() const
+  { return pool_size_; }
+
+private:
+  NameTable(NameTable const&) = delete;
+  NameTable& operator=(NameTable const&) = delete;
+
+  bool                       owned_;
+  std::vector<char>          owned_pool_;
+  std::vector<std::uint32_t> owned_offsets_;
+  std::size_t                count_;
+  std::uint32_t const*       offsets_;
+  char const*                pool_;
+  std::size_t                pool_size_;
+};
+
+
+} // namespace Character
+} // namespace Legacy
+
+#endif /* LEGACY_CHARACTER_NAMETABLE_H */
@@ -20,11 +20,26 @@
  */
 #include <legacy/character/sexuality.h>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
 #include <legacy/core/random.h>
 
 
+namespace
+{
+
+/** The chance an individual is physically male. */
+constexpr double male_probability = 0.49;
+
+/** The rate of the exponential distribution gender bias and preferences follow. */
+constexpr double bias_rate = 0.5;
+
+} // anonymous namespace
+
+
 Legacy::Character::Sexuality::
 Sexuality(Physically sex,
           double     gender_bias,
@@ -52,8 +67,8 @@ Legacy::Character::Sexuality Legacy::Character::Sexuality::
 generate(Legacy::Core::Config const&,
          Legacy::Core::RandomNumberGenerator& rng)
 {
-  std::bernoulli_distribution sex_chooser(0.49);
-  std::exponential_distribution<> bias_chooser(0.5);
+  std::bernoulli_distribution sex_chooser(male_probability);
+  std::exponential_distribution<> bias_chooser(bias_rate);
 
   Sexuality sexuality(sex_chooser(rng) ? Sexuality::Physically::male
                                                : Sexuality::Physically::female,
@@ -64,6 +79,52 @@ generate(Legacy::Core::Config const&,
 }
 
 
+/**
+ * Each individual takes four uniform values, turned into the same bernoulli
+ * and exponential draws as generate() makes by inverting their distribution
+ * functions.
+ */
+void Legacy::Character::Sexuality::
+generate(Legacy::Core::Config const&,
+         Legacy::Core::Xoshiro256x4&                lanes,
+         std::size_t                                count,
+         std::vector<Legacy::Character::Sexuality>& out)
+{
+  std::vector<double> uniforms(4 * count);
+  lanes.fill_uniform(uniforms.size(), uniforms.data());
+
+  auto bias = [](double u) { return std::min(-std::log1p(-u) / bias_rate, 1.0); };
+
+  out.reserve(out.size() + count);
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    double const* u = &uniforms[4 * i];
+    out.push_back(Sexuality(u[0] < male_probability ? Sexuality::Physically::male
+                                                     : Sexuality::Physically::female,
+                            bias(u[1]),
+                            1.0 - bias(u[2]),
+                            bias(u[3])));
+  }
+}
+
+
+/**
+ * The lanes are seeded from two draws of @p rng, so a batch depends on the
+ * generator's state as a series of generate() calls would.
+ */
+void Legacy::Character::Sexuality::
+generate(Legacy::Core::Config const&                config,
+         Legacy::Core::RandomNumberGenerator&       rng,
+         std::size_t                                count,
+         std::vector<Legacy::Character::Sexuality>& out)
+{
+  std::uint64_t seed = std::uint64_t(rng() & 0xffffffffu) << 32;
+  seed |= rng() & 0xffffffffu;
+  Legacy::Core::Xoshiro256x4 lanes{Legacy::Core::SplitSeed(seed)};
+  generate(config, lanes, count, out);
+}
+
+
 std::istream& Legacy::Character::
 operator>>(std::istream& istr, Legacy::Character::Sexuality& sexuality)
 {
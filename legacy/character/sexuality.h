@@ -21,7 +21,9 @@
 #ifndef LEGACY_CHARACTER_SEXUALITY_H_
 #define LEGACY_CHARACTER_SEXUALITY_H_
 
+#include <cstddef>
 #include <iosfwd>
+#include <vector>
 
 
 namespace Legacy
@@ -31,6 +33,7 @@ namespace Core
 {
   class Config;
   class RandomNumberGenerator;
+  class Xoshiro256x4;
 }
 
 namespace Character
@@ -93,6 +96,30 @@ public:
   static Sexuality
   generate(Core::Config const& config, Core::RandomNumberGenerator& rng);
 
+  /**
+   * Randomly generates the sexual characteristics of a batch of individuals,
+   * appending them to @p out.
+   *
+   * All the random values needed are drawn from @p lanes in one pass, several
+   * streams at a time, so the individuals come out distributed as generate()
+   * would make them but not the same ones.
+   */
+  static void
+  generate(Core::Config const&     config,
+           Core::Xoshiro256x4&     lanes,
+           std::size_t             count,
+           std::vector<Sexuality>& out);
+
+  /**
+   * Randomly generates the sexual characteristics of a batch of individuals
+   * as above, drawing them from a lane generator seeded from @p rng.
+   */
+  static void
+  generate(Core::Config const&          config,
+           Core::RandomNumberGenerator& rng,
+           std::size_t                  count,
+           std::vector<Sexuality>&      out);
+
   friend std::istream&
   operator>>(std::istream& istr, Sexuality& sex);
 
@@ -20,8 +20,11 @@
  */
 #include "legacy/character/statisticalnamegenerator.h"
 
+#include <algorithm>
 #include <iostream>
 #include "legacy/core/logger.h"
+#include <stdexcept>
+#include <utility>
 
 using Legacy::Core::LogLevel;
 
@@ -29,30 +32,66 @@ using Legacy::Core::LogLevel;
 namespace
 {
 std::string
-name_part_to_config_key(Legacy::Character::NameGenerator::Part part)
+default_forename_filename(Legacy::Character::Sexuality::Gender gender)
 {
-  if (part == Legacy::Character::NameGenerator::Part::surname)
+  if (gender == Legacy::Character::Sexuality::Gender::masculine)
   {
-    return "surname-datafile";
+    return "dist.male.first";
   }
-  else 
+  else
   {
-    return "forename-datafile";
+    return "dist.female.first";
   }
 }
 
 
 std::string
-default_filename_for_part(Legacy::Character::NameGenerator::Part part)
+forename_config_key(Legacy::Character::Sexuality::Gender gender)
 {
-  if (part == Legacy::Character::NameGenerator::Part::surname)
+  if (gender == Legacy::Character::Sexuality::Gender::masculine)
   {
-    return "dist.all.last";
+    return "masculine-forename-datafile";
   }
-  else 
+  else
   {
-    return "dist.female.first";
+    return "feminine-forename-datafile";
+  }
+}
+
+
+/**
+ * Loads a distribution, preferring a compiled distribution (which is mapped
+ * rather than parsed) if one is available.
+ */
+Legacy::Character::NameDistribution
+load_distribution(Legacy::Core::Config const&     config,
+                  Legacy::Core::FileSystem const& fs,
+                  std::string const&              file_name)
+{
+  using Legacy::Character::NameDistribution;
+
+  std::string compiled_file_name = file_name + NameDistribution::compiled_suffix;
+  auto mapping = config.map_data_file(fs, compiled_file_name);
+  if (mapping)
+  {
+    try
+    {
+      std::clog << LogLevel::INFO << __PRETTY_FUNCTION__ << "() filename=\"" << compiled_file_name << "\"\n";
+      return NameDistribution::from_compiled(std::move(mapping));
+    }
+    catch (std::runtime_error const& ex)
+    {
+      std::clog << LogLevel::WARNING << "ignoring " << compiled_file_name << ": " << ex.what() << "\n";
+    }
   }
+
+  std::clog << LogLevel::INFO << __PRETTY_FUNCTION__ << "() filename=\"" << file_name << "\"\n";
+  auto ifs = config.open_data_file(fs, file_name);
+  if (!ifs)
+  {
+    throw std::runtime_error("error opening dist file");
+  }
+  return NameDistribution::parse(*ifs);
 }
 
 } // anonymous namespace
@@ -63,26 +102,36 @@ StatisticalNameGenerator(Legacy::Core::Config const&            config,
                          Legacy::Core::FileSystem const&        fs,
                          Legacy::Character::NameGenerator::Part part)
 {
-  std::clog << LogLevel::INFO << __PRETTY_FUNCTION__ << "() begins\n";
-  std::string file_name = config.get(name_part_to_config_key(part), default_filename_for_part(part));
-  std::clog << LogLevel::INFO << __PRETTY_FUNCTION__ << "() filename=\"" << file_name << "\"\n";
-  auto ifs = config.open_data_file(fs, file_name);
-  if (!ifs)
+  // Each distinct file is loaded once; genders sharing a file share its table.
+  std::vector<std::string> file_names;
+  std::size_t              file_for_gender[gender_count];
+  for (std::size_t g = 0; g < gender_count; ++g)
   {
-    throw std::runtime_error("error opening dist file");
+    std::string file_name = data_file_name(config, part, static_cast<Sexuality::Gender>(g));
+    auto it = std::find(file_names.begin(), file_names.end(), file_name);
+    file_for_gender[g] = it - file_names.begin();
+    if (it == file_names.end())
+    {
+      file_names.push_back(file_name);
+      distributions_.push_back(load_distribution(config, fs, file_name));
+    }
   }
 
-  while (*ifs)
+  // Lay the tables end-to-end in one index space.
+  std::vector<NameIndex> bases;
+  NameIndex              base = 0;
+  for (auto const& distribution: distributions_)
   {
-    std::string name;
-    double      weight;
-    double      cum_weight;
-    int         index;
-    *ifs >> name >> weight >> cum_weight >> index;
-    weights_.push_back(weight);
-    names_.push_back(name);
+    bases.push_back(base);
+    base += static_cast<NameIndex>(distribution.names().size());
   }
-  std::clog << LogLevel::INFO << __PRETTY_FUNCTION__ << "() ends\n";
+  for (std::size_t g = 0; g < gender_count; ++g)
+  {
+    samplers_[g].chooser = &distributions_[file_for_gender[g]].chooser();
+    samplers_[g].base    = bases[file_for_gender[g]];
+  }
+
+  std::clog << LogLevel::INFO << __PRETTY_FUNCTION__ << "() loaded " << base << " names\n";
 }
 
 
@@ -92,11 +141,55 @@ Legacy::Character::StatisticalNameGenerator::
 
 
 std::string Legacy::Character::StatisticalNameGenerator::
-pick_name(Legacy::Character::Sexuality::Gender,
-          Legacy::Core::RandomNumberGenerator& prng)
+data_file_name(Legacy::Core::Config const&            config,
+               Legacy::Character::NameGenerator::Part part,
+               Legacy::Character::Sexuality::Gender   gender)
+{
+  if (part == NameGenerator::Part::surname)
+  {
+    return config.get<std::string>("surname-datafile", "dist.all.last");
+  }
+  std::string forename_file_name = config.get<std::string>("forename-datafile", default_forename_filename(gender));
+  return config.get(forename_config_key(gender), forename_file_name);
+}
+
+
+std::string Legacy::Character::StatisticalNameGenerator::
+pick_name(Legacy::Character::Sexuality::Gender gender,
+          Legacy::Core::RandomNumberGenerator& prng) const
+{
+  NameIndex index;
+  pick_names(gender, prng, 1, &index);
+  return name(index);
+}
+
+
+void Legacy::Character::StatisticalNameGenerator::
+pick_names(Legacy::Character::Sexuality::Gender gender,
+           Legacy::Core::RandomNumberGenerator& prng,
+           std::size_t                          count,
+           NameIndex*                           out) const
 {
-  Chooser chooser(std::begin(weights_), std::end(weights_));
-  return names_[chooser(prng)];
+  Sampler const& sampler = samplers_[static_cast<std::size_t>(gender)];
+  Core::AliasTable const& chooser = *sampler.chooser;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    out[i] = sampler.base + static_cast<NameIndex>(chooser(prng));
+  }
+}
+
+
+char const* Legacy::Character::StatisticalNameGenerator::
+name(NameIndex index) const
+{
+  for (auto const& distribution: distributions_)
+  {
+    NameTable const& names = distribution.names();
+    if (index < names.size())
+      return names[index];
+    index -= static_cast<NameIndex>(names.size());
+  }
+  throw std::out_of_range("invalid name index");
 }
 
 
@@ -21,10 +21,10 @@
 #ifndef LEGACY_CHARACTER_STATISTICALNAMEGENERATOR_H
 #define LEGACY_CHARACTER_STATISTICALNAMEGENERATOR_H
 
+#include "legacy/character/namedistribution.h"
 #include "legacy/character/namegenerator.h"
 
 #include "legacy/core/filesystem.h"
-#include <random>
 #include <vector>
 
 
@@ -34,28 +34,64 @@ namespace Character
 {
 
 /**
- * Abstract base class for various kinds of character name generators.
+ * A name generator that picks names according to their frequency in a
+ * census-style distribution file.
+ *
+ * Forenames are picked from a distribution per gender (dist.male.first and
+ * dist.female.first by default).  The names of all the distributions share a
+ * single packed index space and each gender has its own sampler into it, so a
+ * pick costs the same whatever the gender and name() needs no gender.
+ * Surnames use one distribution for all genders.
+ *
+ * The distribution is turned into an alias table when the generator is
+ * constructed so each pick is constant-time and allocation-free.  If a compiled
+ * copy of the distribution file (with NameDistribution::compiled_suffix
+ * appended to its name) is found on the data path it is mapped and used as-is
+ * instead of parsing the text file.
  */
 class StatisticalNameGenerator
 : public NameGenerator
 {
-private:
-  using Weights = std::vector<double>;
-  using Names   = std::vector<std::string>;
-  using Chooser = std::discrete_distribution<>;
-
 public:
   StatisticalNameGenerator(Core::Config const& config, Core::FileSystem const& fs, Part part);
 
   ~StatisticalNameGenerator();
 
+  /**
+   * The name of the distribution file configured for a name part and gender.
+   *
+   * Forenames use the "masculine-forename-datafile" or
+   * "feminine-forename-datafile" setting, falling back to
+   * "forename-datafile" and then the gender's default file.
+   */
+  static std::string
+  data_file_name(Core::Config const& config, Part part, Sexuality::Gender gender);
+
   std::string
   pick_name(Sexuality::Gender            gender,
-            Core::RandomNumberGenerator& rng) override;
+            Core::RandomNumberGenerator& rng) const override;
+
+  void
+  pick_names(Sexuality::Gender            gender,
+             Core::RandomNumberGenerator& rng,
+             std::size_t                  count,
+             NameIndex*                   out) const override;
+
+  char const*
+  name(NameIndex index) const override;
 
 private:
-  Names    names_;
-  Weights  weights_;
+  static constexpr std::size_t gender_count = 2;
+
+  /** Where picks for one gender come from in the packed index. */
+  struct Sampler
+  {
+    Core::AliasTable const* chooser;
+    NameIndex               base;
+  };
+
+  std::vector<NameDistribution> distributions_;
+  Sampler                       samplers_[gender_count];
 };
 
 
@@ -0,0 +1,94 @@
+/**
+ * @file legacy/character/tests/fake_filesystem.h
+ * @brief A fake filesystem serving canned name distribution files.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_TESTS_CHARACTER_FAKE_FILESYSTEM_H_
+#define LEGACY_TESTS_CHARACTER_FAKE_FILESYSTEM_H_
+
+#include "legacy/core/filesystem.h"
+#include <map>
+#include <sstream>
+#include <string>
+
+
+namespace Legacy {
+namespace Tests {
+namespace Character {
+
+
+/**
+ * A filesystem in which every directory contains the same set of files, whose
+ * contents are given as strings.
+ */
+class FakeFileSystem
+: public Legacy::Core::FileSystem
+{
+public:
+  using Files = std::map<std::string, std::string>;
+
+  class FakeFileInfo
+  : public Legacy::Core::FileInfo
+  {
+  public:
+    FakeFileInfo(std::string const& name, bool exists)
+    : name_(name), exists_(exists)
+    { }
+
+    std::string name() const override       { return name_; }
+    bool        exists() const override      { return exists_; }
+    bool        is_readable() const override { return exists_; }
+    bool        is_writable() const override { return false; }
+
+  private:
+    std::string name_;
+    bool        exists_;
+  };
+
+public:
+  FakeFileSystem(Files const& files)
+  : files_(files)
+  { }
+
+  Legacy::Core::FileInfoOwningPtr
+  get_fileinfo(Legacy::Core::Path const& path) const override
+  {
+    std::string name = path.basename();
+    return Legacy::Core::FileInfoOwningPtr(new FakeFileInfo(name, files_.count(name) > 0));
+  }
+
+  std::unique_ptr<std::istream>
+  open_for_input(Legacy::Core::Path const& path) const override
+  {
+    auto it = files_.find(path.basename());
+    if (it == files_.end())
+      return std::unique_ptr<std::istream>();
+    return std::unique_ptr<std::istream>(new std::istringstream(it->second));
+  }
+
+private:
+  Files files_;
+};
+
+
+} // namespace Character
+} // namespace Tests
+} // namespace Legacy
+
+#endif // LEGACY_TESTS_CHARACTER_FAKE_FILESYSTEM_H_
@@ -20,9 +20,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "catch/catch.hpp"
+#include "fake_filesystem.h"
+#include "legacy/character/namedistribution.h"
 #include "legacy/character/namegenerator.h"
+#include "legacy/character/statisticalnamegenerator.h"
+#include <map>
+#include <set>
 #include <sstream>
 #include <stdexcept>
+#include <vector>
+
+using Legacy::Character::NameGenerator;
+using Legacy::Character::Sexuality;
 
 
 SCENARIO("The name generator factory handles invalid input.")
@@ -44,3 +53,271 @@ SCENARIO("The name generator factory handles invalid input.")
   }
 }
 
+
+SCENARIO("The name generator factory shares loaded generators.")
+{
+  Legacy::Tests::Character::FakeFileSystem fs(Legacy::Tests::Character::FakeFileSystem::Files{
+    { "dist.shared.last",  "SMITH          1.000  1.000      1\n" },
+    { "dist.shared.first", "ALICE          1.000  1.000      1\n" }
+  });
+  Legacy::Core::Config config;
+  config.init(Legacy::Core::CLI::OptionSet(), Legacy::Core::StringList{ "test_character" }, fs);
+  config.set<std::string>("surname-datafile", "dist.shared.last");
+  config.set<std::string>("forename-datafile", "dist.shared.first");
+
+  GIVEN("a statistical name generator from the factory")
+  {
+    auto surnames = Legacy::Character::get_name_generator(config, fs, NameGenerator::Part::surname);
+
+    WHEN("the same generator is asked for again")
+    {
+      auto again = Legacy::Character::get_name_generator(config, fs, NameGenerator::Part::surname);
+
+      THEN("the same instance is returned")
+      {
+        REQUIRE(again == surnames);
+      }
+    }
+
+    WHEN("a generator using a different data file is asked for")
+    {
+      auto forenames = Legacy::Character::get_name_generator(config, fs, NameGenerator::Part::forename);
+
+      THEN("a different instance is returned")
+      {
+        REQUIRE(forenames != surnames);
+        Legacy::Core::RandomNumberGenerator rng(1);
+        REQUIRE(forenames->pick_name(Sexuality::Gender::feminine, rng) == "ALICE");
+        REQUIRE(surnames->pick_name(Sexuality::Gender::feminine, rng) == "SMITH");
+      }
+    }
+  }
+}
+
+
+SCENARIO("The statistical name generator picks names by frequency.")
+{
+  Legacy::Tests::Character::FakeFileSystem fs(Legacy::Tests::Character::FakeFileSystem::Files{
+    { "dist.all.last", "SMITH          1.000  1.000      1\n"
+                       "NOBODY         0.000  1.000      2\n"
+                       "JONES          3.000  4.000      3\n" }
+  });
+  Legacy::Core::Config config;
+  config.init(Legacy::Core::CLI::OptionSet(), Legacy::Core::StringList{ "test_character" }, fs);
+  Legacy::Core::RandomNumberGenerator rng(1);
+
+  GIVEN("a statistical surname generator")
+  {
+    Legacy::Character::StatisticalNameGenerator generator(config, fs, NameGenerator::Part::surname);
+
+    WHEN("a large number of names are picked")
+    {
+      std::map<std::string, int> counts;
+      const int pick_count = 4000;
+      for (int i = 0; i < pick_count; ++i)
+      {
+        ++counts[generator.pick_name(Sexuality::Gender::feminine, rng)];
+      }
+
+      THEN("only names with a non-zero frequency are picked")
+      {
+        REQUIRE(counts.size() == 2);
+        REQUIRE(counts.count("NOBODY") == 0);
+      }
+      AND_THEN("names are picked in proportion to their frequency")
+      {
+        REQUIRE(counts["JONES"] == Approx(pick_count * 0.75).epsilon(0.05));
+      }
+    }
+  }
+
+  GIVEN("a missing distribution file")
+  {
+    config.set<std::string>("forename-datafile", "no.such.file");
+    THEN("constructing a statistical generator throws")
+    {
+      REQUIRE_THROWS_AS(Legacy::Character::StatisticalNameGenerator(config, fs, NameGenerator::Part::forename),
+                        std::runtime_error);
+    }
+  }
+}
+
+
+SCENARIO("Forenames are picked by gender.")
+{
+  Legacy::Tests::Character::FakeFileSystem fs(Legacy::Tests::Character::FakeFileSystem::Files{
+    { "dist.male.first",   "JAMES          1.000  1.000      1\n"
+                           "JOHN           1.000  2.000      2\n" },
+    { "dist.female.first", "MARY           1.000  1.000      1\n"
+                           "PATRICIA       1.000  2.000      2\n"
+                           "LINDA          1.000  3.000      3\n" }
+  });
+  Legacy::Core::Config config;
+  config.init(Legacy::Core::CLI::OptionSet(), Legacy::Core::StringList{ "test_character" }, fs);
+  Legacy::Core::RandomNumberGenerator rng(5);
+
+  GIVEN("a statistical forename generator")
+  {
+    Legacy::Character::StatisticalNameGenerator generator(config, fs, NameGenerator::Part::forename);
+
+    WHEN("names are picked for each gender")
+    {
+      std::set<std::string> masculine_names;
+      std::set<std::string> feminine_names;
+      for (int i = 0; i < 200; ++i)
+      {
+        masculine_names.insert(generator.pick_name(Sexuality::Gender::masculine, rng));
+        feminine_names.insert(generator.pick_name(Sexuality::Gender::feminine, rng));
+      }
+
+      THEN("each gender gets only names from its own distribution")
+      {
+        REQUIRE(masculine_names == (std::set<std::string>{ "JAMES", "JOHN" }));
+        REQUIRE(feminine_names == (std::set<std::string>{ "MARY", "PATRICIA", "LINDA" }));
+      }
+    }
+
+    WHEN("batches are picked for each gender")
+    {
+      std::vector<NameGenerator::NameIndex> masculine(50);
+      std::vector<NameGenerator::NameIndex> feminine(50);
+      generator.pick_names(Sexuality::Gender::masculine, rng, masculine.size(), masculine.data());
+      generator.pick_names(Sexuality::Gender::feminine, rng, feminine.size(), feminine.data());
+
+      THEN("the indexes of both genders resolve in the one shared index")
+      {
+        for (auto index: masculine)
+        {
+          std::string name = generator.name(index);
+          REQUIRE((name == "JAMES" || name == "JOHN"));
+        }
+        for (auto index: feminine)
+        {
+          std::string name = generator.name(index);
+          REQUIRE((name == "MARY" || name == "PATRICIA" || name == "LINDA"));
+        }
+      }
+    }
+  }
+
+  GIVEN("a single forename file configured for all genders")
+  {
+    config.set<std::string>("forename-datafile", "dist.male.first");
+    Legacy::Character::StatisticalNameGenerator generator(config, fs, NameGenerator::Part::forename);
+
+    THEN("both genders pick from it")
+    {
+      std::string name = generator.pick_name(Sexuality::Gender::feminine, rng);
+      REQUIRE((name == "JAMES" || name == "JOHN"));
+    }
+  }
+}
+
+
+SCENARIO("Names can be picked in batches.")
+{
+  Legacy::Tests::Character::FakeFileSystem fs(Legacy::Tests::Character::FakeFileSystem::Files{
+    { "dist.all.last", "SMITH          1.000  1.000      1\n"
+                       "JONES          1.000  2.000      2\n" }
+  });
+  Legacy::Core::Config config;
+  config.init(Legacy::Core::CLI::OptionSet(), Legacy::Core::StringList{ "test_character" }, fs);
+
+  GIVEN("a statistical surname generator")
+  {
+    Legacy::Character::StatisticalNameGenerator generator(config, fs, NameGenerator::Part::surname);
+
+    WHEN("a batch of names is picked")
+    {
+      Legacy::Core::RandomNumberGenerator batch_rng(99);
+      std::vector<NameGenerator::NameIndex> batch(100);
+      generator.pick_names(Sexuality::Gender::masculine, batch_rng, batch.size(), batch.data());
+
+      THEN("the batch resolves to the same names as picking them one at a time")
+      {
+        Legacy::Core::RandomNumberGenerator single_rng(99);
+        for (auto index: batch)
+        {
+          REQUIRE(std::string(generator.name(index)) == generator.pick_name(Sexuality::Gender::masculine, single_rng));
+        }
+      }
+    }
+  }
+}
+
+
+SCENARIO("Name distributions can be compiled and used without parsing.")
+{
+  std::istringstream text("SMITH          1.000  1.000      1\n"
+                          "JONES          3.000  4.000      2\n");
+  Legacy::Character::NameDistribution parsed = Legacy::Character::NameDistribution::parse(text);
+
+  GIVEN("a compiled distribution")
+  {
+    std::ostringstream compiled;
+    parsed.write_compiled(compiled);
+
+    WHEN("it is loaded")
+    {
+      Legacy::Tests::Character::FakeFileSystem fs(Legacy::Tests::Character::FakeFileSystem::Files{
+        { "dist.cdist", compiled.str() }
+      });
+      auto loaded = Legacy::Character::NameDistribution::from_compiled(fs.map_for_input(Legacy::Core::Path("dist.cdist")));
+
+      THEN("it has the same names and picks the same names as the original")
+      {
+        REQUIRE(loaded.names().size() == parsed.names().size());
+        Legacy::Core::RandomNumberGenerator rng1(7);
+        Legacy::Core::RandomNumberGenerator rng2(7);
+        for (int i = 0; i < 100; ++i)
+        {
+          REQUIRE(std::string(loaded.names()[loaded.chooser()(rng1)])
+               == std::string(parsed.names()[parsed.chooser()(rng2)]));
+        }
+      }
+    }
+
+    WHEN("a generator finds it next to the text distribution")
+    {
+      Legacy::Tests::Character::FakeFileSystem fs(Legacy::Tests::Character::FakeFileSystem::Files{
+        { "dist.all.last",       "BROWN          1.000  1.000      1\n" },
+        { "dist.all.last.cdist", compiled.str() }
+      });
+      Legacy::Core::Config config;
+      config.init(Legacy::Core::CLI::OptionSet(), Legacy::Core::StringList{ "test_character" }, fs);
+      Legacy::Character::StatisticalNameGenerator generator(config, fs, NameGenerator::Part::surname);
+
+      THEN("the compiled distribution is used")
+      {
+        Legacy::Core::RandomNumberGenerator rng(7);
+        REQUIRE(generator.pick_name(Sexuality::Gender::feminine, rng) != "BROWN");
+      }
+    }
+  }
+
+  GIVEN("a corrupt compiled distribution")
+  {
+    std::ostringstream compiled;
+    parsed.write_compiled(compiled);
+    std::string corrupt = compiled.str().substr(0, compiled.str().size() / 2);
+    Legacy::Tests::Character::FakeFileSystem fs(Legacy::Tests::Character::FakeFileSystem::Files{
+      { "dist.all.last",       "BROWN          1.000  1.000      1\n" },
+      { "dist.all.last.cdist", corrupt }
+    });
+
+    THEN("loading it directly throws")
+    {
+      REQUIRE_THROWS_AS(Legacy::Character::NameDistribution::from_compiled(fs.map_for_input(Legacy::Core::Path("dist.all.last.cdist"))),
+                        std::runtime_error);
+    }
+    AND_THEN("a generator falls back to the text distribution")
+    {
+      Legacy::Core::Config config;
+      config.init(Legacy::Core::CLI::OptionSet(), Legacy::Core::StringList{ "test_character" }, fs);
+      Legacy::Character::StatisticalNameGenerator generator(config, fs, NameGenerator::Part::surname);
+      Legacy::Core::RandomNumberGenerator rng(7);
+      REQUIRE(generator.pick_name(Sexuality::Gender::feminine, rng) == "BROWN");
+    }
+  }
+}
+
@@ -71,3 +71,86 @@ SCENARIO("sexuality objects marshall and unmarshall correctly")
     }
   }
 }
+
+SCENARIO("sexualities are generated in batches")
+{
+  Legacy::Core::RandomNumberGenerator rng(2017);
+  Legacy::Core::Config                config;
+
+  GIVEN("a batch of generated sexualities")
+  {
+    std::vector<Legacy::Character::Sexuality> batch;
+    Legacy::Character::Sexuality::generate(config, rng, 2000, batch);
+
+    THEN("there are as many as asked for, with every preference in range")
+    {
+      REQUIRE(batch.size() == 2000u);
+
+      bool in_range = true;
+      std::size_t males = 0;
+      for (auto const& sexuality: batch)
+      {
+        in_range = in_range
+                && sexuality.gender_bias() >= 0.0 && sexuality.gender_bias() <= 1.0
+                && sexuality.same_sex_preference() >= 0.0 && sexuality.same_sex_preference() <= 1.0
+                && sexuality.opposite_sex_preference() >= 0.0 && sexuality.opposite_sex_preference() <= 1.0;
+        if (sexuality.sex() == Legacy::Character::Sexuality::Physically::male)
+          ++males;
+      }
+      REQUIRE(in_range);
+      REQUIRE(males > 900u);
+      REQUIRE(males < 1060u);
+    }
+
+    WHEN("another batch is appended")
+    {
+      Legacy::Character::Sexuality::generate(config, rng, 10, batch);
+
+      THEN("the first batch is kept")
+      {
+        REQUIRE(batch.size() == 2010u);
+      }
+    }
+  }
+}
+
+SCENARIO("batches of sexualities follow the same distributions as single ones")
+{
+  Legacy::Core::RandomNumberGenerator rng(2017);
+  Legacy::Core::Xoshiro256x4          lanes{Legacy::Core::SplitSeed(2017)};
+  Legacy::Core::Config                config;
+  std::size_t const                   count = 20000;
+
+  GIVEN("a large batch drawn from lane generators and as many single sexualities")
+  {
+    std::vector<Legacy::Character::Sexuality> batch;
+    Legacy::Character::Sexuality::generate(config, lanes, count, batch);
+    std::vector<Legacy::Character::Sexuality> singles;
+    for (std::size_t i = 0; i < count; ++i)
+      singles.push_back(Legacy::Character::Sexuality::generate(config, rng));
+
+    THEN("their mean biases, preferences and share of males agree")
+    {
+      auto mean = [count](std::vector<Legacy::Character::Sexuality> const& sexualities,
+                          double (Legacy::Character::Sexuality::*value)() const) {
+        double sum = 0.0;
+        for (auto const& sexuality: sexualities)
+          sum += (sexuality.*value)();
+        return sum / count;
+      };
+      auto male_share = [count](std::vector<Legacy::Character::Sexuality> const& sexualities) {
+        std::size_t males = 0;
+        for (auto const& sexuality: sexualities)
+          if (sexuality.sex() == Legacy::Character::Sexuality::Physically::male)
+            ++males;
+        return double(males) / count;
+      };
+
+      using Legacy::Character::Sexuality;
+      REQUIRE(mean(batch, &Sexuality::gender_bias) == Approx(mean(singles, &Sexuality::gender_bias)).epsilon(0.02));
+      REQUIRE(mean(batch, &Sexuality::same_sex_preference) == Approx(mean(singles, &Sexuality::same_sex_preference)).epsilon(0.05));
+      REQUIRE(mean(batch, &Sexuality::opposite_sex_preference) == Approx(mean(singles, &Sexuality::opposite_sex_preference)).epsilon(0.02));
+      REQUIRE(male_share(batch) == Approx(male_share(singles)).epsilon(0.05));
+    }
+  }
+}
@@ -0,0 +1,106 @@
+/**
+ * @file legacy/core/alias_table.cpp
+ * @brief Implementation of the Legacy core alias table sampler.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/core/alias_table.h"
+
+#include <cmath>
+#include <stdexcept>
+
+
+Legacy::Core::AliasTable::
+AliasTable(Weights const& weights)
+: owned_probability_(weights.size())
+, owned_alias_(weights.size())
+, size_(weights.size())
+, probability_(owned_probability_.data())
+, alias_(owned_alias_.data())
+{
+  if (weights.empty())
+    throw std::invalid_argument("alias table requires at least one weight");
+
+  double total = 0.0;
+  for (double w: weights)
+  {
+    if (!std::isfinite(w) || w < 0.0)
+      throw std::invalid_argument("alias table weights must be finite and non-negative");
+    total += w;
+  }
+  if (total <= 0.0)
+    throw std::invalid_argument("alias table weights must not all be zero");
+
+  // Scale the weights so the average bucket holds exactly 1.0, then split
+  // them into underfull and overfull worklists.
+  std::size_t const n = weights.size();
+  std::vector<double> scaled(n);
+  std::vector<std::uint32_t> small;
+  std::vector<std::uint32_t> large;
+  small.reserve(n);
+  large.reserve(n);
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    scaled[i] = weights[i] * n / total;
+    if (scaled[i] < 1.0)
+      small.push_back(static_cast<std::uint32_t>(i));
+    else
+      large.push_back(static_cast<std::uint32_t>(i));
+  }
+
+  // Top up each underfull bucket from an overfull one.
+  while (!small.empty() && !large.empty())
+  {
+    std::uint32_t l = small.back();
+    small.pop_back();
+    std::uint32_t g = large.back();
+    large.pop_back();
+
+    owned_probability_[l] = scaled[l];
+    owned_alias_[l] = g;
+
+    scaled[g] = (scaled[g] + scaled[l]) - 1.0;
+    if (scaled[g] < 1.0)
+      small.push_back(g);
+    else
+      large.push_back(g);
+  }
+
+  // Whatever remains is full, give or take some rounding error.
+  for (std::uint32_t g: large)
+  {
+    owned_probability_[g] = 1.0;
+    owned_alias_[g] = g;
+  }
+  for (std::uint32_t l: small)
+  {
+    owned_probability_[l] = 1.0;
+    owned_alias_[l] = l;
+  }
+}
+
+
+Legacy::Core::AliasTable::
+AliasTable(std::size_t size, double const* probability, std::uint32_t const* alias)
+: size_(size)
+, probability_(probability)
+, alias_(alias)
+{
+  if (size == 0)
+    throw std::invalid_argument("alias table requires at least one entry");
+}
+
@@ -0,0 +1,129 @@
+/**
+ * @file legacy/core/alias_table.h
+ * @brief Public interface of the Legacy core alias table sampler.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_CORE_ALIAS_TABLE_H
+#define LEGACY_CORE_ALIAS_TABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+
+namespace Legacy
+{
+namespace Core
+{
+
+/**
+ * A sampler for an arbitrary discrete distribution using Vose's alias method.
+ *
+ * The table is built once from a set of (not necessarily normalized) weights
+ * in O(N) time.  Each draw afterwards costs O(1) -- one column choice and one
+ * biased coin toss -- and does not allocate, which makes it suitable for very
+ * large distributions sampled many times, like the census name lists.
+ *
+ * A table either owns its arrays or borrows them from storage that outlives
+ * it, such as a precompiled table in a memory-mapped file.
+ */
+class AliasTable
+{
+public:
+  using Weights = std::vector<double>;
+
+public:
+  /**
+   * Builds the alias table for the given weights.
+   *
+   * @throws std::invalid_argument if there are no weights, any weight is
+   * negative or not finite, or all the weights are zero.
+   */
+  explicit
+  AliasTable(Weights const& weights);
+
+  /**
+   * Uses a previously-built alias table without copying it.
+   * @param[in] size         The number of outcomes in the distribution.
+   * @param[in] probability  The @p size acceptance probabilities.
+   * @param[in] alias        The @p size alias indexes.
+   */
+  AliasTable(std::size_t size, double const* probability, std::uint32_t const* alias);
+
+  AliasTable(AliasTable&&) = default;
+
+  AliasTable&
+  operator=(AliasTable&&) = default;
+
+  /** The number of outcomes in the distribution. */
+  std::size_t
+  size() const
+  { return size_; }
+
+  /** The acceptance probability of each column. */
+  double const*
+  probabilities() const
+  { return probability_; }
+
+  /** The alias of each column. */
+  std::uint32_t const*
+  aliases() const
+  { return alias_; }
+
+  /**
+   * Picks an outcome index in [0, size()) according to the weights.
+   * @param[in] rng  Any UniformRandomNumberGenerator.
+   *
+   * A single uniform variate is used for both the column choice (its integral
+   * part once scaled) and the coin toss (the fractional part).
+   */
+  template<typename URNG>
+    std::size_t
+    operator()(URNG& rng) const
+    { return pick(std::generate_canonical<double, 53>(rng)); }
+
+  /**
+   * Picks the outcome index corresponding to a uniform variate in [0, 1).
+   */
+  std::size_t
+  pick(double u) const
+  {
+    double scaled = u * size_;
+    std::size_t i = static_cast<std::size_t>(scaled);
+    if (i >= size_)
+      i = size_ - 1;
+    return (scaled - i) < probability_[i] ? i : alias_[i];
+  }
+
+private:
+  AliasTable(AliasTable const&) = delete;
+  AliasTable& operator=(AliasTable const&) = delete;
+
+  std::vector<double>        owned_probability_;
+  std::vector<std::uint32_t> owned_alias_;
+  std::size_t                size_;
+  double const*              probability_;
+  std::uint32_t const*       alias_;
+};
+
+
+} // namespace Core
+} // namespace Legacy
+
+#endif /* LEGACY_CORE_ALIAS_TABLE_H */
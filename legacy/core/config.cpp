@@ -302,6 +302,26 @@ init(CLI::OptionSet const& option_set, StringList const& args, FileSystem const&
 
 std::unique_ptr<std::istream> Config::
 open_data_file(FileSystem const& fs, std::string const& data_file_name) const
+{
+  std::string path = find_data_file(fs, data_file_name);
+  if (path.empty())
+    return std::unique_ptr<std::istream>();
+  return fs.open_for_input(Path(path));
+}
+
+
+MappedFileOwningPtr Config::
+map_data_file(FileSystem const& fs, std::string const& data_file_name) const
+{
+  std::string path = find_data_file(fs, data_file_name);
+  if (path.empty())
+    return MappedFileOwningPtr();
+  return fs.map_for_input(Path(path));
+}
+
+
+std::string Config::
+find_data_file(FileSystem const& fs, std::string const& data_file_name) const
 {
   auto it = std::find_if(std::begin(data_paths_), std::end(data_paths_),
                           [&fs, &data_file_name](Path const& path) {
@@ -310,8 +330,8 @@ open_data_file(FileSystem const& fs, std::string const& data_file_name) const
                             return file_info->exists() && file_info->is_readable();
                           });
   if (it == std::end(data_paths_))
-    return std::unique_ptr<std::istream>();
-  return fs.open_for_input(*it / data_file_name);
+    return std::string();
+  return (*it / data_file_name).string();
 }
 
 
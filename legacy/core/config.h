@@ -87,6 +87,30 @@ public:
   std::unique_ptr<std::istream>
   open_data_file(FileSystem const& fs, std::string const& data_file_name) const;
 
+  /**
+   * Finds and maps a file into memory in the given filesystem using the
+   * configured data file search paths.
+   * @param[in] fs              The filesystem to search for the file.
+   * @param[in] data_file_name  The name of the data file.
+   *
+   * @returns a pointer to the mapped file if one is found, otherwise a null
+   * pointer.
+   */
+  MappedFileOwningPtr
+  map_data_file(FileSystem const& fs, std::string const& data_file_name) const;
+
+  /**
+   * Finds a file in the given filesystem using the configured data file search
+   * paths.
+   * @param[in] fs              The filesystem to search for the file.
+   * @param[in] data_file_name  The name of the data file.
+   *
+   * @returns the full path of the first readable match, or an empty string if
+   * there is none.
+   */
+  std::string
+  find_data_file(FileSystem const& fs, std::string const& data_file_name) const;
+
 private:
   std::map<std::string, int>         int_values_;
   std::map<std::string, double>      double_values_;
@@ -0,0 +1,90 @@
+/**
+ * @file legacy/core/crc32.cpp
+ * @brief Implementation of the Legacy core CRC-32 checksum.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/core/crc32.h"
+
+
+namespace
+{
+
+/**
+ * The slicing tables: table[0] is the classic byte-at-a-time table and
+ * table[k] advances the CRC of a byte followed by k zero bytes.
+ */
+struct Crc32Tables
+{
+  std::uint32_t table[8][256];
+
+  Crc32Tables()
+  {
+    for (std::uint32_t i = 0; i < 256; ++i)
+    {
+      std::uint32_t crc = i;
+      for (int bit = 0; bit < 8; ++bit)
+      {
+        crc = (crc >> 1) ^ ((crc & 1) ? 0xedb88320u : 0u);
+      }
+      table[0][i] = crc;
+    }
+    for (std::uint32_t i = 0; i < 256; ++i)
+    {
+      for (int k = 1; k < 8; ++k)
+      {
+        table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+      }
+    }
+  }
+};
+
+Crc32Tables const&
+crc32_tables()
+{
+  static const Crc32Tables tables;
+  return tables;
+}
+
+} // anonymous namespace
+
+
+std::uint32_t Legacy::Core::
+crc32(void const* data, std::size_t size, std::uint32_t crc)
+{
+  auto const& t = crc32_tables().table;
+  unsigned char const* p = static_cast<unsigned char const*>(data);
+
+  crc = ~crc;
+  while (size >= 8)
+  {
+    // Assembled byte by byte so the result does not depend on host byte order.
+    std::uint32_t lo = crc ^ (std::uint32_t(p[0])       | std::uint32_t(p[1]) << 8
+                           | std::uint32_t(p[2]) << 16 | std::uint32_t(p[3]) << 24);
+    std::uint32_t hi = std::uint32_t(p[4])       | std::uint32_t(p[5]) << 8
+                     | std::uint32_t(p[6]) << 16 | std::uint32_t(p[7]) << 24;
+    crc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24]
+        ^ t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+    p += 8;
+    size -= 8;
+  }
+  while (size-- > 0)
+  {
+    crc = (crc >> 8) ^ t[0][(crc ^ *p++) & 0xff];
+  }
+  return ~crc;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file legacy/core/crc32.h
+ * @brief Public interface of the Legacy core CRC-32 checksum.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_CORE_CRC32_H
+#define LEGACY_CORE_CRC32_H
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace Legacy
+{
+namespace Core
+{
+
+/**
+ * Computes the CRC-32 (the IEEE 802.3 polynomial, as used by zlib and PNG) of
+ * @p size bytes at @p data.
+ * @param[in] crc  The CRC of any preceding data, so a checksum can be built up
+ *                 a piece at a time.
+ *
+ * The bytes are processed eight at a time using slicing tables, which runs at
+ * well over a gigabyte a second on current hardware.
+ */
+std::uint32_t
+crc32(void const* data, std::size_t size, std::uint32_t crc = 0);
+
+} // namespace Core
+} // namespace Legacy
+
+#endif /* LEGACY_CORE_CRC32_H */
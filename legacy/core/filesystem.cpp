@@ -23,6 +23,7 @@
 #include <algorithm>
 #include <iterator>
 #include <regex>
+#include <utility>
 
 
 namespace Legacy
@@ -146,10 +147,62 @@ FileInfo::
 ~FileInfo()
 { }
 
+MappedFile::
+~MappedFile()
+{ }
+
 FileSystem::
 ~FileSystem()
 { }
 
+
+namespace
+{
+
+/**
+ * A "mapped" file that is really just a copy of the file contents in memory.
+ */
+class BufferedMappedFile
+: public MappedFile
+{
+public:
+  BufferedMappedFile(std::vector<char>&& buffer)
+  : buffer_(std::move(buffer))
+  { }
+
+  ~BufferedMappedFile() override = default;
+
+  char const*
+  data() const override
+  { return buffer_.data(); }
+
+  std::size_t
+  size() const override
+  { return buffer_.size(); }
+
+private:
+  std::vector<char> buffer_;
+};
+
+} // anonymous namespace
+
+
+MappedFileOwningPtr FileSystem::
+map_for_input(Path const& path) const
+{
+  auto istr = open_for_input(path);
+  if (!istr || !*istr)
+    return MappedFileOwningPtr();
+
+  std::vector<char> buffer;
+  char block[4096];
+  while (istr->read(block, sizeof(block)) || istr->gcount() > 0)
+  {
+    buffer.insert(buffer.end(), block, block + istr->gcount());
+  }
+  return MappedFileOwningPtr(new BufferedMappedFile(std::move(buffer)));
+}
+
 } // namespace Core
 } // namespace Legacy
 
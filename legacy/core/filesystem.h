@@ -21,6 +21,7 @@
 #ifndef LEGACY_CORE_FILESYSTEM_H
 #define LEGACY_CORE_FILESYSTEM_H
 
+#include <cstddef>
 #include <istream>
 #include <memory>
 #include <string>
@@ -139,6 +140,27 @@ public:
 using FileInfoOwningPtr = std::unique_ptr<FileInfo>;
 
 
+/**
+ * The read-only contents of a file, mapped into memory.
+ *
+ * The contents remain valid for the lifetime of the MappedFile object.
+ */
+class MappedFile
+{
+public:
+  virtual
+  ~MappedFile() = 0;
+
+  virtual char const*
+  data() const = 0;
+
+  std::size_t virtual
+  size() const = 0;
+};
+
+using MappedFileOwningPtr = std::unique_ptr<MappedFile>;
+
+
 /**
  * An abstract base class for filesystem wrappers.
  */
@@ -153,6 +175,18 @@ public:
 
   std::unique_ptr<std::istream> virtual
   open_for_input(Path const&) const = 0;
+
+  /**
+   * Maps the contents of a file into memory for reading.
+   *
+   * The default implementation reads the entire file through open_for_input()
+   * into a buffer.  Filesystems that can do better (eg. using mmap()) should
+   * override it.
+   *
+   * @returns the mapped file, or a null pointer if the file could not be read.
+   */
+  MappedFileOwningPtr virtual
+  map_for_input(Path const& path) const;
 };
 
 
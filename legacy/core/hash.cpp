@@ -0,0 +1,136 @@
+/**
+ * @file legacy/core/hash.cpp
+ * @brief Implementation of the Legacy core 64-bit content hash.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/core/hash.h"
+
+
+namespace
+{
+
+constexpr std::uint64_t prime1 = 11400714785074694791ull;
+constexpr std::uint64_t prime2 = 14029467366897019727ull;
+constexpr std::uint64_t prime3 =  1609587929392839161ull;
+constexpr std::uint64_t prime4 =  9650029242287828579ull;
+constexpr std::uint64_t prime5 =  2870177450012600261ull;
+
+
+inline std::uint64_t
+rotl(std::uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+
+/** Reads little-endian values byte by byte so the hash does not depend on host byte order. */
+inline std::uint64_t
+read64(unsigned char const* p)
+{
+  return std::uint64_t(p[0])       | std::uint64_t(p[1]) << 8
+       | std::uint64_t(p[2]) << 16 | std::uint64_t(p[3]) << 24
+       | std::uint64_t(p[4]) << 32 | std::uint64_t(p[5]) << 40
+       | std::uint64_t(p[6]) << 48 | std::uint64_t(p[7]) << 56;
+}
+
+
+inline std::uint64_t
+read32(unsigned char const* p)
+{
+  return std::uint64_t(p[0])       | std::uint64_t(p[1]) << 8
+       | std::uint64_t(p[2]) << 16 | std::uint64_t(p[3]) << 24;
+}
+
+
+inline std::uint64_t
+round(std::uint64_t acc, std::uint64_t input)
+{
+  acc += input * prime2;
+  return rotl(acc, 31) * prime1;
+}
+
+
+inline std::uint64_t
+merge_round(std::uint64_t acc, std::uint64_t lane)
+{
+  acc ^= round(0, lane);
+  return acc * prime1 + prime4;
+}
+
+} // anonymous namespace
+
+
+std::uint64_t Legacy::Core::
+hash64(void const* data, std::size_t size, std::uint64_t seed)
+{
+  unsigned char const* p = static_cast<unsigned char const*>(data);
+  unsigned char const* const end = p + size;
+  std::uint64_t h;
+
+  if (size >= 32)
+  {
+    std::uint64_t v1 = seed + prime1 + prime2;
+    std::uint64_t v2 = seed + prime2;
+    std::uint64_t v3 = seed;
+    std::uint64_t v4 = seed - prime1;
+    unsigned char const* const limit = end - 32;
+    do
+    {
+      v1 = round(v1, read64(p));
+      v2 = round(v2, read64(p + 8));
+      v3 = round(v3, read64(p + 16));
+      v4 = round(v4, read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+
+    h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+    h = merge_round(h, v1);
+    h = merge_round(h, v2);
+    h = merge_round(h, v3);
+    h = merge_round(h, v4);
+  }
+  else
+  {
+    h = seed + prime5;
+  }
+
+  h += size;
+  for (; end - p >= 8; p += 8)
+  {
+    h ^= round(0, read64(p));
+    h = rotl(h, 27) * prime1 + prime4;
+  }
+  if (end - p >= 4)
+  {
+    h ^= read32(p) * prime1;
+    h = rotl(h, 23) * prime2 + prime3;
+    p += 4;
+  }
+  for (; p < end; ++p)
+  {
+    h ^= *p * prime5;
+    h = rotl(h, 11) * prime1;
+  }
+
+  h ^= h >> 33;
+  h *= prime2;
+  h ^= h >> 29;
+  h *= prime3;
+  h ^= h >> 32;
+  return h;
+}
@@ -0,0 +1,48 @@
+/**
+ * @file legacy/core/hash.h
+ * @brief Public interface of the Legacy core 64-bit content hash.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_CORE_HASH_H
+#define LEGACY_CORE_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+
+namespace Legacy
+{
+namespace Core
+{
+
+/**
+ * Computes the 64-bit XXH64 hash of @p size bytes at @p data.
+ * @param[in] seed  Selects one of a family of unrelated hashes.
+ *
+ * Unlike crc32() this is not a checksum for detecting damage but a fast,
+ * well-mixed hash for telling contents apart, as a cache key or to skip
+ * comparisons.  Long inputs are consumed 32 bytes at a time in four
+ * independent lanes, which runs at several gigabytes a second.
+ */
+std::uint64_t
+hash64(void const* data, std::size_t size, std::uint64_t seed = 0);
+
+} // namespace Core
+} // namespace Legacy
+
+#endif /* LEGACY_CORE_HASH_H */
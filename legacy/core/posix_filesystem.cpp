@@ -20,8 +20,11 @@
  */
 #include "legacy/core/posix_filesystem.h"
 
+#include <fcntl.h>
 #include <fstream>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 
 namespace Legacy
@@ -81,6 +84,41 @@ private:
 };
 
 
+/**
+ * A file mapped read-only into memory using mmap().
+ */
+class PosixMappedFile
+: public MappedFile
+{
+public:
+  PosixMappedFile(void* addr, std::size_t size)
+  : addr_(addr)
+  , size_(size)
+  { }
+
+  ~PosixMappedFile() override
+  {
+    if (addr_)
+      ::munmap(addr_, size_);
+  }
+
+  char const*
+  data() const override
+  { return static_cast<char const*>(addr_); }
+
+  std::size_t
+  size() const override
+  { return size_; }
+
+private:
+  PosixMappedFile(PosixMappedFile const&) = delete;
+  PosixMappedFile& operator=(PosixMappedFile const&) = delete;
+
+  void*       addr_;
+  std::size_t size_;
+};
+
+
 /**
  * An POSIX-based filesystem class.
  */
@@ -100,6 +138,38 @@ open_for_input(Path const& path) const
 }
 
 
+MappedFileOwningPtr PosixFileSystem::
+map_for_input(Path const& path) const
+{
+  int fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return MappedFileOwningPtr();
+
+  struct stat f_stat;
+  if (::fstat(fd, &f_stat) != 0)
+  {
+    ::close(fd);
+    return MappedFileOwningPtr();
+  }
+
+  std::size_t size = static_cast<std::size_t>(f_stat.st_size);
+  void* addr = nullptr;
+  if (size > 0)
+  {
+    addr = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED)
+    {
+      ::close(fd);
+      return MappedFileOwningPtr();
+    }
+  }
+
+  // The mapping outlives the descriptor.
+  ::close(fd);
+  return MappedFileOwningPtr(new PosixMappedFile(addr, size));
+}
+
+
 } // namespace Core
 } // namespace Legacy
 
@@ -44,6 +44,9 @@ public:
 
   std::unique_ptr<std::istream>
   open_for_input(Path const&) const override;
+
+  MappedFileOwningPtr
+  map_for_input(Path const& path) const override;
 };
 
 
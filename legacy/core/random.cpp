@@ -23,6 +23,10 @@
 #include <iostream>
 
 
+constexpr std::uint64_t Legacy::Core::SplitSeed::golden_gamma;
+constexpr std::size_t Legacy::Core::Xoshiro256x4::lanes;
+
+
 Legacy::Core::RandomNumberGenerator::
 RandomNumberGenerator()
 : mt_()
@@ -43,18 +47,28 @@ Legacy::Core::RandomNumberGenerator::
 
 
 Legacy::Core::RandomNumberGenerator::result_type Legacy::Core::RandomNumberGenerator::
-min()
-{ return mt_.min(); }
+operator()()
+{ return mt_(); }
 
 
-Legacy::Core::RandomNumberGenerator::result_type Legacy::Core::RandomNumberGenerator::
-max()
-{ return mt_.max(); }
+void Legacy::Core::RandomNumberGenerator::
+fill(std::size_t count, std::uint32_t* out)
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    out[i] = static_cast<std::uint32_t>(mt_());
+  }
+}
 
 
-Legacy::Core::RandomNumberGenerator::result_type Legacy::Core::RandomNumberGenerator::
-operator()()
-{ return mt_(); }
+void Legacy::Core::RandomNumberGenerator::
+fill_uniform(std::size_t count, double* out)
+{
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    out[i] = std::generate_canonical<double, 53>(mt_);
+  }
+}
 
 
 std::istream& Legacy::Core::
@@ -72,3 +86,225 @@ operator<<(std::ostream& ostr, Legacy::Core::RandomNumberGenerator const& rng)
   return ostr;
 }
 
+
+
+Legacy::Core::Xoshiro256::
+Xoshiro256()
+{
+  std::random_device rd;
+  std::uint64_t seed = std::uint64_t(rd()) << 32 | rd();
+  *this = Xoshiro256(SplitSeed(seed));
+}
+
+
+Legacy::Core::Xoshiro256::
+Xoshiro256(std::uint64_t seed)
+: Xoshiro256(SplitSeed(seed))
+{ }
+
+
+/**
+ * Seeding from a SplitMix64 stream, as the authors recommend, keeps the
+ * state from being all zeros or poorly mixed however alike the seeds are.
+ */
+Legacy::Core::Xoshiro256::
+Xoshiro256(SplitSeed seed)
+: state_{ seed.draw(0), seed.draw(1), seed.draw(2), seed.draw(3) }
+{ }
+
+
+void Legacy::Core::Xoshiro256::
+jump()
+{
+  static std::uint64_t const polynomial[4] = {
+    0x180ec6d33cfd0abau, 0xd5a61266f0c9392cu, 0xa9582618e03fc9aau, 0x39abdc4529b1661cu
+  };
+  jump(polynomial);
+}
+
+
+void Legacy::Core::Xoshiro256::
+long_jump()
+{
+  static std::uint64_t const polynomial[4] = {
+    0x76e15d3efefdcbbfu, 0xc5004e441c522fb3u, 0x77710069854ee241u, 0x39109bb02acbe635u
+  };
+  jump(polynomial);
+}
+
+
+Legacy::Core::Xoshiro256 Legacy::Core::Xoshiro256::
+split()
+{
+  Xoshiro256 stream(*this);
+  jump();
+  return stream;
+}
+
+
+/**
+ * Jumps ahead by the characteristic polynomial of the jump distance, summing
+ * the states the generator passes through for each of its set bits.
+ */
+void Legacy::Core::Xoshiro256::
+jump(std::uint64_t const (&polynomial)[4])
+{
+  std::uint64_t sum[4] = { 0, 0, 0, 0 };
+  for (std::uint64_t word: polynomial)
+  {
+    for (int bit = 0; bit < 64; ++bit)
+    {
+      if (word & (std::uint64_t(1) << bit))
+      {
+        for (int i = 0; i < 4; ++i)
+          sum[i] ^= state_[i];
+      }
+      (*this)();
+    }
+  }
+  for (int i = 0; i < 4; ++i)
+    state_[i] = sum[i];
+}
+
+
+std::istream& Legacy::Core::
+operator>>(std::istream& istr, Legacy::Core::Xoshiro256& rng)
+{
+  std::uint64_t state[4];
+  istr >> state[0] >> state[1] >> state[2] >> state[3];
+  if (!istr)
+    return istr;
+  if ((state[0] | state[1] | state[2] | state[3]) == 0)
+  {
+    istr.setstate(std::ios::failbit);
+    return istr;
+  }
+  for (int i = 0; i < 4; ++i)
+    rng.state_[i] = state[i];
+  return istr;
+}
+
+
+std::ostream& Legacy::Core::
+operator<<(std::ostream& ostr, Legacy::Core::Xoshiro256 const& rng)
+{
+  ostr << rng.state_[0] << ' ' << rng.state_[1] << ' ' << rng.state_[2] << ' ' << rng.state_[3];
+  return ostr;
+}
+
+
+Legacy::Core::Xoshiro256x4::
+Xoshiro256x4(Legacy::Core::Xoshiro256 rng)
+{
+  for (std::size_t lane = 0; lane < lanes; ++lane)
+  {
+    s0_[lane] = rng.state_[0];
+    s1_[lane] = rng.state_[1];
+    s2_[lane] = rng.state_[2];
+    s3_[lane] = rng.state_[3];
+    rng.jump();
+  }
+}
+
+
+Legacy::Core::Xoshiro256x4::
+Xoshiro256x4(Legacy::Core::SplitSeed seed)
+: Xoshiro256x4(Xoshiro256(seed))
+{ }
+
+
+/**
+ * The multiplications by 5 and 9 are written as shifts and adds, which every
+ * vector instruction set has for 64-bit lanes where a multiply may not be.
+ */
+inline void Legacy::Core::Xoshiro256x4::
+step(std::uint64_t (&out)[lanes])
+{
+  for (std::size_t lane = 0; lane < lanes; ++lane)
+  {
+    std::uint64_t x = s1_[lane] + (s1_[lane] << 2);
+    x = (x << 7) | (x >> 57);
+    out[lane] = x + (x << 3);
+
+    std::uint64_t t = s1_[lane] << 17;
+    s2_[lane] ^= s0_[lane];
+    s3_[lane] ^= s1_[lane];
+    s1_[lane] ^= s2_[lane];
+    s0_[lane] ^= s3_[lane];
+    s2_[lane] ^= t;
+    s3_[lane] = (s3_[lane] << 45) | (s3_[lane] >> 19);
+  }
+}
+
+
+void Legacy::Core::Xoshiro256x4::
+fill(std::size_t count, std::uint64_t* out)
+{
+  std::size_t i = 0;
+  for (; i + lanes <= count; i += lanes)
+  {
+    std::uint64_t values[lanes];
+    step(values);
+    for (std::size_t lane = 0; lane < lanes; ++lane)
+      out[i + lane] = values[lane];
+  }
+  if (i < count)
+  {
+    std::uint64_t values[lanes];
+    step(values);
+    for (std::size_t lane = 0; i + lane < count; ++lane)
+      out[i + lane] = values[lane];
+  }
+}
+
+
+void Legacy::Core::Xoshiro256x4::
+fill(std::size_t count, std::uint32_t* out)
+{
+  std::size_t i = 0;
+  for (; i + 2 * lanes <= count; i += 2 * lanes)
+  {
+    std::uint64_t values[lanes];
+    step(values);
+    for (std::size_t lane = 0; lane < lanes; ++lane)
+    {
+      out[i + lane] = static_cast<std::uint32_t>(values[lane]);
+      out[i + lanes + lane] = static_cast<std::uint32_t>(values[lane] >> 32);
+    }
+  }
+  if (i < count)
+  {
+    std::uint64_t values[lanes];
+    step(values);
+    std::uint32_t halves[2 * lanes];
+    for (std::size_t lane = 0; lane < lanes; ++lane)
+    {
+      halves[lane] = static_cast<std::uint32_t>(values[lane]);
+      halves[lanes + lane] = static_cast<std::uint32_t>(values[lane] >> 32);
+    }
+    for (std::size_t k = 0; i + k < count; ++k)
+      out[i + k] = halves[k];
+  }
+}
+
+
+void Legacy::Core::Xoshiro256x4::
+fill_uniform(std::size_t count, double* out)
+{
+  double const scale = 1.0 / 9007199254740992.0;  // 2^-53
+  std::size_t i = 0;
+  for (; i + lanes <= count; i += lanes)
+  {
+    std::uint64_t values[lanes];
+    step(values);
+    for (std::size_t lane = 0; lane < lanes; ++lane)
+      out[i + lane] = static_cast<double>(values[lane] >> 11) * scale;
+  }
+  if (i < count)
+  {
+    std::uint64_t values[lanes];
+    step(values);
+    for (std::size_t lane = 0; i + lane < count; ++lane)
+      out[i + lane] = static_cast<double>(values[lane] >> 11) * scale;
+  }
+}
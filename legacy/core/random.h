@@ -21,6 +21,7 @@
 #ifndef LEGACY_CORE_RANDOM_H
 #define LEGACY_CORE_RANDOM_H
 
+#include <cstddef>
 #include <cstdint>
 #include <iosfwd>
 #include <random>
@@ -65,15 +66,17 @@ public:
    * The smallest value returned by operator().
    * Required by the UniformRandomNumberGenerator concept.
    */
-  result_type
-  min();
+  static constexpr result_type
+  min()
+  { return std::mt19937::min(); }
 
   /**
    * The largest value returned by operator().
    * Required by the UniformRandomNumberGenerator concept.
    */
-  result_type
-  max();
+  static constexpr result_type
+  max()
+  { return std::mt19937::max(); }
 
   /**
    * Returns a random value in the closed interval [min(), max()].
@@ -84,6 +87,24 @@ public:
   virtual result_type
   operator()();
 
+  /**
+   * Fills @p out with @p count random values, the same values as that many
+   * calls to operator() would return, in one pass over the engine.
+   *
+   * This function is virtual so it can be overridden in mocks.
+   */
+  virtual void
+  fill(std::size_t count, std::uint32_t* out);
+
+  /**
+   * Fills @p out with @p count random values uniformly distributed over
+   * [0, 1), each as std::generate_canonical<double, 53>() would draw it.
+   *
+   * This function is virtual so it can be overridden in mocks.
+   */
+  virtual void
+  fill_uniform(std::size_t count, double* out);
+
   friend std::istream&
   operator>>(std::istream& istr, RandomNumberGenerator& rng);
 
@@ -100,6 +121,247 @@ operator>>(std::istream& istr, RandomNumberGenerator& rng);
 std::ostream&
 operator<<(std::ostream& ostr, RandomNumberGenerator const& rng);
 
+
+/**
+ * Scrambles a 64-bit value into a well-mixed one: the SplitMix64 finalizer.
+ * Distinct values always give distinct results.
+ */
+inline std::uint64_t
+mix64(std::uint64_t value)
+{
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9u;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebu;
+  return value ^ (value >> 31);
+}
+
+
+/**
+ * A seed that can be split into independent seeds for the parts of whatever
+ * it seeds, such as the chunks of a map, without drawing them from a shared
+ * sequence.
+ *
+ * Each derived seed is a hash of its parent and its key, so it is the same
+ * whenever and in whatever order it is derived, and a part can be generated
+ * again on its own, or alongside others on several threads, with the same
+ * result.  The seeds derived from one parent with different keys are always
+ * different.  A seed also gives a counter-based stream of random values, the
+ * SplitMix64 sequence starting from it, any of which can be had directly.
+ */
+class SplitSeed
+{
+public:
+  explicit
+  SplitSeed(std::uint64_t seed)
+  : value_(seed)
+  { }
+
+  /** The seed itself. */
+  std::uint64_t
+  value() const
+  { return value_; }
+
+  /** Derives the seed of the part of this one identified by @p key. */
+  SplitSeed
+  split(std::uint64_t key) const
+  { return SplitSeed(mix64(value_ ^ mix64(key + golden_gamma))); }
+
+  /** Derives the seed of the chunk at (@p x, @p y). */
+  SplitSeed
+  at(std::int32_t x, std::int32_t y) const
+  { return split(std::uint64_t(std::uint32_t(x)) << 32 | std::uint32_t(y)); }
+
+  /** Derives the seed of the chunk at (@p x, @p y, @p z). */
+  SplitSeed
+  at(std::int32_t x, std::int32_t y, std::int32_t z) const
+  { return at(x, y).split(std::uint32_t(z)); }
+
+  /** The random value at position @p counter of the seed's stream. */
+  std::uint64_t
+  draw(std::uint64_t counter) const
+  { return mix64(value_ + (counter + 1) * golden_gamma); }
+
+  /**
+   * A 32-bit seed folded from this one, for seeding generators that take
+   * no more, such as RandomNumberGenerator or FastNoise.
+   */
+  std::uint32_t
+  seed32() const
+  { return std::uint32_t(value_ ^ (value_ >> 32)); }
+
+private:
+  static constexpr std::uint64_t golden_gamma = 0x9e3779b97f4a7c15u;
+
+  std::uint64_t value_;
+};
+
+
+/**
+ * A small, fast random number generator: xoshiro256** by Blackman and Vigna.
+ *
+ * Its whole state is four 64-bit words, so it is cheap to keep one for each
+ * entity and to copy, and its operator() is not virtual and is inlined where
+ * it is used as a template argument, such as by the std random distributions
+ * or an AliasTable.  It can jump ahead 2^128 or 2^192 values at once, so a
+ * sequence can be split into streams that will never overlap.
+ *
+ * It provides the UniformRandomNumberGenerator concept and is saved and
+ * restored through operator<< and operator>> as RandomNumberGenerator is.
+ */
+class Xoshiro256
+{
+public:
+  using result_type = std::uint64_t;
+
+public:
+  /** Constructs a generator primed from std::random_device. */
+  Xoshiro256();
+
+  /** Constructs a generator from a specific seed. */
+  explicit
+  Xoshiro256(std::uint64_t seed);
+
+  /**
+   * Constructs a generator whose state is the first values of a split seed's
+   * stream, so each part of whatever the seed is split for can have a
+   * generator of its own.
+   */
+  explicit
+  Xoshiro256(SplitSeed seed);
+
+  static constexpr result_type
+  min()
+  { return 0; }
+
+  static constexpr result_type
+  max()
+  { return ~result_type(0); }
+
+  /** Returns a random value in the closed interval [min(), max()]. */
+  result_type
+  operator()()
+  {
+    result_type result = rotl(state_[1] * 5, 7) * 9;
+    result_type t = state_[1] << 17;
+    state_[2] ^= state_[0];
+    state_[3] ^= state_[1];
+    state_[1] ^= state_[2];
+    state_[0] ^= state_[3];
+    state_[2] ^= t;
+    state_[3] = rotl(state_[3], 45);
+    return result;
+  }
+
+  /** Advances the generator as if by 2^128 calls. */
+  void
+  jump();
+
+  /** Advances the generator as if by 2^192 calls. */
+  void
+  long_jump();
+
+  /**
+   * Splits off a generator for the next 2^128 values and jumps this one past
+   * them, so the two streams never overlap.
+   */
+  Xoshiro256
+  split();
+
+  friend bool
+  operator==(Xoshiro256 const& lhs, Xoshiro256 const& rhs)
+  {
+    return lhs.state_[0] == rhs.state_[0] && lhs.state_[1] == rhs.state_[1]
+        && lhs.state_[2] == rhs.state_[2] && lhs.state_[3] == rhs.state_[3];
+  }
+
+  friend bool
+  operator!=(Xoshiro256 const& lhs, Xoshiro256 const& rhs)
+  { return !(lhs == rhs); }
+
+  friend std::istream&
+  operator>>(std::istream& istr, Xoshiro256& rng);
+
+  friend std::ostream&
+  operator<<(std::ostream& ostr, Xoshiro256 const& rng);
+
+private:
+  friend class Xoshiro256x4;
+
+  static result_type
+  rotl(result_type x, int k)
+  { return (x << k) | (x >> (64 - k)); }
+
+  void
+  jump(std::uint64_t const (&polynomial)[4]);
+
+  std::uint64_t state_[4];
+};
+
+std::istream&
+operator>>(std::istream& istr, Xoshiro256& rng);
+
+std::ostream&
+operator<<(std::ostream& ostr, Xoshiro256 const& rng);
+
+
+/**
+ * Several xoshiro256** streams stepped side by side, for drawing random values
+ * in bulk.
+ *
+ * The state is held a word of every lane at a time, so each step is the same
+ * few shifts, adds and exclusive-ors over a short array that the compiler can
+ * do in vector registers, one lane to an element.  Lane k starts where the
+ * generator it was made from would be after k calls to Xoshiro256::jump(), so
+ * the lanes never overlap each other or that generator's own stream.
+ *
+ * Values are drawn a step of every lane at a time and written lane by lane, so
+ * the first lanes values written are the first of each lane's stream, and so
+ * on.  A fill that ends partway through a step throws away the rest of it: the
+ * values drawn depend on how the draws are split into fills, though never on
+ * anything else.
+ */
+class Xoshiro256x4
+{
+public:
+  /** The number of streams stepped together. */
+  static constexpr std::size_t lanes = 4;
+
+public:
+  /** Constructs the lanes from a generator and the next lanes-1 jumps of it. */
+  explicit
+  Xoshiro256x4(Xoshiro256 rng);
+
+  /** Constructs the lanes from the generator for a split seed. */
+  explicit
+  Xoshiro256x4(SplitSeed seed);
+
+  /** Fills @p out with @p count random 64-bit values. */
+  void
+  fill(std::size_t count, std::uint64_t* out);
+
+  /**
+   * Fills @p out with @p count random 32-bit values: the low halves of a step
+   * of every lane, then their high halves.
+   */
+  void
+  fill(std::size_t count, std::uint32_t* out);
+
+  /**
+   * Fills @p out with @p count random values uniformly distributed over
+   * [0, 1), from the top 53 bits of each 64-bit value drawn.
+   */
+  void
+  fill_uniform(std::size_t count, double* out);
+
+private:
+  void
+  step(std::uint64_t (&out)[lanes]);
+
+  std::uint64_t s0_[lanes];
+  std::uint64_t s1_[lanes];
+  std::uint64_t s2_[lanes];
+  std::uint64_t s3_[lanes];
+};
+
 } // namespace Core
 } // namespace Legacy
 
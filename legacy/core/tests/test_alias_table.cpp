@@ -0,0 +1,104 @@
+/**
+ * @file legacy/core/tests/test_alias_table.cpp
+ * @brief Tests for the Legacy core alias table sampler.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "catch/catch.hpp"
+#include "legacy/core/alias_table.h"
+#include "legacy/core/random.h"
+#include <stdexcept>
+#include <vector>
+
+using Legacy::Core::AliasTable;
+
+
+SCENARIO("alias tables reject invalid weights")
+{
+  GIVEN("an empty set of weights")
+  {
+    AliasTable::Weights weights;
+    THEN("building an alias table throws")
+    {
+      REQUIRE_THROWS_AS(AliasTable{weights}, std::invalid_argument);
+    }
+  }
+
+  GIVEN("a set of weights that are all zero")
+  {
+    AliasTable::Weights weights{ 0.0, 0.0, 0.0 };
+    THEN("building an alias table throws")
+    {
+      REQUIRE_THROWS_AS(AliasTable{weights}, std::invalid_argument);
+    }
+  }
+
+  GIVEN("a set of weights with a negative weight")
+  {
+    AliasTable::Weights weights{ 1.0, -1.0, 3.0 };
+    THEN("building an alias table throws")
+    {
+      REQUIRE_THROWS_AS(AliasTable{weights}, std::invalid_argument);
+    }
+  }
+}
+
+SCENARIO("alias tables sample according to their weights")
+{
+  Legacy::Core::RandomNumberGenerator rng(2017);
+
+  GIVEN("a single weight")
+  {
+    AliasTable table(AliasTable::Weights{ 0.25 });
+    THEN("the only outcome is always picked")
+    {
+      for (int i = 0; i < 100; ++i)
+      {
+        REQUIRE(table(rng) == 0);
+      }
+    }
+  }
+
+  GIVEN("a set of weights including some zero weights")
+  {
+    AliasTable table(AliasTable::Weights{ 0.0, 2.0, 0.0, 1.0, 0.0 });
+    REQUIRE(table.size() == 5);
+
+    WHEN("a large number of samples are drawn")
+    {
+      std::vector<int> counts(table.size());
+      const int sample_count = 30000;
+      for (int i = 0; i < sample_count; ++i)
+      {
+        ++counts[table(rng)];
+      }
+
+      THEN("the zero-weighted outcomes are never picked")
+      {
+        REQUIRE(counts[0] == 0);
+        REQUIRE(counts[2] == 0);
+        REQUIRE(counts[4] == 0);
+      }
+      AND_THEN("the other outcomes are picked in proportion to their weights")
+      {
+        REQUIRE(counts[1] == Approx(sample_count * 2.0 / 3.0).epsilon(0.05));
+        REQUIRE(counts[3] == Approx(sample_count * 1.0 / 3.0).epsilon(0.05));
+      }
+    }
+  }
+}
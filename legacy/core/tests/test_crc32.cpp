@@ -0,0 +1,70 @@
+/**
+ * @file legacy/core/tests/test_crc32.cpp
+ * @brief Tests for the Legacy core CRC-32 checksum.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include "catch/catch.hpp"
+#include "legacy/core/crc32.h"
+#include <string>
+#include <vector>
+
+using Legacy::Core::crc32;
+
+
+SCENARIO("CRC-32 checksums match the standard check values")
+{
+  GIVEN("no data")
+  {
+    THEN("the checksum is zero")
+    {
+      REQUIRE(crc32("", 0) == 0u);
+    }
+  }
+
+  GIVEN("the standard check string")
+  {
+    std::string check = "123456789";
+    THEN("the checksum is the standard check value")
+    {
+      REQUIRE(crc32(check.data(), check.size()) == 0xcbf43926u);
+    }
+  }
+
+  GIVEN("a longer string")
+  {
+    std::string text = "The quick brown fox jumps over the lazy dog";
+    THEN("the checksum matches zlib's")
+    {
+      REQUIRE(crc32(text.data(), text.size()) == 0x414fa339u);
+    }
+
+    WHEN("the checksum is built up a piece at a time")
+    {
+      std::uint32_t crc = 0;
+      for (std::size_t i = 0; i < text.size(); i += 5)
+      {
+        crc = crc32(text.data() + i, std::min<std::size_t>(5, text.size() - i), crc);
+      }
+      THEN("it matches the checksum of the whole")
+      {
+        REQUIRE(crc == 0x414fa339u);
+      }
+    }
+  }
+}
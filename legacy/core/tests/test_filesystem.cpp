@@ -21,6 +21,7 @@
  */
 #include "catch/catch.hpp"
 #include "legacy/core/filesystem.h"
+#include "legacy/core/tests/mock_filesystem.h"
 
 using namespace Legacy::Core;
 
@@ -253,3 +254,22 @@ SCENARIO("parsing a colon-separated pathlist_string into a PathList")
     }
   }
 }
+
+SCENARIO("mapping a file into memory")
+{
+  GIVEN("a filesystem that does not provide its own mapping")
+  {
+    Legacy::Core::Tests::MockFileSystem filesystem;
+
+    WHEN("a file is mapped")
+    {
+      MappedFileOwningPtr mapped = filesystem.map_for_input(Path("/dir/file"));
+
+      THEN("the mapping holds the contents of the file")
+      {
+        REQUIRE(mapped);
+        REQUIRE(std::string(mapped->data(), mapped->size()) == "hello");
+      }
+    }
+  }
+}
@@ -0,0 +1,85 @@
+/**
+ * @file legacy/core/tests/test_hash.cpp
+ * @brief Tests for the Legacy core 64-bit content hash.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "catch/catch.hpp"
+#include "legacy/core/hash.h"
+#include <string>
+#include <vector>
+
+using Legacy::Core::hash64;
+
+
+SCENARIO("64-bit hashes match the XXH64 reference values")
+{
+  GIVEN("no data")
+  {
+    THEN("the hash is the reference value")
+    {
+      REQUIRE(hash64("", 0) == 0xef46db3751d8e999ull);
+    }
+  }
+
+  GIVEN("short strings")
+  {
+    THEN("the hashes are the reference values")
+    {
+      REQUIRE(hash64("a", 1) == 0xd24ec4f1a98c6e5bull);
+      REQUIRE(hash64("abc", 3) == 0x44bc2cf5ad770999ull);
+    }
+  }
+
+  GIVEN("a string longer than one stripe")
+  {
+    std::string text = "Nobody inspects the spammish repetition";
+    THEN("the hash is the reference value")
+    {
+      REQUIRE(hash64(text.data(), text.size()) == 0xfbcea83c8a378bf1ull);
+    }
+  }
+}
+
+
+SCENARIO("64-bit hashes tell contents apart")
+{
+  GIVEN("a buffer of words")
+  {
+    std::vector<int> words(1000);
+    for (std::size_t i = 0; i < words.size(); ++i)
+      words[i] = int(i * 7);
+    std::uint64_t hash = hash64(words.data(), words.size() * sizeof(int));
+
+    THEN("changing any one word changes the hash")
+    {
+      bool all_changed = true;
+      for (std::size_t i = 0; i < words.size(); i += 37)
+      {
+        std::vector<int> changed = words;
+        changed[i] ^= 1;
+        all_changed = all_changed && hash64(changed.data(), changed.size() * sizeof(int)) != hash;
+      }
+      REQUIRE(all_changed);
+    }
+
+    THEN("a different seed gives a different hash")
+    {
+      REQUIRE(hash64(words.data(), words.size() * sizeof(int), 1) != hash);
+    }
+  }
+}
@@ -21,7 +21,11 @@
  */
 #include "catch/catch.hpp"
 #include "legacy/core/random.h"
+#include <cstdint>
+#include <random>
 #include <sstream>
+#include <unordered_set>
+#include <vector>
 
 
 SCENARIO("random number generator give expected sequences")
@@ -116,3 +120,310 @@ SCENARIO("Legacy RNGs have savable, restorable state")
     }
   }
 }
+
+
+SCENARIO("split seeds are derived from their parents alone")
+{
+  using Legacy::Core::SplitSeed;
+
+  GIVEN("A split seed")
+  {
+    SplitSeed seed(1234567);
+
+    THEN("its stream is the SplitMix64 sequence from the seed, drawn in any order")
+    {
+      REQUIRE(seed.draw(4) == 16408922859458223821u);
+      REQUIRE(seed.draw(0) == 6457827717110365317u);
+      REQUIRE(seed.draw(1) == 3203168211198807973u);
+      REQUIRE(seed.draw(2) == 9817491932198370423u);
+      REQUIRE(seed.draw(3) == 4593380528125082431u);
+    }
+
+    THEN("the seeds of chunks are the same whatever order they are derived in")
+    {
+      std::vector<std::uint64_t> forward;
+      for (int y = -4; y < 4; ++y)
+        for (int x = -4; x < 4; ++x)
+          forward.push_back(seed.at(x, y).value());
+      std::vector<std::uint64_t> backward(forward.size());
+      for (int y = 3; y >= -4; --y)
+        for (int x = 3; x >= -4; --x)
+          backward[(y + 4) * 8 + (x + 4)] = seed.at(x, y).value();
+      REQUIRE(forward == backward);
+    }
+
+    THEN("seeds split from it with different keys are all different")
+    {
+      std::unordered_set<std::uint64_t> seen;
+      for (std::uint64_t key = 0; key < 100000; ++key)
+        seen.insert(seed.split(key).value());
+      REQUIRE(seen.size() == 100000);
+      REQUIRE(seed.at(1, -1).value() != seed.at(-1, 1).value());
+      REQUIRE(seed.at(0, 0, 1).value() != seed.at(0, 1, 0).value());
+    }
+
+    THEN("splitting twice depends on the order of the keys")
+    {
+      REQUIRE(seed.split(1).split(2).value() != seed.split(2).split(1).value());
+    }
+
+    THEN("a different parent gives different children")
+    {
+      REQUIRE(seed.split(7).value() != SplitSeed(7654321).split(7).value());
+    }
+
+    THEN("a folded seed can seed a sequential generator")
+    {
+      Legacy::Core::RandomNumberGenerator rng1(seed.at(3, 4).seed32());
+      Legacy::Core::RandomNumberGenerator rng2(seed.at(3, 4).seed32());
+      REQUIRE(rng1() == rng2());
+    }
+  }
+}
+
+
+SCENARIO("the xoshiro256** generator gives the reference sequence and splits into streams")
+{
+  using Legacy::Core::Xoshiro256;
+
+  GIVEN("A generator restored to the state 1, 2, 3, 4")
+  {
+    Xoshiro256 rng(0);
+    std::istringstream istr("1 2 3 4");
+    istr >> rng;
+    REQUIRE(istr);
+
+    THEN("it gives the reference values")
+    {
+      REQUIRE(rng() == 11520u);
+      REQUIRE(rng() == 0u);
+      REQUIRE(rng() == 1509978240u);
+      REQUIRE(rng() == 1215971899390074240u);
+    }
+
+    THEN("it saves as it was restored")
+    {
+      std::ostringstream ostr;
+      ostr << rng;
+      REQUIRE(ostr.str() == "1 2 3 4");
+    }
+  }
+
+  GIVEN("Two generators with the same seed and one with another")
+  {
+    Xoshiro256 rng1(100);
+    Xoshiro256 rng2(100);
+    Xoshiro256 rng3(101);
+
+    THEN("the same seeds give the same sequence and different seeds differ")
+    {
+      REQUIRE(rng1 == rng2);
+      REQUIRE(rng1 != rng3);
+      REQUIRE(rng1() == rng2());
+      REQUIRE(rng1() == rng2());
+      REQUIRE(rng1() != rng3());
+    }
+
+    WHEN("one is split")
+    {
+      Xoshiro256 stream = rng1.split();
+
+      THEN("the split-off stream carries on the original sequence")
+      {
+        REQUIRE(stream == rng2);
+      }
+
+      THEN("the original has jumped as jump() does")
+      {
+        Xoshiro256 jumped(rng2);
+        jumped.jump();
+        REQUIRE(rng1 == jumped);
+        REQUIRE(rng1 != rng2);
+      }
+    }
+
+    WHEN("one jumps and long-jumps")
+    {
+      Xoshiro256 jumped(rng1);
+      jumped.jump();
+      Xoshiro256 long_jumped(rng1);
+      long_jumped.long_jump();
+
+      THEN("each lands somewhere different, the same every time")
+      {
+        REQUIRE(jumped != rng1);
+        REQUIRE(long_jumped != rng1);
+        REQUIRE(long_jumped != jumped);
+        rng2.jump();
+        REQUIRE(rng2 == jumped);
+      }
+    }
+
+    WHEN("one is advanced, then saved and restored into another")
+    {
+      rng1(); rng1(); rng1();
+      std::stringstream sstr;
+      sstr << rng1;
+      Xoshiro256 restored;
+      sstr >> restored;
+
+      THEN("the sequences carry on identically")
+      {
+        REQUIRE(restored() == rng1());
+        REQUIRE(restored() == rng1());
+      }
+    }
+  }
+
+  GIVEN("A generator and an all-zero saved state")
+  {
+    Xoshiro256 rng(7);
+    Xoshiro256 before(rng);
+    std::istringstream istr("0 0 0 0");
+    istr >> rng;
+
+    THEN("the state is refused and the generator unchanged")
+    {
+      REQUIRE_FALSE(istr);
+      REQUIRE(rng == before);
+    }
+  }
+
+  GIVEN("A generator used with a std random distribution")
+  {
+    Xoshiro256 rng(Legacy::Core::SplitSeed(5).at(1, 2));
+    std::uniform_int_distribution<int> die(1, 6);
+
+    THEN("every roll is in range")
+    {
+      bool in_range = true;
+      for (int i = 0; i < 1000; ++i)
+      {
+        int roll = die(rng);
+        in_range = in_range && roll >= 1 && roll <= 6;
+      }
+      REQUIRE(in_range);
+      REQUIRE(Xoshiro256::min() == 0u);
+      REQUIRE(Xoshiro256::max() == ~std::uint64_t(0));
+    }
+  }
+}
+
+
+SCENARIO("random values are drawn in bulk")
+{
+  GIVEN("Two mt19937 generators with the same seed")
+  {
+    Legacy::Core::RandomNumberGenerator rng1(42);
+    Legacy::Core::RandomNumberGenerator rng2(42);
+
+    WHEN("one fills a buffer and the other is called as many times")
+    {
+      std::vector<std::uint32_t> values(1000);
+      rng1.fill(values.size(), values.data());
+
+      THEN("they draw the same values")
+      {
+        bool same = true;
+        for (std::uint32_t value: values)
+          same = same && value == rng2();
+        REQUIRE(same);
+      }
+    }
+
+    WHEN("one fills a buffer with uniform values")
+    {
+      std::vector<double> values(1000);
+      rng1.fill_uniform(values.size(), values.data());
+
+      THEN("they are the values generate_canonical draws")
+      {
+        bool same = true;
+        for (double value: values)
+          same = same && value == std::generate_canonical<double, 53>(rng2);
+        REQUIRE(same);
+      }
+    }
+  }
+
+  GIVEN("A lane generator and the generators each of its lanes starts as")
+  {
+    using Legacy::Core::Xoshiro256;
+    using Legacy::Core::Xoshiro256x4;
+
+    Xoshiro256 rng(Legacy::Core::SplitSeed(9));
+    Xoshiro256x4 lanes(rng);
+    std::vector<Xoshiro256> streams;
+    for (std::size_t lane = 0; lane < Xoshiro256x4::lanes; ++lane)
+    {
+      streams.push_back(rng);
+      rng.jump();
+    }
+
+    WHEN("64-bit values are drawn")
+    {
+      std::vector<std::uint64_t> values(10 * Xoshiro256x4::lanes);
+      lanes.fill(values.size(), values.data());
+
+      THEN("they are each lane's stream in turn")
+      {
+        bool same = true;
+        for (std::size_t i = 0; i < values.size(); ++i)
+          same = same && values[i] == streams[i % Xoshiro256x4::lanes]();
+        REQUIRE(same);
+      }
+    }
+
+    WHEN("32-bit values are drawn")
+    {
+      std::vector<std::uint32_t> values(2 * Xoshiro256x4::lanes);
+      lanes.fill(values.size(), values.data());
+
+      THEN("they are the low then the high halves of a step of every lane")
+      {
+        for (std::size_t lane = 0; lane < Xoshiro256x4::lanes; ++lane)
+        {
+          std::uint64_t value = streams[lane]();
+          REQUIRE(values[lane] == static_cast<std::uint32_t>(value));
+          REQUIRE(values[Xoshiro256x4::lanes + lane] == static_cast<std::uint32_t>(value >> 32));
+        }
+      }
+    }
+
+    WHEN("uniform values are drawn")
+    {
+      std::vector<double> values(1001);
+      lanes.fill_uniform(values.size(), values.data());
+
+      THEN("they are all in [0, 1) and average about a half")
+      {
+        bool in_range = true;
+        double sum = 0.0;
+        for (double value: values)
+        {
+          in_range = in_range && value >= 0.0 && value < 1.0;
+          sum += value;
+        }
+        REQUIRE(in_range);
+        REQUIRE(sum / values.size() == Approx(0.5).epsilon(0.05));
+      }
+    }
+
+    WHEN("a fill ends partway through a step")
+    {
+      std::uint64_t first[3];
+      lanes.fill(3, first);
+      std::uint64_t second[Xoshiro256x4::lanes];
+      lanes.fill(Xoshiro256x4::lanes, second);
+
+      THEN("the rest of the step is thrown away")
+      {
+        for (std::size_t lane = 0; lane < 3; ++lane)
+          REQUIRE(first[lane] == streams[lane]());
+        streams[3]();
+        for (std::size_t lane = 0; lane < Xoshiro256x4::lanes; ++lane)
+          REQUIRE(second[lane] == streams[lane]());
+      }
+    }
+  }
+}
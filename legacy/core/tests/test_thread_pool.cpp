@@ -0,0 +1,118 @@
+/**
+ * @file legacy/core/tests/test_thread_pool.cpp
+ * @brief Tests for the Legacy core thread pool.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "catch/catch.hpp"
+#include "legacy/core/thread_pool.h"
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using Legacy::Core::ThreadPool;
+
+
+SCENARIO("a thread pool runs every task exactly once")
+{
+  GIVEN("a pool of four threads")
+  {
+    ThreadPool pool(4);
+    REQUIRE(pool.thread_count() == 4);
+
+    WHEN("a range of tasks is run")
+    {
+      std::vector<std::atomic<int>> runs(1000);
+      for (auto& run: runs)
+        run = 0;
+      pool.parallel_for(runs.size(), [&runs](std::size_t i) { ++runs[i]; });
+
+      THEN("each task has been run once")
+      {
+        bool all_once = true;
+        for (auto const& run: runs)
+          all_once = all_once && run == 1;
+        REQUIRE(all_once);
+      }
+    }
+
+    WHEN("several ranges are run one after another")
+    {
+      std::atomic<std::size_t> total(0);
+      for (std::size_t count = 0; count < 50; ++count)
+      {
+        pool.parallel_for(count, [&total](std::size_t i) { total += i + 1; });
+      }
+
+      THEN("every task of every range has been run")
+      {
+        REQUIRE(total == 20825);
+      }
+    }
+
+    WHEN("a task runs a nested range on the same pool")
+    {
+      std::atomic<int> total(0);
+      pool.parallel_for(8, [&pool, &total](std::size_t) {
+        pool.parallel_for(8, [&total](std::size_t) { ++total; });
+      });
+
+      THEN("the nested tasks are all run")
+      {
+        REQUIRE(total == 64);
+      }
+    }
+  }
+
+  GIVEN("a pool of one thread")
+  {
+    ThreadPool pool(1);
+    REQUIRE(pool.thread_count() == 1);
+
+    THEN("the tasks run in order on the calling thread")
+    {
+      std::vector<std::size_t> order;
+      pool.parallel_for(10, [&order](std::size_t i) { order.push_back(i); });
+      REQUIRE(order == std::vector<std::size_t>({ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9 }));
+    }
+  }
+}
+
+
+SCENARIO("a thread pool passes on exceptions thrown by tasks")
+{
+  GIVEN("a pool of four threads")
+  {
+    ThreadPool pool(4);
+
+    WHEN("a task throws")
+    {
+      THEN("the exception is rethrown to the caller and the pool carries on")
+      {
+        REQUIRE_THROWS_AS(pool.parallel_for(100, [](std::size_t i) {
+                            if (i == 42)
+                              throw std::runtime_error("task failed");
+                          }),
+                          std::runtime_error);
+
+        std::atomic<int> total(0);
+        pool.parallel_for(100, [&total](std::size_t) { ++total; });
+        REQUIRE(total == 100);
+      }
+    }
+  }
+}
@@ -0,0 +1,167 @@
+/**
+ * @file legacy/core/thread_pool.cpp
+ * @brief Implementation of the Legacy core thread pool.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/core/thread_pool.h"
+
+#include <utility>
+
+
+namespace
+{
+
+/** The pool whose tasks the current thread is running, if any. */
+thread_local Legacy::Core::ThreadPool const* running_pool = nullptr;
+
+} // anonymous namespace
+
+
+Legacy::Core::ThreadPool::
+ThreadPool(unsigned thread_count)
+: stopping_(false)
+, generation_(0)
+, busy_(0)
+, task_(nullptr)
+, count_(0)
+, next_(0)
+{
+  if (thread_count == 0)
+    thread_count = std::thread::hardware_concurrency();
+  if (thread_count == 0)
+    thread_count = 1;
+
+  workers_.reserve(thread_count - 1);
+  for (unsigned i = 1; i < thread_count; ++i)
+  {
+    workers_.emplace_back(&ThreadPool::worker_loop, this);
+  }
+}
+
+
+Legacy::Core::ThreadPool::
+~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  work_ready_.notify_all();
+  for (auto& worker: workers_)
+  {
+    worker.join();
+  }
+}
+
+
+void Legacy::Core::ThreadPool::
+parallel_for(std::size_t count, Task const& task)
+{
+  if (count == 0)
+    return;
+
+  if (workers_.empty() || count == 1 || running_pool == this)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      task(i);
+    }
+    return;
+  }
+
+  // One range at a time: callers on other threads wait their turn.
+  std::lock_guard<std::mutex> run_lock(run_mutex_);
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task_  = &task;
+    count_ = count;
+    next_  = 0;
+    busy_  = workers_.size();
+    error_ = nullptr;
+    ++generation_;
+  }
+  work_ready_.notify_all();
+
+  run_tasks();
+
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    work_done_.wait(lock, [this]{ return busy_ == 0; });
+    task_ = nullptr;
+    std::swap(error, error_);
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+
+Legacy::Core::ThreadPool& Legacy::Core::ThreadPool::
+default_pool()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+
+void Legacy::Core::ThreadPool::
+worker_loop()
+{
+  unsigned long seen = 0;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    work_ready_.wait(lock, [this, seen]{ return stopping_ || generation_ != seen; });
+    if (stopping_)
+      return;
+    seen = generation_;
+
+    lock.unlock();
+    run_tasks();
+    lock.lock();
+
+    if (--busy_ == 0)
+      work_done_.notify_one();
+  }
+}
+
+
+void Legacy::Core::ThreadPool::
+run_tasks()
+{
+  ThreadPool const* outer = running_pool;
+  running_pool = this;
+  while (true)
+  {
+    std::size_t i = next_.fetch_add(1);
+    if (i >= count_)
+      break;
+    try
+    {
+      (*task_)(i);
+    }
+    catch (...)
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (!error_)
+        error_ = std::current_exception();
+      next_ = count_;
+    }
+  }
+  running_pool = outer;
+}
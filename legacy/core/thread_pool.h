@@ -0,0 +1,112 @@
+/**
+ * @file legacy/core/thread_pool.h
+ * @brief Public interface of the Legacy core thread pool.
+ */
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_CORE_THREAD_POOL_H
+#define LEGACY_CORE_THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace Legacy
+{
+namespace Core
+{
+
+/**
+ * A fixed set of worker threads for running independent tasks in parallel.
+ *
+ * Work is handed out as a range of task indexes: each thread, including the
+ * calling thread, repeatedly claims the next unclaimed index until the range
+ * is exhausted.  Which thread runs which index is unspecified, so tasks must
+ * not depend on each other or on the order they are run in.
+ */
+class ThreadPool
+{
+public:
+  using Task = std::function<void(std::size_t)>;
+
+public:
+  /**
+   * Creates a pool that runs up to @p thread_count tasks at once.
+   * @param[in] thread_count  The number of threads to run tasks on, counting
+   *                          the thread that calls parallel_for(), or 0 to use
+   *                          one per hardware thread.
+   */
+  explicit
+  ThreadPool(unsigned thread_count = 0);
+
+  /** Stops and joins the worker threads. */
+  ~ThreadPool();
+
+  /** The number of threads tasks are run on, counting the calling thread. */
+  unsigned
+  thread_count() const
+  { return workers_.size() + 1; }
+
+  /**
+   * Runs @p task once for each index in [0, @p count) and waits for them all.
+   *
+   * If any task throws, no further indexes are handed out and the first
+   * exception is rethrown once the running tasks have finished.  A task that
+   * itself calls parallel_for() on the same pool runs its range serially.
+   */
+  void
+  parallel_for(std::size_t count, Task const& task);
+
+  /** A process-wide pool with one thread per hardware thread. */
+  static ThreadPool&
+  default_pool();
+
+private:
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+
+  void
+  worker_loop();
+
+  void
+  run_tasks();
+
+private:
+  std::vector<std::thread> workers_;
+  std::mutex               run_mutex_;
+  std::mutex               mutex_;
+  std::condition_variable  work_ready_;
+  std::condition_variable  work_done_;
+  bool                     stopping_;
+  unsigned long            generation_;
+  std::size_t              busy_;
+  Task const*              task_;
+  std::size_t              count_;
+  std::atomic<std::size_t> next_;
+  std::exception_ptr       error_;
+};
+
+} // namespace Core
+} // namespace Legacy
+
+#endif /* LEGACY_CORE_THREAD_POOL_H */
@@ -22,16 +22,88 @@
 #ifndef LEGACY_WORLD_CELL_H_
 #define LEGACY_WORLD_CELL_H_
 
+#include <cstdint>
+
+
 namespace Legacy {
 namespace World {
 
 /**
  * A single addressable unit in the world map.
+ *
+ * A cell is a small value: what it is made of, some property flags and how
+ * full it is.  Maps do not hold cells themselves but indexes of cells held in a
+ * CellCache, so every position with the same contents shares one cell.
  */
 class Cell
 {
+public:
+  using Material  = std::uint16_t;
+  using Flags     = std::uint16_t;
+  using Occupancy = std::uint8_t;
+
+  /** The occupancy of a completely filled cell. */
+  static constexpr Occupancy full = 255;
+
+public:
+  /** Creates an empty cell: material 0, no flags and nothing in it. */
+  Cell()
+  : material_(0), flags_(0), occupancy_(0)
+  { }
+
+  Cell(Material material, Flags flags, Occupancy occupancy)
+  : material_(material), flags_(flags), occupancy_(occupancy)
+  { }
+
+  /** What the cell is made of. */
+  Material
+  material() const
+  { return material_; }
+
+  /** The cell's property flags. */
+  Flags
+  flags() const
+  { return flags_; }
+
+  /** How full the cell is, from 0 (empty) to full. */
+  Occupancy
+  occupancy() const
+  { return occupancy_; }
+
+  /** A cell like this one but made of @p material. */
+  Cell
+  with_material(Material material) const
+  { return Cell(material, flags_, occupancy_); }
+
+  /** A cell like this one but with the property @p flags. */
+  Cell
+  with_flags(Flags flags) const
+  { return Cell(material_, flags, occupancy_); }
+
+  /** A cell like this one but with the @p occupancy. */
+  Cell
+  with_occupancy(Occupancy occupancy) const
+  { return Cell(material_, flags_, occupancy); }
+
+private:
+  Material  material_;
+  Flags     flags_;
+  Occupancy occupancy_;
 };
 
+
+bool inline
+operator==(Cell const& lhs, Cell const& rhs)
+{
+  return lhs.material() == rhs.material()
+      && lhs.flags() == rhs.flags()
+      && lhs.occupancy() == rhs.occupancy();
+}
+
+bool inline
+operator!=(Cell const& lhs, Cell const& rhs)
+{ return !(lhs == rhs); }
+
 } // namespace World
 } // namespace Legacy
 
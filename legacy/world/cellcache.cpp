@@ -0,0 +1,361 @@
+/**
+ * @file legacy/world/cellcache.cpp
+ * @brief Implementation of the Legacy world Cell Cache class.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/world/cellcache.h"
+
+#include <algorithm>
+#include "legacy/world/chunkstore.h"
+#include <stdexcept>
+
+
+constexpr Legacy::World::Cell::Occupancy Legacy::World::Cell::full;
+constexpr Legacy::World::CellCache::Index Legacy::World::CellCache::empty_index;
+constexpr std::size_t Legacy::World::CellCache::max_cells;
+constexpr unsigned Legacy::World::CellCache::slab_shift;
+constexpr std::size_t Legacy::World::CellCache::slab_cells;
+constexpr Legacy::World::CellCache::Index Legacy::World::CellCache::slab_mask;
+constexpr std::size_t Legacy::World::CellCache::max_slabs;
+
+
+Legacy::World::CellCache::
+CellCache()
+: slabs_(new std::unique_ptr<Slab>[max_slabs])
+, slab_count_(0)
+, next_(0)
+, unused_(0)
+{
+  intern_locked(Cell());
+  unused_ = 0;
+}
+
+
+Legacy::World::CellCache::
+~CellCache()
+{ }
+
+
+Legacy::World::CellCache::Index Legacy::World::CellCache::
+intern(Cell const& cell)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return intern_locked(cell);
+}
+
+
+Legacy::World::CellCache::Index Legacy::World::CellCache::
+acquire(Cell const& cell)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  Index index = intern_locked(cell);
+  if (index != empty_index && refs_of(index)++ == 0)
+    --unused_;
+  return index;
+}
+
+
+void Legacy::World::CellCache::
+add_refs(Index index, std::uint64_t count)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!contains_locked(index))
+    throw std::out_of_range("cell index out of range");
+  if (index == empty_index || count == 0)
+    return;
+  std::uint64_t& refs = refs_of(index);
+  if (refs == 0)
+    --unused_;
+  refs += count;
+}
+
+
+void Legacy::World::CellCache::
+add_refs(ChunkStore const& cells)
+{
+  // Count the positions of each cell a brick at a time, then check them all
+  // before taking any.  The padding of bricks at the edge of the store holds
+  // no positions, whatever is in it, so it is left out.
+  std::unordered_map<Index, std::uint64_t> counts;
+  std::vector<int> brick(cells.brick_cells());
+  for (std::size_t i = 0; i < cells.brick_count(); ++i)
+  {
+    unsigned nx, ny, nz;
+    cells.brick_extent(i, nx, ny, nz);
+    if (cells.brick_mode(i) == ChunkStore::BrickMode::uniform)
+    {
+      counts[cells.encoded_brick(i).value] += std::uint64_t(nx) * ny * nz;
+      continue;
+    }
+    cells.decode_brick(i, brick.data());
+    for (unsigned z = 0; z < nz; ++z)
+    {
+      for (unsigned y = 0; y < ny; ++y)
+      {
+        int const* row = brick.data() + (std::size_t(z) * ChunkStore::brick_size + y) * ChunkStore::brick_size;
+        for (unsigned x = 0; x < nx; ++x)
+          ++counts[row[x]];
+      }
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (auto const& count: counts)
+  {
+    if (!contains_locked(count.first))
+      throw std::out_of_range("cell index out of range");
+  }
+  for (auto const& count: counts)
+  {
+    if (count.first == empty_index)
+      continue;
+    std::uint64_t& refs = refs_of(count.first);
+    if (refs == 0)
+      --unused_;
+    refs += count.second;
+  }
+}
+
+
+void Legacy::World::CellCache::
+drop_ref(Index index)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!contains_locked(index))
+    throw std::out_of_range("cell index out of range");
+  if (index == empty_index)
+    return;
+  std::uint64_t& refs = refs_of(index);
+  if (refs == 0)
+    throw std::logic_error("cell has no references to drop");
+  if (--refs == 0)
+    ++unused_;
+}
+
+
+std::uint64_t Legacy::World::CellCache::
+ref_count(Index index) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!contains_locked(index))
+    throw std::out_of_range("cell index out of range");
+  return slabs_[index >> slab_shift]->refs[index & slab_mask];
+}
+
+
+Legacy::World::CellCache::Index Legacy::World::CellCache::
+find(Cell const& cell) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = interned_.find(key_of(cell));
+  return found == interned_.end() ? -1 : found->second;
+}
+
+
+void Legacy::World::CellCache::
+release(Index index)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!contains_locked(index))
+    throw std::out_of_range("cell index out of range");
+  if (index == empty_index)
+    return;
+  if (refs_of(index) != 0)
+    throw std::logic_error("cell is still referred to");
+  release_locked(index);
+}
+
+
+Legacy::World::CellCache::Compaction Legacy::World::CellCache::
+compact()
+{
+  Compaction compaction;
+  compaction.released = 0;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    compaction.memory_before = memory_used_locked();
+  }
+
+  // One slab at a time, letting other threads in between.
+  for (std::size_t s = 0; ; ++s)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (s >= slab_count_ || unused_ == 0)
+      break;
+    Slab const& slab = *slabs_[s];
+    Index first = std::max(Index(1), Index(s * slab_cells));
+    Index last = std::min(next_, Index((s + 1) * slab_cells));
+    for (Index index = first; index < last; ++index)
+    {
+      if (slab.live[index & slab_mask] && slab.refs[index & slab_mask] == 0)
+      {
+        release_locked(index);
+        ++compaction.released;
+      }
+    }
+  }
+
+  // Hand back the slabs left empty at the end, and their free indexes.  The
+  // table of slabs is left where it is for readers not taking the lock.
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (slab_count_ > 1 && slabs_[slab_count_ - 1]->live_count == 0)
+  {
+    slabs_[--slab_count_].reset();
+  }
+  if (std::size_t(next_) > capacity_locked())
+  {
+    next_ = Index(capacity_locked());
+    free_.erase(std::remove_if(free_.begin(), free_.end(),
+                               [this](Index index) { return index >= next_; }),
+                free_.end());
+  }
+  free_.shrink_to_fit();
+  interned_.rehash(0);
+
+  compaction.memory_after = memory_used_locked();
+  return compaction;
+}
+
+
+std::future<Legacy::World::CellCache::Compaction> Legacy::World::CellCache::
+compact_in_background()
+{
+  return std::async(std::launch::async, [this]() { return compact(); });
+}
+
+
+bool Legacy::World::CellCache::
+contains(Index index) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return contains_locked(index);
+}
+
+
+Legacy::World::Cell Legacy::World::CellCache::
+cell_at(Index index) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!contains_locked(index))
+    throw std::out_of_range("cell index out of range");
+  return Cell(material_at(index), flags_at(index), occupancy_at(index));
+}
+
+
+std::size_t Legacy::World::CellCache::
+size() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return interned_.size();
+}
+
+
+std::size_t Legacy::World::CellCache::
+unused() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return unused_;
+}
+
+
+std::size_t Legacy::World::CellCache::
+capacity() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return capacity_locked();
+}
+
+
+std::size_t Legacy::World::CellCache::
+memory_used() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return memory_used_locked();
+}
+
+
+Legacy::World::CellCache::Index Legacy::World::CellCache::
+intern_locked(Cell const& cell)
+{
+  auto found = interned_.find(key_of(cell));
+  if (found != interned_.end())
+    return found->second;
+
+  Index index;
+  if (!free_.empty())
+  {
+    index = free_.back();
+    free_.pop_back();
+  }
+  else
+  {
+    if (std::size_t(next_) == capacity_locked())
+    {
+      if (slab_count_ == max_slabs)
+        throw std::length_error("cell cache is full");
+      slabs_[slab_count_++].reset(new Slab());
+    }
+    index = next_++;
+  }
+
+  Slab& slab = *slabs_[index >> slab_shift];
+  Index offset = index & slab_mask;
+  slab.material[offset]  = cell.material();
+  slab.flags[offset]     = cell.flags();
+  slab.occupancy[offset] = cell.occupancy();
+  slab.live[offset]      = true;
+  slab.refs[offset]      = 0;
+  ++slab.live_count;
+  ++unused_;
+  interned_.emplace(key_of(cell), index);
+  return index;
+}
+
+
+bool Legacy::World::CellCache::
+contains_locked(Index index) const
+{
+  return index >= 0 && index < next_ && slabs_[index >> slab_shift]->live[index & slab_mask];
+}
+
+
+void Legacy::World::CellCache::
+release_locked(Index index)
+{
+  Slab& slab = *slabs_[index >> slab_shift];
+  Index offset = index & slab_mask;
+  interned_.erase(key_of(Cell(slab.material[offset], slab.flags[offset], slab.occupancy[offset])));
+  slab.live[offset] = false;
+  --slab.live_count;
+  --unused_;
+  free_.push_back(index);
+}
+
+
+std::size_t Legacy::World::CellCache::
+memory_used_locked() const
+{
+  // Each interned cell costs a hash node of about a key, an index and a link.
+  return sizeof(*this)
+       + max_slabs * sizeof(std::unique_ptr<Slab>)
+       + slab_count_ * sizeof(Slab)
+       + free_.capacity() * sizeof(Index)
+       + interned_.bucket_count() * sizeof(void*)
+       + interned_.size() * (sizeof(std::uint64_t) + sizeof(Index) + sizeof(void*));
+}
@@ -22,16 +22,260 @@
 #ifndef LEGACY_WORLD_CELLCACHE_H_
 #define LEGACY_WORLD_CELLCACHE_H_
 
+#include <cstddef>
+#include <cstdint>
+#include "legacy/world/cell.h"
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
 namespace Legacy {
 namespace World {
 
+class ChunkStore;
+
 /**
  * A cache of cells.
  *
- * At runtime the Cache is the definitive owner of all Cells.
+ * At runtime the Cache is the definitive owner of all Cells.  Maps hold the
+ * integer index of each position's cell in the cache, and identical cells are
+ * interned so that however many positions there are, there is one record for
+ * each distinct cell.
+ *
+ * The cells are kept structure-of-arrays style in fixed-size slabs: each slab
+ * has an array of materials, one of flags and one of occupancies.  Slabs never
+ * move, so an index stays valid until its cell is released, and looking up a
+ * cell is a shift and a mask.  Released indexes are reused by later cells.
+ * The table of slabs is made at its largest up front and never moves either,
+ * which limits a cache to max_cells distinct cells.
+ *
+ * Index 0 is always the empty cell, so a freshly created map, which is all
+ * zeros, is all empty cells.
+ *
+ * Cells are shared copy-on-write: a cell is never changed in place, instead
+ * changing a position gets a reference to the cell with the new contents and
+ * drops the one to the old.  A cell nothing refers to any more is kept until
+ * the cache is compacted, so a cell that comes and goes is not added and
+ * removed each time.  The empty cell is never counted or removed.
+ *
+ * Compaction may run on another thread while the cache is used.  Everything
+ * but the unchecked accessors takes a lock, and those may be used without one
+ * for any cell the caller holds a reference to, since compaction removes only
+ * cells nothing refers to and adding a slab does not move the others.
  */
 class CellCache
 {
+public:
+  using Index = int;
+
+  /** The index of the empty cell. */
+  static constexpr Index empty_index = 0;
+
+  /** The largest number of distinct cells a cache can hold. */
+  static constexpr std::size_t max_cells = std::size_t(1) << 22;
+
+  /** What a compaction removed. */
+  struct Compaction
+  {
+    std::size_t released;       ///< the number of cells removed
+    std::size_t memory_before;  ///< memory_used() before compacting
+    std::size_t memory_after;   ///< memory_used() after compacting
+  };
+
+public:
+  /** Creates a cache holding only the empty cell. */
+  CellCache();
+
+  ~CellCache();
+
+  /**
+   * Gets the index of a cell with the contents of @p cell, adding one if the
+   * cache does not have one yet.  No reference is taken, so an added cell is
+   * removed by the next compaction unless something acquires it first.
+   * @throws std::length_error if a cell must be added and the cache already
+   *         holds max_cells.
+   */
+  Index
+  intern(Cell const& cell);
+
+  /**
+   * Gets the index of a cell with the contents of @p cell, as intern(), and
+   * takes a reference to it.
+   * @throws std::length_error if a cell must be added and the cache already
+   *         holds max_cells.
+   */
+  Index
+  acquire(Cell const& cell);
+
+  /**
+   * Takes @p count more references to the cell at @p index.
+   * @throws std::out_of_range if @p index is not the index of a cell in the
+   *         cache.
+   */
+  void
+  add_refs(Index index, std::uint64_t count = 1);
+
+  /**
+   * Takes a reference to the cell of every position in @p cells, so they can
+   * be changed through the cache.  Either all are taken or none are.
+   * @throws std::out_of_range if any position is not the index of a cell in
+   *         the cache.
+   */
+  void
+  add_refs(ChunkStore const& cells);
+
+  /**
+   * Drops a reference to the cell at @p index.  A cell with no references left
+   * stays in the cache until it is compacted.
+   * @throws std::out_of_range if @p index is not the index of a cell in the
+   *         cache.
+   * @throws std::logic_error if the cell has no references.
+   */
+  void
+  drop_ref(Index index);
+
+  /**
+   * The number of references to the cell at @p index.
+   * @throws std::out_of_range if @p index is not the index of a cell in the
+   *         cache.
+   */
+  std::uint64_t
+  ref_count(Index index) const;
+
+  /**
+   * Finds the index of a cell with the contents of @p cell.
+   * @returns the index, or -1 if the cache has no such cell.
+   */
+  Index
+  find(Cell const& cell) const;
+
+  /**
+   * Removes the cell at @p index from the cache, making the index free for
+   * reuse.  The empty cell is never removed.
+   * @throws std::out_of_range if @p index is not the index of a cell in the
+   *         cache.
+   * @throws std::logic_error if the cell is referred to.
+   */
+  void
+  release(Index index);
+
+  /**
+   * Removes every cell nothing refers to, and any slabs left with no cells at
+   * the end of the cache.
+   *
+   * The lock is taken for one slab at a time rather than for the whole pass,
+   * so a compaction on another thread holds up other calls only briefly.  A
+   * cell interned but not yet acquired while it runs may be removed.
+   */
+  Compaction
+  compact();
+
+  /** Compacts the cache on another thread. */
+  std::future<Compaction>
+  compact_in_background();
+
+  /** Indicates if @p index is the index of a cell in the cache. */
+  bool
+  contains(Index index) const;
+
+  /**
+   * Gets the cell at @p index.
+   * @throws std::out_of_range if @p index is not the index of a cell in the
+   *         cache.
+   */
+  Cell
+  cell_at(Index index) const;
+
+  /** Gets the material of the cell at @p index without checking the index. */
+  Cell::Material
+  material_at(Index index) const
+  { return slabs_[index >> slab_shift]->material[index & slab_mask]; }
+
+  /** Gets the flags of the cell at @p index without checking the index. */
+  Cell::Flags
+  flags_at(Index index) const
+  { return slabs_[index >> slab_shift]->flags[index & slab_mask]; }
+
+  /** Gets the occupancy of the cell at @p index without checking the index. */
+  Cell::Occupancy
+  occupancy_at(Index index) const
+  { return slabs_[index >> slab_shift]->occupancy[index & slab_mask]; }
+
+  /** The number of cells in the cache. */
+  std::size_t
+  size() const;
+
+  /** The number of cells in the cache that nothing refers to. */
+  std::size_t
+  unused() const;
+
+  /** The number of indexes the cache has room for without adding a slab. */
+  std::size_t
+  capacity() const;
+
+  /** The number of bytes of memory used by the cache. */
+  std::size_t
+  memory_used() const;
+
+private:
+  CellCache(CellCache const&) = delete;
+  CellCache& operator=(CellCache const&) = delete;
+
+  static constexpr unsigned    slab_shift = 10;
+  static constexpr std::size_t slab_cells = std::size_t(1) << slab_shift;
+  static constexpr Index       slab_mask  = slab_cells - 1;
+  static constexpr std::size_t max_slabs  = max_cells / slab_cells;
+
+  struct Slab
+  {
+    Cell::Material  material[slab_cells];
+    Cell::Flags     flags[slab_cells];
+    Cell::Occupancy occupancy[slab_cells];
+    bool            live[slab_cells];
+    std::uint64_t   refs[slab_cells];
+    std::size_t     live_count;
+  };
+
+  /** The interning key of a cell: all of its contents in one word. */
+  static std::uint64_t
+  key_of(Cell const& cell)
+  {
+    return std::uint64_t(cell.material())
+         | std::uint64_t(cell.flags()) << 16
+         | std::uint64_t(cell.occupancy()) << 32;
+  }
+
+  Index
+  intern_locked(Cell const& cell);
+
+  bool
+  contains_locked(Index index) const;
+
+  void
+  release_locked(Index index);
+
+  std::uint64_t&
+  refs_of(Index index)
+  { return slabs_[index >> slab_shift]->refs[index & slab_mask]; }
+
+  std::size_t
+  capacity_locked() const
+  { return slab_count_ * slab_cells; }
+
+  std::size_t
+  memory_used_locked() const;
+
+private:
+  mutable std::mutex                        mutex_;
+  std::unique_ptr<std::unique_ptr<Slab>[]>  slabs_;       ///< max_slabs entries
+  std::size_t                               slab_count_;
+  std::vector<Index>                        free_;
+  Index                                     next_;
+  std::size_t                               unused_;
+  std::unordered_map<std::uint64_t, Index>  interned_;
 };
 
 } // namespace World
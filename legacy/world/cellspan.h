@@ -0,0 +1,72 @@
+/**
+ * @file legacy/world/cellspan.h
+ * @brief Public interface for the Legacy world cell span classes.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_WORLD_CELLSPAN_H_
+#define LEGACY_WORLD_CELLSPAN_H_
+
+#include <cstddef>
+
+
+namespace Legacy {
+namespace World {
+
+/**
+ * A contiguous run of cell indexes.
+ *
+ * Nothing is bounds-checked: a span is only ever handed out for cells known to
+ * exist, so loops over it are plain pointer loops.
+ */
+template<typename T>
+class BasicCellSpan
+{
+public:
+  BasicCellSpan(T* first, T* last)
+  : first_(first), last_(last)
+  { }
+
+  T*
+  begin() const
+  { return first_; }
+
+  T*
+  end() const
+  { return last_; }
+
+  std::size_t
+  size() const
+  { return last_ - first_; }
+
+  T&
+  operator[](std::size_t i) const
+  { return first_[i]; }
+
+private:
+  T* first_;
+  T* last_;
+};
+
+using CellSpan = BasicCellSpan<int>;
+using ConstCellSpan = BasicCellSpan<int const>;
+
+} // namespace World
+} // namespace Legacy
+
+#endif // LEGACY_WORLD_CELLSPAN_H_
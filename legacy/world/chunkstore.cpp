@@ -0,0 +1,1088 @@
+/**
+ * @file legacy/world/chunkstore.cpp
+ * @brief Implementation of the Legacy world ChunkStore class.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/world/chunkstore.h"
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include "legacy/core/hash.h"
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+
+constexpr unsigned Legacy::World::ChunkStore::brick_size;
+
+
+namespace
+{
+
+/** The number of palette bits needed for @p entries distinct values. */
+std::uint8_t
+palette_bits_for(std::size_t entries)
+{
+  if (entries <= 2)  return 1;
+  if (entries <= 4)  return 2;
+  if (entries <= 16) return 4;
+  return 8;
+}
+
+/** The largest palette that packed storage handles before going dense. */
+const std::size_t max_palette_entries = 256;
+
+} // anonymous namespace
+
+
+Legacy::World::ChunkStore::SlabPool::
+SlabPool(std::size_t slab_cells)
+: slab_cells_(slab_cells)
+, next_block_slabs_(1)
+, mutex_(new std::mutex)
+{ }
+
+
+int* Legacy::World::ChunkStore::SlabPool::
+allocate()
+{
+  std::lock_guard<std::mutex> lock(*mutex_);
+  if (free_.empty())
+  {
+    // Grow geometrically so small stores stay small and large ones make few
+    // allocations.
+    std::size_t slabs = next_block_slabs_;
+    blocks_.emplace_back(new int[slabs * slab_cells_]);
+    block_slabs_.push_back(slabs);
+    for (std::size_t i = slabs; i > 0; --i)
+    {
+      free_.push_back(blocks_.back().get() + (i - 1) * slab_cells_);
+    }
+    next_block_slabs_ = std::min<std::size_t>(next_block_slabs_ * 2, 64);
+  }
+  int* slab = free_.back();
+  free_.pop_back();
+  return slab;
+}
+
+
+void Legacy::World::ChunkStore::SlabPool::
+release(int* slab)
+{
+  std::lock_guard<std::mutex> lock(*mutex_);
+  free_.push_back(slab);
+}
+
+
+void Legacy::World::ChunkStore::SlabPool::
+trim()
+{
+  std::lock_guard<std::mutex> lock(*mutex_);
+  std::sort(free_.begin(), free_.end(), std::less<int*>());
+  std::size_t kept = 0;
+  for (std::size_t b = 0; b < blocks_.size(); ++b)
+  {
+    int* first = blocks_[b].get();
+    int* last  = first + block_slabs_[b] * slab_cells_;
+    auto lower = std::lower_bound(free_.begin(), free_.end(), first, std::less<int*>());
+    auto upper = std::lower_bound(lower, free_.end(), last, std::less<int*>());
+    if (std::size_t(upper - lower) == block_slabs_[b])
+    {
+      free_.erase(lower, upper);
+      continue;
+    }
+    if (kept != b)
+    {
+      blocks_[kept] = std::move(blocks_[b]);
+      block_slabs_[kept] = block_slabs_[b];
+    }
+    ++kept;
+  }
+  blocks_.resize(kept);
+  block_slabs_.resize(kept);
+  if (blocks_.empty())
+  {
+    next_block_slabs_ = 1;
+    std::vector<int*>().swap(free_);
+  }
+}
+
+
+std::size_t Legacy::World::ChunkStore::SlabPool::
+bytes_reserved() const
+{
+  std::size_t slabs = 0;
+  for (auto count: block_slabs_)
+    slabs += count;
+  return slabs * slab_cells_ * sizeof(int) + free_.capacity() * sizeof(int*);
+}
+
+
+Legacy::World::ChunkStore::
+ChunkStore(unsigned length, unsigned width, unsigned height)
+: length_(length)
+, width_(width)
+, height_(height)
+, brick_depth_(std::min(height, brick_size))
+, brick_cells_(std::size_t(brick_size) * brick_size * brick_depth_)
+, bricks_x_((length + brick_size - 1) / brick_size)
+, bricks_y_((width + brick_size - 1) / brick_size)
+, bricks_z_((height + brick_size - 1) / brick_size)
+, bricks_(bricks_x_ * bricks_y_ * bricks_z_)
+, slabs_(brick_cells_)
+, hash_mutex_(new std::mutex)
+{ }
+
+
+Legacy::World::ChunkStore::
+ChunkStore(ChunkStore const& rhs)
+: ChunkStore(rhs.length_, rhs.width_, rhs.height_)
+{
+  std::lock_guard<std::mutex> lock(*rhs.hash_mutex_);
+  for (std::size_t i = 0; i < bricks_.size(); ++i)
+  {
+    set_encoded_brick(i, rhs.encoded_brick(i));
+    Brick const& from = rhs.bricks_[i];
+    Brick& to = bricks_[i];
+    to.dirty         = from.dirty;
+    to.hashed        = from.hashed;
+    to.hash          = from.hash;
+    to.levels_hashed = from.levels_hashed;
+    to.level_hashes  = from.level_hashes;
+  }
+}
+
+
+Legacy::World::ChunkStore::
+~ChunkStore()
+{ }
+
+
+int Legacy::World::ChunkStore::
+cell_index_at(unsigned x, unsigned y, unsigned z) const
+{
+  std::size_t offset = this->cell_offset_of(x, y, z);
+  return brick_cell(bricks_[brick_index_of(x, y, z)], offset);
+}
+
+
+void Legacy::World::ChunkStore::
+set_cell_index_at(unsigned x, unsigned y, unsigned z, int index)
+{
+  std::size_t offset = this->cell_offset_of(x, y, z);
+  Brick& brick = bricks_[brick_index_of(x, y, z)];
+  touch(brick);
+  set_brick_cell(brick, offset, index);
+}
+
+
+Legacy::World::CellRow Legacy::World::ChunkStore::
+row(unsigned y, unsigned z)
+{
+  if (y >= width_ || z >= height_)
+    throw std::out_of_range("cell row out of range");
+  return CellRow(this, y, z);
+}
+
+
+Legacy::World::ConstCellRow Legacy::World::ChunkStore::
+row(unsigned y, unsigned z) const
+{
+  if (y >= width_ || z >= height_)
+    throw std::out_of_range("cell row out of range");
+  return ConstCellRow(this, y, z);
+}
+
+
+void Legacy::World::ChunkStore::
+column_at(unsigned x, unsigned y, int* out) const
+{
+  if (x >= length_ || y >= width_)
+    throw std::out_of_range("cell index out of range");
+  box_at(x, y, 0, 1, 1, height_, out);
+}
+
+
+void Legacy::World::ChunkStore::
+box_at(unsigned x0, unsigned y0, unsigned z0,
+       unsigned nx, unsigned ny, unsigned nz,
+       int* out) const
+{
+  if (x0 > length_ || nx > length_ - x0
+   || y0 > width_  || ny > width_ - y0
+   || z0 > height_ || nz > height_ - z0)
+    throw std::out_of_range("cell box out of range");
+  if (nx == 0 || ny == 0 || nz == 0)
+    return;
+
+  std::size_t row_stride   = nx;
+  std::size_t layer_stride = std::size_t(nx) * ny;
+  for (unsigned by = y0 / brick_size; by <= (y0 + ny - 1) / brick_size; ++by)
+  {
+    unsigned ya = std::max(y0, by * brick_size);
+    unsigned yb = std::min(y0 + ny, (by + 1) * brick_size);
+    for (unsigned bx = x0 / brick_size; bx <= (x0 + nx - 1) / brick_size; ++bx)
+    {
+      unsigned xa = std::max(x0, bx * brick_size);
+      unsigned xb = std::min(x0 + nx, (bx + 1) * brick_size);
+      for (unsigned bz = z0 / brick_size; bz <= (z0 + nz - 1) / brick_size; ++bz)
+      {
+        unsigned za = std::max(z0, bz * brick_size);
+        unsigned zb = std::min(z0 + nz, (bz + 1) * brick_size);
+        Brick const& brick = bricks_[(std::size_t(by) * bricks_x_ + bx) * bricks_z_ + bz];
+        for (unsigned z = za; z < zb; ++z)
+        {
+          for (unsigned y = ya; y < yb; ++y)
+          {
+            int* dst = out + (z - z0) * layer_stride + (y - y0) * row_stride + (xa - x0);
+            std::size_t offset = brick_offset_of(xa, y, z);
+            switch (brick.mode)
+            {
+              case BrickMode::uniform:
+                std::fill(dst, dst + (xb - xa), brick.value);
+                break;
+              case BrickMode::dense:
+                std::copy(brick.cells + offset, brick.cells + offset + (xb - xa), dst);
+                break;
+              default:
+                for (unsigned x = xa; x < xb; ++x)
+                  *dst++ = palette_cell(brick, offset++);
+                break;
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+
+void Legacy::World::ChunkStore::
+fill(int index)
+{
+  for (auto& brick: bricks_)
+  {
+    make_uniform(brick, index);
+    touch(brick);
+  }
+}
+
+
+void Legacy::World::ChunkStore::
+compact()
+{
+  for (std::size_t i = 0; i < bricks_.size(); ++i)
+  {
+    compact_brick(i);
+  }
+  slabs_.trim();
+}
+
+
+void Legacy::World::ChunkStore::
+compact_rows(unsigned y_begin, unsigned y_end)
+{
+  if (bricks_.empty() || y_begin >= y_end || y_begin >= width_)
+    return;
+  y_end = std::min(y_end, width_);
+
+  // Brick columns are ordered by y, so a band of rows is a contiguous range.
+  std::size_t first = brick_index_of(0, y_begin, 0);
+  std::size_t last  = brick_index_of(length_ - 1, y_end - 1, height_ - 1);
+  for (std::size_t i = first; i <= last; ++i)
+  {
+    compact_brick(i);
+  }
+}
+
+
+void Legacy::World::ChunkStore::
+surface_heights(unsigned* out) const
+{
+  std::fill(out, out + std::size_t(length_) * width_, 0u);
+  std::vector<int> cells(brick_cells_);
+  for (std::size_t by = 0; by < bricks_y_; ++by)
+  {
+    for (std::size_t bx = 0; bx < bricks_x_; ++bx)
+    {
+      unsigned x0 = bx * brick_size;
+      unsigned y0 = by * brick_size;
+      unsigned nx = std::min<unsigned>(brick_size, length_ - x0);
+      unsigned ny = std::min<unsigned>(brick_size, width_ - y0);
+      std::size_t unsettled = std::size_t(nx) * ny;
+
+      // Work down the brick column until every one of its columns has found
+      // its surface.
+      for (std::size_t bz = bricks_z_; bz-- > 0 && unsettled > 0; )
+      {
+        std::size_t i = (by * bricks_x_ + bx) * bricks_z_ + bz;
+        Brick const& brick = bricks_[i];
+        unsigned z0 = bz * brick_size;
+        unsigned nz = std::min<unsigned>(brick_depth_, height_ - z0);
+        if (brick.mode == BrickMode::uniform)
+        {
+          if (brick.value == 0)
+            continue;
+          for (unsigned y = 0; y < ny; ++y)
+          {
+            unsigned* row = out + std::size_t(y0 + y) * length_ + x0;
+            std::replace(row, row + nx, 0u, z0 + nz);
+          }
+          unsettled = 0;
+          continue;
+        }
+
+        int const* data = brick.cells;
+        if (brick.mode != BrickMode::dense)
+        {
+          decode_brick(i, cells.data());
+          data = cells.data();
+        }
+        for (unsigned y = 0; y < ny; ++y)
+        {
+          unsigned* row = out + std::size_t(y0 + y) * length_ + x0;
+          for (unsigned x = 0; x < nx; ++x)
+          {
+            if (row[x] != 0)
+              continue;
+            for (unsigned z = nz; z-- > 0; )
+            {
+              if (data[(std::size_t(z) * brick_size + y) * brick_size + x] != 0)
+              {
+                row[x] = z0 + z + 1;
+                --unsettled;
+                break;
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+
+std::size_t Legacy::World::ChunkStore::
+dirty_brick_count() const
+{
+  return std::count_if(bricks_.begin(), bricks_.end(),
+                       [](Brick const& brick) { return brick.dirty; });
+}
+
+
+void Legacy::World::ChunkStore::
+clear_dirty()
+{
+  for (auto& brick: bricks_)
+  {
+    brick.dirty = false;
+  }
+}
+
+
+std::uint64_t Legacy::World::ChunkStore::
+content_hash() const
+{
+  // Uniform bricks of the same value and extent hash alike, so each is hashed
+  // once.
+  std::vector<std::uint64_t> hashes;
+  hashes.reserve(bricks_.size() + 3);
+  hashes.push_back(length_);
+  hashes.push_back(width_);
+  hashes.push_back(height_);
+  std::vector<int> scratch;
+  std::unordered_map<std::uint64_t, std::uint64_t> uniform_hashes;
+  std::lock_guard<std::mutex> lock(*hash_mutex_);
+  for (std::size_t i = 0; i < bricks_.size(); ++i)
+  {
+    Brick const& brick = bricks_[i];
+    if (!brick.hashed && brick.mode == BrickMode::uniform)
+    {
+      unsigned nx, ny, nz;
+      brick_extent(i, nx, ny, nz);
+      std::uint64_t key = std::uint64_t(std::uint32_t(brick.value)) << 32 | (nx * ny * nz);
+      auto found = uniform_hashes.find(key);
+      if (found == uniform_hashes.end())
+        found = uniform_hashes.emplace(key, hash_brick(i, scratch)).first;
+      brick.hash = found->second;
+      brick.hashed = true;
+    }
+    else if (!brick.hashed)
+    {
+      brick.hash = hash_brick(i, scratch);
+      brick.hashed = true;
+    }
+    hashes.push_back(brick.hash);
+  }
+  return Legacy::Core::hash64(hashes.data(), hashes.size() * sizeof(std::uint64_t));
+}
+
+
+std::uint64_t Legacy::World::ChunkStore::
+brick_hash(std::size_t i) const
+{
+  std::lock_guard<std::mutex> lock(*hash_mutex_);
+  Brick const& brick = bricks_[i];
+  if (!brick.hashed)
+  {
+    std::vector<int> scratch;
+    brick.hash = hash_brick(i, scratch);
+    brick.hashed = true;
+  }
+  return brick.hash;
+}
+
+
+std::uint64_t Legacy::World::ChunkStore::
+brick_level_hash(std::size_t i, unsigned level) const
+{
+  unsigned nx, ny, nz;
+  brick_extent(i, nx, ny, nz);
+  if (level >= nz)
+    throw std::out_of_range("brick level out of range");
+  if (height_ == 1)
+    return brick_hash(i);
+
+  std::lock_guard<std::mutex> lock(*hash_mutex_);
+  Brick const& brick = bricks_[i];
+  if (brick.levels_hashed & (std::uint32_t(1) << level))
+    return brick.level_hashes[level];
+
+  std::vector<int> scratch;
+  int const* cells = brick.cells;
+  if (brick.mode != BrickMode::dense)
+  {
+    scratch.resize(brick_cells_);
+    decode_brick(i, scratch.data());
+    cells = scratch.data();
+  }
+  cells += std::size_t(level) * brick_size * brick_size;
+  if (nx != brick_size)
+  {
+    // Pack the rows inside the store together.  The level lies at or after
+    // the start of the scratch, so no row is overwritten before it is moved.
+    scratch.resize(brick_cells_);
+    int* packed = scratch.data();
+    for (unsigned y = 0; y < ny; ++y)
+    {
+      int const* row = cells + std::size_t(y) * brick_size;
+      packed = std::copy(row, row + nx, packed);
+    }
+    cells = scratch.data();
+  }
+  std::size_t count = std::size_t(nx) * ny;
+  brick.level_hashes.resize(brick_size);
+  brick.level_hashes[level] = Legacy::Core::hash64(cells, count * sizeof(int), count);
+  brick.levels_hashed |= std::uint32_t(1) << level;
+  return brick.level_hashes[level];
+}
+
+
+bool Legacy::World::ChunkStore::
+kept_hash(std::size_t i, std::uint64_t& hash) const
+{
+  std::lock_guard<std::mutex> lock(*hash_mutex_);
+  hash = bricks_[i].hash;
+  return bricks_[i].hashed;
+}
+
+
+Legacy::World::ChunkStore::MemoryUsage Legacy::World::ChunkStore::
+memory_usage() const
+{
+  MemoryUsage usage = { 0, 0, 0, sizeof(*this) + bricks_.capacity() * sizeof(Brick), 0 };
+  for (auto const& brick: bricks_)
+  {
+    if (brick.borrowed)
+      ++usage.borrowed_bricks;
+    switch (brick.mode)
+    {
+      case BrickMode::uniform:
+        ++usage.uniform_bricks;
+        break;
+      case BrickMode::palette:
+        ++usage.palette_bricks;
+        usage.bytes += brick.palette.capacity() * sizeof(int)
+                     + brick.packed.capacity() * sizeof(std::uint32_t);
+        break;
+      case BrickMode::dense:
+        ++usage.dense_bricks;
+        break;
+    }
+  }
+  usage.bytes += slabs_.bytes_reserved();
+  return usage;
+}
+
+
+void Legacy::World::ChunkStore::
+decode_brick(std::size_t i, int* out) const
+{
+  Brick const& brick = bricks_[i];
+  switch (brick.mode)
+  {
+    case BrickMode::uniform:
+      std::fill(out, out + brick_cells_, brick.value);
+      break;
+    case BrickMode::dense:
+      std::copy(brick.cells, brick.cells + brick_cells_, out);
+      break;
+    case BrickMode::palette:
+      for (std::size_t offset = 0; offset < brick_cells_; ++offset)
+      {
+        out[offset] = palette_cell(brick, offset);
+      }
+      break;
+  }
+}
+
+
+Legacy::World::ChunkStore::EncodedBrick Legacy::World::ChunkStore::
+encoded_brick(std::size_t i) const
+{
+  Brick const& brick = bricks_[i];
+  return EncodedBrick{ brick.mode, brick.bits, brick.value,
+                       brick.palette_data(), brick.palette_size(),
+                       brick.packed_data(), brick.cells };
+}
+
+
+void Legacy::World::ChunkStore::
+set_encoded_brick(std::size_t i, EncodedBrick const& encoded)
+{
+  Brick& brick = bricks_[i];
+  touch(brick);
+  if (brick.borrowed)
+    make_uniform(brick, 0);
+  switch (encoded.mode)
+  {
+    case BrickMode::uniform:
+      make_uniform(brick, encoded.value);
+      return;
+
+    case BrickMode::dense:
+      if (brick.mode != BrickMode::dense)
+      {
+        make_uniform(brick, 0);
+        brick.mode  = BrickMode::dense;
+        brick.cells = slabs_.allocate();
+      }
+      std::copy(encoded.cells, encoded.cells + brick_cells_, brick.cells);
+      return;
+
+    case BrickMode::palette:
+      break;
+
+    default:
+      throw std::invalid_argument("unknown brick storage mode");
+  }
+
+  std::uint8_t bits = encoded.bits;
+  if ((bits != 1 && bits != 2 && bits != 4 && bits != 8)
+      || encoded.palette_size < 1 || encoded.palette_size > (std::size_t(1) << bits))
+    throw std::invalid_argument("invalid brick palette");
+
+  // Every entry must name a palette value, or reading the brick would run off
+  // the end of the palette.
+  std::uint32_t const* packed = encoded.packed;
+  if (encoded.palette_size < (std::size_t(1) << bits))
+  {
+    for (std::size_t offset = 0; offset < brick_cells_; ++offset)
+    {
+      std::size_t bit = offset * bits;
+      std::uint32_t entry = (packed[bit / 32] >> (bit % 32)) & ((1u << bits) - 1);
+      if (entry >= encoded.palette_size)
+        throw std::invalid_argument("brick palette entry out of range");
+    }
+  }
+
+  make_uniform(brick, 0);
+  brick.mode = BrickMode::palette;
+  brick.bits = bits;
+  brick.palette.assign(encoded.palette, encoded.palette + encoded.palette_size);
+  brick.packed.assign(packed, packed + packed_words(bits));
+}
+
+
+void Legacy::World::ChunkStore::
+borrow_encoded_brick(std::size_t i, EncodedBrick const& encoded)
+{
+  Brick& brick = bricks_[i];
+  touch(brick);
+  switch (encoded.mode)
+  {
+    case BrickMode::uniform:
+      make_uniform(brick, encoded.value);
+      return;
+
+    case BrickMode::dense:
+      make_uniform(brick, 0);
+      brick.mode     = BrickMode::dense;
+      brick.borrowed = true;
+      brick.cells    = const_cast<int*>(encoded.cells);
+      return;
+
+    case BrickMode::palette:
+      break;
+
+    default:
+      throw std::invalid_argument("unknown brick storage mode");
+  }
+
+  std::uint8_t bits = encoded.bits;
+  if ((bits != 1 && bits != 2 && bits != 4 && bits != 8)
+      || encoded.palette_size < 1 || encoded.palette_size > (std::size_t(1) << bits))
+    throw std::invalid_argument("invalid brick palette");
+
+  make_uniform(brick, 0);
+  brick.mode                  = BrickMode::palette;
+  brick.bits                  = bits;
+  brick.borrowed              = true;
+  brick.borrowed_palette      = encoded.palette;
+  brick.borrowed_palette_size = encoded.palette_size;
+  brick.borrowed_packed       = encoded.packed;
+}
+
+
+void Legacy::World::ChunkStore::
+hold_storage(std::shared_ptr<void const> storage)
+{
+  held_storage_.push_back(std::move(storage));
+}
+
+
+void Legacy::World::ChunkStore::
+set_brick_cell(Brick& brick, std::size_t offset, int index)
+{
+  own_brick(brick);
+  switch (brick.mode)
+  {
+    case BrickMode::dense:
+      brick.cells[offset] = index;
+      return;
+
+    case BrickMode::uniform:
+      if (index == brick.value)
+        return;
+      brick.mode = BrickMode::palette;
+      brick.bits = 1;
+      brick.palette.assign({ brick.value, index });
+      brick.packed.assign(packed_words(1), 0);
+      break;
+
+    case BrickMode::palette:
+      break;
+  }
+
+  auto it = std::find(brick.palette.begin(), brick.palette.end(), index);
+  std::uint32_t entry = it - brick.palette.begin();
+  if (it == brick.palette.end())
+  {
+    if (brick.palette.size() == max_palette_entries)
+    {
+      make_dense(brick)[offset] = index;
+      return;
+    }
+    if (brick.palette.size() == (std::size_t(1) << brick.bits))
+    {
+      // Widen every packed entry to make room for the new one.
+      std::uint8_t bits = palette_bits_for(brick.palette.size() + 1);
+      std::vector<std::uint32_t> packed(packed_words(bits), 0);
+      for (std::size_t i = 0; i < brick_cells_; ++i)
+      {
+        std::size_t old_bit = i * brick.bits;
+        std::uint32_t old_entry = (brick.packed[old_bit / 32] >> (old_bit % 32)) & ((1u << brick.bits) - 1);
+        std::size_t new_bit = i * bits;
+        packed[new_bit / 32] |= old_entry << (new_bit % 32);
+      }
+      brick.packed.swap(packed);
+      brick.bits = bits;
+    }
+    brick.palette.push_back(index);
+  }
+
+  std::size_t bit = offset * brick.bits;
+  std::uint32_t mask = ((1u << brick.bits) - 1) << (bit % 32);
+  brick.packed[bit / 32] = (brick.packed[bit / 32] & ~mask) | (entry << (bit % 32));
+}
+
+
+int* Legacy::World::ChunkStore::
+make_dense(Brick& brick)
+{
+  if (brick.mode == BrickMode::dense && !brick.borrowed)
+    return brick.cells;
+
+  int* cells = slabs_.allocate();
+  if (brick.mode == BrickMode::uniform)
+  {
+    std::fill(cells, cells + brick_cells_, brick.value);
+  }
+  else if (brick.mode == BrickMode::dense)
+  {
+    std::copy(brick.cells, brick.cells + brick_cells_, cells);
+  }
+  else
+  {
+    for (std::size_t offset = 0; offset < brick_cells_; ++offset)
+    {
+      cells[offset] = palette_cell(brick, offset);
+    }
+  }
+  brick.mode     = BrickMode::dense;
+  brick.borrowed = false;
+  brick.cells    = cells;
+  std::vector<int>().swap(brick.palette);
+  std::vector<std::uint32_t>().swap(brick.packed);
+  return cells;
+}
+
+
+void Legacy::World::ChunkStore::
+make_uniform(Brick& brick, int index)
+{
+  if (brick.mode == BrickMode::dense && !brick.borrowed)
+    slabs_.release(brick.cells);
+  brick.mode     = BrickMode::uniform;
+  brick.bits     = 0;
+  brick.borrowed = false;
+  brick.value    = index;
+  brick.cells    = nullptr;
+  std::vector<int>().swap(brick.palette);
+  std::vector<std::uint32_t>().swap(brick.packed);
+}
+
+
+void Legacy::World::ChunkStore::
+own_brick(Brick& brick)
+{
+  if (!brick.borrowed)
+    return;
+  if (brick.mode == BrickMode::dense)
+  {
+    make_dense(brick);
+    return;
+  }
+  brick.palette.assign(brick.borrowed_palette, brick.borrowed_palette + brick.borrowed_palette_size);
+  brick.packed.assign(brick.borrowed_packed, brick.borrowed_packed + packed_words(brick.bits));
+  brick.borrowed = false;
+}
+
+
+void Legacy::World::ChunkStore::
+compact_brick(std::size_t i)
+{
+  // Borrowed bricks are left as they were stored rather than copied.
+  Brick& brick = bricks_[i];
+  if (brick.mode == BrickMode::uniform || brick.borrowed)
+    return;
+
+  if (brick.mode == BrickMode::dense)
+  {
+    store_brick_cells(i, brick.cells);
+    return;
+  }
+  std::vector<int> decoded(brick_cells_);
+  decode_brick(i, decoded.data());
+  store_brick_cells(i, decoded.data());
+}
+
+
+void Legacy::World::ChunkStore::
+store_brick(std::size_t i, int const* cells)
+{
+  touch(bricks_[i]);
+  store_brick_cells(i, cells);
+}
+
+
+void Legacy::World::ChunkStore::
+store_brick_cells(std::size_t i, int const* cells)
+{
+  Brick& brick = bricks_[i];
+  if (brick.borrowed)
+    make_uniform(brick, 0);
+
+  // Only the cells inside the store count; padding takes whatever value is
+  // convenient.
+  unsigned nx, ny, nz;
+  brick_extent(i, nx, ny, nz);
+
+  // Most bricks hold only a few distinct values, so look for those first and
+  // only sort the whole brick when there are many.
+  static const std::size_t few_values = 16;
+  int  few[few_values];
+  std::size_t few_count = 0;
+  bool many = false;
+  for (unsigned z = 0; z < nz && !many; ++z)
+  {
+    for (unsigned y = 0; y < ny && !many; ++y)
+    {
+      int const* row = cells + (std::size_t(z) * brick_size + y) * brick_size;
+      for (unsigned x = 0; x < nx; ++x)
+      {
+        if (few_count > 0 && row[x] == few[few_count - 1])
+          continue;
+        int* found = std::find(few, few + few_count, row[x]);
+        if (found != few + few_count)
+        {
+          std::swap(*found, few[few_count - 1]);
+          continue;
+        }
+        if (few_count == few_values)
+        {
+          many = true;
+          break;
+        }
+        few[few_count++] = row[x];
+      }
+    }
+  }
+
+  std::vector<int> values;
+  if (!many)
+  {
+    values.assign(few, few + few_count);
+  }
+  else
+  {
+    values.reserve(std::size_t(nx) * ny * nz);
+    for (unsigned z = 0; z < nz; ++z)
+    {
+      for (unsigned y = 0; y < ny; ++y)
+      {
+        int const* row = cells + (std::size_t(z) * brick_size + y) * brick_size;
+        values.insert(values.end(), row, row + nx);
+      }
+    }
+  }
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+  if (values.size() == 1)
+  {
+    make_uniform(brick, values.front());
+    return;
+  }
+  if (values.size() > max_palette_entries)
+  {
+    if (brick.mode != BrickMode::dense)
+    {
+      brick.mode  = BrickMode::dense;
+      brick.bits  = 0;
+      brick.cells = slabs_.allocate();
+      std::vector<int>().swap(brick.palette);
+      std::vector<std::uint32_t>().swap(brick.packed);
+    }
+    if (brick.cells != cells)
+      std::copy(cells, cells + brick_cells_, brick.cells);
+    return;
+  }
+
+  std::uint8_t bits = palette_bits_for(values.size());
+  std::vector<std::uint32_t> packed(packed_words(bits), 0);
+  for (unsigned z = 0; z < nz; ++z)
+  {
+    for (unsigned y = 0; y < ny; ++y)
+    {
+      std::size_t row = (std::size_t(z) * brick_size + y) * brick_size;
+      for (unsigned x = 0; x < nx; ++x)
+      {
+        std::uint32_t entry = std::lower_bound(values.begin(), values.end(), cells[row + x]) - values.begin();
+        std::size_t bit = (row + x) * bits;
+        packed[bit / 32] |= entry << (bit % 32);
+      }
+    }
+  }
+
+  if (brick.mode == BrickMode::dense)
+    slabs_.release(brick.cells);
+  brick.mode  = BrickMode::palette;
+  brick.bits  = bits;
+  brick.cells = nullptr;
+  brick.palette.swap(values);
+  brick.palette.shrink_to_fit();
+  brick.packed.swap(packed);
+}
+
+
+void Legacy::World::ChunkStore::
+brick_extent(std::size_t i, unsigned& nx, unsigned& ny, unsigned& nz) const
+{
+  std::size_t bz = i % bricks_z_;
+  std::size_t bx = (i / bricks_z_) % bricks_x_;
+  std::size_t by = i / bricks_z_ / bricks_x_;
+  nx = std::min<std::size_t>(brick_size, length_ - bx * brick_size);
+  ny = std::min<std::size_t>(brick_size, width_ - by * brick_size);
+  nz = std::min<std::size_t>(brick_depth_, height_ - bz * brick_size);
+}
+
+
+/**
+ * Hashes the cells of brick @p i inside the store, leaving out the padding, as
+ * one run of values.
+ */
+std::uint64_t Legacy::World::ChunkStore::
+hash_brick(std::size_t i, std::vector<int>& scratch) const
+{
+  unsigned nx, ny, nz;
+  brick_extent(i, nx, ny, nz);
+  std::size_t count = std::size_t(nx) * ny * nz;
+
+  Brick const& brick = bricks_[i];
+  int const* cells = brick.cells;
+  if (brick.mode != BrickMode::dense)
+  {
+    scratch.resize(brick_cells_);
+    decode_brick(i, scratch.data());
+    cells = scratch.data();
+  }
+  if (nx != brick_size || ny != brick_size)
+  {
+    // Pack the rows inside the store together, working forwards so no row
+    // is overwritten before it is moved.
+    scratch.resize(brick_cells_);
+    int* packed = scratch.data();
+    for (unsigned z = 0; z < nz; ++z)
+    {
+      for (unsigned y = 0; y < ny; ++y)
+      {
+        int const* row = cells + (std::size_t(z) * brick_size + y) * brick_size;
+        packed = std::copy(row, row + nx, packed);
+      }
+    }
+    cells = scratch.data();
+  }
+  return Legacy::Core::hash64(cells, count * sizeof(int), count);
+}
+
+
+std::size_t Legacy::World::ChunkStore::
+cell_offset_of(unsigned x, unsigned y, unsigned z) const
+{
+  if (x >= length_ || y >= width_ || z >= height_)
+    throw std::out_of_range("cell index out of range");
+  return brick_offset_of(x, y, z);
+}
+
+
+bool Legacy::World::
+operator==(ChunkStore const& lhs, ChunkStore const& rhs)
+{
+  if (lhs.length() != rhs.length()) return false;
+  if (lhs.width()  != rhs.width())  return false;
+  if (lhs.height() != rhs.height()) return false;
+
+  // Any brick whose kept hashes differ settles it before any cells are read.
+  for (std::size_t i = 0; i < lhs.brick_count(); ++i)
+  {
+    std::uint64_t lhs_hash;
+    std::uint64_t rhs_hash;
+    if (lhs.kept_hash(i, lhs_hash) && rhs.kept_hash(i, rhs_hash) && lhs_hash != rhs_hash)
+      return false;
+  }
+
+  std::vector<int> lhs_cells;
+  std::vector<int> rhs_cells;
+  for (std::size_t i = 0; i < lhs.brick_count(); ++i)
+  {
+    ChunkStore::Brick const& lhs_brick = lhs.bricks_[i];
+    ChunkStore::Brick const& rhs_brick = rhs.bricks_[i];
+    if (lhs_brick.mode == ChunkStore::BrickMode::uniform && rhs_brick.mode == ChunkStore::BrickMode::uniform)
+    {
+      if (lhs_brick.value != rhs_brick.value)
+        return false;
+      continue;
+    }
+
+    // Compare only the cells inside the store, not the padding.
+    int const* lhs_data = lhs_brick.cells;
+    if (lhs_brick.mode != ChunkStore::BrickMode::dense)
+    {
+      lhs_cells.resize(lhs.brick_cells());
+      lhs.decode_brick(i, lhs_cells.data());
+      lhs_data = lhs_cells.data();
+    }
+    int const* rhs_data = rhs_brick.cells;
+    if (rhs_brick.mode != ChunkStore::BrickMode::dense)
+    {
+      rhs_cells.resize(rhs.brick_cells());
+      rhs.decode_brick(i, rhs_cells.data());
+      rhs_data = rhs_cells.data();
+    }
+
+    unsigned nx, ny, nz;
+    lhs.brick_extent(i, nx, ny, nz);
+    if (nx == ChunkStore::brick_size && ny == ChunkStore::brick_size)
+    {
+      // The cells inside the store are one contiguous run.
+      std::size_t count = std::size_t(nz) * ChunkStore::brick_size * ChunkStore::brick_size;
+      if (std::memcmp(lhs_data, rhs_data, count * sizeof(int)) != 0)
+        return false;
+      continue;
+    }
+    for (unsigned z = 0; z < nz; ++z)
+    {
+      for (unsigned y = 0; y < ny; ++y)
+      {
+        std::size_t row = (std::size_t(z) * ChunkStore::brick_size + y) * ChunkStore::brick_size;
+        if (std::memcmp(lhs_data + row, rhs_data + row, nx * sizeof(int)) != 0)
+          return false;
+      }
+    }
+  }
+  return true;
+}
+
+
+Legacy::World::CellSpan Legacy::World::CellRow::
+segment(std::size_t i) const
+{
+  unsigned x = i * ChunkStore::brick_size;
+  ChunkStore::Brick& brick = store_->bricks_[store_->brick_index_of(x, y_, z_)];
+  ChunkStore::touch(brick);
+  int* cells = store_->make_dense(brick) + store_->brick_offset_of(x, y_, z_);
+  std::size_t count = std::min<std::size_t>(ChunkStore::brick_size, store_->length() - x);
+  return CellSpan(cells, cells + count);
+}
+
+
+Legacy::World::ConstCellSpan Legacy::World::ConstCellRow::
+segment(std::size_t i) const
+{
+  unsigned x = i * ChunkStore::brick_size;
+  ChunkStore::Brick const& brick = store_->bricks_[store_->brick_index_of(x, y_, z_)];
+  std::size_t offset = store_->brick_offset_of(x, y_, z_);
+  std::size_t count = std::min<std::size_t>(ChunkStore::brick_size, store_->length() - x);
+  switch (brick.mode)
+  {
+    case ChunkStore::BrickMode::dense:
+      return ConstCellSpan(brick.cells + offset, brick.cells + offset + count);
+    case ChunkStore::BrickMode::uniform:
+      std::fill(decoded_, decoded_ + count, brick.value);
+      break;
+    case ChunkStore::BrickMode::palette:
+      for (std::size_t j = 0; j < count; ++j)
+      {
+        decoded_[j] = ChunkStore::palette_cell(brick, offset + j);
+      }
+      break;
+  }
+  return ConstCellSpan(decoded_, decoded_ + count);
+}
@@ -0,0 +1,683 @@
+/**
+ * @file legacy/world/chunkstore.h
+ * @brief Public interface for the Legacy world ChunkStore class.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_WORLD_CHUNKSTORE_H_
+#define LEGACY_WORLD_CHUNKSTORE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include "legacy/world/cellspan.h"
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+namespace Legacy {
+namespace World {
+
+class CellRow;
+class ConstCellRow;
+
+
+/**
+ * The cell indexes of a whole 3D map.
+ *
+ * The map is divided into bricks of 16x16 cells horizontally and up to 16
+ * cells vertically (fewer if the map itself is shallower).  Within a brick
+ * cells are ordered x-fastest, then y, then z.  The bricks of one brick column
+ * (same x and y, increasing z) are adjacent and brick columns are ordered by y
+ * then x, so a vertical column of cells is a short, forward walk through a
+ * handful of neighbouring bricks.
+ *
+ * Each brick is stored in whichever of three modes suits its contents:
+ *
+ * - uniform: every cell has the same index and the brick takes no storage;
+ * - palette: the brick's distinct indexes are kept in a small palette and each
+ *   cell holds a 1, 2, 4 or 8 bit palette entry, packed into words;
+ * - dense: every cell holds its index in a slab taken from a pool of
+ *   brick-sized slabs.
+ *
+ * A brick may also be borrowed: its palette or dense cells are used in place
+ * from storage the store does not own, such as a mapped save file, and copied
+ * into the store's own storage the first time the brick is changed.
+ *
+ * Single-cell writes keep a brick in the cheapest mode that can hold the new
+ * value (uniform becomes palette, a full palette widens or goes dense).  Writing
+ * through a mutable row makes the bricks along it dense; compact() moves dense
+ * bricks back to the cheapest mode that holds their contents.
+ *
+ * Each brick remembers whether it has been changed since the store was last
+ * marked clean, so a save can write only the bricks that changed.  Any write
+ * marks a brick dirty, even one that leaves its cells as they were; changing
+ * how a brick is stored does not.
+ *
+ * The store can also give a hash of its contents, which does not depend on how
+ * the bricks are stored.  Each brick's hash is kept until the brick is next
+ * changed, so hashing a store again after a few changes rehashes only those
+ * bricks, and comparing stores skips any brick whose kept hashes differ.
+ *
+ * Cells outside the map extents but inside a brick are padding and have no
+ * meaningful value.
+ */
+class ChunkStore
+{
+public:
+  /** The horizontal extent of a brick. */
+  static constexpr unsigned brick_size = 16;
+
+  /** How a brick stores its cells. */
+  enum class BrickMode : std::uint8_t { uniform, palette, dense };
+
+  /**
+   * The stored form of one brick, as written to and read from binary map
+   * files.  Only the members used by the brick's mode are meaningful.
+   */
+  struct EncodedBrick
+  {
+    BrickMode            mode;
+    std::uint8_t         bits;          ///< palette: bits per cell
+    int                  value;         ///< uniform: the value of every cell
+    int const*           palette;       ///< palette: the distinct values
+    std::size_t          palette_size;
+    std::uint32_t const* packed;        ///< palette: packed_words() words of entries
+    int const*           cells;         ///< dense: brick_cells() values
+  };
+
+  /** A summary of the storage used by a store. */
+  struct MemoryUsage
+  {
+    std::size_t uniform_bricks;
+    std::size_t palette_bricks;
+    std::size_t dense_bricks;
+    std::size_t bytes;
+    std::size_t borrowed_bricks;  ///< bricks using storage not counted in bytes
+  };
+
+public:
+  /** Creates a store of the given extents with all cells set to zero. */
+  ChunkStore(unsigned length, unsigned width, unsigned height);
+
+  /**
+   * Creates a store with the cells, changed bricks and kept hashes of @p rhs.
+   * Borrowed bricks are copied into the new store's own storage.
+   */
+  ChunkStore(ChunkStore const& rhs);
+
+  ChunkStore(ChunkStore&&) = default;
+
+  ChunkStore&
+  operator=(ChunkStore&&) = default;
+
+  ~ChunkStore();
+
+  /** The east-west extent of the store. */
+  unsigned
+  length() const
+  { return length_; }
+
+  /** The north-south extent of the store. */
+  unsigned
+  width() const
+  { return width_; }
+
+  /** The vertical extent of the store. */
+  unsigned
+  height() const
+  { return height_; }
+
+  /** The vertical extent of a brick. */
+  unsigned
+  brick_depth() const
+  { return brick_depth_; }
+
+  /** The number of cells in a brick. */
+  std::size_t
+  brick_cells() const
+  { return brick_cells_; }
+
+  /** The number of bricks in the store. */
+  std::size_t
+  brick_count() const
+  { return bricks_.size(); }
+
+  /** The storage mode of brick @p i. */
+  BrickMode
+  brick_mode(std::size_t i) const
+  { return bricks_[i].mode; }
+
+  /**
+   * Gets the cache index of the cell at given coordinates.
+   * @throws std::out_of_range if the coordinates are outside the store.
+   */
+  int
+  cell_index_at(unsigned x, unsigned y, unsigned z) const;
+
+  /**
+   * Sets the cache index of the cell at given coordinates.
+   * @throws std::out_of_range if the coordinates are outside the store.
+   */
+  void
+  set_cell_index_at(unsigned x, unsigned y, unsigned z, int index);
+
+  /**
+   * Gets the cache index of the cell at given coordinates without checking
+   * them.
+   */
+  int
+  cell_index_at_unchecked(unsigned x, unsigned y, unsigned z) const
+  { return brick_cell(bricks_[brick_index_of(x, y, z)], brick_offset_of(x, y, z)); }
+
+  /**
+   * Sets the cache index of the cell at given coordinates without checking
+   * them.
+   */
+  void
+  set_cell_index_at_unchecked(unsigned x, unsigned y, unsigned z, int index)
+  {
+    Brick& brick = bricks_[brick_index_of(x, y, z)];
+    touch(brick);
+    if (brick.mode == BrickMode::dense && !brick.borrowed)
+      brick.cells[brick_offset_of(x, y, z)] = index;
+    else
+      set_brick_cell(brick, brick_offset_of(x, y, z), index);
+  }
+
+  /**
+   * Gets the row of cells at (y, z) for writing.
+   *
+   * The bricks along the row are made dense as the row's segments are visited.
+   * @throws std::out_of_range if the coordinates are outside the store.
+   */
+  CellRow
+  row(unsigned y, unsigned z);
+
+  /**
+   * Gets the row of cells at (y, z) for reading.
+   * @throws std::out_of_range if the coordinates are outside the store.
+   */
+  ConstCellRow
+  row(unsigned y, unsigned z) const;
+
+  /**
+   * Copies the cache indexes of the vertical column of cells at (x, y),
+   * bottom to top, into the @p height() elements at @p out.
+   * @throws std::out_of_range if the coordinates are outside the store.
+   */
+  void
+  column_at(unsigned x, unsigned y, int* out) const;
+
+  /**
+   * Copies the cache indexes of the @p nx by @p ny by @p nz box of cells
+   * starting at (@p x0, @p y0, @p z0) into @p out, x fastest then y then z.
+   * The bricks the box overlaps are read one after another in storage order,
+   * a row segment at a time.
+   * @throws std::out_of_range if the box is not all inside the store.
+   */
+  void
+  box_at(unsigned x0, unsigned y0, unsigned z0,
+         unsigned nx, unsigned ny, unsigned nz,
+         int* out) const;
+
+  /** Sets every cell to @p index, releasing all brick storage. */
+  void
+  fill(int index);
+
+  /** Stores every brick in the cheapest mode that holds its contents. */
+  void
+  compact();
+
+  /**
+   * Stores the bricks holding rows @p y_begin up to (not including) @p y_end in
+   * the cheapest mode that holds their contents.
+   *
+   * Builders that generate a map a band of rows at a time can use this to keep
+   * only one band of bricks dense at a time.
+   */
+  void
+  compact_rows(unsigned y_begin, unsigned y_end);
+
+  /**
+   * Fills in the surface height of every column of cells, y-major: one more
+   * than the z of its topmost non-zero cell, or 0 if every cell is zero.  Only
+   * the bricks down to each column's surface are read, and whole uniform
+   * bricks are settled without reading their cells.
+   */
+  void
+  surface_heights(unsigned* out) const;
+
+  /** Whether brick @p i has been changed since the store was marked clean. */
+  bool
+  brick_dirty(std::size_t i) const
+  { return bricks_[i].dirty; }
+
+  /** The number of bricks changed since the store was marked clean. */
+  std::size_t
+  dirty_brick_count() const;
+
+  /** Marks every brick clean, as after saving the whole store. */
+  void
+  clear_dirty();
+
+  /**
+   * A 64-bit hash of the extents and cells of the store.  Stores with the same
+   * contents have the same hash, so it can be used as a cache key.
+   *
+   * The hash of each brick, and of each level of a brick, is kept until the
+   * brick is next changed.  The kept hashes are guarded by a lock, so the
+   * hashes of a store may be asked for from several threads at once, as long
+   * as none of them is changing it.
+   */
+  std::uint64_t
+  content_hash() const;
+
+  /** A 64-bit hash of the cells of brick @p i, as used by content_hash(). */
+  std::uint64_t
+  brick_hash(std::size_t i) const;
+
+  /**
+   * A 64-bit hash of the cells of level @p level of brick @p i, counting from
+   * the brick's lowest level, hashed as brick_hash() hashes a brick one level
+   * deep.  In a store one level high this is brick_hash().
+   * @throws std::out_of_range if the brick has no such level.
+   */
+  std::uint64_t
+  brick_level_hash(std::size_t i, unsigned level) const;
+
+  /** Reports the storage used by the store. */
+  MemoryUsage
+  memory_usage() const;
+
+  /**
+   * Copies the cells of brick @p i into the brick_cells() elements at @p out.
+   */
+  void
+  decode_brick(std::size_t i, int* out) const;
+
+  /**
+   * Gets the number of cells of brick @p i inside the store along each axis.
+   * The rest of a brick at the edge of the store is padding.
+   */
+  void
+  brick_extent(std::size_t i, unsigned& nx, unsigned& ny, unsigned& nz) const;
+
+  /**
+   * Gets the stored form of brick @p i.
+   *
+   * The pointers refer to the brick's own storage and are valid until the
+   * brick is next changed.
+   */
+  EncodedBrick
+  encoded_brick(std::size_t i) const;
+
+  /**
+   * Replaces brick @p i with a copy of a stored form.
+   * @throws std::invalid_argument if @p brick is not a valid stored form.
+   */
+  void
+  set_encoded_brick(std::size_t i, EncodedBrick const& brick);
+
+  /**
+   * Makes brick @p i use a stored form in place instead of copying it.
+   *
+   * The brick is copied into the store's own storage the first time it is
+   * changed.  Until then the palette, packed entries or cells must stay valid
+   * and unchanged, which hold_storage() can see to.  The packed entries are
+   * not checked, so the palette storage must have room for 2^bits values.
+   * @throws std::invalid_argument if @p brick is not a valid stored form.
+   */
+  void
+  borrow_encoded_brick(std::size_t i, EncodedBrick const& brick);
+
+  /** Whether brick @p i is borrowed. */
+  bool
+  brick_borrowed(std::size_t i) const
+  { return bricks_[i].borrowed; }
+
+  /**
+   * Keeps @p storage alive for as long as the store, for the storage of
+   * borrowed bricks.
+   */
+  void
+  hold_storage(std::shared_ptr<void const> storage);
+
+  /** The number of words of packed entries in a palette brick of @p bits. */
+  std::size_t
+  packed_words(unsigned bits) const
+  { return brick_cells_ * bits / 32 + 1; }
+
+  /**
+   * Replaces the cells of brick @p i with the brick_cells() elements at
+   * @p cells, storing the brick in the cheapest mode that holds them.
+   *
+   * Generators can build each brick in a local buffer and store it whole.
+   * Different bricks may be stored from different threads at the same time.
+   */
+  void
+  store_brick(std::size_t i, int const* cells);
+
+  /** The index of the brick holding the cell at (x, y, z). */
+  std::size_t
+  brick_index_of(unsigned x, unsigned y, unsigned z) const
+  {
+    return (std::size_t(y / brick_size) * bricks_x_ + x / brick_size) * bricks_z_
+         + z / brick_size;
+  }
+
+  /** The offset of the cell at (x, y, z) within its brick. */
+  std::size_t
+  brick_offset_of(unsigned x, unsigned y, unsigned z) const
+  {
+    return (std::size_t(z % brick_size) * brick_size + y % brick_size) * brick_size
+         + x % brick_size;
+  }
+
+private:
+  friend class CellRow;
+  friend class ConstCellRow;
+  friend bool operator==(ChunkStore const& lhs, ChunkStore const& rhs);
+
+  struct Brick
+  {
+    BrickMode                  mode = BrickMode::uniform;
+    std::uint8_t               bits = 0;
+    bool                       borrowed = false;
+    bool                       dirty = false;
+    mutable bool               hashed = false;
+    mutable std::uint64_t      hash = 0;
+    mutable std::uint32_t      levels_hashed = 0;  ///< a bit for each kept level hash
+    mutable std::vector<std::uint64_t> level_hashes;
+    int                        value = 0;
+    int*                       cells = nullptr;  ///< never written while borrowed
+    std::vector<int>           palette;
+    std::vector<std::uint32_t> packed;
+    int const*                 borrowed_palette = nullptr;
+    std::size_t                borrowed_palette_size = 0;
+    std::uint32_t const*       borrowed_packed = nullptr;
+
+    int const*
+    palette_data() const
+    { return borrowed ? borrowed_palette : palette.data(); }
+
+    std::size_t
+    palette_size() const
+    { return borrowed ? borrowed_palette_size : palette.size(); }
+
+    std::uint32_t const*
+    packed_data() const
+    { return borrowed ? borrowed_packed : packed.data(); }
+  };
+
+  /**
+   * A pool of brick-sized slabs for dense bricks.  Slabs are carved out of
+   * blocks that are never moved, so a dense brick's cells stay put for as long
+   * as the brick stays dense.  Slabs may be taken and returned from several
+   * threads at once.
+   */
+  class SlabPool
+  {
+  public:
+    SlabPool(std::size_t slab_cells);
+
+    int*
+    allocate();
+
+    void
+    release(int* slab);
+
+    /** Returns blocks with no slabs in use to the system. */
+    void
+    trim();
+
+    std::size_t
+    bytes_reserved() const;
+
+  private:
+    std::size_t                         slab_cells_;
+    std::size_t                         next_block_slabs_;
+    std::vector<std::unique_ptr<int[]>> blocks_;
+    std::vector<std::size_t>            block_slabs_;
+    std::vector<int*>                   free_;
+    std::unique_ptr<std::mutex>         mutex_;
+  };
+
+  int
+  brick_cell(Brick const& brick, std::size_t offset) const
+  {
+    switch (brick.mode)
+    {
+      case BrickMode::dense:
+        return brick.cells[offset];
+      case BrickMode::uniform:
+        return brick.value;
+      default:
+        return palette_cell(brick, offset);
+    }
+  }
+
+  static int
+  palette_cell(Brick const& brick, std::size_t offset)
+  {
+    std::size_t bit = offset * brick.bits;
+    std::uint32_t entry = (brick.packed_data()[bit / 32] >> (bit % 32)) & ((1u << brick.bits) - 1);
+    return brick.palette_data()[entry];
+  }
+
+  /** Marks a brick as changed: dirty, and with no kept hash. */
+  static void
+  touch(Brick& brick)
+  {
+    brick.dirty = true;
+    brick.hashed = false;
+    brick.levels_hashed = 0;
+  }
+
+  /** Gets the kept hash of brick @p i, if it has one, under the hash lock. */
+  bool
+  kept_hash(std::size_t i, std::uint64_t& hash) const;
+
+  std::uint64_t
+  hash_brick(std::size_t i, std::vector<int>& scratch) const;
+
+  void
+  set_brick_cell(Brick& brick, std::size_t offset, int index);
+
+  int*
+  make_dense(Brick& brick);
+
+  void
+  make_uniform(Brick& brick, int index);
+
+  void
+  own_brick(Brick& brick);
+
+  void
+  compact_brick(std::size_t i);
+
+  void
+  store_brick_cells(std::size_t i, int const* cells);
+
+  std::size_t
+  cell_offset_of(unsigned x, unsigned y, unsigned z) const;
+
+private:
+  unsigned           length_;
+  unsigned           width_;
+  unsigned           height_;
+  unsigned           brick_depth_;
+  std::size_t        brick_cells_;
+  std::size_t        bricks_x_;
+  std::size_t        bricks_y_;
+  std::size_t        bricks_z_;
+  std::vector<Brick> bricks_;
+  SlabPool           slabs_;
+  std::vector<std::shared_ptr<void const>> held_storage_;
+  std::unique_ptr<std::mutex>              hash_mutex_;  ///< guards the kept hashes
+};
+
+
+bool
+operator==(ChunkStore const& lhs, ChunkStore const& rhs);
+
+bool inline
+operator!=(ChunkStore const& lhs, ChunkStore const& rhs)
+{ return !(lhs == rhs); }
+
+
+/**
+ * One row (fixed y and z, increasing x) of a ChunkStore, for writing.
+ *
+ * The cells of a row are stored in one segment per brick the row passes
+ * through.  Iterating over a row yields each segment as a contiguous span, in
+ * order of increasing x, making the segment's brick dense first.
+ */
+class CellRow
+{
+public:
+  class iterator
+  {
+  public:
+    iterator(CellRow const* row, std::size_t segment)
+    : row_(row), segment_(segment)
+    { }
+
+    CellSpan
+    operator*() const
+    { return row_->segment(segment_); }
+
+    iterator&
+    operator++()
+    { ++segment_; return *this; }
+
+    bool
+    operator!=(iterator const& rhs) const
+    { return segment_ != rhs.segment_; }
+
+  private:
+    CellRow const* row_;
+    std::size_t    segment_;
+  };
+
+public:
+  CellRow(ChunkStore* store, unsigned y, unsigned z)
+  : store_(store), y_(y), z_(z)
+  { }
+
+  /** The number of cells in the row. */
+  std::size_t
+  size() const
+  { return store_->length(); }
+
+  /** The number of segments in the row. */
+  std::size_t
+  segment_count() const
+  { return (size() + ChunkStore::brick_size - 1) / ChunkStore::brick_size; }
+
+  /** The cells of segment @p i, which start at x = 16 * i. */
+  CellSpan
+  segment(std::size_t i) const;
+
+  iterator
+  begin() const
+  { return iterator(this, 0); }
+
+  iterator
+  end() const
+  { return iterator(this, segment_count()); }
+
+private:
+  ChunkStore* store_;
+  unsigned    y_;
+  unsigned    z_;
+};
+
+
+/**
+ * One row (fixed y and z, increasing x) of a ChunkStore, for reading.
+ *
+ * Segments of dense bricks are spans of the brick's own cells.  Segments of
+ * uniform and palette bricks are decoded into a buffer in the row, so such a
+ * span is only valid until the next segment is taken from the same row.
+ */
+class ConstCellRow
+{
+public:
+  class iterator
+  {
+  public:
+    iterator(ConstCellRow const* row, std::size_t segment)
+    : row_(row), segment_(segment)
+    { }
+
+    ConstCellSpan
+    operator*() const
+    { return row_->segment(segment_); }
+
+    iterator&
+    operator++()
+    { ++segment_; return *this; }
+
+    bool
+    operator!=(iterator const& rhs) const
+    { return segment_ != rhs.segment_; }
+
+  private:
+    ConstCellRow const* row_;
+    std::size_t         segment_;
+  };
+
+public:
+  ConstCellRow(ChunkStore const* store, unsigned y, unsigned z)
+  : store_(store), y_(y), z_(z)
+  { }
+
+  /** The number of cells in the row. */
+  std::size_t
+  size() const
+  { return store_->length(); }
+
+  /** The number of segments in the row. */
+  std::size_t
+  segment_count() const
+  { return (size() + ChunkStore::brick_size - 1) / ChunkStore::brick_size; }
+
+  /** The cells of segment @p i, which start at x = 16 * i. */
+  ConstCellSpan
+  segment(std::size_t i) const;
+
+  iterator
+  begin() const
+  { return iterator(this, 0); }
+
+  iterator
+  end() const
+  { return iterator(this, segment_count()); }
+
+private:
+  ChunkStore const* store_;
+  unsigned          y_;
+  unsigned          z_;
+  mutable int       decoded_[ChunkStore::brick_size];
+};
+
+} // namespace World
+} // namespace Legacy
+
+#endif // LEGACY_WORLD_CHUNKSTORE_H_
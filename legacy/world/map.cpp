@@ -21,8 +21,138 @@
  */
 #include "legacy/world/map.h"
 
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
+#include "legacy/world/mapbuilderbinary.h"
+#include <list>
+#include <sstream>
 #include <stdexcept>
+#include <string>
+#include <unordered_map>
+
+constexpr int Legacy::World::Map::outside;
+constexpr int Legacy::World::Map::neighbours6[6][3];
+constexpr int Legacy::World::Map::neighbours26[26][3];
+
+
+/**
+ * The regions of a lazily built map held in memory, most recently used first,
+ * and the saved contents of changed regions that have been dropped.
+ */
+class Legacy::World::Map::RegionCache
+{
+public:
+  RegionCache(MapBuilder& builder, Map const& map, LazyMapOptions const& options)
+  : builder_(builder)
+  , length_(map.length())
+  , width_(map.width())
+  , height_(map.height())
+  , region_size_(options.region_size)
+  , resident_limit_(options.resident_regions)
+  , last_key_(0)
+  , last_(nullptr)
+  { }
+
+  unsigned
+  region_size() const
+  { return region_size_; }
+
+  std::size_t
+  resident_regions() const
+  { return regions_.size(); }
+
+  /**
+   * Gets the cells of the region holding column (@p x, @p y), building it if
+   * it is not held.  A region got for @p changing is saved when dropped.
+   */
+  ChunkStore&
+  region(unsigned x, unsigned y, bool changing)
+  {
+    Key key = std::uint64_t(y / region_size_) << 32 | (x / region_size_);
+    if (last_ == nullptr || key != last_key_)
+    {
+      auto it = regions_.find(key);
+      if (it == regions_.end())
+        it = load(key);
+      else
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+      last_key_ = key;
+      last_ = &it->second;
+    }
+    last_->changed = last_->changed || changing;
+    return *last_->cells;
+  }
+
+private:
+  using Key = std::uint64_t;
+
+  struct Region
+  {
+    std::unique_ptr<ChunkStore> cells;
+    std::list<Key>::iterator    lru;
+    bool                        changed;
+  };
+
+  std::unordered_map<Key, Region>::iterator
+  load(Key key)
+  {
+    while (regions_.size() >= resident_limit_)
+      evict(lru_.back());
+
+    unsigned x0 = (key & 0xffffffffu) * region_size_;
+    unsigned y0 = (key >> 32) * region_size_;
+    std::unique_ptr<ChunkStore> cells(new ChunkStore(std::min(region_size_, length_ - x0),
+                                                     std::min(region_size_, width_ - y0),
+                                                     height_));
+    bool changed = false;
+    auto saved = saved_.find(key);
+    if (saved != saved_.end())
+    {
+      std::istringstream istr(saved->second);
+      MapBuilderBinary(istr).build_cells(*cells);
+      saved_.erase(saved);
+      changed = true;
+    }
+    else
+    {
+      builder_.build_region(x0, y0, *cells);
+      cells->compact();
+    }
+
+    lru_.push_front(key);
+    return regions_.emplace(key, Region{ std::move(cells), lru_.begin(), changed }).first;
+  }
+
+  void
+  evict(Key key)
+  {
+    auto it = regions_.find(key);
+    if (it->second.changed)
+    {
+      std::ostringstream ostr;
+      write_binary(ostr, *it->second.cells);
+      saved_[key] = ostr.str();
+    }
+    if (last_ == &it->second)
+      last_ = nullptr;
+    lru_.erase(it->second.lru);
+    regions_.erase(it);
+  }
+
+private:
+  MapBuilder&                          builder_;
+  unsigned                             length_;
+  unsigned                             width_;
+  unsigned                             height_;
+  unsigned                             region_size_;
+  std::size_t                          resident_limit_;
+  std::unordered_map<Key, Region>      regions_;
+  std::list<Key>                       lru_;
+  std::unordered_map<Key, std::string> saved_;
+  Key                                  last_key_;
+  Region*                              last_;
+};
 
 
 Legacy::World::MapBuilder::
@@ -30,20 +160,148 @@ Legacy::World::MapBuilder::
 { }
 
 
+bool Legacy::World::MapBuilder::
+builds_regions()
+{
+  return false;
+}
+
+
+void Legacy::World::MapBuilder::
+build_region(unsigned, unsigned, ChunkStore&)
+{
+  throw std::logic_error("map builder can not build regions");
+}
+
+
+bool Legacy::World::MapBuilder::
+surface_heights(unsigned*)
+{
+  return false;
+}
+
+
+void Legacy::World::MapBuilder::
+build_cells(ChunkStore& cells)
+{
+  MapLayerBag layers = this->layers();
+  if (layers.size() != cells.height())
+    throw std::runtime_error("map builder produced the wrong number of layers");
+  for (unsigned z = 0; z < cells.height(); ++z)
+  {
+    MapLayer view(cells, z);
+    view = layers[z];
+  }
+}
+
+
+Legacy::World::MapLayerBag Legacy::World::MapBuilder::
+layers_from_cells()
+{
+  ChunkStore cells(map_length(), map_width(), map_height());
+  build_cells(cells);
+
+  MapLayerBag layers;
+  layers.reserve(cells.height());
+  for (unsigned z = 0; z < cells.height(); ++z)
+  {
+    // Copying a view makes a layer that owns its cells, outliving the store.
+    MapLayer view(cells, z);
+    layers.push_back(view);
+  }
+  return layers;
+}
+
+
 Legacy::World::Map::
 Map(MapBuilder& builder)
 : length_(builder.map_length())
 , width_(builder.map_width())
 , height_(builder.map_height())
-, layers_(builder.layers())
+, cells_(new ChunkStore(length_, width_, height_))
+, surface_(std::size_t(length_) * width_)
+, surface_found_(true)
+{
+  builder.build_cells(*cells_);
+  cells_->compact();
+  // Heights the builder does not know are found at the first surface query,
+  // so a map whose bricks are borrowed does not read them all as it loads.
+  if (!builder.surface_heights(surface_.data()))
+    surface_found_ = false;
+  layers_.reserve(height_);
+  for (unsigned z = 0; z < height_; ++z)
+  {
+    layers_.emplace_back(*cells_, z);
+  }
+}
+
+
+Legacy::World::Map::
+Map(MapBuilder& builder, LazyMapOptions const& options)
+: length_(builder.map_length())
+, width_(builder.map_width())
+, height_(builder.map_height())
+, surface_found_(false)
+{
+  if (!builder.builds_regions())
+    throw std::invalid_argument("map builder can not build regions");
+  if (options.region_size == 0 || options.region_size % ChunkStore::brick_size != 0)
+    throw std::invalid_argument("map region size must be a multiple of the brick size");
+  if (options.resident_regions == 0)
+    throw std::invalid_argument("a lazy map must be able to hold at least one region");
+  regions_.reset(new RegionCache(builder, *this, options));
+}
+
+
+Legacy::World::Map::
+Map(Map const& rhs)
+: length_(rhs.length_)
+, width_(rhs.width_)
+, height_(rhs.height_)
+, surface_(rhs.surface_)
+, surface_found_(rhs.surface_found_)
+{
+  if (rhs.regions_)
+    throw std::logic_error("a lazy map can not be copied");
+  cells_.reset(new ChunkStore(*rhs.cells_));
+  layers_.reserve(height_);
+  for (unsigned z = 0; z < height_; ++z)
+  {
+    layers_.emplace_back(*cells_, z);
+  }
+}
+
+
+Legacy::World::Map::
+Map(Map&&) = default;
+
+
+Legacy::World::Map& Legacy::World::Map::
+operator=(Map const& rhs)
+{
+  if (this != &rhs)
+    *this = Map(rhs);
+  return *this;
+}
+
+
+Legacy::World::Map& Legacy::World::Map::
+operator=(Map&&) = default;
+
+
+Legacy::World::Map::
+~Map()
 { }
 
 
 Legacy::World::MapLayer& Legacy::World::Map::
 layer(unsigned i)
 {
+  if (regions_)
+    throw std::logic_error("a lazy map has no layers");
   if (i >= height_)
     throw std::out_of_range("layer index out of range");
+  surface_found_ = false;
   return layers_[i];
 }
 
@@ -51,12 +309,318 @@ layer(unsigned i)
 Legacy::World::MapLayer const& Legacy::World::Map::
 layer(unsigned i) const
 {
+  if (regions_)
+    throw std::logic_error("a lazy map has no layers");
   if (i >= height_)
     throw std::out_of_range("layer index out of range");
   return layers_[i];
 }
 
 
+Legacy::World::ChunkStore& Legacy::World::Map::
+cells()
+{
+  if (regions_)
+    throw std::logic_error("a lazy map has no single store of cells");
+  surface_found_ = false;
+  return *cells_;
+}
+
+
+Legacy::World::ChunkStore const& Legacy::World::Map::
+cells() const
+{
+  if (regions_)
+    throw std::logic_error("a lazy map has no single store of cells");
+  return *cells_;
+}
+
+
+int Legacy::World::Map::
+cell_index_at(unsigned x, unsigned y, unsigned z) const
+{
+  if (!regions_)
+    return cells_->cell_index_at(x, y, z);
+  if (x >= length_ || y >= width_ || z >= height_)
+    throw std::out_of_range("cell index out of range");
+  unsigned size = regions_->region_size();
+  return regions_->region(x, y, false).cell_index_at_unchecked(x % size, y % size, z);
+}
+
+
+void Legacy::World::Map::
+set_cell_index_at(unsigned x, unsigned y, unsigned z, int index)
+{
+  if (!regions_)
+  {
+    cells_->set_cell_index_at(x, y, z, index);
+    if (surface_found_)
+      update_surface(x, y, z, index);
+    return;
+  }
+  if (x >= length_ || y >= width_ || z >= height_)
+    throw std::out_of_range("cell index out of range");
+  unsigned size = regions_->region_size();
+  regions_->region(x, y, true).set_cell_index_at_unchecked(x % size, y % size, z, index);
+}
+
+
+void Legacy::World::Map::
+box_at(unsigned x0, unsigned y0, unsigned z0,
+       unsigned nx, unsigned ny, unsigned nz,
+       int* out) const
+{
+  if (!regions_)
+  {
+    cells_->box_at(x0, y0, z0, nx, ny, nz, out);
+    return;
+  }
+  if (x0 > length_ || nx > length_ - x0
+   || y0 > width_  || ny > width_ - y0
+   || z0 > height_ || nz > height_ - z0)
+    throw std::out_of_range("cell box out of range");
+  if (nx == 0 || ny == 0 || nz == 0)
+    return;
+
+  // Each region the box overlaps is read as a box of its own and its rows
+  // copied into place.
+  unsigned size = regions_->region_size();
+  std::vector<int> part;
+  for (unsigned ry = y0 / size; ry <= (y0 + ny - 1) / size; ++ry)
+  {
+    unsigned ya = std::max(y0, ry * size);
+    unsigned yb = std::min(y0 + ny, (ry + 1) * size);
+    for (unsigned rx = x0 / size; rx <= (x0 + nx - 1) / size; ++rx)
+    {
+      unsigned xa = std::max(x0, rx * size);
+      unsigned xb = std::min(x0 + nx, (rx + 1) * size);
+      part.resize(std::size_t(xb - xa) * (yb - ya) * nz);
+      regions_->region(xa, ya, false).box_at(xa % size, ya % size, z0,
+                                             xb - xa, yb - ya, nz,
+                                             part.data());
+      int const* src = part.data();
+      for (unsigned z = 0; z < nz; ++z)
+      {
+        for (unsigned y = ya; y < yb; ++y)
+        {
+          int* dst = out + (std::size_t(z) * ny + (y - y0)) * nx + (xa - x0);
+          std::copy(src, src + (xb - xa), dst);
+          src += xb - xa;
+        }
+      }
+    }
+  }
+}
+
+
+void Legacy::World::Map::
+column_at(unsigned x, unsigned y, int* out) const
+{
+  if (!regions_)
+  {
+    cells_->column_at(x, y, out);
+    return;
+  }
+  if (x >= length_ || y >= width_)
+    throw std::out_of_range("map column out of range");
+  unsigned size = regions_->region_size();
+  regions_->region(x, y, false).column_at(x % size, y % size, out);
+}
+
+
+void Legacy::World::Map::
+neighbours6_at(unsigned x, unsigned y, unsigned z, int* out) const
+{
+  if (x >= length_ || y >= width_ || z >= height_)
+    throw std::out_of_range("cell index out of range");
+
+  if (!regions_ && x > 0 && x + 1 < length_ && y > 0 && y + 1 < width_
+   && z > 0 && z + 1 < height_)
+  {
+    ChunkStore const& cells = *cells_;
+    out[0] = cells.cell_index_at_unchecked(x, y, z - 1);
+    out[1] = cells.cell_index_at_unchecked(x, y - 1, z);
+    out[2] = cells.cell_index_at_unchecked(x - 1, y, z);
+    out[3] = cells.cell_index_at_unchecked(x + 1, y, z);
+    out[4] = cells.cell_index_at_unchecked(x, y + 1, z);
+    out[5] = cells.cell_index_at_unchecked(x, y, z + 1);
+    return;
+  }
+
+  for (std::size_t i = 0; i < 6; ++i)
+  {
+    // Unsigned wrap-around takes a step off the low edge past the high one.
+    unsigned nx = x + neighbours6[i][0];
+    unsigned ny = y + neighbours6[i][1];
+    unsigned nz = z + neighbours6[i][2];
+    if (nx < length_ && ny < width_ && nz < height_)
+      out[i] = cell_index_at(nx, ny, nz);
+    else
+      out[i] = outside;
+  }
+}
+
+
+void Legacy::World::Map::
+neighbours26_at(unsigned x, unsigned y, unsigned z, int* out) const
+{
+  if (x >= length_ || y >= width_ || z >= height_)
+    throw std::out_of_range("cell index out of range");
+
+  // Read the part of the 3x3x3 block around the cell inside the map in one
+  // go, with the rest given as outside.
+  unsigned xa = x > 0 ? x - 1 : 0;
+  unsigned ya = y > 0 ? y - 1 : 0;
+  unsigned za = z > 0 ? z - 1 : 0;
+  unsigned xb = std::min(x + 2, length_);
+  unsigned yb = std::min(y + 2, width_);
+  unsigned zb = std::min(z + 2, height_);
+  int block[27];
+  if (xb - xa == 3 && yb - ya == 3 && zb - za == 3)
+    box_at(xa, ya, za, 3, 3, 3, block);
+  else
+  {
+    int part[27];
+    box_at(xa, ya, za, xb - xa, yb - ya, zb - za, part);
+    std::fill(block, block + 27, outside);
+    int const* src = part;
+    for (unsigned k = za; k < zb; ++k)
+      for (unsigned j = ya; j < yb; ++j)
+        for (unsigned i = xa; i < xb; ++i)
+          block[((k + 1 - z) * 3 + (j + 1 - y)) * 3 + (i + 1 - x)] = *src++;
+  }
+  out = std::copy(block, block + 13, out);
+  std::copy(block + 14, block + 27, out);
+}
+
+
+Legacy::World::Cell Legacy::World::Map::
+cell_at(unsigned x, unsigned y, unsigned z, CellCache const& cache) const
+{
+  return cache.cell_at(cell_index_at(x, y, z));
+}
+
+
+void Legacy::World::Map::
+set_cell_at(unsigned x, unsigned y, unsigned z, Cell const& cell, CellCache& cache)
+{
+  int old_index = cell_index_at(x, y, z);
+  if (cache.cell_at(old_index) == cell)
+    return;
+  int new_index = cache.acquire(cell);
+  try
+  {
+    set_cell_index_at(x, y, z, new_index);
+  }
+  catch (...)
+  {
+    // The position still holds the old cell, so the new one is not used.
+    cache.drop_ref(new_index);
+    throw;
+  }
+  cache.drop_ref(old_index);
+}
+
+
+unsigned Legacy::World::Map::
+surface_height(unsigned x, unsigned y) const
+{
+  if (x >= length_ || y >= width_)
+    throw std::out_of_range("map column out of range");
+  if (regions_)
+    return probe_surface(x, y);
+  if (!surface_found_)
+    find_surface();
+  return surface_[std::size_t(y) * length_ + x];
+}
+
+
+void Legacy::World::Map::
+surface_heights(unsigned x0, unsigned y0, unsigned nx, unsigned ny, unsigned* out) const
+{
+  if (x0 > length_ || nx > length_ - x0 || y0 > width_ || ny > width_ - y0)
+    throw std::out_of_range("map columns out of range");
+  if (!regions_ && !surface_found_)
+    find_surface();
+  for (unsigned y = 0; y < ny; ++y)
+  {
+    if (regions_)
+    {
+      for (unsigned x = 0; x < nx; ++x)
+        *out++ = probe_surface(x0 + x, y0 + y);
+      continue;
+    }
+    unsigned const* row = surface_.data() + std::size_t(y0 + y) * length_ + x0;
+    out = std::copy(row, row + nx, out);
+  }
+}
+
+
+std::uint64_t Legacy::World::Map::
+content_hash() const
+{
+  return cells().content_hash();
+}
+
+
+std::size_t Legacy::World::Map::
+dirty_bricks() const
+{
+  return cells().dirty_brick_count();
+}
+
+
+void Legacy::World::Map::
+clear_dirty()
+{
+  cells().clear_dirty();
+}
+
+
+std::size_t Legacy::World::Map::
+resident_regions() const
+{
+  return regions_ ? regions_->resident_regions() : 0;
+}
+
+
+/**
+ * Keeps the surface height of a column up to date after one of its cells is
+ * set: a non-empty cell above the surface raises it, and emptying the surface
+ * cell lowers it to the next non-empty cell down.
+ */
+void Legacy::World::Map::
+update_surface(unsigned x, unsigned y, unsigned z, int index)
+{
+  unsigned& height = surface_[std::size_t(y) * length_ + x];
+  if (index != 0 && z >= height)
+    height = z + 1;
+  else if (index == 0 && z + 1 == height)
+  {
+    while (height > 0 && cells_->cell_index_at_unchecked(x, y, height - 1) == 0)
+      --height;
+  }
+}
+
+
+void Legacy::World::Map::
+find_surface() const
+{
+  cells_->surface_heights(surface_.data());
+  surface_found_ = true;
+}
+
+
+unsigned Legacy::World::Map::
+probe_surface(unsigned x, unsigned y) const
+{
+  unsigned height = height_;
+  while (height > 0 && cell_index_at(x, y, height - 1) == 0)
+    --height;
+  return height;
+}
+
+
 std::ostream& Legacy::World::
 operator<<(std::ostream& ostr, Map const& map)
 {
@@ -65,7 +629,19 @@ operator<<(std::ostream& ostr, Map const& map)
   for (unsigned i = 0; i < map.height(); ++i)
   {
     ostr << "layer " << i << "\n";
-    ostr << map.layer(i);
+    if (!map.is_lazy())
+    {
+      ostr << map.layer(i);
+      continue;
+    }
+    for (unsigned y = 0; y < map.width(); ++y)
+    {
+      for (unsigned x = 0; x < map.length(); ++x)
+      {
+        ostr << std::setw(4) << map.cell_index_at(x, y, i);
+      }
+      ostr << "\n";
+    }
   }
   return ostr;
 }
@@ -78,10 +654,21 @@ operator==(Map const& lhs, Map const& rhs)
   if (lhs.width()  != rhs.width())  return false;
   if (lhs.height() != rhs.height()) return false;
 
-  for (unsigned i = 0; i < lhs.height(); ++i)
+  if (!lhs.is_lazy() && !rhs.is_lazy())
+    return lhs.cells() == rhs.cells();
+
+  // A lazy map is compared cell by cell, building its regions as they are
+  // reached.
+  for (unsigned y = 0; y < lhs.width(); ++y)
   {
-    if (lhs.layer(i) != rhs.layer(i)) return false;
+    for (unsigned x = 0; x < lhs.length(); ++x)
+    {
+      for (unsigned z = 0; z < lhs.height(); ++z)
+      {
+        if (lhs.cell_index_at(x, y, z) != rhs.cell_index_at(x, y, z))
+          return false;
+      }
+    }
   }
-
   return true;
 }
@@ -22,8 +22,13 @@
 #ifndef LEGACY_WORLD_MAP_H_
 #define LEGACY_WORLD_MAP_H_
 
+#include <cstddef>
+#include <cstdint>
 #include <iosfwd>
+#include "legacy/world/cellcache.h"
+#include "legacy/world/chunkstore.h"
 #include "legacy/world/maplayer.h"
+#include <memory>
 #include <vector>
 
 
@@ -58,32 +63,334 @@ public:
 
   virtual Legacy::World::MapLayerBag
   layers() = 0;
+
+  /**
+   * Fills in the cells of a map.
+   *
+   * The @p cells have the extents given by map_length(), map_width() and
+   * map_height() and are all zero on entry.  The map compacts the cells
+   * afterwards.  The default copies the cells from layers(); builders that can
+   * generate cells directly should override this to avoid building the
+   * intermediate layers.
+   */
+  virtual void
+  build_cells(ChunkStore& cells);
+
+  /**
+   * Indicates if the builder can build a map a region at a time through
+   * build_region(), so it can be used for a lazily built map.  The default is
+   * false.
+   */
+  virtual bool
+  builds_regions();
+
+  /**
+   * Fills in the cells of one region of a map.
+   *
+   * The region is the full height of the map and its columns start at
+   * (@p x0, @p y0).  The @p cells have the extents of the region and are all
+   * zero on entry.  A region must come out the same whenever it is built,
+   * whatever other regions have been built before it.
+   * @throws std::logic_error by default.
+   */
+  virtual void
+  build_region(unsigned x0, unsigned y0, ChunkStore& cells);
+
+  /**
+   * Fills in the surface height of every column of the map last built by
+   * build_cells(), as ChunkStore::surface_heights() would find them.
+   *
+   * Builders that know the heights as they generate can override this to
+   * save the map finding them.  The default fills in nothing.
+   * @returns whether the heights were filled in.
+   */
+  virtual bool
+  surface_heights(unsigned* out);
+
+protected:
+  /**
+   * Builds the layers of a map as views of the cells filled in by
+   * build_cells(), for builders that generate cells directly to implement
+   * layers() with.
+   */
+  Legacy::World::MapLayerBag
+  layers_from_cells();
+};
+
+
+/**
+ * How a lazily built map divides itself into regions and how many it keeps.
+ */
+struct LazyMapOptions
+{
+  /** The length and width of a region; a multiple of the brick size. */
+  unsigned    region_size = 64;
+
+  /** The most regions held in memory at once. */
+  std::size_t resident_regions = 256;
 };
 
 
 /**
  * The local (playable) part of the world
+ *
+ * All the cells of the map are held in a single ChunkStore and the layers are
+ * views of it.
+ *
+ * A map can instead be built lazily, a region at a time, as its cells are
+ * first used.  Only a limited number of regions are kept; when another is
+ * needed the least recently used one is dropped, to be built again if it is
+ * used again.  Regions that have been changed are kept in the binary save
+ * format when dropped rather than being rebuilt.  A lazy map has no layers or
+ * single ChunkStore, so its cells are reached through cell_index_at() and
+ * set_cell_index_at(), and it is not safe to use from several threads at once
+ * even for reading.
+ *
+ * A map that is not lazy keeps the surface height of each of its columns, so
+ * finding the top of the ground is a lookup.  Changes made through the map
+ * keep the heights up to date as they are made; after the cells have been
+ * reached through the non-const layer() or cells() the heights are found
+ * again the next time they are asked for.
+ *
+ * The cells of a map that is not lazy remember which bricks have changed since
+ * the map was last marked clean.  A map built from a binary save starts clean,
+ * so a delta save of it writes only what has changed since.
+ *
+ * A copy of a map that is not lazy has its own cells and layers.  A lazy map
+ * can not be copied, since its regions are built by a builder it does not own.
  */
 class Map
 {
 public:
+  /** The cache index given for a neighbour that is outside the map. */
+  static constexpr int outside = -1;
+
+  /** The (dx, dy, dz) offsets of the neighbours given by neighbours6_at(). */
+  static constexpr int neighbours6[6][3] = {
+    {  0,  0, -1 }, {  0, -1,  0 }, { -1,  0,  0 },
+    {  1,  0,  0 }, {  0,  1,  0 }, {  0,  0,  1 }
+  };
+
+  /** The (dx, dy, dz) offsets of the neighbours given by neighbours26_at(). */
+  static constexpr int neighbours26[26][3] = {
+    { -1, -1, -1 }, {  0, -1, -1 }, {  1, -1, -1 },
+    { -1,  0, -1 }, {  0,  0, -1 }, {  1,  0, -1 },
+    { -1,  1, -1 }, {  0,  1, -1 }, {  1,  1, -1 },
+    { -1, -1,  0 }, {  0, -1,  0 }, {  1, -1,  0 },
+    { -1,  0,  0 },                 {  1,  0,  0 },
+    { -1,  1,  0 }, {  0,  1,  0 }, {  1,  1,  0 },
+    { -1, -1,  1 }, {  0, -1,  1 }, {  1, -1,  1 },
+    { -1,  0,  1 }, {  0,  0,  1 }, {  1,  0,  1 },
+    { -1,  1,  1 }, {  0,  1,  1 }, {  1,  1,  1 }
+  };
+
+public:
+  /** Builds the whole map. */
   Map(MapBuilder& builder);
 
+  /**
+   * Creates a lazily built map.  The @p builder must outlive the map.
+   * @throws std::invalid_argument if the builder can not build regions or the
+   *         options are invalid.
+   */
+  Map(MapBuilder& builder, LazyMapOptions const& options);
+
+  /**
+   * Copies the cells and surface heights of a map.
+   * @throws std::logic_error if @p rhs is lazy.
+   */
+  Map(Map const& rhs);
+
+  Map(Map&&);
+
+  /**
+   * Replaces the cells and surface heights of the map with copies of those of
+   * @p rhs.
+   * @throws std::logic_error if @p rhs is lazy.
+   */
+  Map&
+  operator=(Map const& rhs);
+
+  Map&
+  operator=(Map&&);
+
+  ~Map();
+
   unsigned length() const { return length_; }
   unsigned width() const  { return width_;  }
   unsigned height() const { return height_; }
 
+  /** Indicates if the map is built lazily. */
+  bool
+  is_lazy() const
+  { return regions_ != nullptr; }
+
+  /**
+   * Gets layer @p i of the map.
+   * @throws std::out_of_range if there is no such layer.
+   * @throws std::logic_error if the map is lazy.
+   */
   MapLayer&
   layer(unsigned i);
 
   MapLayer const&
   layer(unsigned i) const;
 
+  /**
+   * The cells of the whole map.
+   * @throws std::logic_error if the map is lazy.
+   */
+  ChunkStore&
+  cells();
+
+  ChunkStore const&
+  cells() const;
+
+  /**
+   * Gets the cache index of the cell at given coordinates, building its
+   * region first if the map is lazy.
+   * @throws std::out_of_range if the coordinates are outside the map.
+   */
+  int
+  cell_index_at(unsigned x, unsigned y, unsigned z) const;
+
+  /**
+   * Sets the cache index of the cell at given coordinates, building its
+   * region first if the map is lazy.
+   * @throws std::out_of_range if the coordinates are outside the map.
+   */
+  void
+  set_cell_index_at(unsigned x, unsigned y, unsigned z, int index);
+
+  /**
+   * Copies the cache indexes of the @p nx by @p ny by @p nz box of cells
+   * starting at (@p x0, @p y0, @p z0) into @p out, x fastest then y then z.
+   * The box is checked once and its cells read a brick at a time, which is
+   * much faster than reading them one by one.
+   * @throws std::out_of_range if the box is not all inside the map.
+   */
+  void
+  box_at(unsigned x0, unsigned y0, unsigned z0,
+         unsigned nx, unsigned ny, unsigned nz,
+         int* out) const;
+
+  /**
+   * Copies the cache indexes of the column of cells at (@p x, @p y), bottom to
+   * top, into the height() elements at @p out.
+   * @throws std::out_of_range if the column is outside the map.
+   */
+  void
+  column_at(unsigned x, unsigned y, int* out) const;
+
+  /**
+   * Copies the cache indexes of the six face neighbours of the cell at
+   * (@p x, @p y, @p z) into @p out, in the order of neighbours6: below,
+   * north, west, east, south, above.  A neighbour outside the map is given as
+   * Map::outside.
+   * @throws std::out_of_range if the cell is outside the map.
+   */
+  void
+  neighbours6_at(unsigned x, unsigned y, unsigned z, int* out) const;
+
+  /**
+   * Copies the cache indexes of the 26 neighbours of the cell at
+   * (@p x, @p y, @p z) into @p out, in the order of neighbours26: x fastest
+   * then y then z, skipping the cell itself.  A neighbour outside the map is
+   * given as Map::outside.
+   * @throws std::out_of_range if the cell is outside the map.
+   */
+  void
+  neighbours26_at(unsigned x, unsigned y, unsigned z, int* out) const;
+
+  /**
+   * Gets the cell at given coordinates from the @p cache the map's cells are
+   * held in.
+   * @throws std::out_of_range if the coordinates are outside the map or the
+   *         position's index is not in the cache.
+   */
+  Cell
+  cell_at(unsigned x, unsigned y, unsigned z, CellCache const& cache) const;
+
+  /**
+   * Changes the cell at given coordinates to one with the contents of
+   * @p cell.
+   *
+   * The position gets a reference to the cache's cell with those contents,
+   * which is shared with every other position holding the same, and drops its
+   * reference to the old cell, which is left as it is for the positions still
+   * using it.  The map's cells must have been referenced in the @p cache
+   * through CellCache::add_refs().
+   * @throws std::out_of_range if the coordinates are outside the map or the
+   *         position's index is not in the cache.
+   */
+  void
+  set_cell_at(unsigned x, unsigned y, unsigned z, Cell const& cell, CellCache& cache);
+
+  /**
+   * Gets the surface height of the column at (@p x, @p y): one more than the z
+   * of its topmost non-empty (non-zero) cell, or 0 if it has none.  A lazy
+   * map probes the column.
+   * @throws std::out_of_range if the column is outside the map.
+   */
+  unsigned
+  surface_height(unsigned x, unsigned y) const;
+
+  /**
+   * Copies the surface heights of the @p nx by @p ny columns starting at
+   * (@p x0, @p y0) into @p out, y-major.
+   * @throws std::out_of_range if the columns are not all inside the map.
+   */
+  void
+  surface_heights(unsigned x0, unsigned y0, unsigned nx, unsigned ny, unsigned* out) const;
+
+  /**
+   * A 64-bit hash of the extents and cells of the map, which can be used as a
+   * cache key for generated maps.  Only bricks changed since the last hash are
+   * hashed again.
+   * @throws std::logic_error if the map is lazy.
+   */
+  std::uint64_t
+  content_hash() const;
+
+  /**
+   * The number of bricks of the map changed since it was last marked clean.
+   * @throws std::logic_error if the map is lazy.
+   */
+  std::size_t
+  dirty_bricks() const;
+
+  /**
+   * Marks every brick of the map clean, as after a full save.
+   * @throws std::logic_error if the map is lazy.
+   */
+  void
+  clear_dirty();
+
+  /** The number of regions of a lazy map held in memory. */
+  std::size_t
+  resident_regions() const;
+
+private:
+  class RegionCache;
+
+  void
+  update_surface(unsigned x, unsigned y, unsigned z, int index);
+
+  void
+  find_surface() const;
+
+  unsigned
+  probe_surface(unsigned x, unsigned y) const;
+
 private:
-  unsigned     length_;
-  unsigned     width_;
-  unsigned     height_;
-  MapLayerBag  layers_;
+  unsigned                      length_;
+  unsigned                      width_;
+  unsigned                      height_;
+  std::unique_ptr<ChunkStore>   cells_;
+  MapLayerBag                   layers_;
+  std::unique_ptr<RegionCache>  regions_;
+  mutable std::vector<unsigned> surface_;
+  mutable bool                  surface_found_;
 };
 
 
@@ -0,0 +1,705 @@
+/**
+ * @file legacy/world/mapbuilderbinary.cpp
+ * @brief A builder of maps from binary save files.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/world/mapbuilderbinary.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include "legacy/core/crc32.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+static_assert(sizeof(int) == sizeof(std::uint32_t), "cells are saved as 32-bit values");
+
+using Words = std::vector<std::uint32_t>;
+using ChunkStore = Legacy::World::ChunkStore;
+
+
+bool
+host_is_little_endian()
+{
+  std::uint32_t const one = 1;
+  unsigned char first;
+  std::memcpy(&first, &one, 1);
+  return first == 1;
+}
+
+
+/**
+ * Converts words between host and little-endian byte order.  Block payloads
+ * are built and decoded as arrays of host words, so this is the only place the
+ * byte order of the file matters.
+ */
+void
+swap_to_little_endian(std::uint32_t* words, std::size_t count)
+{
+  if (host_is_little_endian())
+    return;
+  for (std::size_t i = 0; i < count; ++i)
+  {
+    std::uint32_t w = words[i];
+    words[i] = (w >> 24) | ((w >> 8) & 0xff00u) | ((w << 8) & 0xff0000u) | (w << 24);
+  }
+}
+
+
+void
+put_u32(unsigned char* out, std::uint32_t value)
+{
+  out[0] = value & 0xff;
+  out[1] = (value >> 8) & 0xff;
+  out[2] = (value >> 16) & 0xff;
+  out[3] = (value >> 24) & 0xff;
+}
+
+
+std::uint32_t
+get_u32(unsigned char const* in)
+{
+  return std::uint32_t(in[0])
+       | std::uint32_t(in[1]) << 8
+       | std::uint32_t(in[2]) << 16
+       | std::uint32_t(in[3]) << 24;
+}
+
+
+/** The number of bricks along each horizontal axis and the vertical axis. */
+struct BrickGrid
+{
+  std::size_t x;
+  std::size_t y;
+  std::size_t z;
+
+  BrickGrid(unsigned length, unsigned width, unsigned height)
+  : x((length + ChunkStore::brick_size - 1) / ChunkStore::brick_size)
+  , y((width + ChunkStore::brick_size - 1) / ChunkStore::brick_size)
+  , z((height + ChunkStore::brick_size - 1) / ChunkStore::brick_size)
+  { }
+};
+
+
+/** Checks a binary save header and gets the map extents from it. */
+void
+read_header(unsigned char const* header,
+            unsigned& length, unsigned& width, unsigned& height, std::uint32_t& block_count)
+{
+  using namespace Legacy::World;
+  if (std::memcmp(header, BinaryMap::magic, sizeof(BinaryMap::magic)) != 0)
+    throw std::runtime_error("error reading map: not a binary map");
+  if (get_u32(header + 36) != Legacy::Core::crc32(header, 36))
+    throw std::runtime_error("error reading map: header checksum mismatch");
+  if (get_u32(header + 8) != BinaryMap::version)
+    throw std::runtime_error("error reading map: unsupported binary map version");
+
+  length      = get_u32(header + 12);
+  width       = get_u32(header + 16);
+  height      = get_u32(header + 20);
+  block_count = get_u32(header + 32);
+  if (get_u32(header + 24) != ChunkStore::brick_size
+      || get_u32(header + 28) != std::min(height, ChunkStore::brick_size)
+      || block_count != BrickGrid(length, width, height).z)
+    throw std::runtime_error("error reading map: unsupported brick layout");
+}
+
+
+/** The sizes and checksums of a block, in words. */
+struct BlockHeader
+{
+  std::size_t   table_words;
+  std::uint32_t table_crc;
+  std::uint64_t data_words;
+  std::uint32_t data_crc;
+};
+
+
+/**
+ * Checks the header of a block of @p brick_count bricks of @p cells, tagged
+ * @p tag and numbered @p index, and gets the sizes of its table and data,
+ * which are limited to what valid bricks could need.  Each brick has
+ * @p brick_words words in the table besides its palette.
+ */
+BlockHeader
+read_block_header(unsigned char const* block_header, char const* tag, std::uint32_t index,
+                  std::size_t brick_count, std::size_t brick_words, ChunkStore const& cells)
+{
+  if (std::memcmp(block_header, tag, 4) != 0
+      || get_u32(block_header + 4) != index
+      || get_u32(block_header + 8) != brick_count)
+    throw std::runtime_error("error reading map: bad block header");
+
+  std::uint32_t table_size = get_u32(block_header + 12);
+  std::uint64_t data_size = get_u32(block_header + 24)
+                          | std::uint64_t(get_u32(block_header + 28)) << 32;
+  std::uint64_t max_table_words = std::uint64_t(brick_count) * (brick_words + 256);
+  std::uint64_t max_data_words = std::uint64_t(brick_count)
+                               * std::max(cells.brick_cells(), cells.packed_words(8));
+  if (table_size % sizeof(std::uint32_t) != 0 || data_size % sizeof(std::uint32_t) != 0
+      || table_size / sizeof(std::uint32_t) < brick_count * brick_words
+      || table_size / sizeof(std::uint32_t) > max_table_words
+      || data_size / sizeof(std::uint32_t) > max_data_words)
+    throw std::runtime_error("error reading map: bad block size");
+
+  return BlockHeader{ table_size / sizeof(std::uint32_t), get_u32(block_header + 16),
+                      data_size / sizeof(std::uint32_t), get_u32(block_header + 20) };
+}
+
+
+/**
+ * Checks the header of layer block @p bz of a save of @p cells and gets the
+ * sizes of its table and data.
+ */
+BlockHeader
+read_block_header(unsigned char const* block_header, std::uint32_t bz, ChunkStore const& cells)
+{
+  BrickGrid bricks(cells.length(), cells.width(), cells.height());
+  return read_block_header(block_header, Legacy::World::BinaryMap::block_tag, bz,
+                           bricks.x * bricks.y, 4, cells);
+}
+
+
+/**
+ * Swaps a block's table and data to little-endian order and writes them after
+ * a block header with their sizes and checksums.
+ */
+void
+write_block(std::ostream& ostr, char const* tag, std::uint32_t index, std::size_t brick_count,
+            Words& table, Words& data)
+{
+  if (data.size() > 0xffffffffu)
+    throw std::runtime_error("error writing map: block too large for the binary format");
+  swap_to_little_endian(table.data(), table.size());
+  swap_to_little_endian(data.data(), data.size());
+  std::size_t table_size = table.size() * sizeof(std::uint32_t);
+  std::uint64_t data_size = data.size() * sizeof(std::uint32_t);
+
+  unsigned char block_header[Legacy::World::BinaryMap::block_header_size];
+  std::memcpy(block_header, tag, 4);
+  put_u32(block_header +  4, index);
+  put_u32(block_header +  8, brick_count);
+  put_u32(block_header + 12, table_size);
+  put_u32(block_header + 16, Legacy::Core::crc32(table.data(), table_size));
+  put_u32(block_header + 20, Legacy::Core::crc32(data.data(), data_size));
+  put_u32(block_header + 24, data_size & 0xffffffffu);
+  put_u32(block_header + 28, data_size >> 32);
+  ostr.write(reinterpret_cast<char const*>(block_header), sizeof(block_header));
+  ostr.write(reinterpret_cast<char const*>(table.data()), table_size);
+  ostr.write(reinterpret_cast<char const*>(data.data()), data_size);
+}
+
+
+/**
+ * Reads a block's table and data following its header, checks them against
+ * their checksums and swaps them to host order.
+ */
+void
+read_block(std::istream& istr, BlockHeader const& block, Words& table, Words& data)
+{
+  table.resize(block.table_words);
+  data.resize(block.data_words);
+  istr.read(reinterpret_cast<char*>(table.data()), table.size() * sizeof(std::uint32_t));
+  istr.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(std::uint32_t));
+  if (!istr)
+    throw std::runtime_error("error reading map: truncated block");
+  if (block.table_crc != Legacy::Core::crc32(table.data(), table.size() * sizeof(std::uint32_t))
+      || block.data_crc != Legacy::Core::crc32(data.data(), data.size() * sizeof(std::uint32_t)))
+    throw std::runtime_error("error reading map: block checksum mismatch");
+  swap_to_little_endian(table.data(), table.size());
+  swap_to_little_endian(data.data(), data.size());
+}
+
+
+/**
+ * Fills in the four-word table entry at word @p at of a block for brick @p i
+ * and appends its palette and data.
+ */
+void
+encode_brick(ChunkStore const& cells, std::size_t i, std::size_t at, Words& table, Words& data)
+{
+  ChunkStore::EncodedBrick brick = cells.encoded_brick(i);
+  std::uint32_t* entry = &table[at];
+  entry[0] = std::uint32_t(brick.mode) | std::uint32_t(brick.bits) << 8;
+  switch (brick.mode)
+  {
+    case ChunkStore::BrickMode::uniform:
+      entry[1] = std::uint32_t(brick.value);
+      break;
+
+    case ChunkStore::BrickMode::palette:
+    {
+      std::size_t palette_at = table.size();
+      table.resize(palette_at + (std::size_t(1) << brick.bits), std::uint32_t(brick.palette[brick.palette_size - 1]));
+      entry = &table[at];
+      entry[1] = brick.palette_size;
+      entry[2] = palette_at;
+      entry[3] = data.size();
+      std::memcpy(&table[palette_at], brick.palette, brick.palette_size * sizeof(std::uint32_t));
+      data.insert(data.end(), brick.packed, brick.packed + cells.packed_words(brick.bits));
+      break;
+    }
+
+    case ChunkStore::BrickMode::dense:
+    {
+      entry[3] = data.size();
+      std::size_t cells_at = data.size();
+      data.resize(cells_at + cells.brick_cells());
+      std::memcpy(&data[cells_at], brick.cells, cells.brick_cells() * sizeof(std::uint32_t));
+      break;
+    }
+  }
+}
+
+
+/**
+ * Gets the stored form of the brick with its table entry at word @p at of a
+ * block from the block's table and data, checking everything it refers to
+ * lies within them.
+ */
+ChunkStore::EncodedBrick
+decode_brick(ChunkStore const& cells, std::size_t at,
+             std::uint32_t const* table, std::size_t table_words,
+             std::uint32_t const* data, std::uint64_t data_words)
+{
+  std::uint32_t const* entry = table + at;
+  ChunkStore::EncodedBrick brick{};
+  if ((entry[0] & 0xff) > std::uint32_t(ChunkStore::BrickMode::dense) || (entry[0] >> 16) != 0)
+    throw std::runtime_error("error reading map: bad brick record");
+  brick.mode = ChunkStore::BrickMode(entry[0] & 0xff);
+  brick.bits = (entry[0] >> 8) & 0xff;
+
+  switch (brick.mode)
+  {
+    case ChunkStore::BrickMode::uniform:
+      brick.value = int(entry[1]);
+      break;
+
+    case ChunkStore::BrickMode::palette:
+    {
+      brick.palette_size = entry[1];
+      if (brick.bits > 8 || brick.palette_size > (std::size_t(1) << brick.bits)
+          || std::uint64_t(entry[2]) + (std::size_t(1) << brick.bits) > table_words
+          || std::uint64_t(entry[3]) + cells.packed_words(brick.bits) > data_words)
+        throw std::runtime_error("error reading map: bad brick palette");
+      brick.palette = reinterpret_cast<int const*>(table + entry[2]);
+      brick.packed = data + entry[3];
+      break;
+    }
+
+    case ChunkStore::BrickMode::dense:
+      if (std::uint64_t(entry[3]) + cells.brick_cells() > data_words)
+        throw std::runtime_error("error reading map: brick record overruns its block");
+      brick.cells = reinterpret_cast<int const*>(data + entry[3]);
+      break;
+  }
+  return brick;
+}
+
+} // anonymous namespace
+
+
+void Legacy::World::
+write_binary(std::ostream& ostr, ChunkStore const& cells)
+{
+  BrickGrid bricks(cells.length(), cells.width(), cells.height());
+  std::size_t brick_count = bricks.x * bricks.y;
+
+  unsigned char header[BinaryMap::header_size];
+  std::memcpy(header, BinaryMap::magic, sizeof(BinaryMap::magic));
+  put_u32(header +  8, BinaryMap::version);
+  put_u32(header + 12, cells.length());
+  put_u32(header + 16, cells.width());
+  put_u32(header + 20, cells.height());
+  put_u32(header + 24, ChunkStore::brick_size);
+  put_u32(header + 28, cells.brick_depth());
+  put_u32(header + 32, bricks.z);
+  put_u32(header + 36, Legacy::Core::crc32(header, 36));
+  ostr.write(reinterpret_cast<char const*>(header), sizeof(header));
+
+  // Each block is built in memory, checksummed and written before the next is
+  // started, so only one layer of bricks is ever held in encoded form.
+  Words table;
+  Words data;
+  for (std::size_t bz = 0; bz < bricks.z; ++bz)
+  {
+    table.assign(brick_count * 4, 0);
+    data.clear();
+    std::size_t j = 0;
+    for (std::size_t by = 0; by < bricks.y; ++by)
+    {
+      for (std::size_t bx = 0; bx < bricks.x; ++bx)
+      {
+        encode_brick(cells, (by * bricks.x + bx) * bricks.z + bz, 4 * j++, table, data);
+      }
+    }
+    write_block(ostr, BinaryMap::block_tag, bz, brick_count, table, data);
+  }
+
+  if (!ostr)
+    throw std::runtime_error("error writing map");
+}
+
+
+void Legacy::World::
+write_binary(std::ostream& ostr, Map const& map)
+{
+  write_binary(ostr, map.cells());
+}
+
+
+Legacy::World::MapBuilderBinary::
+MapBuilderBinary(std::istream& istr)
+: istr_(istr)
+, length_(0), width_(0), height_(0)
+, block_count_(0)
+{
+  unsigned char header[BinaryMap::header_size];
+  istr_.read(reinterpret_cast<char*>(header), sizeof(header));
+  if (!istr_)
+    throw std::runtime_error("error reading map: expected a binary map header");
+  read_header(header, length_, width_, height_, block_count_);
+}
+
+
+Legacy::World::MapBuilderBinary::
+~MapBuilderBinary()
+{ }
+
+
+unsigned Legacy::World::MapBuilderBinary::
+map_length()
+{
+  return length_;
+}
+
+
+unsigned Legacy::World::MapBuilderBinary::
+map_width()
+{
+  return width_;
+}
+
+
+unsigned Legacy::World::MapBuilderBinary::
+map_height()
+{
+  return height_;
+}
+
+
+Legacy::World::MapLayerBag Legacy::World::MapBuilderBinary::
+layers()
+{ return layers_from_cells(); }
+
+
+void Legacy::World::MapBuilderBinary::
+build_cells(ChunkStore& cells)
+{
+  BrickGrid bricks(length_, width_, height_);
+
+  Words table;
+  Words data;
+  for (std::uint32_t bz = 0; bz < block_count_; ++bz)
+  {
+    unsigned char block_header[BinaryMap::block_header_size];
+    istr_.read(reinterpret_cast<char*>(block_header), sizeof(block_header));
+    if (!istr_)
+      throw std::runtime_error("error reading map: expected a layer block");
+    BlockHeader block = read_block_header(block_header, bz, cells);
+    read_block(istr_, block, table, data);
+
+    std::size_t j = 0;
+    for (std::size_t by = 0; by < bricks.y; ++by)
+    {
+      for (std::size_t bx = 0; bx < bricks.x; ++bx)
+      {
+        ChunkStore::EncodedBrick brick = decode_brick(cells, 4 * j++, table.data(), table.size(),
+                                                      data.data(), data.size());
+        try
+        {
+          cells.set_encoded_brick((by * bricks.x + bx) * bricks.z + bz, brick);
+        }
+        catch (std::invalid_argument const& ex)
+        {
+          throw std::runtime_error(std::string("error reading map: ") + ex.what());
+        }
+      }
+    }
+  }
+  cells.clear_dirty();
+}
+
+
+Legacy::World::MapBuilderMapped::
+MapBuilderMapped(Core::MappedFileOwningPtr mapping, bool check_data)
+: mapping_(std::move(mapping))
+, check_data_(check_data)
+, length_(0), width_(0), height_(0)
+, block_count_(0)
+{
+  if (!mapping_)
+    throw std::runtime_error("error reading map: no mapped map file");
+  if (!host_is_little_endian())
+    throw std::runtime_error("error reading map: binary maps can only be mapped on little-endian hosts");
+  if (mapping_->size() < BinaryMap::header_size)
+    throw std::runtime_error("error reading map: expected a binary map header");
+  read_header(reinterpret_cast<unsigned char const*>(mapping_->data()),
+              length_, width_, height_, block_count_);
+}
+
+
+Legacy::World::MapBuilderMapped::
+~MapBuilderMapped()
+{ }
+
+
+unsigned Legacy::World::MapBuilderMapped::
+map_length()
+{
+  return length_;
+}
+
+
+unsigned Legacy::World::MapBuilderMapped::
+map_width()
+{
+  return width_;
+}
+
+
+unsigned Legacy::World::MapBuilderMapped::
+map_height()
+{
+  return height_;
+}
+
+
+Legacy::World::MapLayerBag Legacy::World::MapBuilderMapped::
+layers()
+{ return layers_from_cells(); }
+
+
+void Legacy::World::MapBuilderMapped::
+build_cells(ChunkStore& cells)
+{
+  BrickGrid bricks(length_, width_, height_);
+  char const* file = mapping_->data();
+  std::uint64_t file_size = mapping_->size();
+
+  std::uint64_t offset = BinaryMap::header_size;
+  for (std::uint32_t bz = 0; bz < block_count_; ++bz)
+  {
+    if (file_size - offset < BinaryMap::block_header_size)
+      throw std::runtime_error("error reading map: expected a layer block");
+    BlockHeader block = read_block_header(reinterpret_cast<unsigned char const*>(file + offset), bz, cells);
+    offset += BinaryMap::block_header_size;
+    std::uint64_t table_size = block.table_words * sizeof(std::uint32_t);
+    std::uint64_t data_size = block.data_words * sizeof(std::uint32_t);
+    if (file_size - offset < table_size || file_size - offset - table_size < data_size)
+      throw std::runtime_error("error reading map: truncated block");
+
+    // Every header, table and array is a whole number of words from the
+    // start of the mapping, which is page aligned.
+    auto table = reinterpret_cast<std::uint32_t const*>(file + offset);
+    auto data = reinterpret_cast<std::uint32_t const*>(file + offset + table_size);
+    offset += table_size + data_size;
+    if (block.table_crc != Legacy::Core::crc32(table, table_size))
+      throw std::runtime_error("error reading map: block checksum mismatch");
+    if (check_data_ && block.data_crc != Legacy::Core::crc32(data, data_size))
+      throw std::runtime_error("error reading map: block checksum mismatch");
+
+    std::size_t j = 0;
+    for (std::size_t by = 0; by < bricks.y; ++by)
+    {
+      for (std::size_t bx = 0; bx < bricks.x; ++bx)
+      {
+        ChunkStore::EncodedBrick brick = decode_brick(cells, 4 * j++, table, block.table_words,
+                                                      data, block.data_words);
+        try
+        {
+          cells.borrow_encoded_brick((by * bricks.x + bx) * bricks.z + bz, brick);
+        }
+        catch (std::invalid_argument const& ex)
+        {
+          throw std::runtime_error(std::string("error reading map: ") + ex.what());
+        }
+      }
+    }
+  }
+  cells.hold_storage(mapping_);
+  cells.clear_dirty();
+}
+
+
+void Legacy::World::
+write_binary_delta(std::ostream& ostr, ChunkStore const& cells)
+{
+  std::vector<std::uint32_t> dirty;
+  for (std::size_t i = 0; i < cells.brick_count(); ++i)
+  {
+    if (cells.brick_dirty(i))
+      dirty.push_back(i);
+  }
+
+  unsigned char header[BinaryMap::header_size];
+  std::memcpy(header, BinaryMap::delta_magic, sizeof(BinaryMap::delta_magic));
+  put_u32(header +  8, BinaryMap::delta_version);
+  put_u32(header + 12, cells.length());
+  put_u32(header + 16, cells.width());
+  put_u32(header + 20, cells.height());
+  put_u32(header + 24, ChunkStore::brick_size);
+  put_u32(header + 28, cells.brick_depth());
+  put_u32(header + 32, dirty.size());
+  put_u32(header + 36, Legacy::Core::crc32(header, 36));
+  ostr.write(reinterpret_cast<char const*>(header), sizeof(header));
+
+  // The table starts with the index of each brick, followed by their entries.
+  Words table(dirty.size() * 5, 0);
+  Words data;
+  std::copy(dirty.begin(), dirty.end(), table.begin());
+  for (std::size_t j = 0; j < dirty.size(); ++j)
+  {
+    encode_brick(cells, dirty[j], dirty.size() + 4 * j, table, data);
+  }
+  write_block(ostr, BinaryMap::delta_tag, 0, dirty.size(), table, data);
+
+  if (!ostr)
+    throw std::runtime_error("error writing map");
+}
+
+
+void Legacy::World::
+write_binary_delta(std::ostream& ostr, Map const& map)
+{
+  write_binary_delta(ostr, map.cells());
+}
+
+
+void Legacy::World::
+apply_binary_delta(std::istream& istr, ChunkStore& cells)
+{
+  unsigned char header[BinaryMap::header_size];
+  istr.read(reinterpret_cast<char*>(header), sizeof(header));
+  if (!istr)
+    throw std::runtime_error("error reading map: expected a binary map delta header");
+  if (std::memcmp(header, BinaryMap::delta_magic, sizeof(BinaryMap::delta_magic)) != 0)
+    throw std::runtime_error("error reading map: not a binary map delta");
+  if (get_u32(header + 36) != Legacy::Core::crc32(header, 36))
+    throw std::runtime_error("error reading map: header checksum mismatch");
+  if (get_u32(header + 8) != BinaryMap::delta_version)
+    throw std::runtime_error("error reading map: unsupported binary map delta version");
+  if (get_u32(header + 12) != cells.length()
+      || get_u32(header + 16) != cells.width()
+      || get_u32(header + 20) != cells.height()
+      || get_u32(header + 24) != ChunkStore::brick_size
+      || get_u32(header + 28) != cells.brick_depth())
+    throw std::runtime_error("error reading map: delta does not match the map");
+  std::size_t brick_count = get_u32(header + 32);
+  if (brick_count > cells.brick_count())
+    throw std::runtime_error("error reading map: bad delta brick count");
+
+  unsigned char block_header[BinaryMap::block_header_size];
+  istr.read(reinterpret_cast<char*>(block_header), sizeof(block_header));
+  if (!istr)
+    throw std::runtime_error("error reading map: expected a delta block");
+  BlockHeader block = read_block_header(block_header, BinaryMap::delta_tag, 0, brick_count, 5, cells);
+  Words table;
+  Words data;
+  read_block(istr, block, table, data);
+
+  // Every brick is checked before any is replaced, so a damaged delta leaves
+  // the cells as they were.
+  std::vector<ChunkStore::EncodedBrick> bricks;
+  bricks.reserve(brick_count);
+  for (std::size_t j = 0; j < brick_count; ++j)
+  {
+    if (table[j] >= cells.brick_count())
+      throw std::runtime_error("error reading map: delta brick index out of range");
+    bricks.push_back(decode_brick(cells, brick_count + 4 * j, table.data(), table.size(),
+                                  data.data(), data.size()));
+  }
+  ChunkStore checked(ChunkStore::brick_size, ChunkStore::brick_size, cells.brick_depth());
+  for (auto const& brick: bricks)
+  {
+    try
+    {
+      checked.set_encoded_brick(0, brick);
+    }
+    catch (std::invalid_argument const& ex)
+    {
+      throw std::runtime_error(std::string("error reading map: ") + ex.what());
+    }
+  }
+  for (std::size_t j = 0; j < brick_count; ++j)
+  {
+    cells.set_encoded_brick(table[j], bricks[j]);
+  }
+}
+
+
+Legacy::World::MapBuilderDelta::
+MapBuilderDelta(MapBuilder& base, std::istream& delta)
+: base_(base)
+, delta_(delta)
+{ }
+
+
+Legacy::World::MapBuilderDelta::
+~MapBuilderDelta()
+{ }
+
+
+unsigned Legacy::World::MapBuilderDelta::
+map_length()
+{
+  return base_.map_length();
+}
+
+
+unsigned Legacy::World::MapBuilderDelta::
+map_width()
+{
+  return base_.map_width();
+}
+
+
+unsigned Legacy::World::MapBuilderDelta::
+map_height()
+{
+  return base_.map_height();
+}
+
+
+Legacy::World::MapLayerBag Legacy::World::MapBuilderDelta::
+layers()
+{ return layers_from_cells(); }
+
+
+void Legacy::World::MapBuilderDelta::
+build_cells(ChunkStore& cells)
+{
+  base_.build_cells(cells);
+  cells.clear_dirty();
+  apply_binary_delta(delta_, cells);
+}
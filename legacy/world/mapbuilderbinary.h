@@ -0,0 +1,269 @@
+/**
+ * @file legacy/world/mapbuilderbinary.h
+ * @brief Builders of maps from binary save files.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_WORLD_MAPBUILDERBINARY_H_
+#define LEGACY_WORLD_MAPBUILDERBINARY_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include "legacy/core/filesystem.h"
+#include "legacy/world/map.h"
+#include <memory>
+
+
+namespace Legacy {
+namespace World {
+
+/**
+ * The binary map save format.
+ *
+ * A binary save is a fixed-size header followed by one block for each layer of
+ * bricks (the bricks sharing a range of brick_depth() map layers), bottom to
+ * top.  Bricks are saved in their stored form, so uniform and palette bricks
+ * take a fraction of the space of their cells.  All values are little-endian
+ * and every table and array starts on a 4-byte boundary, so a mapped save can
+ * be used in place.
+ *
+ * The header holds the magic "LGCYMAPB" then 32-bit values: the format
+ * version, the map length, width and height, the brick size and depth, the
+ * number of blocks and the CRC-32 of the preceding 36 bytes.
+ *
+ * Each block starts with the tag "LAYR" then 32-bit values: the block index,
+ * the number of bricks, the size and CRC-32 of the brick table and the CRC-32
+ * and 64-bit size of the brick data.
+ *
+ * The brick table has four words for each brick in the block, in order of
+ * increasing y then x: the storage mode in the low byte and the palette width
+ * in the next, the uniform value or palette size, the word offset of the
+ * palette within the table and the word offset of the packed entries or dense
+ * cells within the data.  The palettes follow, each padded with copies of its
+ * last value to 2^bits entries so no packed entry can index past it.  Loading
+ * a map needs only the headers and tables; the data holds everything else.
+ *
+ * A delta save holds only the bricks changed since a full save, to be applied
+ * on top of it.  Its header is laid out as a full save's but starts with the
+ * magic "LGCYMAPD" and has the number of bricks in place of the number of
+ * blocks.  A single block tagged "DLTA" follows, whose table starts with the
+ * store index of each brick before their four-word entries.
+ */
+namespace BinaryMap {
+
+  constexpr char          magic[8]          = { 'L', 'G', 'C', 'Y', 'M', 'A', 'P', 'B' };
+  constexpr char          block_tag[4]      = { 'L', 'A', 'Y', 'R' };
+  constexpr std::uint32_t version           = 2;
+  constexpr std::size_t   header_size       = 40;
+  constexpr std::size_t   block_header_size = 32;
+
+  constexpr char          delta_magic[8]    = { 'L', 'G', 'C', 'Y', 'M', 'A', 'P', 'D' };
+  constexpr char          delta_tag[4]      = { 'D', 'L', 'T', 'A' };
+  constexpr std::uint32_t delta_version     = 1;
+
+} // namespace BinaryMap
+
+
+/**
+ * Writes the cells of a store in the binary map save format.
+ * @throws std::runtime_error if the stream can not be written.
+ */
+void
+write_binary(std::ostream& ostr, ChunkStore const& cells);
+
+/**
+ * Writes a map in the binary map save format.
+ * @throws std::runtime_error if the stream can not be written.
+ */
+void
+write_binary(std::ostream& ostr, Map const& map);
+
+/**
+ * Writes the bricks of a store changed since it was last marked clean as a
+ * delta save.  The store is not marked clean, so each delta holds every change
+ * since the full save it applies to.
+ * @throws std::runtime_error if the stream can not be written.
+ */
+void
+write_binary_delta(std::ostream& ostr, ChunkStore const& cells);
+
+/**
+ * Writes the bricks of a map changed since it was last marked clean as a
+ * delta save.
+ * @throws std::logic_error if the map is lazy.
+ * @throws std::runtime_error if the stream can not be written.
+ */
+void
+write_binary_delta(std::ostream& ostr, Map const& map);
+
+/**
+ * Replaces bricks of @p cells with those of a delta save, marking them dirty.
+ * Nothing is replaced unless the whole delta is read and checked.
+ * @throws std::runtime_error if the delta is missing, truncated, damaged or
+ *         for a map of different extents.
+ */
+void
+apply_binary_delta(std::istream& istr, ChunkStore& cells);
+
+
+/**
+ * Builds a map from a binary save, reading one block at a time.
+ */
+class MapBuilderBinary
+: public MapBuilder
+{
+public:
+  /**
+   * Reads and checks the header of a binary save.
+   * @throws std::runtime_error if the header is missing, damaged or of an
+   *         unsupported version.
+   */
+  MapBuilderBinary(std::istream& istr);
+
+  ~MapBuilderBinary();
+
+  unsigned
+  map_length() override;
+
+  unsigned
+  map_width() override;
+
+  unsigned
+  map_height() override;
+
+  Legacy::World::MapLayerBag
+  layers() override;
+
+  /**
+   * Reads the blocks of the save into @p cells.
+   * @throws std::runtime_error if a block is missing, truncated or damaged.
+   */
+  void
+  build_cells(ChunkStore& cells) override;
+
+private:
+  std::istream&  istr_;
+  unsigned       length_;
+  unsigned       width_;
+  unsigned       height_;
+  std::uint32_t  block_count_;
+};
+
+
+/**
+ * Builds a map from a binary save mapped into memory, without copying it.
+ *
+ * Only the headers and brick tables are read up front.  Palette and dense
+ * bricks are borrowed from the mapping, so their pages are read in only when
+ * the cells are used and are copied only when they are changed.  The maps
+ * built share the mapping, which is released when the builder and the last of
+ * them are gone.
+ */
+class MapBuilderMapped
+: public MapBuilder
+{
+public:
+  /**
+   * Takes ownership of a mapped binary save and checks its header.
+   * @param[in] mapping     The mapped save.
+   * @param[in] check_data  Also checks the brick data against its checksums
+   *                        when building, which reads the whole save.
+   * @throws std::runtime_error if there is no mapping or the header is missing,
+   *         damaged or of an unsupported version.
+   */
+  MapBuilderMapped(Core::MappedFileOwningPtr mapping, bool check_data = false);
+
+  ~MapBuilderMapped();
+
+  unsigned
+  map_length() override;
+
+  unsigned
+  map_width() override;
+
+  unsigned
+  map_height() override;
+
+  Legacy::World::MapLayerBag
+  layers() override;
+
+  /**
+   * Points the bricks of @p cells into the mapping.
+   * @throws std::runtime_error if a block or brick table is missing, truncated
+   *         or damaged.
+   */
+  void
+  build_cells(ChunkStore& cells) override;
+
+private:
+  std::shared_ptr<Core::MappedFile const> mapping_;
+  bool                                    check_data_;
+  unsigned                                length_;
+  unsigned                                width_;
+  unsigned                                height_;
+  std::uint32_t                           block_count_;
+};
+
+
+/**
+ * Builds a map from another builder, usually of a full save, and a delta save
+ * applied on top.
+ *
+ * The map's cells are marked clean as built by the base builder, so the bricks
+ * of the delta are dirty and the next delta saved holds them as well as any
+ * later changes.
+ */
+class MapBuilderDelta
+: public MapBuilder
+{
+public:
+  /** Both the @p base builder and the @p delta stream must outlive this one. */
+  MapBuilderDelta(MapBuilder& base, std::istream& delta);
+
+  ~MapBuilderDelta();
+
+  unsigned
+  map_length() override;
+
+  unsigned
+  map_width() override;
+
+  unsigned
+  map_height() override;
+
+  Legacy::World::MapLayerBag
+  layers() override;
+
+  /**
+   * Builds the cells with the base builder and applies the delta.
+   * @throws std::runtime_error if the delta can not be read or does not match
+   *         the map.
+   */
+  void
+  build_cells(ChunkStore& cells) override;
+
+private:
+  MapBuilder&   base_;
+  std::istream& delta_;
+};
+
+} // namespace World
+} // namespace Legacy
+
+#endif // LEGACY_WORLD_MAPBUILDERBINARY_H_
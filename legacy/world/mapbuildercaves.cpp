@@ -0,0 +1,114 @@
+/**
+ * @file legacy/world/mapbuildercaves.cpp
+ * @brief Implementation of the cave map builder.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/world/mapbuildercaves.h"
+
+#include "legacy/core/random.h"
+#include "legacy/world/mapstages.h"
+#include <memory>
+
+
+namespace
+{
+
+/** The key of the seed derived from the map seed for the caves. */
+constexpr std::uint64_t cave_stream = 1;
+
+} // anonymous namespace
+
+
+Legacy::World::MapBuilderCaves::
+MapBuilderCaves(unsigned           length,
+                unsigned           width,
+                unsigned           height,
+                std::uint_fast32_t seed,
+                unsigned           step,
+                Core::ThreadPool&  pool)
+: pipeline_(pool)
+, builder_(length, width, height, pipeline_)
+{
+  pipeline_.add_stage(std::unique_ptr<MapStage>(new TerrainStage(seed)));
+  // The terrain keeps the map seed so it matches the simple builder's; the
+  // caves get a seed of their own derived from it.
+  Core::SplitSeed caves = Core::SplitSeed(seed).split(cave_stream);
+  pipeline_.add_stage(std::unique_ptr<MapStage>(new CaveStage(caves.seed32(), step)));
+}
+
+
+Legacy::World::MapBuilderCaves::
+~MapBuilderCaves()
+{ }
+
+
+unsigned Legacy::World::MapBuilderCaves::
+map_length()
+{
+  return builder_.map_length();
+}
+
+
+unsigned Legacy::World::MapBuilderCaves::
+map_width()
+{
+  return builder_.map_width();
+}
+
+
+unsigned Legacy::World::MapBuilderCaves::
+map_height()
+{
+  return builder_.map_height();
+}
+
+
+Legacy::World::MapLayerBag Legacy::World::MapBuilderCaves::
+layers()
+{
+  return builder_.layers();
+}
+
+
+void Legacy::World::MapBuilderCaves::
+build_cells(ChunkStore& cells)
+{
+  builder_.build_cells(cells);
+}
+
+
+bool Legacy::World::MapBuilderCaves::
+builds_regions()
+{
+  return true;
+}
+
+
+void Legacy::World::MapBuilderCaves::
+build_region(unsigned x0, unsigned y0, ChunkStore& cells)
+{
+  builder_.build_region(x0, y0, cells);
+}
+
+
+bool Legacy::World::MapBuilderCaves::
+surface_heights(unsigned* out)
+{
+  return builder_.surface_heights(out);
+}
@@ -0,0 +1,92 @@
+/**
+ * @file legacy/world/mapbuildercaves.h
+ * @brief A builder of maps with caves.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_WORLD_MAPBUILDERCAVES_H_
+#define LEGACY_WORLD_MAPBUILDERCAVES_H_
+
+#include <cstdint>
+#include "legacy/core/thread_pool.h"
+#include "legacy/world/mappipeline.h"
+
+
+namespace Legacy {
+namespace World {
+
+/**
+ * Builds a map of the simple builder's terrain with caves and overhangs carved
+ * out of it by a CaveStage, through a MapPipeline.  Like the simple builder it
+ * can build any region on its own, for a lazily built map.
+ */
+class MapBuilderCaves
+: public MapBuilder
+{
+public:
+  /**
+   * @param[in] step  The spacing of the cave noise lattice, in cells.
+   * @throws std::invalid_argument if the step is zero.
+   */
+  MapBuilderCaves(unsigned length,
+                  unsigned width,
+                  unsigned height,
+                  std::uint_fast32_t seed,
+                  unsigned step = 4,
+                  Legacy::Core::ThreadPool& pool = Legacy::Core::ThreadPool::default_pool());
+
+  ~MapBuilderCaves();
+
+  unsigned
+  map_length() override;
+
+  unsigned
+  map_width() override;
+
+  unsigned
+  map_height() override;
+
+  Legacy::World::MapLayerBag
+  layers() override;
+
+  void
+  build_cells(ChunkStore& cells) override;
+
+  bool
+  builds_regions() override;
+
+  void
+  build_region(unsigned x0, unsigned y0, ChunkStore& cells) override;
+
+  bool
+  surface_heights(unsigned* out) override;
+
+  /** The pipeline the map is built through, for its stage timings. */
+  MapPipeline const&
+  pipeline() const
+  { return pipeline_; }
+
+private:
+  MapPipeline        pipeline_;
+  MapBuilderPipeline builder_;
+};
+
+} // namespace World
+} // namespace Legacy
+
+#endif // LEGACY_WORLD_MAPBUILDERCAVES_H_
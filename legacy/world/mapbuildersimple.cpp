@@ -21,15 +21,22 @@
  */
 #include "legacy/world/mapbuildersimple.h"
 
+#include <algorithm>
 #include "FastNoise/FastNoise.h"
+#include <vector>
 
 
 Legacy::World::MapBuilderSimple::
-MapBuilderSimple(unsigned length, unsigned width, unsigned height, std::uint_fast32_t seed)
+MapBuilderSimple(unsigned           length,
+                 unsigned           width,
+                 unsigned           height,
+                 std::uint_fast32_t seed,
+                 Core::ThreadPool&  pool)
 : length_(length)
 , width_(width)
 , height_(height)
 , seed_(seed)
+, pool_(pool)
 { }
 
 
@@ -61,8 +68,50 @@ map_height()
 
 Legacy::World::MapLayerBag Legacy::World::MapBuilderSimple::
 layers()
+{ return layers_from_cells(); }
+
+
+void Legacy::World::MapBuilderSimple::
+build_cells(ChunkStore& cells)
+{
+  surface_.resize(std::size_t(cells.length()) * cells.width());
+  build_tiles(0, 0, cells, surface_.data());
+}
+
+
+bool Legacy::World::MapBuilderSimple::
+builds_regions()
+{
+  return true;
+}
+
+
+void Legacy::World::MapBuilderSimple::
+build_region(unsigned x0, unsigned y0, ChunkStore& cells)
+{
+  build_tiles(x0, y0, cells, nullptr);
+}
+
+
+bool Legacy::World::MapBuilderSimple::
+surface_heights(unsigned* out)
+{
+  if (surface_.empty())
+    return false;
+  std::copy(surface_.begin(), surface_.end(), out);
+  return true;
+}
+
+
+/**
+ * Builds the cells of a region, recording the surface height of each column
+ * in @p surface if there is one.
+ */
+void Legacy::World::MapBuilderSimple::
+build_tiles(unsigned x0, unsigned y0, ChunkStore& cells, unsigned* surface)
 {
-  // Set up a noise-based heightmap generator.
+  // Set up a noise-based heightmap generator.  Sampling only reads the
+  // generator's tables, so one generator serves every tile.
   FastNoise noise;
   noise.SetSeed(seed_);
   noise.SetNoiseType(FastNoise::GradientFractal);
@@ -70,19 +119,53 @@ layers()
   float base_height = map_height() / 2.0f;
   float surface_variance = map_height() / 4.0f;
 
-  Legacy::World::MapLayerBag layers(map_height(), Legacy::World::MapLayer(map_length(), map_width()));
-  for (unsigned y = 0; y < map_width(); ++y)
+  unsigned const brick_size = ChunkStore::brick_size;
+  unsigned const tiles_x = (cells.length() + brick_size - 1) / brick_size;
+  unsigned const tiles_y = (cells.width() + brick_size - 1) / brick_size;
+  unsigned const bricks_z = (cells.height() + brick_size - 1) / brick_size;
+
+  // Each tile is one column of bricks: sample the noise for all of its columns
+  // at once to find their surface heights, then build each brick whole and
+  // store it in its cheapest form.
+  pool_.parallel_for(std::size_t(tiles_x) * tiles_y, [&](std::size_t tile)
   {
-    for (unsigned x = 0; x < map_length(); ++x)
+    unsigned tx = (tile % tiles_x) * brick_size;
+    unsigned ty = (tile / tiles_x) * brick_size;
+    unsigned nx = std::min(brick_size, cells.length() - tx);
+    unsigned ny = std::min(brick_size, cells.width() - ty);
+
+    float samples[brick_size * brick_size];
+    noise.FillNoiseSet(samples, x0 + tx, y0 + ty, nx, ny);
+
+    unsigned heights[brick_size * brick_size] = { };
+    for (unsigned y = 0; y < ny; ++y)
     {
-      unsigned height = base_height + surface_variance * noise.GetNoise(x, y) + 1.0f;
-      for (unsigned h = 0; h < height; ++h)
+      for (unsigned x = 0; x < nx; ++x)
       {
-        layers[h].set_cell_index_at(x, y, 1);
+        unsigned height = base_height + surface_variance * samples[y * nx + x] + 1.0f;
+        heights[y * brick_size + x] = std::min(height, map_height());
       }
     }
-  }
+    if (surface)
+    {
+      for (unsigned y = 0; y < ny; ++y)
+        std::copy(heights + y * brick_size, heights + y * brick_size + nx,
+                  surface + std::size_t(ty + y) * cells.length() + tx);
+    }
 
-  return layers;
+    std::vector<int> brick(cells.brick_cells());
+    for (unsigned bz = 0; bz < bricks_z; ++bz)
+    {
+      unsigned z0 = bz * brick_size;
+      int* cell = brick.data();
+      for (unsigned z = 0; z < cells.brick_depth(); ++z)
+      {
+        for (unsigned i = 0; i < brick_size * brick_size; ++i)
+        {
+          *cell++ = (z0 + z < heights[i]) ? 1 : 0;
+        }
+      }
+      cells.store_brick(cells.brick_index_of(tx, ty, z0), brick.data());
+    }
+  });
 }
-
@@ -23,7 +23,9 @@
 #define LEGACY_WORLD_MAPBUILDERSIMPLE_H_
 
 #include <cstdint>
+#include "legacy/core/thread_pool.h"
 #include "legacy/world/map.h"
+#include <vector>
 
 
 namespace Legacy {
@@ -31,12 +33,23 @@ namespace World {
 
 /**
  * Builds a simple map.
+ *
+ * The terrain is generated one 16x16 column of bricks at a time, and the
+ * columns are spread over a thread pool.  Each column depends only on the seed
+ * and its position, so the map is the same whatever the number of threads, and
+ * any region of it can be built on its own for a lazily built map.  The
+ * surface height of every column is kept as the whole map is built, so the map
+ * does not have to find it again.
  */
 class MapBuilderSimple
 : public MapBuilder
 {
 public:
-  MapBuilderSimple(unsigned length, unsigned width, unsigned height, std::uint_fast32_t seed);
+  MapBuilderSimple(unsigned length,
+                   unsigned width,
+                   unsigned height,
+                   std::uint_fast32_t seed,
+                   Legacy::Core::ThreadPool& pool = Legacy::Core::ThreadPool::default_pool());
 
   ~MapBuilderSimple();
 
@@ -52,11 +65,28 @@ public:
   Legacy::World::MapLayerBag
   layers() override;
 
+  void
+  build_cells(ChunkStore& cells) override;
+
+  bool
+  builds_regions() override;
+
+  void
+  build_region(unsigned x0, unsigned y0, ChunkStore& cells) override;
+
+  bool
+  surface_heights(unsigned* out) override;
+
 private:
+  void
+  build_tiles(unsigned x0, unsigned y0, ChunkStore& cells, unsigned* surface);
+
   unsigned            length_;
   unsigned            width_;
   unsigned            height_;
   std::uint_fast32_t  seed_;
+  Core::ThreadPool&   pool_;
+  std::vector<unsigned> surface_;
 };
 
 } // namespace World
@@ -21,9 +21,13 @@
  */
 #include "legacy/world/mapbuilderstream.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <stdexcept>
+#include <vector>
 
 
 namespace {
@@ -68,6 +72,174 @@ struct confirm_input
   }
 };
 
+
+/**
+ * Reads the words and integers of a text map from large blocks of a stream's
+ * buffer rather than extracting them one at a time.  Bytes read ahead of the
+ * last word used are put back when the reader is done with, so the stream is
+ * left just after the map.
+ *
+ * A stream that can seek is read a block at a time and seeks back over the
+ * bytes not used.  One that can not, such as a pipe, is read no further than
+ * the bytes its buffer already holds and no more are asked for until they are
+ * used up, so the bytes not used are all still in its buffer to be put back.
+ * If they can not be put back the stream's failbit is set.
+ */
+class TextReader
+{
+public:
+  TextReader(std::istream& istr)
+  : istr_(istr)
+  , buffer_(block_size)
+  , next_(buffer_.data())
+  , end_(buffer_.data())
+  , at_eof_(false)
+  , seekable_(istr.rdbuf()->pubseekoff(0, std::ios::cur, std::ios::in) != std::streampos(std::streamoff(-1)))
+  { }
+
+  ~TextReader()
+  {
+    if (end_ == next_)
+      return;
+    std::streambuf* buf = istr_.rdbuf();
+    if (seekable_ && buf->pubseekoff(next_ - end_, std::ios::cur, std::ios::in) != std::streampos(std::streamoff(-1)))
+      return;
+    for (char const* p = end_; p != next_; )
+    {
+      if (buf->sputbackc(*--p) == std::char_traits<char>::eof())
+      {
+        istr_.setstate(std::ios::failbit);
+        return;
+      }
+    }
+  }
+
+  /** Skips whitespace and confirms @p word comes next. */
+  bool
+  expect(char const* word)
+  {
+    if (!skip_space())
+      return false;
+    std::size_t length = std::strlen(word);
+    if (!ensure(length) || std::memcmp(next_, word, length) != 0)
+      return false;
+    next_ += length;
+    return true;
+  }
+
+  /** Skips whitespace and reads a decimal integer that fits an int. */
+  bool
+  read_int(int& value)
+  {
+    if (!skip_space())
+      return false;
+    // Read on only while the number runs to the end of the bytes buffered.
+    while (number_end() == end_ && std::size_t(end_ - next_) < max_token && refill())
+      ;
+    char const* p = next_;
+    bool negative = (*p == '-');
+    if (*p == '-' || *p == '+')
+      ++p;
+    char const* digits = p;
+    long long magnitude = 0;
+    while (p != end_ && *p >= '0' && *p <= '9')
+    {
+      magnitude = magnitude * 10 + (*p - '0');
+      if (magnitude > limit)
+        return false;
+      ++p;
+    }
+    // As with extraction, the number ends at the first non-digit, which may
+    // start the next one: wide indexes are written with no space between
+    // them.  Running into the end of a full buffer means it is too long.
+    if (p == digits || (p == end_ && !at_eof_))
+      return false;
+    long long signed_value = negative ? -magnitude : magnitude;
+    if (signed_value > std::numeric_limits<int>::max())
+      return false;
+    value = static_cast<int>(signed_value);
+    next_ = p;
+    return true;
+  }
+
+private:
+  static constexpr std::size_t block_size = 1 << 16;
+  static constexpr std::size_t max_token  = 16;
+  static constexpr long long   limit = -static_cast<long long>(std::numeric_limits<int>::min());
+
+  static bool
+  is_space(char c)
+  { return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+  /** The end of the sign and digits starting at the next byte. */
+  char const*
+  number_end() const
+  {
+    char const* p = next_;
+    if (p != end_ && (*p == '-' || *p == '+'))
+      ++p;
+    while (p != end_ && *p >= '0' && *p <= '9')
+      ++p;
+    return p;
+  }
+
+  /** Skips whitespace, returning false if there is nothing after it. */
+  bool
+  skip_space()
+  {
+    while (true)
+    {
+      while (next_ != end_ && is_space(*next_))
+        ++next_;
+      if (next_ != end_ || !refill())
+        return next_ != end_;
+    }
+  }
+
+  /**
+   * Makes sure @p count bytes are buffered past the next one, or as many as
+   * are left in the stream, returning false only if there are fewer than
+   * one.
+   */
+  bool
+  ensure(std::size_t count)
+  {
+    while (std::size_t(end_ - next_) < count && refill())
+      ;
+    return next_ != end_;
+  }
+
+  /** Reads another block after the unused bytes, returning false at the end. */
+  bool
+  refill()
+  {
+    if (at_eof_)
+      return false;
+    std::size_t kept = end_ - next_;
+    std::memmove(buffer_.data(), next_, kept);
+    std::streambuf* buf = istr_.rdbuf();
+    std::streamsize wanted = buffer_.size() - kept;
+    if (!seekable_ && buf->sgetc() != std::char_traits<char>::eof())
+      wanted = std::min(wanted, std::max<std::streamsize>(buf->in_avail(), 1));
+    std::streamsize got = buf->sgetn(buffer_.data() + kept, wanted);
+    next_ = buffer_.data();
+    end_ = next_ + kept + std::max<std::streamsize>(got, 0);
+    at_eof_ = got <= 0;
+    return !at_eof_;
+  }
+
+  std::istream&     istr_;
+  std::vector<char> buffer_;
+  char const*       next_;
+  char const*       end_;
+  bool              at_eof_;
+  bool              seekable_;
+};
+
+constexpr std::size_t TextReader::block_size;
+constexpr std::size_t TextReader::max_token;
+constexpr long long   TextReader::limit;
+
 } // anonymous namespace
 
 
@@ -118,28 +290,30 @@ map_height()
 
 Legacy::World::MapLayerBag Legacy::World::MapBuilderStream::
 layers()
+{ return layers_from_cells(); }
+
+
+void Legacy::World::MapBuilderStream::
+build_cells(ChunkStore& cells)
 {
-  MapLayerBag layers(height_, MapLayer(length_, width_));
+  TextReader reader(istr_);
   for (unsigned i = 0; i < height_; ++i)
   {
-    istr_ >> confirm_input("layer ");
-    if (!istr_)
+    if (!reader.expect("layer"))
       throw std::runtime_error("error reading map: expected 'layer'");
     int num;
-    istr_ >> num;
-    if (!istr_)
+    if (!reader.read_int(num))
       throw std::runtime_error("error reading map: expected layer number");
     for (unsigned y = 0; y < width_; ++y)
     {
-      for (unsigned x = 0; x < length_; ++x)
+      for (CellSpan segment: cells.row(y, i))
       {
-        istr_ >> num;
-        if (!istr_)
-          throw std::runtime_error("error reading map: expected index");
-        layers[i].set_cell_index_at(x, y, num);
+        for (int& index: segment)
+        {
+          if (!reader.read_int(index))
+            throw std::runtime_error("error reading map: expected index");
+        }
       }
     }
   }
-  return layers;
 }
-
@@ -52,6 +52,9 @@ public:
   Legacy::World::MapLayerBag
   layers() override;
 
+  void
+  build_cells(ChunkStore& cells) override;
+
 private:
   std::istream&  istr_;
   unsigned       length_;
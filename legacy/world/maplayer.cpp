@@ -21,47 +21,133 @@
  */
 #include "legacy/world/maplayer.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include "legacy/core/hash.h"
 #include <stdexcept>
+#include <utility>
+#include <vector>
 
 
 Legacy::World::MapLayer::
 MapLayer(unsigned length, unsigned width)
-: length_(length)
-, width_(width)
-, cells_(length*width)
+: owned_(new ChunkStore(length, width, 1))
+, store_(owned_.get())
+, z_(0)
 { }
 
 
+Legacy::World::MapLayer::
+MapLayer(ChunkStore& store, unsigned z)
+: store_(&store)
+, z_(z)
+{
+  if (z >= store.height())
+    throw std::out_of_range("layer index out of range");
+}
+
+
+Legacy::World::MapLayer::
+MapLayer(MapLayer const& rhs)
+: MapLayer(rhs.length(), rhs.width())
+{
+  *this = rhs;
+}
+
+
+Legacy::World::MapLayer& Legacy::World::MapLayer::
+operator=(MapLayer const& rhs)
+{
+  if (this == &rhs)
+    return *this;
+
+  if (rhs.length() != length() || rhs.width() != width())
+  {
+    if (is_view())
+      throw std::logic_error("can not resize a map layer view");
+    owned_.reset(new ChunkStore(rhs.length(), rhs.width(), 1));
+    store_ = owned_.get();
+  }
+  for (unsigned y = 0; y < width(); ++y)
+  {
+    CellRow      to   = row(y);
+    ConstCellRow from = rhs.row(y);
+    for (std::size_t i = 0; i < to.segment_count(); ++i)
+    {
+      ConstCellSpan from_segment = from.segment(i);
+      std::copy(from_segment.begin(), from_segment.end(), to.segment(i).begin());
+    }
+  }
+  if (owned_)
+    owned_->compact();
+  return *this;
+}
+
+
+Legacy::World::MapLayer& Legacy::World::MapLayer::
+operator=(MapLayer&& rhs)
+{
+  // A view refers to storage owned by someone else, so moving into it has to
+  // write the cells through rather than take over the source's storage.
+  if (is_view())
+    return *this = static_cast<MapLayer const&>(rhs);
+
+  owned_ = std::move(rhs.owned_);
+  store_ = rhs.store_;
+  z_     = rhs.z_;
+  return *this;
+}
+
+
+std::size_t Legacy::World::MapLayer::
+memory_used() const
+{
+  std::size_t bytes = sizeof(*this);
+  if (owned_)
+    bytes += owned_->memory_usage().bytes;
+  return bytes;
+}
+
+
 unsigned
 Legacy::World::MapLayer::
 length() const
-{ return length_; }
+{ return store_->length(); }
 
 
 unsigned
 Legacy::World::MapLayer::
 width() const
-{ return width_; }
+{ return store_->width(); }
 
 
 int Legacy::World::MapLayer::
 cell_index_at(unsigned x, unsigned y) const
-{ return cells_[this->cell_offset_of(x, y)]; }
+{ return store_->cell_index_at(x, y, z_); }
 
 
 void Legacy::World::MapLayer::
 set_cell_index_at(unsigned x, unsigned y, int index)
-{ cells_[this->cell_offset_of(x, y)] = index; }
+{ store_->set_cell_index_at(x, y, z_, index); }
 
 
-unsigned Legacy::World::MapLayer::
-cell_offset_of(unsigned x, unsigned y) const
+std::uint64_t Legacy::World::MapLayer::
+content_hash() const
 {
-  if (x >= length_ || y >= width_)
-    throw std::out_of_range("cell index out of range");
-  return y * length_ + x;
+  std::vector<std::uint64_t> hashes;
+  hashes.push_back(length());
+  hashes.push_back(width());
+  unsigned level = z_ % ChunkStore::brick_size;
+  for (unsigned y = 0; y < width(); y += ChunkStore::brick_size)
+  {
+    for (unsigned x = 0; x < length(); x += ChunkStore::brick_size)
+    {
+      hashes.push_back(store_->brick_level_hash(store_->brick_index_of(x, y, z_), level));
+    }
+  }
+  return Legacy::Core::hash64(hashes.data(), hashes.size() * sizeof(std::uint64_t));
 }
 
 
@@ -70,9 +156,12 @@ operator<<(std::ostream& ostr, MapLayer const& layer)
 {
   for (unsigned y = 0; y < layer.width(); ++y)
   {
-    for (unsigned x = 0; x < layer.length(); ++x)
+    for (ConstCellSpan segment: layer.row(y))
     {
-      ostr << std::setw(4) << layer.cell_index_at(x, y);
+      for (int index: segment)
+      {
+        ostr << std::setw(4) << index;
+      }
     }
     ostr << "\n";
   }
@@ -89,11 +178,23 @@ operator==(MapLayer const& lhs, MapLayer const& rhs)
   if (lhs.width() != rhs.width())
     return false;
 
+  if (lhs.is_same_cells(rhs))
+    return true;
+
+  // Layers that own their cells are the whole of their stores, whose equality
+  // settles on any brick whose kept hashes differ before reading cells.  A
+  // view's bricks hold other levels too, so their hashes can not settle it.
+  if (lhs.owned_ && rhs.owned_)
+    return *lhs.owned_ == *rhs.owned_;
+
   for (unsigned y = 0; y < lhs.width(); ++y)
   {
-    for (unsigned x = 0; x < lhs.length(); ++x)
+    ConstCellRow lhs_row = lhs.row(y);
+    ConstCellRow rhs_row = rhs.row(y);
+    for (std::size_t i = 0; i < lhs_row.segment_count(); ++i)
     {
-      if (lhs.cell_index_at(x, y) != rhs.cell_index_at(x, y))
+      ConstCellSpan lhs_segment = lhs_row.segment(i);
+      if (std::memcmp(lhs_segment.begin(), rhs_row.segment(i).begin(), lhs_segment.size() * sizeof(int)) != 0)
         return false;
     }
   }
@@ -22,8 +22,10 @@
 #ifndef LEGACY_WORLD_MAPLAYER_H_
 #define LEGACY_WORLD_MAPLAYER_H_
 
+#include <cstdint>
 #include <iosfwd>
-#include <vector>
+#include "legacy/world/chunkstore.h"
+#include <memory>
 
 
 namespace Legacy {
@@ -31,13 +33,36 @@ namespace World {
 
 /**
  * An ordered collection of Cell indexes that make up a single map layer.
+ *
+ * A layer either owns its cells or is a view of one level of a ChunkStore,
+ * which is how a Map presents its layers.  Either way the cells are kept in
+ * ChunkStore bricks, so a layer that is all one index costs next to nothing.
+ * Copying any layer makes a new layer that owns a copy of the cells; assigning
+ * to a layer of the same extents copies the cells into it, through to the
+ * ChunkStore if it is a view.
  */
 class MapLayer
 {
 public:
+  /** Creates a layer that owns its cells, all set to zero. */
   MapLayer(unsigned length, unsigned width);
 
-  MapLayer(MapLayer const& rhs) = default;
+  /** Creates a view of level @p z of @p store. */
+  MapLayer(ChunkStore& store, unsigned z);
+
+  MapLayer(MapLayer const& rhs);
+
+  MapLayer(MapLayer&& rhs) = default;
+
+  /**
+   * Copies the cells of another layer into this one.
+   * @throws std::logic_error if this layer is a view and the extents differ.
+   */
+  MapLayer&
+  operator=(MapLayer const& rhs);
+
+  MapLayer&
+  operator=(MapLayer&& rhs);
 
   /** The east-west extent of the map layer. */
   unsigned
@@ -55,14 +80,62 @@ public:
   void
   set_cell_index_at(unsigned x, unsigned y, int index);
 
-private:
-  unsigned 
-  cell_offset_of(unsigned x, unsigned y) const;
+  /** Gets the cache index of the cell at given coordinates without checking them. */
+  int
+  cell_index_at_unchecked(unsigned x, unsigned y) const
+  { return store_->cell_index_at_unchecked(x, y, z_); }
+
+  /** Sets the cache index of the cell at given coordinates without checking them. */
+  void
+  set_cell_index_at_unchecked(unsigned x, unsigned y, int index)
+  { store_->set_cell_index_at_unchecked(x, y, z_, index); }
+
+  /**
+   * Gets row @p y of the layer as a sequence of contiguous spans.
+   * @throws std::out_of_range if @p y is outside the layer.
+   */
+  CellRow
+  row(unsigned y)
+  { return store_->row(y, z_); }
+
+  ConstCellRow
+  row(unsigned y) const
+  { return static_cast<ChunkStore const*>(store_)->row(y, z_); }
+
+  /**
+   * The number of bytes of memory used by the layer, including the cells it
+   * owns.  A view owns no cells.
+   */
+  std::size_t
+  memory_used() const;
+
+  /** Indicates if this layer is a view of cells it does not own. */
+  bool
+  is_view() const
+  { return !owned_; }
+
+  /** Indicates if this layer and @p rhs are the same cells of the same store. */
+  bool
+  is_same_cells(MapLayer const& rhs) const
+  { return store_ == rhs.store_ && z_ == rhs.z_; }
+
+  /**
+   * A 64-bit hash of the extents and cells of the layer, built from the hashes
+   * of the layer's part of each brick.  Layers with the same cells have the
+   * same hash whether they are views or own their cells.  The store keeps the
+   * hash of each brick's part of the layer until that brick is changed, so
+   * hashing the layer again reads only the changed bricks.
+   */
+  std::uint64_t
+  content_hash() const;
+
+  friend bool
+  operator==(MapLayer const& lhs, MapLayer const& rhs);
 
 private:
-  unsigned         length_;
-  unsigned         width_;
-  std::vector<int> cells_;
+  std::unique_ptr<ChunkStore> owned_;
+  ChunkStore*                 store_;
+  unsigned                    z_;
 };
 
 
@@ -0,0 +1,285 @@
+/**
+ * @file legacy/world/mappipeline.cpp
+ * @brief Implementation of the staged map generation pipeline.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/world/mappipeline.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+
+Legacy::World::MapTile::
+MapTile(int x0, int y0, unsigned height, unsigned border)
+: x0_(x0)
+, y0_(y0)
+, height_(height)
+, border_(border)
+, margin_(0)
+, span_(ChunkStore::brick_size + 2 * border)
+, cells_(std::size_t(span_) * span_ * height)
+{ }
+
+
+Legacy::World::MapStage::
+~MapStage()
+{ }
+
+
+unsigned Legacy::World::MapStage::
+halo() const
+{
+  return 0;
+}
+
+
+Legacy::World::MapPipeline::
+MapPipeline(Core::ThreadPool& pool)
+: pool_(pool)
+, tiles_(0)
+{
+  nanoseconds_.emplace_back(0);
+}
+
+
+Legacy::World::MapPipeline::
+~MapPipeline()
+{ }
+
+
+void Legacy::World::MapPipeline::
+add_stage(std::unique_ptr<MapStage> stage)
+{
+  stages_.push_back(std::move(stage));
+  nanoseconds_.emplace_back(0);
+}
+
+
+unsigned Legacy::World::MapPipeline::
+border() const
+{
+  unsigned border = 0;
+  for (auto const& stage: stages_)
+    border += stage->halo();
+  return border;
+}
+
+
+void Legacy::World::MapPipeline::
+run(unsigned x0, unsigned y0, ChunkStore& cells, unsigned* surface)
+{
+  using Clock = std::chrono::steady_clock;
+
+  unsigned const brick_size = ChunkStore::brick_size;
+  unsigned const tiles_x = (cells.length() + brick_size - 1) / brick_size;
+  unsigned const tiles_y = (cells.width() + brick_size - 1) / brick_size;
+  unsigned const border = this->border();
+
+  pool_.parallel_for(std::size_t(tiles_x) * tiles_y, [&](std::size_t i)
+  {
+    unsigned tx = (i % tiles_x) * brick_size;
+    unsigned ty = (i / tiles_x) * brick_size;
+    MapTile tile(x0 + tx, y0 + ty, cells.height(), border);
+
+    // Each stage fills in as much of the border as the stages after it read.
+    unsigned margin = border;
+    auto start = Clock::now();
+    for (std::size_t s = 0; s < stages_.size(); ++s)
+    {
+      margin -= stages_[s]->halo();
+      tile.set_margin(margin);
+      stages_[s]->run(tile);
+      auto end = Clock::now();
+      nanoseconds_[s] += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+      start = end;
+    }
+
+    store_tile(tile, tx, ty, cells, surface);
+    nanoseconds_.back() += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    ++tiles_;
+  });
+}
+
+
+std::vector<Legacy::World::MapPipeline::Timing> Legacy::World::MapPipeline::
+timings() const
+{
+  std::vector<Timing> timings;
+  for (std::size_t s = 0; s < nanoseconds_.size(); ++s)
+  {
+    Timing timing;
+    timing.name = s < stages_.size() ? stages_[s]->name() : "store";
+    timing.time = std::chrono::nanoseconds(nanoseconds_[s].load());
+    timing.tiles = tiles_;
+    timings.push_back(timing);
+  }
+  return timings;
+}
+
+
+void Legacy::World::MapPipeline::
+reset_timings()
+{
+  for (auto& nanoseconds: nanoseconds_)
+    nanoseconds = 0;
+  tiles_ = 0;
+}
+
+
+void Legacy::World::MapPipeline::
+report(std::ostream& ostr) const
+{
+  std::ios::fmtflags flags = ostr.flags();
+  std::streamsize precision = ostr.precision();
+  std::vector<Timing> timings = this->timings();
+  std::int64_t total = 0;
+  for (auto const& timing: timings)
+    total += timing.time.count();
+
+  for (auto const& timing: timings)
+  {
+    ostr << std::left << std::setw(16) << timing.name << std::right
+         << std::fixed << std::setprecision(3) << std::setw(10)
+         << timing.time.count() / 1e6 << " ms "
+         << std::setprecision(1) << std::setw(5)
+         << (total ? 100.0 * timing.time.count() / total : 0.0) << "% over "
+         << timing.tiles << " tiles\n";
+  }
+  ostr.flags(flags);
+  ostr.precision(precision);
+}
+
+
+/**
+ * Stores the bricks of a tile and finds the surface height of each of its
+ * columns while its cells are still in cache.
+ */
+void Legacy::World::MapPipeline::
+store_tile(MapTile const& tile, unsigned tx, unsigned ty, ChunkStore& cells, unsigned* surface) const
+{
+  unsigned const brick_size = ChunkStore::brick_size;
+  unsigned const border = tile.border();
+  unsigned const depth = cells.brick_depth();
+
+  std::vector<int> brick(cells.brick_cells());
+  for (unsigned z0 = 0; z0 < cells.height(); z0 += depth)
+  {
+    int* cell = brick.data();
+    for (unsigned z = z0; z < z0 + depth; ++z)
+    {
+      for (unsigned y = 0; y < brick_size; ++y)
+      {
+        if (z < cells.height())
+          std::copy_n(tile.row(y, z) + border, brick_size, cell);
+        else
+          std::fill_n(cell, brick_size, 0);
+        cell += brick_size;
+      }
+    }
+    cells.store_brick(cells.brick_index_of(tx, ty, z0), brick.data());
+  }
+
+  if (!surface)
+    return;
+  unsigned nx = std::min(brick_size, cells.length() - tx);
+  unsigned ny = std::min(brick_size, cells.width() - ty);
+  for (unsigned y = 0; y < ny; ++y)
+  {
+    for (unsigned x = 0; x < nx; ++x)
+    {
+      unsigned height = cells.height();
+      while (height > 0 && tile.at(x, y, height - 1) == 0)
+        --height;
+      surface[std::size_t(ty + y) * cells.length() + tx + x] = height;
+    }
+  }
+}
+
+
+Legacy::World::MapBuilderPipeline::
+MapBuilderPipeline(unsigned length, unsigned width, unsigned height, MapPipeline& pipeline)
+: length_(length)
+, width_(width)
+, height_(height)
+, pipeline_(pipeline)
+{ }
+
+
+Legacy::World::MapBuilderPipeline::
+~MapBuilderPipeline()
+{ }
+
+
+unsigned Legacy::World::MapBuilderPipeline::
+map_length()
+{
+  return length_;
+}
+
+
+unsigned Legacy::World::MapBuilderPipeline::
+map_width()
+{
+  return width_;
+}
+
+
+unsigned Legacy::World::MapBuilderPipeline::
+map_height()
+{
+  return height_;
+}
+
+
+Legacy::World::MapLayerBag Legacy::World::MapBuilderPipeline::
+layers()
+{ return layers_from_cells(); }
+
+
+void Legacy::World::MapBuilderPipeline::
+build_cells(ChunkStore& cells)
+{
+  surface_.resize(std::size_t(cells.length()) * cells.width());
+  pipeline_.run(0, 0, cells, surface_.data());
+}
+
+
+bool Legacy::World::MapBuilderPipeline::
+builds_regions()
+{
+  return true;
+}
+
+
+void Legacy::World::MapBuilderPipeline::
+build_region(unsigned x0, unsigned y0, ChunkStore& cells)
+{
+  pipeline_.run(x0, y0, cells);
+}
+
+
+bool Legacy::World::MapBuilderPipeline::
+surface_heights(unsigned* out)
+{
+  if (surface_.empty())
+    return false;
+  std::copy(surface_.begin(), surface_.end(), out);
+  return true;
+}
@@ -0,0 +1,292 @@
+/**
+ * @file legacy/world/mappipeline.h
+ * @brief A staged map generation pipeline.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_WORLD_MAPPIPELINE_H_
+#define LEGACY_WORLD_MAPPIPELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <iosfwd>
+#include "legacy/core/thread_pool.h"
+#include "legacy/world/map.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace Legacy {
+namespace World {
+
+/**
+ * The cells of one tile of a map while it is being generated: a column of
+ * bricks, ChunkStore::brick_size cells square and the full height of the map,
+ * with a border of cells around it.
+ *
+ * Coordinates are relative to the tile's first column, so the cells held run
+ * from -border() to brick_size + border() across and are x fastest, then y,
+ * then z.  The border holds cells of the neighbouring tiles (or beyond the
+ * edge of the map), which stages generate as they would any other, so a stage
+ * can read around the cells it changes without waiting for other tiles.
+ */
+class MapTile
+{
+public:
+  MapTile(int x0, int y0, unsigned height, unsigned border);
+
+  /** The map x coordinate of the tile's first column. */
+  int
+  x0() const
+  { return x0_; }
+
+  /** The map y coordinate of the tile's first column. */
+  int
+  y0() const
+  { return y0_; }
+
+  /** The height of the map. */
+  unsigned
+  height() const
+  { return height_; }
+
+  /** The number of cells held on each side of the tile. */
+  unsigned
+  border() const
+  { return border_; }
+
+  /**
+   * The number of cells on each side of the tile the running stage must
+   * fill in, for the stages after it to read: its cells run from -margin()
+   * to brick_size + margin() across.
+   */
+  unsigned
+  margin() const
+  { return margin_; }
+
+  /** The number of cells held along a row. */
+  unsigned
+  span() const
+  { return span_; }
+
+  /** Gets the cell at tile coordinates (@p x, @p y, @p z), without checking. */
+  int&
+  at(int x, int y, unsigned z)
+  { return cells_[offset_of(x, y, z)]; }
+
+  int
+  at(int x, int y, unsigned z) const
+  { return cells_[offset_of(x, y, z)]; }
+
+  /**
+   * Gets the row of span() cells at tile coordinates (-border(), @p y, @p z).
+   */
+  int*
+  row(int y, unsigned z)
+  { return cells_.data() + offset_of(-int(border_), y, z); }
+
+  int const*
+  row(int y, unsigned z) const
+  { return cells_.data() + offset_of(-int(border_), y, z); }
+
+  void
+  set_margin(unsigned margin)
+  { margin_ = margin; }
+
+private:
+  std::size_t
+  offset_of(int x, int y, unsigned z) const
+  { return (std::size_t(z) * span_ + (y + border_)) * span_ + (x + border_); }
+
+  int              x0_;
+  int              y0_;
+  unsigned         height_;
+  unsigned         border_;
+  unsigned         margin_;
+  unsigned         span_;
+  std::vector<int> cells_;
+};
+
+
+/**
+ * One pass of map generation, such as laying down terrain or carving caves.
+ *
+ * A stage is run on one tile at a time, possibly on several tiles at once from
+ * different threads.  It must fill in the cells of the tile out to margin()
+ * from those left by the stages before it, reading no further than halo()
+ * cells beyond them, and come out the same whichever tile it is run for.
+ */
+class MapStage
+{
+public:
+  virtual ~MapStage() = 0;
+
+  /** A short name for the stage, for reports. */
+  virtual std::string
+  name() const = 0;
+
+  /**
+   * The number of cells beyond the ones it fills in that the stage reads
+   * around them horizontally.  The default is 0, for a stage that reads only
+   * the columns it changes.
+   */
+  virtual unsigned
+  halo() const;
+
+  /** Runs the stage on a tile. */
+  virtual void
+  run(MapTile& tile) const = 0;
+};
+
+
+/**
+ * A series of stages run fused over a map, one tile at a time.
+ *
+ * Each tile goes through every stage before the next is started, so its cells
+ * are still in cache from one stage to the next rather than each stage
+ * sweeping the whole map in turn.  A stage that reads around its cells has
+ * the earlier stages fill in a border that wide around the tile first, doing a
+ * little of the neighbouring tiles' work again rather than waiting for them,
+ * so tiles can be run in any order and on any number of threads and the map
+ * still comes out the same.
+ *
+ * The time spent in each stage, over every thread, is added up as the
+ * pipeline runs.
+ */
+class MapPipeline
+{
+public:
+  /** The time spent in a stage. */
+  struct Timing
+  {
+    std::string              name;
+    std::chrono::nanoseconds time;
+    std::size_t              tiles;
+  };
+
+public:
+  MapPipeline(Legacy::Core::ThreadPool& pool = Legacy::Core::ThreadPool::default_pool());
+
+  ~MapPipeline();
+
+  /** Appends a stage to the pipeline. */
+  void
+  add_stage(std::unique_ptr<MapStage> stage);
+
+  /** The number of stages in the pipeline. */
+  std::size_t
+  stage_count() const
+  { return stages_.size(); }
+
+  /** The width of the border kept around each tile for the stages' halos. */
+  unsigned
+  border() const;
+
+  /**
+   * Runs the stages over the cells of a region of a map starting at column
+   * (@p x0, @p y0), and stores the tiles in @p cells.
+   *
+   * The surface height of each column of the region, as
+   * ChunkStore::surface_heights() would find it, is filled in to @p surface
+   * if it is given.
+   */
+  void
+  run(unsigned x0, unsigned y0, ChunkStore& cells, unsigned* surface = nullptr);
+
+  /**
+   * The time spent in each stage since the pipeline was made or last reset,
+   * followed by the time spent storing the tiles.
+   */
+  std::vector<Timing>
+  timings() const;
+
+  /** Sets the stage times back to zero. */
+  void
+  reset_timings();
+
+  /** Writes the time spent in each stage to @p ostr, one stage to a line. */
+  void
+  report(std::ostream& ostr) const;
+
+private:
+  MapPipeline(MapPipeline const&) = delete;
+  MapPipeline& operator=(MapPipeline const&) = delete;
+
+  void
+  store_tile(MapTile const& tile, unsigned tx, unsigned ty,
+             ChunkStore& cells, unsigned* surface) const;
+
+  Legacy::Core::ThreadPool&               pool_;
+  std::vector<std::unique_ptr<MapStage>>  stages_;
+  std::deque<std::atomic<std::int64_t>>   nanoseconds_;  ///< each stage, then storing
+  std::atomic<std::size_t>                tiles_;
+};
+
+
+/**
+ * Builds a map by running a pipeline over it.  Any region of the map can be
+ * built on its own, so the builder can be used for a lazily built map.
+ */
+class MapBuilderPipeline
+: public MapBuilder
+{
+public:
+  /** The @p pipeline must outlive the builder. */
+  MapBuilderPipeline(unsigned length, unsigned width, unsigned height, MapPipeline& pipeline);
+
+  ~MapBuilderPipeline();
+
+  unsigned
+  map_length() override;
+
+  unsigned
+  map_width() override;
+
+  unsigned
+  map_height() override;
+
+  Legacy::World::MapLayerBag
+  layers() override;
+
+  void
+  build_cells(ChunkStore& cells) override;
+
+  bool
+  builds_regions() override;
+
+  void
+  build_region(unsigned x0, unsigned y0, ChunkStore& cells) override;
+
+  bool
+  surface_heights(unsigned* out) override;
+
+private:
+  unsigned              length_;
+  unsigned              width_;
+  unsigned              height_;
+  MapPipeline&          pipeline_;
+  std::vector<unsigned> surface_;
+};
+
+} // namespace World
+} // namespace Legacy
+
+#endif // LEGACY_WORLD_MAPPIPELINE_H_
@@ -0,0 +1,303 @@
+/**
+ * @file legacy/world/mapstages.cpp
+ * @brief Implementation of the stages of the map generation pipeline.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "legacy/world/mapstages.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include "FastNoise/FastNoise.h"
+#include <vector>
+
+
+Legacy::World::TerrainStage::
+TerrainStage(std::uint_fast32_t seed)
+: seed_(seed)
+{ }
+
+
+std::string Legacy::World::TerrainStage::
+name() const
+{
+  return "terrain";
+}
+
+
+void Legacy::World::TerrainStage::
+run(MapTile& tile) const
+{
+  FastNoise noise;
+  noise.SetSeed(seed_);
+  noise.SetNoiseType(FastNoise::GradientFractal);
+
+  float base_height = tile.height() / 2.0f;
+  float surface_variance = tile.height() / 4.0f;
+
+  int const margin = tile.margin();
+  int const span = ChunkStore::brick_size + 2 * margin;
+  std::vector<float> samples(std::size_t(span) * span);
+  noise.FillNoiseSet(samples.data(), tile.x0() - margin, tile.y0() - margin, span, span);
+
+  std::vector<unsigned> heights(samples.size());
+  for (std::size_t i = 0; i < samples.size(); ++i)
+  {
+    unsigned height = base_height + surface_variance * samples[i] + 1.0f;
+    heights[i] = std::min(height, tile.height());
+  }
+
+  for (unsigned z = 0; z < tile.height(); ++z)
+  {
+    for (int y = 0; y < span; ++y)
+    {
+      int* row = &tile.at(-margin, y - margin, z);
+      unsigned const* height = heights.data() + std::size_t(y) * span;
+      for (int x = 0; x < span; ++x)
+        row[x] = (z < height[x]) ? 1 : 0;
+    }
+  }
+}
+
+
+Legacy::World::CoverStage::
+CoverStage(int from, int to)
+: from_(from)
+, to_(to)
+{ }
+
+
+std::string Legacy::World::CoverStage::
+name() const
+{
+  return "cover";
+}
+
+
+unsigned Legacy::World::CoverStage::
+halo() const
+{
+  return 1;
+}
+
+
+void Legacy::World::CoverStage::
+run(MapTile& tile) const
+{
+  // Only cells holding from_ change, and they change to another non-zero
+  // index, so which neighbours are empty is the same before and after.
+  int const margin = tile.margin();
+  int const width = ChunkStore::brick_size + 2 * margin;
+  std::ptrdiff_t const row = tile.span();
+  std::ptrdiff_t const layer = row * row;
+  for (unsigned z = 0; z < tile.height(); ++z)
+  {
+    bool const has_below = z > 0;
+    bool const has_above = z + 1 < tile.height();
+    for (int y = -margin; y < width - margin; ++y)
+    {
+      int* cell = &tile.at(-margin, y, z);
+      for (int x = 0; x < width; ++x, ++cell)
+      {
+        if (*cell != from_)
+          continue;
+        if (cell[-1] == 0 || cell[1] == 0 || cell[-row] == 0 || cell[row] == 0
+         || (has_below && cell[-layer] == 0) || (has_above && cell[layer] == 0))
+          *cell = to_;
+      }
+    }
+  }
+}
+
+
+namespace
+{
+
+/** Divides rounding towards negative infinity. */
+int
+floor_div(int a, int b)
+{
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+float
+lerp(float a, float b, float t)
+{
+  return a + t * (b - a);
+}
+
+} // anonymous namespace
+
+
+Legacy::World::CaveStage::
+CaveStage(std::uint_fast32_t seed, unsigned step, float threshold, float frequency)
+: seed_(seed)
+, step_(step)
+, threshold_(threshold)
+, frequency_(frequency)
+{
+  if (step == 0)
+    throw std::invalid_argument("cave noise lattice step must be positive");
+}
+
+
+std::string Legacy::World::CaveStage::
+name() const
+{
+  return "caves";
+}
+
+
+/**
+ * Every cell's noise value is worked out from the same lattice points in the
+ * same order whichever tile it is in, so neighbouring tiles agree on the cells
+ * they share.
+ */
+void Legacy::World::CaveStage::
+run(MapTile& tile) const
+{
+  FastNoise noise;
+  noise.SetSeed(seed_);
+  noise.SetNoiseType(FastNoise::SimplexFractal);
+  noise.SetFrequency(frequency_);
+
+  int const margin = tile.margin();
+  int const width = ChunkStore::brick_size + 2 * margin;
+  int const xa = tile.x0() - margin;
+  int const ya = tile.y0() - margin;
+  // Nothing above the highest solid cell can be carved, so the noise is
+  // needed only up to there.
+  unsigned height = tile.height();
+  while (height > 1)
+  {
+    bool empty = true;
+    for (int y = 0; y < width && empty; ++y)
+    {
+      int const* row = &tile.at(-margin, y - margin, height - 1);
+      empty = std::all_of(row, row + width, [](int cell) { return cell == 0; });
+    }
+    if (!empty)
+      break;
+    --height;
+  }
+
+  // The lattice points around the cells to be filled in, in map coordinates
+  // divided by the step.
+  int const lx0 = floor_div(xa, step_);
+  int const ly0 = floor_div(ya, step_);
+  int const nlx = floor_div(xa + width - 1, step_) + 2 - lx0;
+  int const nly = floor_div(ya + width - 1, step_) + 2 - ly0;
+  int const nlz = (int(height) - 1) / step_ + 2;
+
+  std::vector<float> lattice(std::size_t(nlx) * nly * nlz);
+  float* sample = lattice.data();
+  for (int lz = 0; lz < nlz; ++lz)
+    for (int ly = 0; ly < nly; ++ly)
+      for (int lx = 0; lx < nlx; ++lx)
+        *sample++ = noise.GetNoise(float((lx0 + lx) * step_),
+                                   float((ly0 + ly) * step_),
+                                   float(lz * step_));
+
+  // Interpolate down each lattice column to every z, then along x for each
+  // lattice row, then between the rows along y.
+  std::vector<float> layer(std::size_t(nlx) * nly);
+  std::vector<float> rows(std::size_t(nly) * width);
+  float const inverse_step = 1.0f / step_;
+  for (unsigned z = 1; z < height; ++z)
+  {
+    int lz = z / step_;
+    float tz = (z - lz * step_) * inverse_step;
+    float const* below = lattice.data() + std::size_t(lz) * nlx * nly;
+    float const* above = below + std::size_t(nlx) * nly;
+    for (std::size_t i = 0; i < layer.size(); ++i)
+      layer[i] = lerp(below[i], above[i], tz);
+
+    for (int ly = 0; ly < nly; ++ly)
+    {
+      float const* points = layer.data() + std::size_t(ly) * nlx;
+      float* row = rows.data() + std::size_t(ly) * width;
+      for (int x = 0; x < width; ++x)
+      {
+        int lx = floor_div(xa + x, step_);
+        float tx = (xa + x - lx * step_) * inverse_step;
+        row[x] = lerp(points[lx - lx0], points[lx - lx0 + 1], tx);
+      }
+    }
+
+    for (int y = 0; y < width; ++y)
+    {
+      int ly = floor_div(ya + y, step_);
+      float ty = (ya + y - ly * step_) * inverse_step;
+      float const* near = rows.data() + std::size_t(ly - ly0) * width;
+      float const* far = near + width;
+      int* cell = &tile.at(-margin, y - margin, z);
+      for (int x = 0; x < width; ++x)
+      {
+        if (cell[x] != 0 && lerp(near[x], far[x], ty) > threshold_)
+          cell[x] = 0;
+      }
+    }
+  }
+}
+
+
+Legacy::World::ScatterStage::
+ScatterStage(std::uint64_t seed, int from, int to, double probability)
+: seed_(seed)
+, from_(from)
+, to_(to)
+, limit_(0)
+, always_(false)
+{
+  if (!(probability >= 0.0 && probability <= 1.0))
+    throw std::invalid_argument("scatter probability must be in [0, 1]");
+  double limit = std::ldexp(probability, 64);
+  always_ = limit >= std::ldexp(1.0, 64);
+  if (!always_)
+    limit_ = std::uint64_t(limit);
+}
+
+
+std::string Legacy::World::ScatterStage::
+name() const
+{
+  return "scatter";
+}
+
+
+void Legacy::World::ScatterStage::
+run(MapTile& tile) const
+{
+  int const margin = tile.margin();
+  int const end = ChunkStore::brick_size + margin;
+  for (int y = -margin; y < end; ++y)
+  {
+    for (int x = -margin; x < end; ++x)
+    {
+      Core::SplitSeed column = seed_.at(tile.x0() + x, tile.y0() + y);
+      for (unsigned z = 0; z < tile.height(); ++z)
+      {
+        int& cell = tile.at(x, y, z);
+        if (cell == from_ && (always_ || column.draw(z) < limit_))
+          cell = to_;
+      }
+    }
+  }
+}
@@ -0,0 +1,155 @@
+/**
+ * @file legacy/world/mapstages.h
+ * @brief Stages of the map generation pipeline.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LEGACY_WORLD_MAPSTAGES_H_
+#define LEGACY_WORLD_MAPSTAGES_H_
+
+#include <cstdint>
+#include "legacy/core/random.h"
+#include "legacy/world/mappipeline.h"
+
+
+namespace Legacy {
+namespace World {
+
+/**
+ * Lays down a noise heightfield of solid (1) cells, the same terrain as
+ * MapBuilderSimple generates for the same seed.
+ */
+class TerrainStage
+: public MapStage
+{
+public:
+  TerrainStage(std::uint_fast32_t seed);
+
+  std::string
+  name() const override;
+
+  void
+  run(MapTile& tile) const override;
+
+private:
+  std::uint_fast32_t seed_;
+};
+
+
+/**
+ * Turns every cell holding @p from that has an empty (zero) face neighbour
+ * into @p to, such as exposed rock into soil.  Neighbours above and below the
+ * map do not count.  Both indexes must be non-zero.
+ */
+class CoverStage
+: public MapStage
+{
+public:
+  CoverStage(int from, int to);
+
+  std::string
+  name() const override;
+
+  unsigned
+  halo() const override;
+
+  void
+  run(MapTile& tile) const override;
+
+private:
+  int from_;
+  int to_;
+};
+
+
+/**
+ * Carves caves and overhangs out of the cells laid down before it, emptying
+ * every cell above the bottom layer where a 3D simplex fractal noise is above
+ * a threshold.
+ *
+ * The noise is sampled only at the points of a coarse lattice, @p step cells
+ * apart along each axis and aligned to the map, and trilinearly interpolated
+ * between them, so a tile costs a few hundred noise samples rather than one for
+ * every cell.  A step of 1 samples every cell.
+ */
+class CaveStage
+: public MapStage
+{
+public:
+  /**
+   * @param[in] seed       Seeds the cave noise.
+   * @param[in] step       The spacing of the noise lattice, in cells.
+   * @param[in] threshold  The noise value above which cells are carved, in
+   *                       [-1, 1]; higher carves less.
+   * @param[in] frequency  The frequency of the noise, in cycles per cell.
+   * @throws std::invalid_argument if the step is zero.
+   */
+  CaveStage(std::uint_fast32_t seed,
+            unsigned           step = 4,
+            float              threshold = 0.3f,
+            float              frequency = 0.04f);
+
+  std::string
+  name() const override;
+
+  void
+  run(MapTile& tile) const override;
+
+private:
+  std::uint_fast32_t seed_;
+  int                step_;
+  float              threshold_;
+  float              frequency_;
+};
+
+
+/**
+ * Turns cells holding @p from into @p to at random, each with the same
+ * probability, such as scattering ore through rock.
+ *
+ * Whether a cell is turned is decided by a random value drawn from the seed of
+ * its column at its height, so it depends only on the seed and the cell's
+ * position and not on which tiles are generated or in what order.
+ */
+class ScatterStage
+: public MapStage
+{
+public:
+  /**
+   * @throws std::invalid_argument if the probability is not in [0, 1].
+   */
+  ScatterStage(std::uint64_t seed, int from, int to, double probability);
+
+  std::string
+  name() const override;
+
+  void
+  run(MapTile& tile) const override;
+
+private:
+  Core::SplitSeed seed_;
+  int             from_;
+  int             to_;
+  std::uint64_t   limit_;
+  bool            always_;
+};
+
+} // namespace World
+} // namespace Legacy
+
+#endif // LEGACY_WORLD_MAPSTAGES_H_
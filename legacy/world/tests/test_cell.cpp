@@ -23,10 +23,41 @@
 #include "legacy/world/cell.h"
 
 
+using Legacy::World::Cell;
+
+
 SCENARIO("basic Cell interface")
 {
-  GIVEN("A Cell")
+  GIVEN("A default Cell")
+  {
+    Cell cell;
+
+    THEN("it is empty")
+    {
+      REQUIRE(cell.material() == 0);
+      REQUIRE(cell.flags() == 0);
+      REQUIRE(cell.occupancy() == 0);
+    }
+  }
+
+  GIVEN("A Cell with contents")
   {
-    Legacy::World::Cell cell;
+    Cell cell(7, 0x0102, Cell::full);
+
+    THEN("it has those contents")
+    {
+      REQUIRE(cell.material() == 7);
+      REQUIRE(cell.flags() == 0x0102);
+      REQUIRE(cell.occupancy() == Cell::full);
+    }
+
+    THEN("it equals only cells with the same contents")
+    {
+      REQUIRE(cell == Cell(7, 0x0102, Cell::full));
+      REQUIRE(cell != Cell(8, 0x0102, Cell::full));
+      REQUIRE(cell != Cell(7, 0x0002, Cell::full));
+      REQUIRE(cell != Cell(7, 0x0102, 1));
+      REQUIRE(cell != Cell());
+    }
   }
 }
@@ -21,12 +21,301 @@
  */
 #include "catch/catch.hpp"
 #include "legacy/world/cellcache.h"
+#include "legacy/world/chunkstore.h"
+#include <stdexcept>
+#include <vector>
+
+
+using Legacy::World::Cell;
+using Legacy::World::CellCache;
 
 
 SCENARIO("basic Cell Cache interface")
 {
   GIVEN("A CellCache")
   {
-    Legacy::World::CellCache cell_cache;
+    CellCache cell_cache;
+
+    THEN("it holds only the empty cell, at index 0")
+    {
+      REQUIRE(cell_cache.size() == 1);
+      REQUIRE(cell_cache.contains(CellCache::empty_index));
+      REQUIRE(cell_cache.cell_at(CellCache::empty_index) == Cell());
+      REQUIRE(cell_cache.find(Cell()) == CellCache::empty_index);
+      REQUIRE(cell_cache.find(Cell(1, 0, 0)) == -1);
+    }
+
+    WHEN("a cell is interned")
+    {
+      Cell stone(3, 0x10, Cell::full);
+      CellCache::Index index = cell_cache.intern(stone);
+
+      THEN("its contents can be found at the index it was given")
+      {
+        REQUIRE(index != CellCache::empty_index);
+        REQUIRE(cell_cache.size() == 2);
+        REQUIRE(cell_cache.cell_at(index) == stone);
+        REQUIRE(cell_cache.material_at(index) == 3);
+        REQUIRE(cell_cache.flags_at(index) == 0x10);
+        REQUIRE(cell_cache.occupancy_at(index) == Cell::full);
+        REQUIRE(cell_cache.find(stone) == index);
+      }
+
+      AND_WHEN("an identical cell is interned")
+      {
+        CellCache::Index again = cell_cache.intern(Cell(3, 0x10, Cell::full));
+
+        THEN("it gets the same index")
+        {
+          REQUIRE(again == index);
+          REQUIRE(cell_cache.size() == 2);
+        }
+      }
+
+      AND_WHEN("the cell is released")
+      {
+        cell_cache.release(index);
+
+        THEN("its index is no longer in the cache")
+        {
+          REQUIRE(cell_cache.size() == 1);
+          REQUIRE_FALSE(cell_cache.contains(index));
+          REQUIRE(cell_cache.find(stone) == -1);
+          REQUIRE_THROWS_AS(cell_cache.cell_at(index), std::out_of_range);
+          REQUIRE_THROWS_AS(cell_cache.release(index), std::out_of_range);
+        }
+
+        THEN("the next new cell reuses its index")
+        {
+          REQUIRE(cell_cache.intern(Cell(4, 0, 1)) == index);
+          REQUIRE(cell_cache.cell_at(index) == Cell(4, 0, 1));
+        }
+      }
+    }
+
+    WHEN("the empty cell is released")
+    {
+      cell_cache.release(CellCache::empty_index);
+
+      THEN("it stays in the cache")
+      {
+        REQUIRE(cell_cache.contains(CellCache::empty_index));
+        REQUIRE(cell_cache.intern(Cell()) == CellCache::empty_index);
+      }
+    }
+
+    THEN("indexes that were never given out are not in the cache")
+    {
+      REQUIRE_FALSE(cell_cache.contains(-1));
+      REQUIRE_FALSE(cell_cache.contains(1));
+      REQUIRE_THROWS_AS(cell_cache.cell_at(1), std::out_of_range);
+      REQUIRE_THROWS_AS(cell_cache.release(-1), std::out_of_range);
+    }
+  }
+}
+
+
+SCENARIO("a Cell Cache holds many cells at stable indexes")
+{
+  GIVEN("A CellCache with several slabs' worth of cells")
+  {
+    CellCache cell_cache;
+    std::vector<CellCache::Index> indexes;
+    for (Cell::Material material = 1; material <= 5000; ++material)
+      indexes.push_back(cell_cache.intern(Cell(material, material & 0xff, material % 7)));
+
+    THEN("every cell is still at the index it was given")
+    {
+      bool all_there = true;
+      for (std::size_t i = 0; i < indexes.size(); ++i)
+      {
+        Cell::Material material = Cell::Material(i + 1);
+        all_there = all_there
+                 && cell_cache.cell_at(indexes[i]) == Cell(material, material & 0xff, material % 7);
+      }
+      REQUIRE(all_there);
+      REQUIRE(cell_cache.size() == 5001);
+      REQUIRE(cell_cache.capacity() >= 5001);
+    }
+
+    WHEN("every other cell is released and as many new ones interned")
+    {
+      std::size_t capacity = cell_cache.capacity();
+      for (std::size_t i = 0; i < indexes.size(); i += 2)
+        cell_cache.release(indexes[i]);
+      for (Cell::Material material = 1; material <= 2500; ++material)
+        cell_cache.intern(Cell(material, 0, Cell::full));
+
+      THEN("the freed indexes are reused without growing the cache")
+      {
+        REQUIRE(cell_cache.size() == 5001);
+        REQUIRE(cell_cache.capacity() == capacity);
+        REQUIRE(cell_cache.cell_at(indexes[1]) == Cell(2, 2, 2));
+      }
+    }
+  }
+}
+
+
+SCENARIO("a Cell Cache counts references to its cells")
+{
+  GIVEN("A CellCache with an acquired cell")
+  {
+    CellCache cell_cache;
+    Cell stone(3, 0, Cell::full);
+    CellCache::Index index = cell_cache.acquire(stone);
+
+    THEN("the cell has one reference")
+    {
+      REQUIRE(cell_cache.ref_count(index) == 1);
+      REQUIRE(cell_cache.unused() == 0);
+    }
+
+    WHEN("it is acquired again and more references are added")
+    {
+      REQUIRE(cell_cache.acquire(stone) == index);
+      cell_cache.add_refs(index, 10);
+
+      THEN("the references are counted")
+      {
+        REQUIRE(cell_cache.ref_count(index) == 12);
+      }
+    }
+
+    WHEN("its reference is dropped")
+    {
+      cell_cache.drop_ref(index);
+
+      THEN("it stays in the cache, unused")
+      {
+        REQUIRE(cell_cache.contains(index));
+        REQUIRE(cell_cache.ref_count(index) == 0);
+        REQUIRE(cell_cache.unused() == 1);
+        REQUIRE_THROWS_AS(cell_cache.drop_ref(index), std::logic_error);
+      }
+    }
+
+    THEN("it can not be released while referred to")
+    {
+      REQUIRE_THROWS_AS(cell_cache.release(index), std::logic_error);
+    }
+
+    THEN("the empty cell is not counted")
+    {
+      cell_cache.add_refs(CellCache::empty_index, 5);
+      cell_cache.drop_ref(CellCache::empty_index);
+      REQUIRE(cell_cache.ref_count(CellCache::empty_index) == 0);
+      REQUIRE(cell_cache.unused() == 0);
+    }
+  }
+
+  GIVEN("A store of cells holding cache indexes")
+  {
+    CellCache cell_cache;
+    CellCache::Index water = cell_cache.intern(Cell(1, 0, 128));
+    Legacy::World::ChunkStore cells(64, 64, 4);
+    cells.set_cell_index_at(3, 4, 1, water);
+    cells.set_cell_index_at(60, 61, 2, water);
+
+    WHEN("references are taken for the store")
+    {
+      cell_cache.add_refs(cells);
+
+      THEN("each position holding a cell refers to it")
+      {
+        REQUIRE(cell_cache.ref_count(water) == 2);
+      }
+    }
+
+    WHEN("the store holds an index not in the cache")
+    {
+      cells.set_cell_index_at(0, 0, 0, 99);
+
+      THEN("no references are taken")
+      {
+        REQUIRE_THROWS_AS(cell_cache.add_refs(cells), std::out_of_range);
+        REQUIRE(cell_cache.ref_count(water) == 0);
+      }
+    }
+  }
+
+  GIVEN("A store whose extents are not a whole number of bricks")
+  {
+    CellCache cell_cache;
+    CellCache::Index water = cell_cache.intern(Cell(1, 0, 128));
+    Legacy::World::ChunkStore cells(20, 20, 4);
+
+    WHEN("every brick is stored filled with one cell")
+    {
+      std::vector<int> brick(cells.brick_cells(), water);
+      for (std::size_t i = 0; i < cells.brick_count(); ++i)
+        cells.store_brick(i, brick.data());
+      cell_cache.add_refs(cells);
+
+      THEN("only the positions inside the store refer to it")
+      {
+        REQUIRE(cell_cache.ref_count(water) == 20u * 20u * 4u);
+      }
+    }
+
+    WHEN("an edge brick has indexes not in the cache in its padding")
+    {
+      std::size_t edge = cells.brick_index_of(19, 19, 0);
+      unsigned nx, ny, nz;
+      cells.brick_extent(edge, nx, ny, nz);
+      std::vector<int> brick(cells.brick_cells());
+      for (std::size_t offset = 0; offset < brick.size(); ++offset)
+        brick[offset] = 1000 + int(offset);
+      for (unsigned z = 0; z < nz; ++z)
+        for (unsigned y = 0; y < ny; ++y)
+          for (unsigned x = 0; x < nx; ++x)
+            brick[(z * Legacy::World::ChunkStore::brick_size + y) * Legacy::World::ChunkStore::brick_size + x] = water;
+      cells.store_brick(edge, brick.data());
+
+      THEN("the padding is ignored")
+      {
+        REQUIRE_NOTHROW(cell_cache.add_refs(cells));
+        REQUIRE(cell_cache.ref_count(water) == std::uint64_t(nx) * ny * nz);
+      }
+    }
+  }
+}
+
+
+SCENARIO("a Cell Cache compacts away unused cells")
+{
+  GIVEN("A CellCache with some cells in use and many unused")
+  {
+    CellCache cell_cache;
+    std::vector<CellCache::Index> kept;
+    for (Cell::Material material = 1; material <= 100; ++material)
+      kept.push_back(cell_cache.acquire(Cell(material, 0, Cell::full)));
+    for (Cell::Material material = 1; material <= 4000; ++material)
+      cell_cache.intern(Cell(material, 1, 1));
+    REQUIRE(cell_cache.unused() == 4000);
+
+    WHEN("the cache is compacted in the background")
+    {
+      std::size_t capacity = cell_cache.capacity();
+      CellCache::Compaction compaction = cell_cache.compact_in_background().get();
+
+      THEN("only the unused cells are gone and memory is handed back")
+      {
+        REQUIRE(compaction.released == 4000);
+        REQUIRE(compaction.memory_after < compaction.memory_before);
+        REQUIRE(compaction.memory_after == cell_cache.memory_used());
+        REQUIRE(cell_cache.size() == 101);
+        REQUIRE(cell_cache.unused() == 0);
+        REQUIRE(cell_cache.capacity() < capacity);
+        REQUIRE(cell_cache.cell_at(kept.back()) == Cell(100, 0, Cell::full));
+      }
+
+      THEN("new cells are given indexes within the slabs that are left")
+      {
+        CellCache::Index index = cell_cache.intern(Cell(5, 5, 5));
+        REQUIRE(std::size_t(index) < cell_cache.capacity());
+        REQUIRE(cell_cache.cell_at(index) == Cell(5, 5, 5));
+      }
+    }
   }
 }
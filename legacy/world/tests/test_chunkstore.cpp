@@ -0,0 +1,432 @@
+/**
+ * @file legacy/world/tests/test_chunkstore.cpp
+ * @brief Tests for the Legacy world ChunkStore class.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ */
+#include "catch/catch.hpp"
+#include "legacy/world/chunkstore.h"
+#include <stdexcept>
+#include <vector>
+
+
+SCENARIO("basic interface for the ChunkStore class")
+{
+  GIVEN("A ChunkStore spanning several bricks in every direction")
+  {
+    static const unsigned given_length = 40;
+    static const unsigned given_width  = 20;
+    static const unsigned given_height = 34;
+    Legacy::World::ChunkStore store(given_length, given_width, given_height);
+
+    WHEN("the store is first created")
+    {
+      THEN("its size should match the given dimensions")
+      {
+        REQUIRE(store.length() == given_length);
+        REQUIRE(store.width()  == given_width);
+        REQUIRE(store.height() == given_height);
+        REQUIRE(store.brick_count() == 3 * 2 * 3);
+      }
+      AND_THEN("every cell should be the empty cell")
+      {
+        REQUIRE(store.cell_index_at(0, 0, 0) == 0);
+        REQUIRE(store.cell_index_at(given_length-1, given_width-1, given_height-1) == 0);
+      }
+    }
+
+    WHEN("a requested cell address is out of bounds")
+    {
+      THEN("an out-of-range exception gets raised")
+      {
+        CHECK_THROWS_AS(store.cell_index_at(given_length, 0, 0), std::out_of_range);
+        CHECK_THROWS_AS(store.cell_index_at(0, given_width, 0), std::out_of_range);
+        CHECK_THROWS_AS(store.cell_index_at(0, 0, given_height), std::out_of_range);
+        CHECK_THROWS_AS(store.set_cell_index_at(0, 0, given_height, 1), std::out_of_range);
+      }
+    }
+
+    WHEN("cells on either side of brick boundaries are updated")
+    {
+      store.set_cell_index_at(15, 15, 15, 1);
+      store.set_cell_index_at(16, 16, 16, 2);
+      store.set_cell_index_at(39, 19, 33, 3);
+
+      THEN("each cell holds its own value")
+      {
+        REQUIRE(store.cell_index_at(15, 15, 15) == 1);
+        REQUIRE(store.cell_index_at(16, 16, 16) == 2);
+        REQUIRE(store.cell_index_at(39, 19, 33) == 3);
+        REQUIRE(store.cell_index_at(16, 15, 15) == 0);
+        REQUIRE(store.cell_index_at(15, 16, 16) == 0);
+      }
+    }
+
+    WHEN("a vertical column is updated")
+    {
+      for (unsigned z = 0; z < given_height; ++z)
+      {
+        store.set_cell_index_at(17, 3, z, z + 1);
+      }
+
+      THEN("the column can be read back in one call")
+      {
+        std::vector<int> column(given_height);
+        store.column_at(17, 3, column.data());
+        for (unsigned z = 0; z < given_height; ++z)
+        {
+          REQUIRE(column[z] == int(z + 1));
+        }
+      }
+      AND_THEN("the bricks of the column are adjacent in the store")
+      {
+        REQUIRE(store.brick_index_of(17, 3, 16) == store.brick_index_of(17, 3, 0) + 1);
+        REQUIRE(store.brick_index_of(17, 3, 32) == store.brick_index_of(17, 3, 0) + 2);
+      }
+    }
+  }
+
+  GIVEN("A ChunkStore shallower than a brick")
+  {
+    Legacy::World::ChunkStore store(10, 10, 3);
+
+    THEN("its bricks are only as deep as the store")
+    {
+      REQUIRE(store.brick_depth() == 3);
+      REQUIRE(store.brick_cells() == 16 * 16 * 3);
+    }
+  }
+
+  GIVEN("Two ChunkStores created from the same criteria")
+  {
+    Legacy::World::ChunkStore store1(20, 20, 20);
+    Legacy::World::ChunkStore store2(20, 20, 20);
+
+    WHEN("first created")
+    {
+      THEN("they should compare as equal")
+      {
+        REQUIRE(store1 == store2);
+      }
+    }
+
+    WHEN("only one has changed")
+    {
+      store1.set_cell_index_at(19, 19, 19, 2);
+      THEN("they should compare as inequal")
+      {
+        REQUIRE(store1 != store2);
+      }
+    }
+  }
+}
+
+
+SCENARIO("ChunkStore boxes of cells are read in one call")
+{
+  using BrickMode = Legacy::World::ChunkStore::BrickMode;
+
+  GIVEN("A ChunkStore with uniform, palette and dense bricks")
+  {
+    Legacy::World::ChunkStore store(40, 35, 20);
+    store.fill(3);
+    store.set_cell_index_at(20, 20, 4, 9);
+    int x = 0;
+    for (Legacy::World::CellSpan segment: store.row(2, 17))
+      for (int& index: segment)
+        index = x++;
+    REQUIRE(store.brick_mode(store.brick_index_of(0, 0, 0)) == BrickMode::uniform);
+    REQUIRE(store.brick_mode(store.brick_index_of(20, 20, 4)) == BrickMode::palette);
+    REQUIRE(store.brick_mode(store.brick_index_of(0, 2, 17)) == BrickMode::dense);
+
+    WHEN("a box crossing bricks of every mode is read")
+    {
+      unsigned const x0 = 5, y0 = 1, z0 = 3, nx = 30, ny = 22, nz = 16;
+      std::vector<int> box(nx * ny * nz);
+      store.box_at(x0, y0, z0, nx, ny, nz, box.data());
+
+      THEN("every cell matches the one read by itself")
+      {
+        bool all_match = true;
+        for (unsigned z = 0; z < nz; ++z)
+          for (unsigned y = 0; y < ny; ++y)
+            for (unsigned x = 0; x < nx; ++x)
+              all_match = all_match
+                       && box[(z * ny + y) * nx + x] == store.cell_index_at(x0 + x, y0 + y, z0 + z);
+        REQUIRE(all_match);
+        REQUIRE(box[(14 * ny + 1) * nx + 10] == 15);
+        REQUIRE(box[(1 * ny + 19) * nx + 15] == 9);
+      }
+    }
+
+    THEN("a box reaching the far edges can be read, but not one past them")
+    {
+      std::vector<int> box(2 * 2 * 2);
+      store.box_at(38, 33, 18, 2, 2, 2, box.data());
+      REQUIRE(box == std::vector<int>(8, 3));
+      store.box_at(40, 35, 20, 0, 0, 0, box.data());
+      REQUIRE_THROWS_AS(store.box_at(39, 33, 18, 2, 2, 2, box.data()), std::out_of_range);
+      REQUIRE_THROWS_AS(store.box_at(38, 34, 18, 2, 2, 2, box.data()), std::out_of_range);
+      REQUIRE_THROWS_AS(store.box_at(38, 33, 19, 2, 2, 2, box.data()), std::out_of_range);
+    }
+  }
+}
+
+
+SCENARIO("ChunkStore bricks adapt their storage to their contents")
+{
+  using BrickMode = Legacy::World::ChunkStore::BrickMode;
+
+  GIVEN("A new ChunkStore")
+  {
+    Legacy::World::ChunkStore store(40, 40, 20);
+    auto empty_usage = store.memory_usage();
+
+    THEN("every brick is uniform and no cell storage is used")
+    {
+      REQUIRE(empty_usage.uniform_bricks == store.brick_count());
+      REQUIRE(empty_usage.palette_bricks == 0);
+      REQUIRE(empty_usage.dense_bricks == 0);
+    }
+
+    WHEN("a single cell is changed")
+    {
+      store.set_cell_index_at(3, 4, 5, 7);
+
+      THEN("its brick becomes a palette brick and keeps every value")
+      {
+        std::size_t brick = store.brick_index_of(3, 4, 5);
+        REQUIRE(store.brick_mode(brick) == BrickMode::palette);
+        REQUIRE(store.cell_index_at(3, 4, 5) == 7);
+        REQUIRE(store.cell_index_at(4, 4, 5) == 0);
+        REQUIRE(store.memory_usage().bytes > empty_usage.bytes);
+      }
+    }
+
+    WHEN("a brick is given more distinct values than a palette holds")
+    {
+      for (unsigned i = 0; i < 300; ++i)
+      {
+        store.set_cell_index_at(i % 16, (i / 16) % 16, i / 256, int(i) + 1);
+      }
+
+      THEN("the brick widens its palette and finally goes dense, keeping every value")
+      {
+        REQUIRE(store.brick_mode(0) == BrickMode::dense);
+        for (unsigned i = 0; i < 300; ++i)
+        {
+          REQUIRE(store.cell_index_at(i % 16, (i / 16) % 16, i / 256) == int(i) + 1);
+        }
+      }
+    }
+
+    WHEN("rows are written through a mutable row")
+    {
+      for (Legacy::World::CellSpan segment: store.row(0, 0))
+      {
+        for (int& index: segment)
+        {
+          index = 2;
+        }
+      }
+
+      THEN("the bricks along the row are dense")
+      {
+        REQUIRE(store.brick_mode(store.brick_index_of(0, 0, 0)) == BrickMode::dense);
+        REQUIRE(store.brick_mode(store.brick_index_of(39, 0, 0)) == BrickMode::dense);
+      }
+      AND_WHEN("the store is compacted")
+      {
+        Legacy::World::ChunkStore expected(40, 40, 20);
+        for (unsigned x = 0; x < 40; ++x)
+        {
+          expected.set_cell_index_at(x, 0, 0, 2);
+        }
+        store.compact();
+
+        THEN("the bricks go back to palette storage and the cells are unchanged")
+        {
+          REQUIRE(store.memory_usage().dense_bricks == 0);
+          REQUIRE(store.brick_mode(store.brick_index_of(0, 0, 0)) == BrickMode::palette);
+          REQUIRE(store == expected);
+        }
+      }
+    }
+
+    WHEN("the store is filled")
+    {
+      store.set_cell_index_at(3, 4, 5, 7);
+      store.fill(1);
+
+      THEN("every brick is uniform again")
+      {
+        REQUIRE(store.memory_usage().uniform_bricks == store.brick_count());
+        REQUIRE(store.cell_index_at(3, 4, 5) == 1);
+      }
+    }
+  }
+
+  GIVEN("A brick at the edge of a store whose cells inside the store are all the same")
+  {
+    Legacy::World::ChunkStore store(20, 20, 20);
+    for (unsigned z = 16; z < 20; ++z)
+      for (unsigned y = 16; y < 20; ++y)
+        for (Legacy::World::CellSpan segment: store.row(y, z))
+          for (int& index: segment)
+            index = 3;
+    store.compact();
+
+    THEN("it compacts to a uniform brick regardless of its padding")
+    {
+      REQUIRE(store.brick_mode(store.brick_index_of(19, 19, 19)) == BrickMode::uniform);
+      REQUIRE(store.cell_index_at(19, 19, 19) == 3);
+    }
+  }
+}
+
+
+SCENARIO("ChunkStore bricks can be borrowed from storage the store does not own")
+{
+  using BrickMode = Legacy::World::ChunkStore::BrickMode;
+
+  GIVEN("A store with a dense and a palette brick and a store borrowing them")
+  {
+    Legacy::World::ChunkStore source(32, 16, 16);
+    for (unsigned i = 0; i < 300; ++i)
+    {
+      source.set_cell_index_at(i % 16, (i / 16) % 16, i / 256, int(i) + 1);
+    }
+    source.set_cell_index_at(20, 3, 4, 9);
+    REQUIRE(source.brick_mode(0) == BrickMode::dense);
+    REQUIRE(source.brick_mode(1) == BrickMode::palette);
+
+    Legacy::World::ChunkStore store(32, 16, 16);
+    for (std::size_t i = 0; i < store.brick_count(); ++i)
+    {
+      store.borrow_encoded_brick(i, source.encoded_brick(i));
+    }
+
+    THEN("the cells are used in place")
+    {
+      REQUIRE(store == source);
+      REQUIRE(store.brick_borrowed(0));
+      REQUIRE(store.brick_borrowed(1));
+      REQUIRE(store.memory_usage().borrowed_bricks == 2);
+      REQUIRE(store.encoded_brick(0).cells == source.encoded_brick(0).cells);
+    }
+
+    WHEN("the borrowed bricks are changed")
+    {
+      store.set_cell_index_at(0, 0, 0, -1);
+      store.set_cell_index_at(20, 3, 4, -2);
+      store.compact();
+
+      THEN("they are copied first and the storage they came from is unchanged")
+      {
+        REQUIRE(!store.brick_borrowed(0));
+        REQUIRE(!store.brick_borrowed(1));
+        REQUIRE(store.cell_index_at(0, 0, 0) == -1);
+        REQUIRE(store.cell_index_at(1, 0, 0) == 2);
+        REQUIRE(store.cell_index_at(20, 3, 4) == -2);
+        REQUIRE(source.cell_index_at(0, 0, 0) == 1);
+        REQUIRE(source.cell_index_at(20, 3, 4) == 9);
+      }
+    }
+
+    WHEN("a borrowed brick is written through a mutable row")
+    {
+      for (Legacy::World::CellSpan segment: store.row(0, 0))
+      {
+        segment[0] = -3;
+        break;
+      }
+
+      THEN("only the copy is changed")
+      {
+        REQUIRE(store.cell_index_at(0, 0, 0) == -3);
+        REQUIRE(source.cell_index_at(0, 0, 0) == 1);
+      }
+    }
+  }
+}
+
+
+SCENARIO("ChunkStore content hashes follow the cells, not their storage")
+{
+  GIVEN("Two stores of the same cells, one compacted and one not")
+  {
+    Legacy::World::ChunkStore dense(40, 35, 20);
+    Legacy::World::ChunkStore compacted(40, 35, 20);
+    for (unsigned z = 0; z < 20; ++z)
+    {
+      for (unsigned y = 0; y < 35; ++y)
+      {
+        for (unsigned x = 0; x < 40; ++x)
+        {
+          int index = (z < 10) ? 1 : int((x * 3 + y) % 5);
+          dense.set_cell_index_at(x, y, z, index);
+          compacted.set_cell_index_at(x, y, z, index);
+        }
+      }
+    }
+    for (auto segment: dense.row(0, 0))
+      segment[0] = 1;
+    compacted.compact();
+
+    THEN("their hashes are the same")
+    {
+      REQUIRE(dense.content_hash() == compacted.content_hash());
+      REQUIRE(dense == compacted);
+    }
+
+    WHEN("a cell of one is changed")
+    {
+      std::uint64_t hash = compacted.content_hash();
+      std::uint64_t brick_hash = compacted.brick_hash(compacted.brick_index_of(39, 34, 19));
+      compacted.set_cell_index_at(39, 34, 19, 9);
+
+      THEN("its hash and that of the cell's brick change")
+      {
+        REQUIRE(compacted.content_hash() != hash);
+        REQUIRE(compacted.brick_hash(compacted.brick_index_of(39, 34, 19)) != brick_hash);
+        REQUIRE(compacted.content_hash() != dense.content_hash());
+        REQUIRE(compacted != dense);
+      }
+
+      AND_WHEN("it is changed back")
+      {
+        compacted.set_cell_index_at(39, 34, 19, (39 * 3 + 34) % 5);
+
+        THEN("the hash is as it was")
+        {
+          REQUIRE(compacted.content_hash() == hash);
+        }
+      }
+    }
+  }
+
+  GIVEN("Two stores of different extents holding the same value")
+  {
+    Legacy::World::ChunkStore lhs(32, 16, 4);
+    Legacy::World::ChunkStore rhs(16, 32, 4);
+
+    THEN("their hashes differ")
+    {
+      REQUIRE(lhs.content_hash() != rhs.content_hash());
+    }
+  }
+}
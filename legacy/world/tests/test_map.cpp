@@ -21,9 +21,14 @@
  */
 #include "catch/catch.hpp"
 #include "fake_mapbuilder.h"
+#include "FastNoise/FastNoise.h"
+#include <algorithm>
+#include "legacy/core/thread_pool.h"
 #include "legacy/world/map.h"
+#include "legacy/world/mapbuildersimple.h"
 #include "legacy/world/mapbuilderstatic.h"
 #include <stdexcept>
+#include <vector>
 
 
 SCENARIO("basic interface for the MapBuilderStatic class")
@@ -65,6 +70,541 @@ SCENARIO("basic interface for the Map class")
       REQUIRE(layer.length() == map_builder.map_length());
       REQUIRE(layer.width()  == map_builder.map_width());
     }
+
+    WHEN("a cell of a layer is updated")
+    {
+      map.layer(3).set_cell_index_at(4, 5, 7);
+
+      THEN("the update is visible in the map's cells")
+      {
+        REQUIRE(map.cells().cell_index_at(4, 5, 3) == 7);
+      }
+    }
+
+    WHEN("a copy of a layer is updated")
+    {
+      Legacy::World::MapLayer layer = map.layer(3);
+      layer.set_cell_index_at(4, 5, 7);
+
+      THEN("the map is unchanged")
+      {
+        REQUIRE(map.layer(3).cell_index_at(4, 5) == 0);
+      }
+    }
+
+    WHEN("a copy of the map is updated")
+    {
+      map.layer(2).set_cell_index_at(1, 1, 5);
+      Legacy::World::Map copy(map);
+      REQUIRE(copy == map);
+      copy.layer(3).set_cell_index_at(4, 5, 7);
+
+      THEN("the copy has its own cells")
+      {
+        REQUIRE(copy.cells().cell_index_at(4, 5, 3) == 7);
+        REQUIRE(copy.layer(2).cell_index_at(1, 1) == 5);
+        REQUIRE(map.cells().cell_index_at(4, 5, 3) == 0);
+        REQUIRE_FALSE(copy == map);
+      }
+
+      THEN("assigning the map to the copy makes them equal again")
+      {
+        copy = map;
+        REQUIRE(copy == map);
+        REQUIRE(copy.layer(3).cell_index_at(4, 5) == 0);
+        REQUIRE(copy.surface_height(1, 1) == map.surface_height(1, 1));
+      }
+    }
+  }
+}
+
+
+SCENARIO("cells of a map are changed copy-on-write through a cell cache")
+{
+  GIVEN("A Map whose cells are referenced in a cell cache")
+  {
+    Legacy::Tests::World::MapBuilderFake map_builder;
+    Legacy::World::Map map(map_builder);
+    Legacy::World::CellCache cache;
+    cache.add_refs(map.cells());
+    Legacy::World::Cell stone(3, 0, Legacy::World::Cell::full);
+
+    WHEN("two positions are changed to the same cell")
+    {
+      map.set_cell_at(1, 2, 3, stone, cache);
+      map.set_cell_at(4, 5, 6, stone, cache);
+
+      THEN("they share one cell")
+      {
+        REQUIRE(map.cell_index_at(1, 2, 3) == map.cell_index_at(4, 5, 6));
+        REQUIRE(map.cell_at(4, 5, 6, cache) == stone);
+        REQUIRE(cache.ref_count(map.cell_index_at(1, 2, 3)) == 2);
+      }
+
+      AND_WHEN("one of them is changed to a variant of the cell")
+      {
+        map.set_cell_at(1, 2, 3, map.cell_at(1, 2, 3, cache).with_occupancy(10), cache);
+
+        THEN("the other keeps the original cell")
+        {
+          REQUIRE(map.cell_at(1, 2, 3, cache) == stone.with_occupancy(10));
+          REQUIRE(map.cell_at(4, 5, 6, cache) == stone);
+          REQUIRE(cache.ref_count(map.cell_index_at(4, 5, 6)) == 1);
+        }
+      }
+
+      AND_WHEN("both are changed back and the cache is compacted")
+      {
+        map.set_cell_at(1, 2, 3, Legacy::World::Cell(), cache);
+        map.set_cell_at(4, 5, 6, Legacy::World::Cell(), cache);
+        Legacy::World::CellCache::Compaction compaction = cache.compact();
+
+        THEN("the cell is gone from the cache")
+        {
+          REQUIRE(compaction.released == 1);
+          REQUIRE(cache.find(stone) == -1);
+          REQUIRE(map.cell_index_at(1, 2, 3) == Legacy::World::CellCache::empty_index);
+        }
+      }
+    }
+  }
+}
+
+
+SCENARIO("the simple map builder generates cells directly")
+{
+  GIVEN("A simple map builder")
+  {
+    Legacy::World::MapBuilderSimple map_builder(40, 24, 20, 1);
+
+    WHEN("a map is built from it")
+    {
+      Legacy::World::Map map(map_builder);
+
+      THEN("its layers match the layers the builder generates")
+      {
+        Legacy::World::MapLayerBag layers = map_builder.layers();
+        REQUIRE(layers.size() == map.height());
+        for (unsigned i = 0; i < map.height(); ++i)
+        {
+          REQUIRE(layers[i] == map.layer(i));
+        }
+      }
+      AND_THEN("the bottom layer is solid and the top layer is empty")
+      {
+        REQUIRE(map.layer(0).cell_index_at(0, 0) == 1);
+        REQUIRE(map.layer(map.height() - 1).cell_index_at(0, 0) == 0);
+      }
+    }
+  }
+}
+
+
+
+SCENARIO("a map keeps the surface height of every column")
+{
+  GIVEN("A map generated by the simple builder")
+  {
+    Legacy::World::MapBuilderSimple builder(70, 50, 40, 3);
+    Legacy::World::Map map(builder);
+
+    THEN("each surface height is one above the topmost non-empty cell of its column")
+    {
+      bool all_match = true;
+      for (unsigned y = 0; y < map.width(); ++y)
+      {
+        for (unsigned x = 0; x < map.length(); ++x)
+        {
+          unsigned height = map.surface_height(x, y);
+          all_match = all_match
+                   && (height == 0 || map.cell_index_at(x, y, height - 1) != 0)
+                   && (height == map.height() || map.cell_index_at(x, y, height) == 0);
+        }
+      }
+      REQUIRE(all_match);
+    }
+
+    THEN("the builder's heights are those found from the cells")
+    {
+      std::vector<unsigned> kept(map.length() * map.width());
+      map.surface_heights(0, 0, map.length(), map.width(), kept.data());
+      std::vector<unsigned> found(map.length() * map.width());
+      map.cells().surface_heights(found.data());
+      REQUIRE(kept == found);
+    }
+
+    WHEN("a cell is set above a column's surface")
+    {
+      unsigned height = map.surface_height(5, 6);
+      map.set_cell_index_at(5, 6, 38, 2);
+
+      THEN("the surface rises to it")
+      {
+        REQUIRE(map.surface_height(5, 6) == 39);
+      }
+
+      AND_WHEN("it is emptied again")
+      {
+        map.set_cell_index_at(5, 6, 38, 0);
+
+        THEN("the surface falls back")
+        {
+          REQUIRE(map.surface_height(5, 6) == height);
+        }
+      }
+    }
+
+    WHEN("a column's surface cell is emptied")
+    {
+      unsigned height = map.surface_height(7, 8);
+      map.set_cell_index_at(7, 8, height - 1, 0);
+
+      THEN("the surface falls by one")
+      {
+        REQUIRE(map.surface_height(7, 8) == height - 1);
+      }
+    }
+
+    WHEN("cells are changed through a layer")
+    {
+      map.layer(39).set_cell_index_at(1, 2, 5);
+
+      THEN("the surface is found again")
+      {
+        REQUIRE(map.surface_height(1, 2) == 40);
+      }
+    }
+
+    WHEN("a block of surface heights is copied out")
+    {
+      std::vector<unsigned> heights(3 * 2);
+      map.surface_heights(60, 40, 3, 2, heights.data());
+
+      THEN("they are the heights of those columns")
+      {
+        REQUIRE(heights[0] == map.surface_height(60, 40));
+        REQUIRE(heights[5] == map.surface_height(62, 41));
+      }
+    }
+
+    THEN("columns outside the map are rejected")
+    {
+      unsigned height;
+      REQUIRE_THROWS_AS(map.surface_height(70, 0), std::out_of_range);
+      REQUIRE_THROWS_AS(map.surface_heights(69, 0, 2, 1, &height), std::out_of_range);
+    }
+  }
+
+  GIVEN("A map built from a builder that does not know its surface")
+  {
+    Legacy::Tests::World::MapBuilderFake map_builder;
+    Legacy::World::Map map(map_builder);
+
+    THEN("the surface is found from the cells")
+    {
+      REQUIRE(map.surface_height(0, 0) == 0);
+    }
+  }
+
+  GIVEN("A lazy map and the same map built whole")
+  {
+    Legacy::World::MapBuilderSimple builder(128, 128, 20, 9);
+    Legacy::World::Map lazy(builder, Legacy::World::LazyMapOptions());
+    Legacy::World::Map whole(builder);
+
+    THEN("their surfaces are the same")
+    {
+      REQUIRE(lazy.surface_height(100, 3) == whole.surface_height(100, 3));
+      REQUIRE(lazy.surface_height(0, 127) == whole.surface_height(0, 127));
+    }
+  }
+}
+
+
+SCENARIO("a map gives boxes, columns and neighbourhoods of cells in bulk")
+{
+  using Legacy::World::Map;
+
+  GIVEN("A map generated by the simple builder")
+  {
+    Legacy::World::MapBuilderSimple builder(70, 50, 40, 5);
+    Map map(builder);
+    map.set_cell_index_at(30, 30, 30, 7);
+
+    THEN("a box holds the cells read one by one")
+    {
+      unsigned const x0 = 10, y0 = 20, z0 = 5, nx = 40, ny = 25, nz = 30;
+      std::vector<int> box(nx * ny * nz);
+      map.box_at(x0, y0, z0, nx, ny, nz, box.data());
+      bool all_match = true;
+      for (unsigned z = 0; z < nz; ++z)
+        for (unsigned y = 0; y < ny; ++y)
+          for (unsigned x = 0; x < nx; ++x)
+            all_match = all_match
+                     && box[(z * ny + y) * nx + x] == map.cell_index_at(x0 + x, y0 + y, z0 + z);
+      REQUIRE(all_match);
+      REQUIRE_THROWS_AS(map.box_at(60, 0, 0, 11, 1, 1, box.data()), std::out_of_range);
+    }
+
+    THEN("a column holds its cells bottom to top")
+    {
+      std::vector<int> column(map.height());
+      map.column_at(30, 30, column.data());
+      REQUIRE(column[30] == 7);
+      for (unsigned z = 0; z < map.height(); ++z)
+        REQUIRE(column[z] == map.cell_index_at(30, 30, z));
+      REQUIRE_THROWS_AS(map.column_at(0, 50, column.data()), std::out_of_range);
+    }
+
+    THEN("the neighbourhoods of a cell inside the map are its neighbours")
+    {
+      int six[6];
+      map.neighbours6_at(30, 30, 31, six);
+      REQUIRE(six[0] == 7);
+      int twenty_six[26];
+      map.neighbours26_at(29, 29, 29, twenty_six);
+      REQUIRE(twenty_six[25] == 7);
+
+      bool all_match = true;
+      for (unsigned x: { 1u, 31u, 68u })
+      {
+        map.neighbours6_at(x, 25, 20, six);
+        for (std::size_t i = 0; i < 6; ++i)
+          all_match = all_match
+                   && six[i] == map.cell_index_at(x + Map::neighbours6[i][0],
+                                                  25 + Map::neighbours6[i][1],
+                                                  20 + Map::neighbours6[i][2]);
+        map.neighbours26_at(x, 25, 20, twenty_six);
+        for (std::size_t i = 0; i < 26; ++i)
+          all_match = all_match
+                   && twenty_six[i] == map.cell_index_at(x + Map::neighbours26[i][0],
+                                                         25 + Map::neighbours26[i][1],
+                                                         20 + Map::neighbours26[i][2]);
+      }
+      REQUIRE(all_match);
+    }
+
+    THEN("the neighbours of a corner cell outside the map are given as outside")
+    {
+      int six[6];
+      map.neighbours6_at(0, 0, 0, six);
+      REQUIRE(six[0] == Map::outside);
+      REQUIRE(six[1] == Map::outside);
+      REQUIRE(six[2] == Map::outside);
+      REQUIRE(six[3] == map.cell_index_at(1, 0, 0));
+      REQUIRE(six[4] == map.cell_index_at(0, 1, 0));
+      REQUIRE(six[5] == map.cell_index_at(0, 0, 1));
+
+      int twenty_six[26];
+      map.neighbours26_at(69, 49, 39, twenty_six);
+      std::size_t inside = 0;
+      for (std::size_t i = 0; i < 26; ++i)
+      {
+        bool in_map = Map::neighbours26[i][0] <= 0
+                   && Map::neighbours26[i][1] <= 0
+                   && Map::neighbours26[i][2] <= 0;
+        if (in_map)
+        {
+          ++inside;
+          REQUIRE(twenty_six[i] == map.cell_index_at(69 + Map::neighbours26[i][0],
+                                                     49 + Map::neighbours26[i][1],
+                                                     39 + Map::neighbours26[i][2]));
+        }
+        else
+          REQUIRE(twenty_six[i] == Map::outside);
+      }
+      REQUIRE(inside == 7);
+      REQUIRE_THROWS_AS(map.neighbours26_at(70, 0, 0, twenty_six), std::out_of_range);
+    }
+  }
+
+  GIVEN("A lazy map and the same map built whole")
+  {
+    Legacy::World::MapBuilderSimple builder(100, 70, 20, 11);
+    Legacy::World::LazyMapOptions options;
+    options.region_size = 32;
+    options.resident_regions = 2;
+    Map lazy(builder, options);
+    Map whole(builder);
+
+    THEN("a box spanning several regions is the same in both")
+    {
+      unsigned const nx = 90, ny = 60, nz = 20;
+      std::vector<int> lazy_box(nx * ny * nz);
+      lazy.box_at(5, 5, 0, nx, ny, nz, lazy_box.data());
+      std::vector<int> whole_box(nx * ny * nz);
+      whole.box_at(5, 5, 0, nx, ny, nz, whole_box.data());
+      REQUIRE(lazy_box == whole_box);
+    }
+
+    THEN("columns and neighbourhoods across a region edge are the same in both")
+    {
+      std::vector<int> lazy_column(20), whole_column(20);
+      lazy.column_at(64, 31, lazy_column.data());
+      whole.column_at(64, 31, whole_column.data());
+      REQUIRE(lazy_column == whole_column);
+
+      std::vector<int> lazy_cells(26), whole_cells(26);
+      lazy.neighbours26_at(32, 31, 10, lazy_cells.data());
+      whole.neighbours26_at(32, 31, 10, whole_cells.data());
+      REQUIRE(lazy_cells == whole_cells);
+      lazy.neighbours6_at(32, 31, 10, lazy_cells.data());
+      whole.neighbours6_at(32, 31, 10, whole_cells.data());
+      REQUIRE(std::equal(lazy_cells.begin(), lazy_cells.begin() + 6, whole_cells.begin()));
+    }
   }
 }
 
+
+SCENARIO("generated maps can be told apart by their content hashes")
+{
+  GIVEN("Maps generated from the same and different seeds")
+  {
+    Legacy::World::MapBuilderSimple builder(64, 48, 20, 11);
+    Legacy::World::MapBuilderSimple same_builder(64, 48, 20, 11);
+    Legacy::World::MapBuilderSimple other_builder(64, 48, 20, 12);
+    Legacy::World::Map map(builder);
+    Legacy::World::Map same(same_builder);
+    Legacy::World::Map other(other_builder);
+
+    THEN("maps from the same seed hash the same and others do not")
+    {
+      REQUIRE(map.content_hash() == same.content_hash());
+      REQUIRE(map.content_hash() != other.content_hash());
+    }
+
+    WHEN("a cell of the map is changed")
+    {
+      std::uint64_t hash = map.content_hash();
+      map.set_cell_index_at(10, 10, 10, 3);
+
+      THEN("its hash changes")
+      {
+        REQUIRE(map.content_hash() != hash);
+        REQUIRE_FALSE(map == same);
+      }
+    }
+  }
+
+  GIVEN("A lazy map")
+  {
+    Legacy::World::MapBuilderSimple builder(128, 128, 8, 1);
+    Legacy::World::Map map(builder, Legacy::World::LazyMapOptions());
+
+    THEN("it has no content hash")
+    {
+      REQUIRE_THROWS_AS(map.content_hash(), std::logic_error);
+    }
+  }
+}
+
+
+SCENARIO("the simple map builder is deterministic whatever the number of threads")
+{
+  GIVEN("simple map builders with the same seed on pools of different sizes")
+  {
+    // Not a multiple of the brick size in any direction, so edge tiles are
+    // partial.
+    unsigned const length = 70, width = 45, height = 37;
+    Legacy::Core::ThreadPool one_thread(1);
+    Legacy::Core::ThreadPool four_threads(4);
+    Legacy::World::MapBuilderSimple serial_builder(length, width, height, 1234, one_thread);
+    Legacy::World::MapBuilderSimple parallel_builder(length, width, height, 1234, four_threads);
+
+    WHEN("a map is built from each")
+    {
+      Legacy::World::Map serial_map(serial_builder);
+      Legacy::World::Map parallel_map(parallel_builder);
+
+      THEN("the maps are identical")
+      {
+        REQUIRE(serial_map == parallel_map);
+      }
+      AND_THEN("every column is filled up to its noise height")
+      {
+        FastNoise noise;
+        noise.SetSeed(1234);
+        noise.SetNoiseType(FastNoise::GradientFractal);
+        bool all_match = true;
+        for (unsigned y = 0; y < width; ++y)
+        {
+          for (unsigned x = 0; x < length; ++x)
+          {
+            unsigned surface = height / 2.0f + height / 4.0f * noise.GetNoise(x, y) + 1.0f;
+            surface = std::min(surface, height);
+            for (unsigned z = 0; z < height; ++z)
+            {
+              int expected = (z < surface) ? 1 : 0;
+              all_match = all_match && parallel_map.cells().cell_index_at(x, y, z) == expected;
+            }
+          }
+        }
+        REQUIRE(all_match);
+      }
+    }
+  }
+}
+
+
+SCENARIO("a lazily built map builds its regions as they are used")
+{
+  GIVEN("a simple map builder and a lazy map from it holding at most two regions")
+  {
+    unsigned const length = 70, width = 45, height = 37;
+    Legacy::World::MapBuilderSimple map_builder(length, width, height, 1234);
+    Legacy::World::LazyMapOptions options;
+    options.region_size = 32;
+    options.resident_regions = 2;
+    Legacy::World::Map lazy_map(map_builder, options);
+
+    THEN("no region is built until a cell is used")
+    {
+      REQUIRE(lazy_map.is_lazy());
+      REQUIRE(lazy_map.resident_regions() == 0);
+      REQUIRE(lazy_map.length() == length);
+      REQUIRE(lazy_map.width() == width);
+      REQUIRE(lazy_map.height() == height);
+      REQUIRE_THROWS_AS(lazy_map.layer(0), std::logic_error);
+      REQUIRE_THROWS_AS(lazy_map.cells(), std::logic_error);
+      REQUIRE_THROWS_AS(Legacy::World::Map{lazy_map}, std::logic_error);
+      REQUIRE_THROWS_AS(lazy_map.cell_index_at(length, 0, 0), std::out_of_range);
+    }
+
+    WHEN("every cell is read")
+    {
+      Legacy::World::Map eager_map(map_builder);
+
+      THEN("the cells match the eagerly built map and the budget is kept")
+      {
+        REQUIRE(lazy_map == eager_map);
+        REQUIRE(lazy_map.resident_regions() == 2);
+      }
+    }
+
+    WHEN("a cell is changed and its region is dropped")
+    {
+      lazy_map.set_cell_index_at(1, 2, 3, 42);
+      lazy_map.cell_index_at(40, 0, 0);
+      lazy_map.cell_index_at(0, 40, 0);
+      lazy_map.cell_index_at(40, 40, 0);
+
+      THEN("the change is kept")
+      {
+        REQUIRE(lazy_map.resident_regions() == 2);
+        REQUIRE(lazy_map.cell_index_at(1, 2, 3) == 42);
+        REQUIRE(lazy_map.cell_index_at(2, 2, 3) != 42);
+      }
+    }
+  }
+
+  GIVEN("a builder that can not build regions")
+  {
+    Legacy::Tests::World::MapBuilderFake map_builder;
+
+    THEN("a lazy map can not be made from it")
+    {
+      REQUIRE_THROWS_AS(Legacy::World::Map(map_builder, Legacy::World::LazyMapOptions()),
+                        std::invalid_argument);
+    }
+  }
+}
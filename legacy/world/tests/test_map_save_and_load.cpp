@@ -20,11 +20,89 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "catch/catch.hpp"
+#include <algorithm>
 #include "fake_mapbuilder.h"
 #include "legacy/world/map.h"
+#include "legacy/world/mapbuilderbinary.h"
+#include "legacy/world/mapbuildersimple.h"
 #include "legacy/world/mapbuilderstream.h"
+#include <cstring>
 #include <sstream>
 #include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+
+/** A save held in memory, standing in for a mapped file. */
+class MemoryMappedFile
+: public Legacy::Core::MappedFile
+{
+public:
+  MemoryMappedFile(std::string const& contents)
+  : words_(contents.size() / sizeof(std::uint64_t) + 1)
+  , size_(contents.size())
+  { std::memcpy(words_.data(), contents.data(), size_); }
+
+  char const*
+  data() const override
+  { return reinterpret_cast<char const*>(words_.data()); }
+
+  std::size_t
+  size() const override
+  { return size_; }
+
+private:
+  std::vector<std::uint64_t> words_;
+  std::size_t                size_;
+};
+
+
+/**
+ * A stream buffer that can not seek, such as that of a pipe, handing out its
+ * contents a few bytes at a time.
+ */
+class PipeStreamBuf
+: public std::streambuf
+{
+public:
+  PipeStreamBuf(std::string const& contents, std::size_t chunk)
+  : contents_(contents)
+  , chunk_(chunk)
+  , next_(0)
+  { }
+
+protected:
+  int_type
+  underflow() override
+  {
+    if (gptr() != egptr())
+      return traits_type::to_int_type(*gptr());
+    if (next_ == contents_.size())
+      return traits_type::eof();
+    std::size_t count = std::min(chunk_, contents_.size() - next_);
+    char* start = &contents_[next_];
+    setg(start, start, start + count);
+    next_ += count;
+    return traits_type::to_int_type(*gptr());
+  }
+
+private:
+  std::string contents_;
+  std::size_t chunk_;
+  std::size_t next_;
+};
+
+
+Legacy::Core::MappedFileOwningPtr
+map_save(std::string const& contents)
+{
+  return Legacy::Core::MappedFileOwningPtr(new MemoryMappedFile(contents));
+}
+
+} // anonymous namespace
 
 
 SCENARIO("saving and loading a map object yields an identical copy")
@@ -48,6 +126,53 @@ SCENARIO("saving and loading a map object yields an identical copy")
       }
     }
   }
+
+  GIVEN("A generated map larger than a read block, with some negative indexes")
+  {
+    Legacy::World::MapBuilderSimple map_builder(70, 50, 40, 8);
+    Legacy::World::Map map(map_builder);
+    map.set_cell_index_at(0, 0, 0, -7);
+    map.set_cell_index_at(69, 49, 39, 999);
+    map.set_cell_index_at(33, 20, 17, -99);
+    map.set_cell_index_at(50, 20, 17, 123);
+
+    WHEN("the map is saved to a stream followed by other text")
+    {
+      std::stringstream sstr;
+      sstr << map << "trailer";
+
+      THEN("the map loaded from the save is identical and the text after it is left")
+      {
+        Legacy::World::MapBuilderStream stream_builder(sstr);
+        Legacy::World::Map map2(stream_builder);
+        REQUIRE(map == map2);
+
+        std::string trailer;
+        sstr >> trailer;
+        REQUIRE(trailer == "trailer");
+      }
+    }
+
+    WHEN("the map is read from a stream that can not seek, followed by other text")
+    {
+      std::ostringstream ostr;
+      ostr << map << "trailer";
+      PipeStreamBuf pipe(ostr.str(), 1000);
+      std::istream istr(&pipe);
+
+      THEN("the map loaded from it is identical and the text after it is left")
+      {
+        Legacy::World::MapBuilderStream stream_builder(istr);
+        Legacy::World::Map map2(stream_builder);
+        REQUIRE(map == map2);
+        REQUIRE(istr);
+
+        std::string trailer;
+        istr >> trailer;
+        REQUIRE(trailer == "trailer");
+      }
+    }
+  }
 }
 
 
@@ -65,5 +190,411 @@ SCENARIO("map streamloading failures")
       }
     }
   }
+
+  GIVEN("Saves with a missing layer, a bad index, an index too large and too few indexes")
+  {
+    char const* header = "version 20161108\nlwh 2 1 2\n";
+    char const* bodies[] = {
+      "layer 0\n 1 2\n laier 1\n 3 4\n",
+      "layer 0\n 1 2\nlayer 1\n 3x 4\n",
+      "layer 0\n 1 2\nlayer 1\n 3 2147483648\n",
+      "layer 0\n 1 2\nlayer 1\n 3\n",
+    };
+
+    THEN("loading each throws an exception")
+    {
+      for (char const* body: bodies)
+      {
+        std::stringstream sstr(std::string(header) + body);
+        Legacy::World::MapBuilderStream stream_builder(sstr);
+        CHECK_THROWS_AS(Legacy::World::Map(stream_builder), std::runtime_error);
+      }
+    }
+  }
+}
+
+
+
+SCENARIO("saving and loading a map in binary yields an identical copy")
+{
+  GIVEN("A Map built from a fake map builder")
+  {
+    Legacy::Tests::World::MapBuilderFake map_builder;
+    Legacy::World::Map map(map_builder);
+
+    WHEN("the map is saved to a stream in binary")
+    {
+      std::stringstream sstr;
+      Legacy::World::write_binary(sstr, map);
+
+      THEN("the map loaded from the save it is identical to the original")
+      {
+        Legacy::World::MapBuilderBinary binary_builder(sstr);
+        Legacy::World::Map map2(binary_builder);
+
+        REQUIRE(map == map2);
+      }
+    }
+  }
+
+  GIVEN("A Map of uniform, palette and dense bricks")
+  {
+    Legacy::World::MapBuilderSimple map_builder(40, 35, 20, 7);
+    Legacy::World::Map map(map_builder);
+    Legacy::World::ChunkStore& cells = map.cells();
+    for (unsigned y = 0; y < 16; ++y)
+      for (unsigned x = 0; x < 16; ++x)
+        for (unsigned z = 0; z < 16; ++z)
+          cells.set_cell_index_at(x, y, z, int(x * 16 + y * 3 + z) - 100);
+    cells.compact();
+    REQUIRE(cells.brick_mode(0) == Legacy::World::ChunkStore::BrickMode::dense);
+
+    WHEN("the map is saved to a stream in binary")
+    {
+      std::stringstream sstr;
+      Legacy::World::write_binary(sstr, map);
+
+      THEN("the map loaded from the save it is identical to the original")
+      {
+        Legacy::World::MapBuilderBinary binary_builder(sstr);
+        REQUIRE(binary_builder.map_length() == 40);
+        REQUIRE(binary_builder.map_width() == 35);
+        REQUIRE(binary_builder.map_height() == 20);
+        Legacy::World::Map map2(binary_builder);
+
+        REQUIRE(map == map2);
+        REQUIRE(map2.cells().memory_usage().dense_bricks == map.cells().memory_usage().dense_bricks);
+      }
+    }
+  }
+}
+
+
+SCENARIO("binary map loading failures")
+{
+  Legacy::Tests::World::MapBuilderFake map_builder;
+  Legacy::World::Map map(map_builder);
+  std::ostringstream ostr;
+  Legacy::World::write_binary(ostr, map);
+  std::string const save = ostr.str();
+
+  GIVEN("An empty stream")
+  {
+    std::stringstream sstr;
+
+    THEN("An exception is thrown on reading the header.")
+    {
+      CHECK_THROWS_AS(Legacy::World::MapBuilderBinary(sstr), std::runtime_error);
+    }
+  }
+
+  GIVEN("A text save")
+  {
+    std::stringstream sstr;
+    sstr << map;
+
+    THEN("An exception is thrown on reading the header.")
+    {
+      CHECK_THROWS_AS(Legacy::World::MapBuilderBinary(sstr), std::runtime_error);
+    }
+  }
+
+  GIVEN("A save with a damaged header")
+  {
+    std::string damaged = save;
+    damaged[12] ^= 1;
+    std::istringstream istr(damaged);
+
+    THEN("An exception is thrown on reading the header.")
+    {
+      CHECK_THROWS_AS(Legacy::World::MapBuilderBinary(istr), std::runtime_error);
+    }
+  }
+
+  GIVEN("A save with a damaged layer block")
+  {
+    std::string damaged = save;
+    damaged[damaged.size() - 1] ^= 1;
+    std::istringstream istr(damaged);
+    Legacy::World::MapBuilderBinary binary_builder(istr);
+
+    THEN("An exception is thrown on loading the map.")
+    {
+      CHECK_THROWS_AS(Legacy::World::Map(binary_builder), std::runtime_error);
+    }
+  }
+
+  GIVEN("A truncated save")
+  {
+    std::istringstream istr(save.substr(0, save.size() - 4));
+    Legacy::World::MapBuilderBinary binary_builder(istr);
+
+    THEN("An exception is thrown on loading the map.")
+    {
+      CHECK_THROWS_AS(Legacy::World::Map(binary_builder), std::runtime_error);
+    }
+  }
+}
+
+
+SCENARIO("loading a mapped binary map uses the mapping in place")
+{
+  GIVEN("A binary save of a map with uniform, palette and dense bricks")
+  {
+    Legacy::World::MapBuilderSimple map_builder(40, 35, 20, 7);
+    Legacy::World::Map map(map_builder);
+    for (unsigned y = 0; y < 16; ++y)
+      for (unsigned x = 0; x < 16; ++x)
+        for (unsigned z = 0; z < 16; ++z)
+          map.cells().set_cell_index_at(x, y, z, int(x * 16 + y * 3 + z));
+    map.cells().compact();
+    std::ostringstream ostr;
+    Legacy::World::write_binary(ostr, map);
+    std::string const save = ostr.str();
+
+    WHEN("the save is mapped and loaded")
+    {
+      Legacy::World::MapBuilderMapped mapped_builder(map_save(save), true);
+      Legacy::World::Map map2(mapped_builder);
+
+      THEN("the map is identical to the original and its bricks are borrowed")
+      {
+        REQUIRE(map == map2);
+        auto usage = map2.cells().memory_usage();
+        REQUIRE(usage.borrowed_bricks == usage.palette_bricks + usage.dense_bricks);
+        REQUIRE(usage.borrowed_bricks > 0);
+        REQUIRE(map2.cells().brick_borrowed(0));
+      }
+
+      AND_WHEN("cells of the loaded map are changed")
+      {
+        map2.cells().set_cell_index_at(0, 0, 0, -1);
+        map2.layer(19).set_cell_index_at(39, 34, -2);
+
+        THEN("only the changed bricks are copied")
+        {
+          REQUIRE(!map2.cells().brick_borrowed(0));
+          REQUIRE(map2.cells().cell_index_at(0, 0, 0) == -1);
+          REQUIRE(map2.cells().cell_index_at(39, 34, 19) == -2);
+          REQUIRE(map2.cells().cell_index_at(1, 0, 0) == map.cells().cell_index_at(1, 0, 0));
+          REQUIRE(map2.cells().memory_usage().borrowed_bricks < map.cells().brick_count());
+        }
+      }
+
+      AND_WHEN("the builder is gone")
+      {
+        Legacy::World::Map map3 = [&save]() {
+          Legacy::World::MapBuilderMapped builder(map_save(save));
+          return Legacy::World::Map(builder);
+        }();
+
+        THEN("the map keeps the mapping alive")
+        {
+          REQUIRE(map == map3);
+        }
+      }
+    }
+
+    WHEN("the save is mapped and loaded and the mapping then changes")
+    {
+      map.cells().set_cell_index_at(0, 0, 16, 0);
+      map.cells().set_cell_index_at(0, 0, 17, 0);
+      map.cells().set_cell_index_at(0, 0, 18, 0);
+      map.cells().set_cell_index_at(0, 0, 19, 0);
+      std::ostringstream column_ostr;
+      Legacy::World::write_binary(column_ostr, map);
+      std::string const column_save = column_ostr.str();
+
+      Legacy::Core::MappedFileOwningPtr mapping = map_save(column_save);
+      char* data = const_cast<char*>(mapping->data());
+      Legacy::World::MapBuilderMapped mapped_builder(std::move(mapping));
+      Legacy::World::Map const map2(mapped_builder);
+
+      // Empty the column at (0, 0) of the first brick, which is dense and
+      // starts the first block's data.
+      std::size_t table_size = 0;
+      for (int i = 3; i >= 0; --i)
+        table_size = table_size << 8 | std::uint8_t(column_save[52 + i]);
+      char* cells = data + Legacy::World::BinaryMap::header_size + Legacy::World::BinaryMap::block_header_size + table_size;
+      for (unsigned z = 0; z < 16; ++z)
+        std::memset(cells + z * 256 * sizeof(std::int32_t), 0, sizeof(std::int32_t));
+
+      THEN("the bricks are borrowed and not read until the first surface query")
+      {
+        REQUIRE(map2.cells().brick_borrowed(0));
+        REQUIRE(map.surface_height(0, 0) == 16);
+        REQUIRE(map2.surface_height(0, 0) == 0);
+      }
+    }
+
+    WHEN("the brick data is damaged")
+    {
+      // The first brick is dense and its cells start the first block's data.
+      std::size_t table_size = 0;
+      for (int i = 3; i >= 0; --i)
+        table_size = table_size << 8 | std::uint8_t(save[52 + i]);
+      std::string damaged = save;
+      damaged[Legacy::World::BinaryMap::header_size + Legacy::World::BinaryMap::block_header_size + table_size] ^= 1;
+
+      THEN("the damage is found only if the data is checked")
+      {
+        Legacy::World::MapBuilderMapped unchecked_builder(map_save(damaged));
+        Legacy::World::Map damaged_map(unchecked_builder);
+        CHECK(damaged_map.cells().cell_index_at(0, 0, 0) != map.cells().cell_index_at(0, 0, 0));
+        Legacy::World::MapBuilderMapped checked_builder(map_save(damaged), true);
+        CHECK_THROWS_AS(Legacy::World::Map(checked_builder), std::runtime_error);
+      }
+    }
+
+    WHEN("the save is truncated or is not a binary save")
+    {
+      THEN("an exception is thrown")
+      {
+        Legacy::World::MapBuilderMapped truncated_builder(map_save(save.substr(0, save.size() - 4)));
+        CHECK_THROWS_AS(Legacy::World::Map(truncated_builder), std::runtime_error);
+        CHECK_THROWS_AS(Legacy::World::MapBuilderMapped(map_save("version 20161108\n")), std::runtime_error);
+        CHECK_THROWS_AS(Legacy::World::MapBuilderMapped(Legacy::Core::MappedFileOwningPtr()), std::runtime_error);
+      }
+    }
+  }
 }
 
+
+SCENARIO("a delta save holds only the bricks changed since a full save")
+{
+  GIVEN("A Map loaded from a full binary save")
+  {
+    Legacy::World::MapBuilderSimple map_builder(100, 90, 20, 5);
+    Legacy::World::Map original(map_builder);
+    std::stringstream base;
+    Legacy::World::write_binary(base, original);
+    std::string const base_save = base.str();
+
+    std::istringstream base_in(base_save);
+    Legacy::World::MapBuilderBinary base_builder(base_in);
+    Legacy::World::Map map(base_builder);
+
+    THEN("no bricks are dirty")
+    {
+      REQUIRE(map.dirty_bricks() == 0);
+    }
+
+    WHEN("a few cells are changed and a delta is saved")
+    {
+      map.set_cell_index_at(3, 4, 5, 42);
+      map.set_cell_index_at(99, 89, 19, 43);
+      for (auto segment: map.cells().row(50, 10))
+        std::fill(segment.begin(), segment.end(), 44);
+      map.cells().compact();
+      std::stringstream delta;
+      Legacy::World::write_binary_delta(delta, map);
+
+      THEN("only the changed bricks are dirty and the delta is smaller than a full save")
+      {
+        REQUIRE(map.dirty_bricks() == 9);
+        REQUIRE(delta.str().size() < base_save.size() / 2);
+      }
+
+      THEN("the base save with the delta applied loads as the changed map")
+      {
+        std::istringstream base_again(base_save);
+        Legacy::World::MapBuilderBinary binary_builder(base_again);
+        Legacy::World::MapBuilderDelta delta_builder(binary_builder, delta);
+        Legacy::World::Map loaded(delta_builder);
+
+        REQUIRE(loaded == map);
+        REQUIRE(loaded.dirty_bricks() == 9);
+      }
+
+      THEN("the delta can be applied to the base save mapped into memory")
+      {
+        Legacy::World::MapBuilderMapped mapped_builder(map_save(base_save));
+        Legacy::World::MapBuilderDelta delta_builder(mapped_builder, delta);
+        Legacy::World::Map loaded(delta_builder);
+
+        REQUIRE(loaded == map);
+      }
+
+      AND_WHEN("the map is marked clean after a full save")
+      {
+        map.clear_dirty();
+        std::stringstream empty_delta;
+        Legacy::World::write_binary_delta(empty_delta, map);
+
+        THEN("the next delta holds no bricks")
+        {
+          std::istringstream base_again(base_save);
+          Legacy::World::MapBuilderBinary binary_builder(base_again);
+          Legacy::World::MapBuilderDelta delta_builder(binary_builder, empty_delta);
+          Legacy::World::Map loaded(delta_builder);
+
+          REQUIRE(map.dirty_bricks() == 0);
+          REQUIRE(loaded == original);
+        }
+      }
+    }
+
+    WHEN("a cell is changed and compacted")
+    {
+      map.set_cell_index_at(3, 4, 5, 42);
+      map.cells().compact();
+
+      THEN("only its brick is dirty")
+      {
+        REQUIRE(map.dirty_bricks() == 1);
+      }
+    }
+  }
+}
+
+
+SCENARIO("map delta loading failures")
+{
+  GIVEN("A delta save of a changed map")
+  {
+    Legacy::World::MapBuilderSimple map_builder(40, 40, 8, 5);
+    Legacy::World::Map map(map_builder);
+    map.clear_dirty();
+    map.set_cell_index_at(1, 1, 1, 7);
+    std::stringstream delta;
+    Legacy::World::write_binary_delta(delta, map);
+    std::string const delta_save = delta.str();
+
+    WHEN("it is applied to a map of different extents")
+    {
+      Legacy::World::ChunkStore cells(40, 41, 8);
+      std::istringstream delta_in(delta_save);
+
+      THEN("an exception is thrown")
+      {
+        REQUIRE_THROWS_AS(Legacy::World::apply_binary_delta(delta_in, cells), std::runtime_error);
+      }
+    }
+
+    WHEN("its brick data is damaged")
+    {
+      std::string damaged = delta_save;
+      damaged[damaged.size() - 1] ^= 0x5a;
+      Legacy::World::ChunkStore cells(40, 40, 8);
+      cells.fill(3);
+      std::istringstream delta_in(damaged);
+
+      THEN("an exception is thrown and the cells are unchanged")
+      {
+        REQUIRE_THROWS_AS(Legacy::World::apply_binary_delta(delta_in, cells), std::runtime_error);
+        REQUIRE(cells.cell_index_at(1, 1, 1) == 3);
+      }
+    }
+
+    WHEN("it is truncated")
+    {
+      std::istringstream delta_in(delta_save.substr(0, delta_save.size() - 8));
+      Legacy::World::ChunkStore cells(40, 40, 8);
+
+      THEN("an exception is thrown")
+      {
+        REQUIRE_THROWS_AS(Legacy::World::apply_binary_delta(delta_in, cells), std::runtime_error);
+      }
+    }
+  }
+}
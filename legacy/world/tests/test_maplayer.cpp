@@ -20,8 +20,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "catch/catch.hpp"
+#include "legacy/world/chunkstore.h"
 #include "legacy/world/maplayer.h"
+#include <cstdint>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
 
 SCENARIO("basic interface for the MapLayer class")
@@ -74,6 +78,101 @@ SCENARIO("basic interface for the MapLayer class")
     }
   }
 
+  GIVEN("A map layer wider than a brick")
+  {
+    static const unsigned given_length = 40;
+    static const unsigned given_width  = 3;
+    Legacy::World::MapLayer map_layer(given_length, given_width);
+    for (unsigned x = 0; x < given_length; ++x)
+    {
+      map_layer.set_cell_index_at(x, 1, x + 1);
+    }
+
+    WHEN("a row is retrieved")
+    {
+      Legacy::World::ConstCellRow row = static_cast<Legacy::World::MapLayer const&>(map_layer).row(1);
+
+      THEN("its segments hold the cells of the row in order")
+      {
+        REQUIRE(row.size() == given_length);
+        REQUIRE(row.segment_count() == 3);
+        std::vector<int> cells;
+        for (Legacy::World::ConstCellSpan segment: row)
+        {
+          cells.insert(cells.end(), segment.begin(), segment.end());
+        }
+        REQUIRE(cells.size() == given_length);
+        for (unsigned x = 0; x < given_length; ++x)
+        {
+          REQUIRE(cells[x] == int(x + 1));
+        }
+      }
+    }
+
+    WHEN("a row is updated through its segments")
+    {
+      for (Legacy::World::CellSpan segment: map_layer.row(2))
+      {
+        for (int& index: segment)
+        {
+          index = 7;
+        }
+      }
+
+      THEN("the cells are updated")
+      {
+        REQUIRE(map_layer.cell_index_at(0, 2) == 7);
+        REQUIRE(map_layer.cell_index_at(given_length - 1, 2) == 7);
+        REQUIRE(map_layer.cell_index_at_unchecked(20, 2) == 7);
+        REQUIRE(map_layer.cell_index_at(20, 1) == 21);
+      }
+    }
+
+    WHEN("a requested row is out of bounds")
+    {
+      THEN("an out-of-range exception gets raised")
+      {
+        CHECK_THROWS_AS(map_layer.row(given_width), std::out_of_range);
+      }
+    }
+  }
+
+  GIVEN("A map layer that is a view of a ChunkStore")
+  {
+    Legacy::World::ChunkStore store(12, 12, 4);
+    Legacy::World::MapLayer view(store, 2);
+
+    WHEN("a cell is updated through the view")
+    {
+      view.set_cell_index_at(3, 4, 5);
+      THEN("the store is updated")
+      {
+        REQUIRE(store.cell_index_at(3, 4, 2) == 5);
+      }
+    }
+
+    WHEN("another layer is assigned to the view")
+    {
+      Legacy::World::MapLayer other(12, 12);
+      other.set_cell_index_at(1, 1, 9);
+      view = other;
+      THEN("the cells are copied into the store")
+      {
+        REQUIRE(store.cell_index_at(1, 1, 2) == 9);
+        REQUIRE(view.is_view());
+      }
+    }
+
+    WHEN("a layer of different extents is assigned to the view")
+    {
+      Legacy::World::MapLayer other(6, 6);
+      THEN("a logic error gets raised")
+      {
+        CHECK_THROWS_AS(view = other, std::logic_error);
+      }
+    }
+  }
+
   GIVEN("Two map layers created from the same criteria")
   {
     static const int given_length = 12;
@@ -109,3 +208,109 @@ SCENARIO("basic interface for the MapLayer class")
     }
   }
 }
+
+
+SCENARIO("MapLayer content hashes")
+{
+  GIVEN("A view of a level of a store and a copy of it")
+  {
+    Legacy::World::ChunkStore store(40, 20, 3);
+    store.set_cell_index_at(5, 6, 1, 4);
+    store.set_cell_index_at(39, 19, 1, 5);
+    Legacy::World::MapLayer view(store, 1);
+    Legacy::World::MapLayer copy = view;
+
+    THEN("they hash the same")
+    {
+      REQUIRE(copy.content_hash() == view.content_hash());
+      REQUIRE(view.content_hash() != Legacy::World::MapLayer(store, 0).content_hash());
+    }
+
+    WHEN("the copy is changed")
+    {
+      copy.set_cell_index_at(0, 0, 1);
+
+      THEN("the hashes differ")
+      {
+        REQUIRE(copy.content_hash() != view.content_hash());
+        REQUIRE(copy != view);
+      }
+    }
+
+    WHEN("the view is hashed and its store is then changed")
+    {
+      std::uint64_t before = view.content_hash();
+      store.set_cell_index_at(6, 6, 1, 7);
+
+      THEN("the view hashes its new cells")
+      {
+        REQUIRE(view.content_hash() != before);
+        REQUIRE(view.content_hash() == Legacy::World::MapLayer(view).content_hash());
+      }
+    }
+
+    WHEN("the view is hashed from several threads at once")
+    {
+      std::vector<std::uint64_t> hashes(4);
+      std::vector<std::thread> threads;
+      for (std::size_t i = 0; i < hashes.size(); ++i)
+        threads.emplace_back([&view, &hashes, i] { hashes[i] = view.content_hash(); });
+      for (auto& thread: threads)
+        thread.join();
+
+      THEN("each thread gets the same hash")
+      {
+        for (std::uint64_t hash: hashes)
+          REQUIRE(hash == copy.content_hash());
+      }
+    }
+  }
+
+  GIVEN("A view of a level in the upper bricks of a tall store and a copy of it")
+  {
+    Legacy::World::ChunkStore store(20, 20, 20);
+    store.set_cell_index_at(19, 3, 17, 8);
+    store.set_cell_index_at(2, 18, 16, 9);
+    Legacy::World::MapLayer view(store, 17);
+    Legacy::World::MapLayer copy = view;
+
+    THEN("they hash the same, and differently from the other levels of the brick")
+    {
+      REQUIRE(copy.content_hash() == view.content_hash());
+      REQUIRE(view.content_hash() != Legacy::World::MapLayer(store, 16).content_hash());
+    }
+  }
+
+  GIVEN("Two hashed layers owning the same cells")
+  {
+    Legacy::World::MapLayer layer1(40, 20);
+    Legacy::World::MapLayer layer2(40, 20);
+    layer1.set_cell_index_at(33, 17, 3);
+    layer2.set_cell_index_at(33, 17, 3);
+    REQUIRE(layer1.content_hash() == layer2.content_hash());
+
+    WHEN("one is changed and hashed again")
+    {
+      layer2.set_cell_index_at(33, 17, 4);
+
+      THEN("the hashes and the layers differ")
+      {
+        REQUIRE(layer1.content_hash() != layer2.content_hash());
+        REQUIRE(layer1 != layer2);
+      }
+    }
+
+    WHEN("one is changed and changed back")
+    {
+      layer2.set_cell_index_at(33, 17, 4);
+      layer2.content_hash();
+      layer2.set_cell_index_at(33, 17, 3);
+
+      THEN("they are equal again")
+      {
+        REQUIRE(layer1.content_hash() == layer2.content_hash());
+        REQUIRE(layer1 == layer2);
+      }
+    }
+  }
+}
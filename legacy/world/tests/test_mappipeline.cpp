@@ -0,0 +1,332 @@
+/**
+ * @file legacy/world/tests/test_mappipeline.cpp
+ * @brief Tests for the Legacy world map generation pipeline.
+ */
+
+/*
+ * Copyright 2016 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "catch/catch.hpp"
+#include <algorithm>
+#include "legacy/core/thread_pool.h"
+#include "legacy/world/map.h"
+#include "legacy/world/mapbuildercaves.h"
+#include "legacy/world/mapbuildersimple.h"
+#include "legacy/world/mappipeline.h"
+#include "legacy/world/mapstages.h"
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+using namespace Legacy::World;
+
+
+namespace
+{
+
+std::unique_ptr<MapPipeline>
+make_pipeline(std::uint_fast32_t seed,
+              Legacy::Core::ThreadPool& pool = Legacy::Core::ThreadPool::default_pool())
+{
+  std::unique_ptr<MapPipeline> pipeline(new MapPipeline(pool));
+  pipeline->add_stage(std::unique_ptr<MapStage>(new TerrainStage(seed)));
+  pipeline->add_stage(std::unique_ptr<MapStage>(new CoverStage(1, 2)));
+  return pipeline;
+}
+
+} // anonymous namespace
+
+
+SCENARIO("a pipeline of one terrain stage builds the simple builder's map")
+{
+  GIVEN("a terrain pipeline and a simple builder with the same seed")
+  {
+    MapPipeline pipeline;
+    pipeline.add_stage(std::unique_ptr<MapStage>(new TerrainStage(17)));
+    MapBuilderPipeline pipeline_builder(70, 45, 37, pipeline);
+    MapBuilderSimple simple_builder(70, 45, 37, 17);
+
+    WHEN("a map is built with each")
+    {
+      Map piped(pipeline_builder);
+      Map simple(simple_builder);
+
+      THEN("the maps and their surfaces are the same")
+      {
+        REQUIRE(pipeline.border() == 0);
+        REQUIRE(piped == simple);
+        std::vector<unsigned> piped_surface(70 * 45), simple_surface(70 * 45);
+        piped.surface_heights(0, 0, 70, 45, piped_surface.data());
+        simple.surface_heights(0, 0, 70, 45, simple_surface.data());
+        REQUIRE(piped_surface == simple_surface);
+      }
+    }
+  }
+}
+
+
+SCENARIO("stages that read around their cells run fused over the tiles")
+{
+  GIVEN("a pipeline laying terrain then covering its exposed cells")
+  {
+    auto pipeline = make_pipeline(5);
+    MapBuilderPipeline builder(70, 45, 37, *pipeline);
+    Map map(builder);
+
+    THEN("the border is as wide as the cover stage reads")
+    {
+      REQUIRE(pipeline->border() == 1);
+    }
+
+    THEN("exactly the solid cells with an empty face neighbour are covered")
+    {
+      bool all_match = true;
+      std::size_t covered = 0;
+      for (unsigned z = 0; z < map.height(); ++z)
+      {
+        for (unsigned y = 1; y + 1 < map.width(); ++y)
+        {
+          for (unsigned x = 1; x + 1 < map.length(); ++x)
+          {
+            int cell = map.cell_index_at(x, y, z);
+            if (cell == 0)
+              continue;
+            int neighbours[6];
+            map.neighbours6_at(x, y, z, neighbours);
+            bool exposed = false;
+            for (int neighbour: neighbours)
+              exposed = exposed || neighbour == 0;
+            all_match = all_match && cell == (exposed ? 2 : 1);
+            covered += (cell == 2);
+          }
+        }
+      }
+      REQUIRE(all_match);
+      REQUIRE(covered > 0);
+    }
+
+    THEN("the map is the same built on one thread")
+    {
+      Legacy::Core::ThreadPool pool(1);
+      auto serial_pipeline = make_pipeline(5, pool);
+      MapBuilderPipeline serial_builder(70, 45, 37, *serial_pipeline);
+      Map serial(serial_builder);
+      REQUIRE(serial == map);
+    }
+
+    THEN("the map is the same built lazily a region at a time")
+    {
+      LazyMapOptions options;
+      options.region_size = 32;
+      options.resident_regions = 2;
+      Map lazy(builder, options);
+      REQUIRE(lazy == map);
+    }
+  }
+}
+
+
+SCENARIO("a pipeline times each of its stages")
+{
+  GIVEN("a pipeline that has built a map")
+  {
+    auto pipeline = make_pipeline(9);
+    MapBuilderPipeline builder(40, 40, 20, *pipeline);
+    Map map(builder);
+
+    THEN("there is a timing for each stage and for storing the tiles")
+    {
+      auto timings = pipeline->timings();
+      REQUIRE(timings.size() == 3);
+      REQUIRE(timings[0].name == "terrain");
+      REQUIRE(timings[1].name == "cover");
+      REQUIRE(timings[2].name == "store");
+      REQUIRE(timings[0].tiles == 9);
+      REQUIRE(timings[0].time.count() > 0);
+
+      std::ostringstream ostr;
+      pipeline->report(ostr);
+      REQUIRE(ostr.str().find("terrain") != std::string::npos);
+      REQUIRE(ostr.str().find("9 tiles") != std::string::npos);
+    }
+
+    WHEN("the timings are reset")
+    {
+      pipeline->reset_timings();
+
+      THEN("they are all zero")
+      {
+        for (auto const& timing: pipeline->timings())
+        {
+          REQUIRE(timing.time.count() == 0);
+          REQUIRE(timing.tiles == 0);
+        }
+      }
+    }
+  }
+}
+
+
+SCENARIO("the cave builder carves caves and overhangs out of the terrain")
+{
+  GIVEN("a cave map and the simple map of the same terrain")
+  {
+    unsigned const length = 70, width = 45, height = 48;
+    MapBuilderCaves cave_builder(length, width, height, 3);
+    Map caves(cave_builder);
+    MapBuilderSimple simple_builder(length, width, height, 3);
+    Map simple(simple_builder);
+
+    THEN("cells are only ever carved, never added, and the bottom layer is kept")
+    {
+      bool only_carved = true;
+      bool bottom_kept = true;
+      std::size_t carved = 0;
+      for (unsigned z = 0; z < height; ++z)
+        for (unsigned y = 0; y < width; ++y)
+          for (unsigned x = 0; x < length; ++x)
+          {
+            int cave_cell = caves.cell_index_at(x, y, z);
+            int simple_cell = simple.cell_index_at(x, y, z);
+            only_carved = only_carved && (cave_cell == simple_cell || cave_cell == 0);
+            bottom_kept = bottom_kept && (z > 0 || cave_cell == simple_cell);
+            carved += (cave_cell != simple_cell);
+          }
+      REQUIRE(only_carved);
+      REQUIRE(bottom_kept);
+      REQUIRE(carved > 0);
+    }
+
+    THEN("some columns have an empty cell below a solid one")
+    {
+      std::size_t overhangs = 0;
+      std::vector<int> column(height);
+      for (unsigned y = 0; y < width; ++y)
+        for (unsigned x = 0; x < length; ++x)
+        {
+          caves.column_at(x, y, column.data());
+          unsigned top = caves.surface_height(x, y);
+          overhangs += std::count(column.begin(), column.begin() + top, 0) > 0;
+        }
+      REQUIRE(overhangs > 0);
+    }
+
+    THEN("the map is the same built lazily a region at a time")
+    {
+      LazyMapOptions options;
+      options.region_size = 32;
+      options.resident_regions = 2;
+      Map lazy(cave_builder, options);
+      REQUIRE(lazy == caves);
+    }
+  }
+
+  GIVEN("cave maps sampling the noise every cell and on a lattice four cells apart")
+  {
+    MapBuilderCaves fine_builder(40, 40, 32, 12, 1);
+    Map fine(fine_builder);
+    MapBuilderCaves coarse_builder(40, 40, 32, 12, 4);
+    Map coarse(coarse_builder);
+
+    THEN("the maps agree at the lattice points, where nothing is interpolated")
+    {
+      bool all_match = true;
+      for (unsigned z = 0; z < 32; z += 4)
+        for (unsigned y = 0; y < 40; y += 4)
+          for (unsigned x = 0; x < 40; x += 4)
+            all_match = all_match && fine.cell_index_at(x, y, z) == coarse.cell_index_at(x, y, z);
+      REQUIRE(all_match);
+    }
+
+    THEN("a lattice step of zero is refused")
+    {
+      REQUIRE_THROWS_AS(MapBuilderCaves(40, 40, 32, 12, 0), std::invalid_argument);
+    }
+  }
+}
+
+
+SCENARIO("a scatter stage turns cells at random, independently of the tiles")
+{
+  GIVEN("a pipeline scattering one solid cell in ten")
+  {
+    MapPipeline pipeline;
+    pipeline.add_stage(std::unique_ptr<MapStage>(new TerrainStage(4)));
+    pipeline.add_stage(std::unique_ptr<MapStage>(new ScatterStage(99, 1, 3, 0.1)));
+    MapBuilderPipeline builder(70, 45, 37, pipeline);
+    Map map(builder);
+
+    THEN("about one solid cell in ten is turned")
+    {
+      std::size_t solid = 0, turned = 0;
+      for (unsigned z = 0; z < map.height(); ++z)
+        for (unsigned y = 0; y < map.width(); ++y)
+          for (unsigned x = 0; x < map.length(); ++x)
+          {
+            int cell = map.cell_index_at(x, y, z);
+            solid += (cell != 0);
+            turned += (cell == 3);
+          }
+      REQUIRE(turned > solid * 8 / 100);
+      REQUIRE(turned < solid * 12 / 100);
+    }
+
+    THEN("the map is the same built on one thread or lazily a region at a time")
+    {
+      Legacy::Core::ThreadPool pool(1);
+      MapPipeline serial_pipeline(pool);
+      serial_pipeline.add_stage(std::unique_ptr<MapStage>(new TerrainStage(4)));
+      serial_pipeline.add_stage(std::unique_ptr<MapStage>(new ScatterStage(99, 1, 3, 0.1)));
+      MapBuilderPipeline serial_builder(70, 45, 37, serial_pipeline);
+      Map serial(serial_builder);
+      REQUIRE(serial == map);
+
+      LazyMapOptions options;
+      options.region_size = 32;
+      Map lazy(builder, options);
+      REQUIRE(lazy == map);
+    }
+  }
+
+  GIVEN("probabilities of nothing, everything and out of range")
+  {
+    THEN("none, all or an exception")
+    {
+      MapPipeline none_pipeline;
+      none_pipeline.add_stage(std::unique_ptr<MapStage>(new TerrainStage(4)));
+      none_pipeline.add_stage(std::unique_ptr<MapStage>(new ScatterStage(99, 1, 3, 0.0)));
+      MapBuilderPipeline none_builder(20, 20, 16, none_pipeline);
+      Map none(none_builder);
+      MapPipeline all_pipeline;
+      all_pipeline.add_stage(std::unique_ptr<MapStage>(new TerrainStage(4)));
+      all_pipeline.add_stage(std::unique_ptr<MapStage>(new ScatterStage(99, 1, 3, 1.0)));
+      MapBuilderPipeline all_builder(20, 20, 16, all_pipeline);
+      Map all(all_builder);
+
+      bool as_expected = true;
+      for (unsigned z = 0; z < 16; ++z)
+        for (unsigned y = 0; y < 20; ++y)
+          for (unsigned x = 0; x < 20; ++x)
+            as_expected = as_expected
+                       && none.cell_index_at(x, y, z) != 3
+                       && (all.cell_index_at(x, y, z) == 0 || all.cell_index_at(x, y, z) == 3);
+      REQUIRE(as_expected);
+      REQUIRE_THROWS_AS(ScatterStage(99, 1, 3, 1.5), std::invalid_argument);
+      REQUIRE_THROWS_AS(ScatterStage(99, 1, 3, -0.1), std::invalid_argument);
+    }
+  }
+}
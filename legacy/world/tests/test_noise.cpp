@@ -0,0 +1,124 @@
+/**
+ * @file legacy/world/tests/test_noise.cpp
+ * @brief Tests for the batch noise evaluation used by the world builders.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "catch/catch.hpp"
+#include <cstring>
+#include "FastNoise/FastNoise.h"
+#include <vector>
+
+
+namespace
+{
+
+/**
+ * Fills a grid by calling GetNoise() for each point, bypassing the batch code.
+ */
+std::vector<float>
+reference_grid(FastNoise& noise, int x0, int y0, int w, int h)
+{
+  std::vector<float> grid(std::size_t(w) * h);
+  for (int j = 0; j < h; ++j)
+  {
+    for (int i = 0; i < w; ++i)
+    {
+      grid[std::size_t(j) * w + i] = noise.GetNoise(float(x0 + i), float(y0 + j));
+    }
+  }
+  return grid;
+}
+
+/**
+ * Checks that every kernel this CPU supports reproduces GetNoise() exactly.
+ */
+bool
+batch_matches_reference(FastNoise& noise, int x0, int y0, int w, int h)
+{
+  std::vector<float> expected = reference_grid(noise, x0, y0, w, h);
+  for (int kernel = FastNoise::BatchScalar; kernel <= FastNoise::GetBatchKernel(); ++kernel)
+  {
+    std::vector<float> actual(expected.size());
+    noise.FillNoiseSet(actual.data(), x0, y0, w, h, FastNoise::BatchKernel(kernel));
+    if (std::memcmp(actual.data(), expected.data(), expected.size() * sizeof(float)) != 0)
+      return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+
+SCENARIO("batch noise is bit-identical to point noise")
+{
+  // Grids straddle zero and are not a multiple of any vector width.
+  static const int x0 = -37, y0 = -11, w = 53, h = 29;
+
+  GIVEN("gradient fractal noise as used by the simple map builder")
+  {
+    FastNoise noise(1234);
+    noise.SetNoiseType(FastNoise::GradientFractal);
+    THEN("every batch kernel reproduces GetNoise()")
+    {
+      REQUIRE(batch_matches_reference(noise, x0, y0, w, h));
+    }
+  }
+
+  GIVEN("gradient noise with each interpolation")
+  {
+    FastNoise noise(99);
+    noise.SetNoiseType(FastNoise::Gradient);
+    noise.SetFrequency(0.137f);
+    THEN("every batch kernel reproduces GetNoise()")
+    {
+      for (auto interp: { FastNoise::Linear, FastNoise::Hermite, FastNoise::Quintic })
+      {
+        noise.SetInterp(interp);
+        REQUIRE(batch_matches_reference(noise, x0, y0, w, h));
+      }
+    }
+  }
+
+  GIVEN("simplex and simplex fractal noise")
+  {
+    FastNoise noise(7);
+    noise.SetFrequency(0.05f);
+    THEN("every batch kernel reproduces GetNoise()")
+    {
+      noise.SetNoiseType(FastNoise::Simplex);
+      REQUIRE(batch_matches_reference(noise, x0, y0, w, h));
+      noise.SetNoiseType(FastNoise::SimplexFractal);
+      noise.SetFractalOctaves(5);
+      REQUIRE(batch_matches_reference(noise, x0, y0, w, h));
+    }
+  }
+
+  GIVEN("noise with no batch kernel")
+  {
+    FastNoise noise(7);
+    noise.SetNoiseType(FastNoise::GradientFractal);
+    noise.SetFractalType(FastNoise::Billow);
+    THEN("the batch call falls back to GetNoise()")
+    {
+      REQUIRE(batch_matches_reference(noise, x0, y0, w, h));
+      noise.SetNoiseType(FastNoise::Value);
+      REQUIRE(batch_matches_reference(noise, x0, y0, w, h));
+    }
+  }
+}
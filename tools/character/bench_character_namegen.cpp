@@ -0,0 +1,241 @@
+/**
+ * @file tools/character/bench_character_namegen.cpp
+ * @brief A micro-benchmark for the character name generator submodule.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include "legacy/character/namedistribution.h"
+#include "legacy/character/sexuality.h"
+#include "legacy/character/statisticalnamegenerator.h"
+#include "legacy/core/argparse.h"
+#include "legacy/core/config.h"
+#include "legacy/core/logger.h"
+#include "legacy/core/posix_filesystem.h"
+#include "legacy/core/random.h"
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+
+using Legacy::Character::NameDistribution;
+using Legacy::Character::NameGenerator;
+using Legacy::Character::Sexuality;
+using Legacy::Character::StatisticalNameGenerator;
+using namespace Legacy::Core;
+using Clock = std::chrono::steady_clock;
+
+
+static CLI::OptionSet option_set = {
+  {"--surname-datafile", 's', 1, CLI::store_string, "", "surname distribution file"},
+  {"--count",            'n', 1, CLI::store_int,    "", "number of alias-table picks"},
+  {"--baseline-count",   'b', 1, CLI::store_int,    "", "number of per-pick discrete_distribution picks"},
+};
+
+
+/**
+ * Reports the rate of a timed run.
+ */
+static void
+report(std::string const& label, int count, Clock::duration elapsed)
+{
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << label << ": " << count << " picks in " << seconds << "s, "
+            << static_cast<long long>(count / seconds) << " picks/s\n";
+}
+
+
+/**
+ * Compares the cold-start cost of parsing the text distribution with mapping a
+ * compiled copy of it.
+ */
+static void
+bench_cold_start(Config const& config, PosixFileSystem const& fs)
+{
+  std::string file_name = config.get<std::string>("surname-datafile", "dist.all.last");
+  auto ifs = config.open_data_file(fs, file_name);
+  if (!ifs)
+  {
+    throw std::runtime_error("error opening dist file");
+  }
+
+  auto start = Clock::now();
+  NameDistribution parsed = NameDistribution::parse(*ifs);
+  double parse_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+  char compiled_name[] = "/tmp/bench_character_namegen.XXXXXX";
+  int fd = ::mkstemp(compiled_name);
+  if (fd < 0)
+  {
+    throw std::runtime_error("error creating temporary file");
+  }
+  ::close(fd);
+  {
+    std::ofstream ostr(compiled_name, std::ios::binary);
+    parsed.write_compiled(ostr);
+  }
+
+  start = Clock::now();
+  NameDistribution compiled = NameDistribution::from_compiled(fs.map_for_input(Path(compiled_name)));
+  double map_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  ::unlink(compiled_name);
+
+  std::cout << "cold start (text)    : " << parsed.names().size() << " names in "
+            << parse_seconds * 1000.0 << "ms\n";
+  std::cout << "cold start (compiled): " << compiled.names().size() << " names in "
+            << map_seconds * 1000.0 << "ms\n";
+}
+
+
+/**
+ * The original sampling strategy: build a fresh discrete distribution from all
+ * the weights for every pick.
+ */
+static void
+bench_discrete_distribution(Config const& config, FileSystem const& fs, RandomNumberGenerator& rng, int count)
+{
+  auto ifs = config.open_data_file(fs, config.get<std::string>("surname-datafile", "dist.all.last"));
+  if (!ifs)
+  {
+    throw std::runtime_error("error opening dist file");
+  }
+
+  std::vector<std::string> names;
+  std::vector<double>      weights;
+  std::string name;
+  double      weight;
+  double      cum_weight;
+  int         index;
+  while (*ifs >> name >> weight >> cum_weight >> index)
+  {
+    names.push_back(name);
+    weights.push_back(weight);
+  }
+
+  std::size_t total_length = 0;
+  auto start = Clock::now();
+  for (int i = 0; i < count; ++i)
+  {
+    std::discrete_distribution<> chooser(std::begin(weights), std::end(weights));
+    total_length += names[chooser(rng)].length();
+  }
+  report("discrete_distribution", count, Clock::now() - start);
+  std::clog << LogLevel::DEBUG << "checksum " << total_length << "\n";
+}
+
+
+/**
+ * The alias-table strategy used by the StatisticalNameGenerator.
+ */
+static void
+bench_alias_table(Config const& config, FileSystem const& fs, RandomNumberGenerator& rng, int count)
+{
+  StatisticalNameGenerator generator(config, fs, NameGenerator::Part::surname);
+
+  std::size_t total_length = 0;
+  auto start = Clock::now();
+  for (int i = 0; i < count; ++i)
+  {
+    total_length += generator.pick_name(Sexuality::Gender::feminine, rng).length();
+  }
+  report("alias table          ", count, Clock::now() - start);
+  std::clog << LogLevel::DEBUG << "checksum " << total_length << "\n";
+
+  std::vector<NameGenerator::NameIndex> batch(count);
+  total_length = 0;
+  start = Clock::now();
+  generator.pick_names(Sexuality::Gender::feminine, rng, batch.size(), batch.data());
+  for (auto index: batch)
+  {
+    total_length += std::char_traits<char>::length(generator.name(index));
+  }
+  report("alias table (batch)  ", count, Clock::now() - start);
+  std::clog << LogLevel::DEBUG << "checksum " << total_length << "\n";
+}
+
+
+/**
+ * Picks forenames for characters of mixed gender.  The rate should not depend
+ * on the mix.
+ */
+static void
+bench_gender_mix(Config const& config, FileSystem const& fs, RandomNumberGenerator& rng, int count)
+{
+  StatisticalNameGenerator generator(config, fs, NameGenerator::Part::forename);
+
+  for (int percent_masculine: { 0, 50, 100 })
+  {
+    std::vector<Sexuality::Gender> genders(count);
+    for (auto& gender: genders)
+    {
+      gender = (std::generate_canonical<double, 53>(rng) * 100.0 < percent_masculine) ? Sexuality::Gender::masculine
+                                                                                     : Sexuality::Gender::feminine;
+    }
+
+    std::size_t total_length = 0;
+    auto start = Clock::now();
+    for (auto gender: genders)
+    {
+      NameGenerator::NameIndex index;
+      generator.pick_names(gender, rng, 1, &index);
+      total_length += std::char_traits<char>::length(generator.name(index));
+    }
+    std::string label = "forenames " + std::to_string(percent_masculine) + "% masc";
+    label.resize(21, ' ');
+    report(label, count, Clock::now() - start);
+    std::clog << LogLevel::DEBUG << "checksum " << total_length << "\n";
+  }
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  DebugRedirector redirected_cerr(std::cerr);
+  DebugRedirector redirected_clog(std::clog);
+
+  Config config;
+  StringList args(argv, argv+argc);
+
+  try
+  {
+    PosixFileSystem fs;
+    auto result = config.init(option_set, args, fs);
+    if (result != CLI::ArgParseResult::SUCCESS)
+    {
+      return 1;
+    }
+
+    RandomNumberGenerator rng(2017);
+    bench_cold_start(config, fs);
+    bench_discrete_distribution(config, fs, rng, config.get("baseline-count", 1000));
+    bench_alias_table(config, fs, rng, config.get("count", 1000000));
+    bench_gender_mix(config, fs, rng, config.get("count", 1000000));
+  }
+  catch (std::exception const& ex)
+  {
+    std::cerr << LogLevel::FATAL << "exception caught: " << ex.what() << "\nexiting...\n";
+    return -1;
+  }
+  return 0;
+}
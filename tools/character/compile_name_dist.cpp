@@ -0,0 +1,134 @@
+/**
+ * @file tools/character/compile_name_dist.cpp
+ * @brief A tool to compile name distribution files into their binary form.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <getopt.h>
+#include <iostream>
+#include "legacy/character/namedistribution.h"
+#include <sstream>
+#include <stdexcept>
+
+
+using Legacy::Character::NameDistribution;
+
+
+static void
+compile_name_dist(std::string const& input_name, std::string const& output_name)
+{
+  std::ifstream istr(input_name);
+  if (!istr)
+  {
+    std::ostringstream ostr;
+    ostr << "error " << errno << " opening '" << input_name << "' -- " << std::strerror(errno);
+    throw std::runtime_error(ostr.str());
+  }
+  NameDistribution distribution = NameDistribution::parse(istr);
+
+  std::ofstream ostr(output_name, std::ios::binary);
+  if (!ostr)
+  {
+    std::ostringstream msg;
+    msg << "error " << errno << " opening '" << output_name << "' -- " << std::strerror(errno);
+    throw std::runtime_error(msg.str());
+  }
+  distribution.write_compiled(ostr);
+
+  std::cout << input_name << ": " << distribution.names().size() << " names written to "
+            << output_name << "\n";
+}
+
+
+static void
+print_help(char const* argv0)
+{
+  std::cerr << "Usage: " << argv0 << " [ options ] DISTFILE...\n"
+            << "Compiles each name distribution DISTFILE into DISTFILE"
+            << NameDistribution::compiled_suffix << ".\n"
+            << "Options:\n"
+            << "  -h, --help                  Prints this message and exits\n"
+            << "  -o, --output=FILENAME       Writes the compiled distribution to FILENAME\n"
+            << "                              (only with a single DISTFILE).\n";
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  std::string output_name;
+
+  static const option options[] = {
+    { "help",       no_argument,       0,    'h' },
+    { "output",     required_argument, 0,    'o' },
+    { NULL,         no_argument,       NULL,  0  }
+  };
+
+  while (1)
+  {
+    int option_index;
+    int c = getopt_long(argc, argv, "ho:", options, &option_index);
+    if (c < 0)
+      break;
+
+    switch (c)
+    {
+      case 'h':
+        print_help(argv[0]);
+        std::exit(0);
+        break;
+
+      case 'o':
+        output_name = ::optarg;
+        break;
+
+      case '?':
+        print_help(argv[0]);
+        std::exit(1);
+        break;
+    }
+  }
+
+  int input_count = argc - ::optind;
+  if (input_count < 1 || (input_count > 1 && !output_name.empty()))
+  {
+    print_help(argv[0]);
+    std::exit(1);
+  }
+
+  try
+  {
+    for (int i = ::optind; i < argc; ++i)
+    {
+      std::string input_name = argv[i];
+      compile_name_dist(input_name,
+                        output_name.empty() ? input_name + NameDistribution::compiled_suffix
+                                            : output_name);
+    }
+  }
+  catch (std::exception const& ex)
+  {
+    std::cerr << "exception caught: " << ex.what() << "\nexiting...\n";
+    return -1;
+  }
+  return 0;
+}
@@ -29,6 +29,7 @@
 #include "legacy/core/posix_filesystem.h"
 #include "legacy/core/random.h"
 #include <stdexcept>
+#include <vector>
 
 
 using Legacy::Character::get_name_generator;
@@ -44,13 +45,22 @@ static CLI::OptionSet option_set = {
 
 
 void
-test_character_namegen(Config const& config, RandomNumberGenerator& rng)
+test_character_namegen(Config const& config, RandomNumberGenerator& rng, int count)
 {
   auto given_name_generator = get_name_generator(config, NameGenerator::Part::forename);
   auto familial_name_generator = get_name_generator(config, NameGenerator::Part::surname);
-  std::cout << given_name_generator->pick_name(Sexuality::Gender::masculine, rng)
-            << " " << familial_name_generator->pick_name(Sexuality::Gender::masculine, rng)
-            << "\n";
+
+  std::vector<NameGenerator::NameIndex> given_names(count);
+  std::vector<NameGenerator::NameIndex> familial_names(count);
+  given_name_generator->pick_names(Sexuality::Gender::masculine, rng, count, given_names.data());
+  familial_name_generator->pick_names(Sexuality::Gender::masculine, rng, count, familial_names.data());
+
+  for (int i = 0; i < count; ++i)
+  {
+    std::cout << given_name_generator->name(given_names[i])
+              << " " << familial_name_generator->name(familial_names[i])
+              << "\n";
+  }
 }
 
 
@@ -75,10 +85,7 @@ main(int argc, char* argv[])
 
     auto rng = Legacy::Core::RandomNumberGenerator();
     int rep_count = config.get("count", 5);
-    for (int i = 0; i < rep_count; ++i)
-    {
-      test_character_namegen(config, rng);
-    }
+    test_character_namegen(config, rng, rep_count);
   }
   catch (std::exception const& ex)
   {
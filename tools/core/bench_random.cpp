@@ -0,0 +1,192 @@
+/**
+ * @file tools/core/bench_random.cpp
+ * @brief A tool to compare the cost of the random number generators.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include "legacy/core/random.h"
+#include <random>
+#include <string>
+#include <vector>
+
+
+using Legacy::Core::RandomNumberGenerator;
+using Legacy::Core::SplitSeed;
+using Legacy::Core::Xoshiro256;
+using Legacy::Core::Xoshiro256x4;
+using Clock = std::chrono::steady_clock;
+
+
+/**
+ * Reports the rate of a timed run.
+ */
+static void
+report(std::string const& label, long count, Clock::duration elapsed, std::uint64_t checksum)
+{
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << label << ": " << count << " in " << seconds << "s, "
+            << static_cast<long long>(count / seconds) << "/s"
+            << " (checksum " << checksum << ")\n";
+}
+
+
+/**
+ * Draws raw values.  The generator is used through a reference, as the game
+ * uses it, so the RandomNumberGenerator's virtual call is kept.
+ */
+template<typename Generator>
+  static void
+  bench_raw(std::string const& label, Generator& rng, long count)
+  {
+    std::uint64_t checksum = 0;
+    auto start = Clock::now();
+    for (long i = 0; i < count; ++i)
+    {
+      checksum += rng();
+    }
+    report(label, count, Clock::now() - start, checksum);
+  }
+
+
+/**
+ * Draws dice rolls through a std distribution.
+ */
+template<typename Generator>
+  static void
+  bench_distribution(std::string const& label, Generator& rng, long count)
+  {
+    std::uniform_int_distribution<int> d20(1, 20);
+    std::uint64_t checksum = 0;
+    auto start = Clock::now();
+    for (long i = 0; i < count; ++i)
+    {
+      checksum += d20(rng);
+    }
+    report(label, count, Clock::now() - start, checksum);
+  }
+
+
+/**
+ * Makes a generator for each of a number of entities and draws one value from
+ * each, as a generator kept per chunk or per character would be used.
+ */
+static void
+bench_per_entity(long count)
+{
+  std::uint64_t checksum = 0;
+  auto start = Clock::now();
+  for (long i = 0; i < count; ++i)
+  {
+    RandomNumberGenerator rng(static_cast<RandomNumberGenerator::result_type>(i));
+    checksum += rng();
+  }
+  report("per entity (mt19937)   ", count, Clock::now() - start, checksum);
+
+  SplitSeed world(2017);
+  checksum = 0;
+  start = Clock::now();
+  for (long i = 0; i < count; ++i)
+  {
+    Xoshiro256 rng(world.split(static_cast<std::uint64_t>(i)));
+    checksum += rng();
+  }
+  report("per entity (xoshiro256)", count, Clock::now() - start, checksum);
+}
+
+
+/**
+ * Draws uniform values a call at a time and in bulk.
+ */
+static void
+bench_bulk(long count)
+{
+  std::vector<double> values(4096);
+  long blocks = count / static_cast<long>(values.size());
+  long drawn = blocks * static_cast<long>(values.size());
+
+  RandomNumberGenerator mt(2017);
+  double sum = 0.0;
+  auto start = Clock::now();
+  for (long i = 0; i < drawn; ++i)
+  {
+    sum += std::generate_canonical<double, 53>(mt);
+  }
+  report("uniform (mt19937)      ", drawn, Clock::now() - start, static_cast<std::uint64_t>(sum));
+
+  sum = 0.0;
+  start = Clock::now();
+  for (long block = 0; block < blocks; ++block)
+  {
+    mt.fill_uniform(values.size(), values.data());
+    sum += values.back();
+  }
+  report("fill (mt19937)         ", drawn, Clock::now() - start, static_cast<std::uint64_t>(sum));
+
+  Xoshiro256 xoshiro(2017);
+  sum = 0.0;
+  start = Clock::now();
+  for (long i = 0; i < drawn; ++i)
+  {
+    sum += std::generate_canonical<double, 53>(xoshiro);
+  }
+  report("uniform (xoshiro256)   ", drawn, Clock::now() - start, static_cast<std::uint64_t>(sum));
+
+  Xoshiro256x4 lanes(SplitSeed(2017));
+  sum = 0.0;
+  start = Clock::now();
+  for (long block = 0; block < blocks; ++block)
+  {
+    lanes.fill_uniform(values.size(), values.data());
+    sum += values.back();
+  }
+  report("fill (xoshiro256x4)    ", drawn, Clock::now() - start, static_cast<std::uint64_t>(sum));
+
+  std::vector<std::uint32_t> words(values.size());
+  std::uint64_t checksum = 0;
+  start = Clock::now();
+  for (long block = 0; block < blocks; ++block)
+  {
+    lanes.fill(words.size(), words.data());
+    checksum += words.back();
+  }
+  report("fill 32 (xoshiro256x4) ", drawn, Clock::now() - start, checksum);
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  long count = (argc > 1) ? std::atol(argv[1]) : 100000000;
+
+  std::cout << "sizeof(RandomNumberGenerator) = " << sizeof(RandomNumberGenerator) << "\n";
+  std::cout << "sizeof(Xoshiro256)            = " << sizeof(Xoshiro256) << "\n";
+
+  RandomNumberGenerator mt(2017);
+  Xoshiro256 xoshiro(2017);
+
+  bench_raw("raw (mt19937)          ", mt, count);
+  bench_raw("raw (xoshiro256)       ", xoshiro, count);
+  bench_distribution("d20 (mt19937)          ", mt, count);
+  bench_distribution("d20 (xoshiro256)       ", xoshiro, count);
+  bench_per_entity(count / 100);
+  bench_bulk(count);
+}
@@ -0,0 +1,955 @@
+/**
+ * @file tools/world/bench_world_map.cpp
+ * @brief A micro-benchmark for the world map submodule.
+ */
+
+/*
+ * Copyright 2017 Stephen M. Webb <stephen.webb@bregmasoft.ca>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "FastNoise/FastNoise.h"
+#include <fstream>
+#include <future>
+#include <getopt.h>
+#include <iostream>
+#include "legacy/core/posix_filesystem.h"
+#include "legacy/core/thread_pool.h"
+#include "legacy/world/cellcache.h"
+#include "legacy/world/chunkstore.h"
+#include "legacy/world/map.h"
+#include "legacy/world/mapbuilderbinary.h"
+#include "legacy/world/mapbuildercaves.h"
+#include "legacy/world/mapbuildersimple.h"
+#include "legacy/world/mapbuilderstream.h"
+#include "legacy/world/mappipeline.h"
+#include "legacy/world/mapstages.h"
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+
+using namespace Legacy::World;
+using Clock = std::chrono::steady_clock;
+
+
+/**
+ * The extents of the maps to benchmark.
+ */
+struct BenchOptions
+{
+  unsigned           length = 512;
+  unsigned           width  = 512;
+  unsigned           height = 64;
+  std::uint_fast32_t seed   = 1;
+  unsigned           threads = 0;
+};
+
+
+/**
+ * Reports the rate of a timed run.
+ */
+static void
+report(std::string const& label, std::size_t cells, Clock::duration elapsed)
+{
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << label << ": " << cells << " cells in " << seconds << "s, "
+            << static_cast<long long>(cells / seconds) << " cells/s\n";
+}
+
+
+/**
+ * Reports the throughput of a timed run over a number of bytes.
+ */
+static void
+report_bytes(std::string const& label, std::size_t bytes, Clock::duration elapsed)
+{
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  std::cout << label << ": " << bytes << " bytes in " << seconds << "s, "
+            << static_cast<long long>(bytes / seconds / 1e6) << " MB/s\n";
+}
+
+
+/**
+ * A cheap, deterministic surface height for each column so the fill loops can
+ * be timed without the cost of generating noise.
+ */
+static std::vector<unsigned>
+make_heights(BenchOptions const& options)
+{
+  std::vector<unsigned> heights(std::size_t(options.length) * options.width);
+  std::uint_fast32_t state = options.seed;
+  for (auto& height: heights)
+  {
+    state = state * 1664525u + 1013904223u;
+    height = (state >> 8) % (options.height + 1);
+  }
+  return heights;
+}
+
+
+/**
+ * Compares the cell-at-a-time fill used by the builders (every write checked)
+ * with filling whole row segments.
+ */
+static void
+bench_fill(BenchOptions const& options)
+{
+  std::vector<unsigned> heights = make_heights(options);
+  std::size_t cell_count = std::size_t(options.length) * options.width * options.height;
+
+  ChunkStore checked(options.length, options.width, options.height);
+  auto start = Clock::now();
+  for (unsigned y = 0; y < options.width; ++y)
+  {
+    for (unsigned x = 0; x < options.length; ++x)
+    {
+      for (unsigned z = 0; z < options.height; ++z)
+      {
+        checked.set_cell_index_at(x, y, z, (z < heights[y * options.length + x]) ? 1 : 0);
+      }
+    }
+  }
+  report("fill (checked)      ", cell_count, Clock::now() - start);
+
+  ChunkStore rows(options.length, options.width, options.height);
+  start = Clock::now();
+  for (unsigned y = 0; y < options.width; ++y)
+  {
+    for (unsigned z = 0; z < options.height; ++z)
+    {
+      unsigned const* column_height = heights.data() + std::size_t(y) * options.length;
+      for (CellSpan segment: rows.row(y, z))
+      {
+        for (std::size_t i = 0; i < segment.size(); ++i)
+        {
+          segment[i] = (z < column_height[i]) ? 1 : 0;
+        }
+        column_height += segment.size();
+      }
+    }
+  }
+  report("fill (rows)         ", cell_count, Clock::now() - start);
+
+  checked.compact();
+  rows.compact();
+  if (checked != rows)
+    throw std::logic_error("fill results differ");
+}
+
+
+/**
+ * Compares cell-at-a-time layer comparison with operator==.
+ */
+static void
+bench_compare(BenchOptions const& options)
+{
+  MapBuilderSimple builder(options.length, options.width, options.height, options.seed);
+  Map lhs(builder);
+  Map rhs(builder);
+  std::size_t cell_count = std::size_t(options.length) * options.width * options.height;
+
+  auto start = Clock::now();
+  bool equal = true;
+  for (unsigned i = 0; i < lhs.height(); ++i)
+  {
+    MapLayer const& lhs_layer = lhs.layer(i);
+    MapLayer const& rhs_layer = rhs.layer(i);
+    for (unsigned y = 0; y < lhs_layer.width(); ++y)
+    {
+      for (unsigned x = 0; x < lhs_layer.length(); ++x)
+      {
+        equal = equal && lhs_layer.cell_index_at(x, y) == rhs_layer.cell_index_at(x, y);
+      }
+    }
+  }
+  report("layer == (checked)  ", cell_count, Clock::now() - start);
+
+  start = Clock::now();
+  for (unsigned i = 0; i < lhs.height(); ++i)
+  {
+    equal = equal && lhs.layer(i) == rhs.layer(i);
+  }
+  report("layer == (rows)     ", cell_count, Clock::now() - start);
+
+  start = Clock::now();
+  equal = equal && lhs == rhs;
+  report("map ==              ", cell_count, Clock::now() - start);
+
+  start = Clock::now();
+  std::uint64_t hash = lhs.content_hash();
+  report("map hash (first)    ", cell_count, Clock::now() - start);
+  rhs.content_hash();
+
+  // A few edits leave only their bricks to hash again, and a map that differs
+  // in one brick is told apart there without comparing the rest.
+  rhs.set_cell_index_at(options.length - 1, options.width - 1, options.height - 1, 7);
+  start = Clock::now();
+  equal = equal && rhs.content_hash() != hash;
+  report("map hash (one edit) ", cell_count, Clock::now() - start);
+
+  start = Clock::now();
+  equal = equal && !(lhs == rhs);
+  report("map == (hashed)     ", cell_count, Clock::now() - start);
+
+  if (!equal)
+    throw std::logic_error("maps compare wrongly");
+}
+
+
+/**
+ * Compares finding the surface of every column by probing down through the
+ * layers with looking it up in the map's surface index.
+ */
+static void
+bench_surface(BenchOptions const& options)
+{
+  MapBuilderSimple builder(options.length, options.width, options.height, options.seed);
+  Map const map(builder);
+  std::size_t columns = std::size_t(options.length) * options.width;
+
+  long long probed = 0;
+  auto start = Clock::now();
+  for (unsigned y = 0; y < map.width(); ++y)
+  {
+    for (unsigned x = 0; x < map.length(); ++x)
+    {
+      unsigned z = map.height();
+      while (z > 0 && map.layer(z - 1).cell_index_at(x, y) == 0)
+        --z;
+      probed += z;
+    }
+  }
+  report("surface (probe)     ", columns, Clock::now() - start);
+
+  long long looked_up = 0;
+  start = Clock::now();
+  for (unsigned y = 0; y < map.width(); ++y)
+  {
+    for (unsigned x = 0; x < map.length(); ++x)
+      looked_up += map.surface_height(x, y);
+  }
+  report("surface (index)     ", columns, Clock::now() - start);
+
+  std::vector<unsigned> heights(columns);
+  start = Clock::now();
+  map.surface_heights(0, 0, map.length(), map.width(), heights.data());
+  report("surface (bulk)      ", columns, Clock::now() - start);
+
+  if (probed != looked_up)
+    throw std::logic_error("surface index differs from the map's cells");
+}
+
+
+/**
+ * Compares reading boxes and neighbourhoods of cells one at a time through the
+ * layers with the map's bulk queries.
+ */
+static void
+bench_queries(BenchOptions const& options)
+{
+  MapBuilderSimple builder(options.length, options.width, options.height, options.seed);
+  Map const map(builder);
+  std::size_t cell_count = std::size_t(map.length()) * map.width() * map.height();
+
+  long long by_cell = 0;
+  auto start = Clock::now();
+  for (unsigned z = 0; z < map.height(); ++z)
+    for (unsigned y = 0; y < map.width(); ++y)
+      for (unsigned x = 0; x < map.length(); ++x)
+        by_cell += map.layer(z).cell_index_at(x, y);
+  report("box (cell)          ", cell_count, Clock::now() - start);
+
+  std::vector<int> box(cell_count);
+  start = Clock::now();
+  map.box_at(0, 0, 0, map.length(), map.width(), map.height(), box.data());
+  report("box (bulk)          ", cell_count, Clock::now() - start);
+  long long by_box = 0;
+  for (int index: box)
+    by_box += index;
+
+  // Count the solid neighbours of every cell inside the map, as a walk over
+  // a pathfinding or visibility graph would.
+  std::size_t visited = std::size_t(map.length() - 2) * (map.width() - 2) * (map.height() - 2);
+  long long solid_by_cell = 0;
+  start = Clock::now();
+  for (unsigned z = 1; z + 1 < map.height(); ++z)
+    for (unsigned y = 1; y + 1 < map.width(); ++y)
+      for (unsigned x = 1; x + 1 < map.length(); ++x)
+        for (auto const& step: Map::neighbours26)
+          solid_by_cell += map.layer(z + step[2]).cell_index_at(x + step[0], y + step[1]) != 0;
+  report("neighbours26 (cell) ", visited, Clock::now() - start);
+
+  long long solid_by_query = 0;
+  int neighbours[26];
+  start = Clock::now();
+  for (unsigned z = 1; z + 1 < map.height(); ++z)
+    for (unsigned y = 1; y + 1 < map.width(); ++y)
+      for (unsigned x = 1; x + 1 < map.length(); ++x)
+      {
+        map.neighbours26_at(x, y, z, neighbours);
+        for (int index: neighbours)
+          solid_by_query += index != 0;
+      }
+  report("neighbours26 (query)", visited, Clock::now() - start);
+
+  long long open_by_cell = 0;
+  start = Clock::now();
+  for (unsigned z = 1; z + 1 < map.height(); ++z)
+    for (unsigned y = 1; y + 1 < map.width(); ++y)
+      for (unsigned x = 1; x + 1 < map.length(); ++x)
+        for (auto const& step: Map::neighbours6)
+          open_by_cell += map.layer(z + step[2]).cell_index_at(x + step[0], y + step[1]) == 0;
+  report("neighbours6 (cell)  ", visited, Clock::now() - start);
+
+  long long open_by_query = 0;
+  start = Clock::now();
+  for (unsigned z = 1; z + 1 < map.height(); ++z)
+    for (unsigned y = 1; y + 1 < map.width(); ++y)
+      for (unsigned x = 1; x + 1 < map.length(); ++x)
+      {
+        map.neighbours6_at(x, y, z, neighbours);
+        for (int i = 0; i < 6; ++i)
+          open_by_query += neighbours[i] == 0;
+      }
+  report("neighbours6 (query) ", visited, Clock::now() - start);
+
+  if (by_cell != by_box || solid_by_cell != solid_by_query || open_by_cell != open_by_query)
+    throw std::logic_error("bulk queries differ from the map's cells");
+}
+
+
+/**
+ * Times the terrain noise of the simple builder, one point at a time and in
+ * batches with each kernel this CPU supports.
+ */
+static void
+bench_noise(BenchOptions const& options)
+{
+  static const char* kernel_names[] = { "scalar", "sse2  ", "avx2  " };
+  std::size_t point_count = std::size_t(options.length) * options.width;
+
+  FastNoise noise;
+  noise.SetSeed(options.seed);
+  noise.SetNoiseType(FastNoise::GradientFractal);
+
+  std::vector<float> expected(point_count);
+  auto start = Clock::now();
+  for (unsigned y = 0; y < options.width; ++y)
+    for (unsigned x = 0; x < options.length; ++x)
+      expected[std::size_t(y) * options.length + x] = noise.GetNoise(x, y);
+  report("noise (point)       ", point_count, Clock::now() - start);
+
+  std::vector<float> actual(point_count);
+  for (int kernel = FastNoise::BatchScalar; kernel <= FastNoise::GetBatchKernel(); ++kernel)
+  {
+    start = Clock::now();
+    noise.FillNoiseSet(actual.data(), 0, 0, options.length, options.width, FastNoise::BatchKernel(kernel));
+    report(std::string("noise (batch ") + kernel_names[kernel] + ")", point_count, Clock::now() - start);
+    if (actual != expected)
+      throw std::logic_error(std::string(kernel_names[kernel]) + " batch noise differs from point noise");
+  }
+}
+
+
+/**
+ * Compares generating terrain and covering its exposed cells fused, a tile at
+ * a time through a pipeline, with a second sweep over the whole built map.
+ */
+static void
+bench_pipeline(BenchOptions const& options)
+{
+  std::size_t cell_count = std::size_t(options.length) * options.width * options.height;
+
+  MapPipeline pipeline;
+  pipeline.add_stage(std::unique_ptr<MapStage>(new TerrainStage(options.seed)));
+  pipeline.add_stage(std::unique_ptr<MapStage>(new CoverStage(1, 2)));
+  MapBuilderPipeline pipeline_builder(options.length, options.width, options.height, pipeline);
+  auto start = Clock::now();
+  Map fused(pipeline_builder);
+  report("pipeline (fused)    ", cell_count, Clock::now() - start);
+  pipeline.report(std::cout);
+
+  MapBuilderSimple simple_builder(options.length, options.width, options.height, options.seed);
+  start = Clock::now();
+  Map swept(simple_builder);
+  ChunkStore& cells = swept.cells();
+  std::vector<int> box(cell_count);
+  cells.box_at(0, 0, 0, cells.length(), cells.width(), cells.height(), box.data());
+  std::size_t row = cells.length();
+  std::size_t layer = row * cells.width();
+  for (unsigned z = 0; z < cells.height(); ++z)
+    for (unsigned y = 1; y + 1 < cells.width(); ++y)
+      for (unsigned x = 1; x + 1 < cells.length(); ++x)
+      {
+        int const* cell = box.data() + z * layer + y * row + x;
+        if (*cell == 1
+         && (cell[-1] == 0 || cell[1] == 0 || cell[-row] == 0 || cell[row] == 0
+          || (z > 0 && cell[-layer] == 0) || (z + 1 < cells.height() && cell[layer] == 0)))
+          cells.set_cell_index_at_unchecked(x, y, z, 2);
+      }
+  cells.compact();
+  report("pipeline (sweeps)   ", cell_count, Clock::now() - start);
+
+  for (unsigned y = 1; y + 1 < options.width; y += 97)
+    for (unsigned x = 1; x + 1 < options.length; x += 89)
+      for (unsigned z = 0; z < options.height; ++z)
+        if (fused.cell_index_at(x, y, z) != swept.cell_index_at(x, y, z))
+          throw std::logic_error("fused pipeline differs from separate sweeps");
+}
+
+
+/**
+ * Compares building a plain heightfield with carving caves out of it from
+ * noise sampled on a coarse lattice and from noise sampled at every cell.
+ */
+static void
+bench_caves(BenchOptions const& options)
+{
+  std::size_t cell_count = std::size_t(options.length) * options.width * options.height;
+
+  MapBuilderSimple simple_builder(options.length, options.width, options.height, options.seed);
+  auto start = Clock::now();
+  Map simple(simple_builder);
+  Clock::duration plain = Clock::now() - start;
+  report("caves (none)        ", cell_count, plain);
+
+  for (unsigned step: { 4u, 1u })
+  {
+    MapBuilderCaves cave_builder(options.length, options.width, options.height, options.seed, step);
+    start = Clock::now();
+    Map caves(cave_builder);
+    Clock::duration elapsed = Clock::now() - start;
+    report(step == 1 ? "caves (every cell)  " : "caves (lattice)     ", cell_count, elapsed);
+    std::cout << "  " << std::chrono::duration<double>(elapsed).count()
+                         / std::chrono::duration<double>(plain).count()
+              << "x the plain terrain\n";
+    cave_builder.pipeline().report(std::cout);
+  }
+}
+
+
+/**
+ * Times the map builders end to end.
+ */
+static void
+bench_build(BenchOptions const& options)
+{
+  std::size_t cell_count = std::size_t(options.length) * options.width * options.height;
+
+  MapBuilderSimple simple_builder(options.length, options.width, options.height, options.seed);
+  auto start = Clock::now();
+  Map map(simple_builder);
+  report("build (simple)      ", cell_count, Clock::now() - start);
+  auto usage = map.cells().memory_usage();
+  std::cout << "simple map storage: " << usage.uniform_bricks << " uniform, " << usage.palette_bricks
+            << " palette, " << usage.dense_bricks << " dense bricks, " << usage.bytes << " bytes (was "
+            << cell_count * sizeof(int) << ")\n";
+
+  std::stringstream sstr;
+  sstr << map;
+
+  // The text save read back by extracting each word and index in turn, as
+  // the stream builder once did.
+  std::istringstream extract_str(sstr.str());
+  start = Clock::now();
+  ChunkStore extracted(options.length, options.width, options.height);
+  std::string word;
+  unsigned extents[3];
+  extract_str >> word >> word >> word >> extents[0] >> extents[1] >> extents[2];
+  for (unsigned z = 0; z < options.height; ++z)
+  {
+    int num;
+    extract_str >> word >> num;
+    for (unsigned y = 0; y < options.width; ++y)
+      for (CellSpan segment: extracted.row(y, z))
+        for (int& index: segment)
+          extract_str >> index;
+  }
+  if (!extract_str)
+    throw std::runtime_error("error extracting the text save");
+  report("build (extract)     ", cell_count, Clock::now() - start);
+
+  start = Clock::now();
+  MapBuilderStream stream_builder(sstr);
+  Map loaded(stream_builder);
+  report("build (stream)      ", cell_count, Clock::now() - start);
+
+  if (!(map == loaded))
+    throw std::logic_error("loaded map differs from saved map");
+
+  std::stringstream bstr;
+  start = Clock::now();
+  write_binary(bstr, map);
+  Clock::duration elapsed = Clock::now() - start;
+  std::size_t save_bytes = bstr.str().size();
+  report_bytes("save (binary)       ", save_bytes, elapsed);
+  std::cout << "binary save: " << save_bytes << " bytes (text " << sstr.str().size() << ")\n";
+
+  start = Clock::now();
+  {
+    MapBuilderBinary binary_builder(bstr);
+    ChunkStore cells(binary_builder.map_length(), binary_builder.map_width(), binary_builder.map_height());
+    binary_builder.build_cells(cells);
+  }
+  report_bytes("load (binary)       ", save_bytes, Clock::now() - start);
+
+  bstr.seekg(0);
+  start = Clock::now();
+  MapBuilderBinary binary_builder(bstr);
+  Map binary_loaded(binary_builder);
+  report("build (binary)      ", cell_count, Clock::now() - start);
+
+  if (!(map == binary_loaded))
+    throw std::logic_error("binary loaded map differs from saved map");
+}
+
+
+/**
+ * Compares the cost of an autosave after a handful of edits as a full binary
+ * save and as a delta save of the changed bricks, and of loading the base save
+ * with the delta applied.
+ */
+static void
+bench_delta(BenchOptions const& options)
+{
+  MapBuilderSimple simple_builder(options.length, options.width, options.height, options.seed);
+  Map map(simple_builder);
+  std::stringstream base;
+  write_binary(base, map);
+  map.clear_dirty();
+
+  std::uint_fast32_t state = options.seed;
+  for (unsigned edit = 0; edit < 100; ++edit)
+  {
+    state = state * 1664525u + 1013904223u;
+    map.set_cell_index_at((state >> 8) % options.length, (state >> 4) % options.width,
+                          state % options.height, 2);
+  }
+  map.cells().compact();
+
+  std::stringstream full;
+  auto start = Clock::now();
+  write_binary(full, map);
+  Clock::duration full_elapsed = Clock::now() - start;
+
+  std::stringstream delta;
+  start = Clock::now();
+  write_binary_delta(delta, map);
+  Clock::duration delta_elapsed = Clock::now() - start;
+
+  std::cout << "autosave after 100 edits: " << map.dirty_bricks() << " of "
+            << map.cells().brick_count() << " bricks dirty, full "
+            << full.str().size() << " bytes in " << std::chrono::duration<double>(full_elapsed).count()
+            << "s, delta " << delta.str().size() << " bytes in "
+            << std::chrono::duration<double>(delta_elapsed).count() << "s\n";
+
+  start = Clock::now();
+  MapBuilderBinary base_builder(base);
+  MapBuilderDelta delta_builder(base_builder, delta);
+  Map loaded(delta_builder);
+  std::cout << "load (base + delta) : " << std::chrono::duration<double>(Clock::now() - start).count() << "s\n";
+
+  if (!(map == loaded))
+    throw std::logic_error("map loaded from a base and delta save differs from saved map");
+}
+
+
+/**
+ * Compares loading a save of a map of random cells (so every brick is dense)
+ * through a stream with mapping it in place.
+ */
+static void
+bench_mapped(BenchOptions const& options)
+{
+  std::size_t cell_count = std::size_t(options.length) * options.width * options.height;
+  ChunkStore cells(options.length, options.width, options.height);
+  std::uint_fast32_t state = options.seed;
+  for (unsigned z = 0; z < options.height; ++z)
+  {
+    for (unsigned y = 0; y < options.width; ++y)
+    {
+      for (CellSpan segment: cells.row(y, z))
+      {
+        for (int& index: segment)
+        {
+          state = state * 1664525u + 1013904223u;
+          index = state >> 8;
+        }
+      }
+    }
+  }
+
+  char file_name[] = "/tmp/bench_world_map.XXXXXX";
+  int fd = ::mkstemp(file_name);
+  if (fd < 0)
+    throw std::runtime_error("can not create a temporary save file");
+  ::close(fd);
+  {
+    std::ofstream ostr(file_name, std::ios::binary);
+    write_binary(ostr, cells);
+  }
+
+  try
+  {
+    auto start = Clock::now();
+    {
+      std::ifstream istr(file_name, std::ios::binary);
+      MapBuilderBinary binary_builder(istr);
+      Map loaded(binary_builder);
+    }
+    report("load (stream)       ", cell_count, Clock::now() - start);
+
+    Legacy::Core::PosixFileSystem fs;
+    start = Clock::now();
+    MapBuilderMapped mapped_builder(fs.map_for_input(Legacy::Core::Path(file_name)));
+    Map mapped(mapped_builder);
+    report("load (mapped)       ", cell_count, Clock::now() - start);
+    auto usage = mapped.cells().memory_usage();
+    std::cout << "mapped map storage: " << usage.borrowed_bricks << " of " << mapped.cells().brick_count()
+              << " bricks borrowed, " << usage.bytes << " bytes owned\n";
+
+    start = Clock::now();
+    bool equal = mapped.cells() == cells;
+    report("compare (mapped)    ", cell_count, Clock::now() - start);
+    if (!equal)
+      throw std::logic_error("mapped map differs from saved map");
+  }
+  catch (...)
+  {
+    std::remove(file_name);
+    throw;
+  }
+  std::remove(file_name);
+}
+
+
+/**
+ * Times a walk across a lazily built world far too large to build whole,
+ * reading the cells around each step.
+ */
+static void
+bench_lazy(BenchOptions const& options)
+{
+  unsigned const world_size = 1u << 20;
+  unsigned const steps = 4096;
+  unsigned const radius = 8;
+
+  MapBuilderSimple builder(world_size, world_size, options.height, options.seed);
+  LazyMapOptions lazy_options;
+  lazy_options.region_size = 64;
+  lazy_options.resident_regions = 64;
+  Map map(builder, lazy_options);
+
+  std::size_t reads = 0;
+  long long checksum = 0;
+  unsigned x = world_size / 2;
+  unsigned y = world_size / 2;
+  auto start = Clock::now();
+  for (unsigned step = 0; step < steps; ++step, ++x, y += step % 2)
+  {
+    for (unsigned dy = y - radius; dy < y + radius; ++dy)
+    {
+      for (unsigned dx = x - radius; dx < x + radius; ++dx)
+      {
+        checksum += map.cell_index_at(dx, dy, options.height / 2);
+        ++reads;
+      }
+    }
+  }
+  report("lazy walk           ", reads, Clock::now() - start);
+  std::cout << "lazy world: " << world_size << "x" << world_size << "x" << options.height << ", "
+            << map.resident_regions() << " regions resident (checksum " << checksum << ")\n";
+}
+
+
+/**
+ * Times changing cells of a map to variants of their cells through a cell
+ * cache, then compacting the cache on another thread once most of the
+ * variants are out of use, reporting its memory before and after.
+ */
+static void
+bench_cells(BenchOptions const& options)
+{
+  MapBuilderSimple builder(options.length, options.width, options.height, options.seed);
+  Map map(builder);
+  CellCache cache;
+  if (cache.intern(Cell(1, 0, Cell::full)) != 1)
+    throw std::logic_error("the solid cell is not at the index the builder uses");
+  cache.add_refs(map.cells());
+
+  std::size_t edits = std::size_t(options.length) * options.width;
+  std::vector<unsigned> heights = make_heights(options);
+  auto start = Clock::now();
+  for (std::size_t i = 0; i < edits; ++i)
+  {
+    unsigned x = i % options.length;
+    unsigned y = i / options.length;
+    unsigned z = heights[i] % options.height;
+    Cell cell = map.cell_at(x, y, z, cache);
+    map.set_cell_at(x, y, z, cell.with_material(Cell::Material(i % 4096)).with_occupancy(i % 251), cache);
+  }
+  report("cell variant edits  ", edits, Clock::now() - start);
+  std::cout << "cell cache: " << cache.size() << " cells, " << cache.unused() << " unused\n";
+
+  // Empty most of the changed positions again.
+  for (std::size_t i = 0; i < edits; ++i)
+  {
+    if (i % 64 == 0)
+      continue;
+    unsigned x = i % options.length;
+    unsigned y = i / options.length;
+    unsigned z = heights[i] % options.height;
+    map.set_cell_at(x, y, z, Cell(), cache);
+  }
+
+  start = Clock::now();
+  std::future<CellCache::Compaction> pending = cache.compact_in_background();
+  long long checksum = 0;
+  for (unsigned x = 0; x < options.length; ++x)
+    checksum += cache.material_at(map.cell_index_at(x, 0, options.height / 2));
+  CellCache::Compaction compaction = pending.get();
+  auto elapsed = Clock::now() - start;
+  std::cout << "cell cache compaction: " << compaction.released << " cells released in "
+            << std::chrono::duration<double>(elapsed).count() << "s, memory "
+            << compaction.memory_before << " bytes before, " << compaction.memory_after
+            << " bytes after (checksum " << checksum << ")\n";
+}
+
+
+/**
+ * Times the simple builder on pools of 1, 2, 4, ... threads up to the number of
+ * hardware threads (or --threads), checking each map matches the
+ * single-threaded one.
+ */
+static void
+bench_scaling(BenchOptions const& options)
+{
+  std::size_t cell_count = std::size_t(options.length) * options.width * options.height;
+  unsigned max_threads = options.threads ? options.threads : std::thread::hardware_concurrency();
+  max_threads = std::max(1u, max_threads);
+
+  Legacy::Core::ThreadPool serial_pool(1);
+  MapBuilderSimple serial_builder(options.length, options.width, options.height, options.seed, serial_pool);
+  auto start = Clock::now();
+  Map serial_map(serial_builder);
+  Clock::duration serial_elapsed = Clock::now() - start;
+  report("build (1 thread)    ", cell_count, serial_elapsed);
+
+  for (unsigned threads = 2; threads <= max_threads; threads *= 2)
+  {
+    Legacy::Core::ThreadPool pool(threads);
+    MapBuilderSimple builder(options.length, options.width, options.height, options.seed, pool);
+    start = Clock::now();
+    Map map(builder);
+    Clock::duration elapsed = Clock::now() - start;
+
+    std::string label = "build (" + std::to_string(threads) + " threads)";
+    label.resize(20, ' ');
+    report(label, cell_count, elapsed);
+    std::cout << "  speedup " << std::chrono::duration<double>(serial_elapsed).count()
+                               / std::chrono::duration<double>(elapsed).count() << "x\n";
+
+    if (!(map == serial_map))
+      throw std::logic_error("map built on " + std::to_string(threads) + " threads differs");
+  }
+}
+
+
+/**
+ * Fills a store so that every brick ends up in the given storage mode.
+ */
+static void
+fill_for_mode(ChunkStore& store, ChunkStore::BrickMode mode)
+{
+  if (mode == ChunkStore::BrickMode::uniform)
+  {
+    store.fill(1);
+    return;
+  }
+  for (unsigned z = 0; z < store.height(); ++z)
+  {
+    for (unsigned y = 0; y < store.width(); ++y)
+    {
+      unsigned x = 0;
+      for (CellSpan segment: store.row(y, z))
+      {
+        for (int& index: segment)
+        {
+          // A handful of values for palette bricks, all different for dense.
+          index = (mode == ChunkStore::BrickMode::palette) ? (x + y + z) % 4
+                                                           : int(store.brick_offset_of(x, y, z));
+          ++x;
+        }
+      }
+    }
+  }
+  store.compact();
+}
+
+
+/**
+ * Reports the read and write costs and memory use of each brick storage mode.
+ */
+static void
+bench_modes(BenchOptions const& options)
+{
+  static const char* mode_names[] = { "uniform", "palette", "dense  " };
+  std::size_t cell_count = std::size_t(options.length) * options.width * options.height;
+
+  for (auto mode: { ChunkStore::BrickMode::uniform, ChunkStore::BrickMode::palette, ChunkStore::BrickMode::dense })
+  {
+    std::string name = mode_names[static_cast<int>(mode)];
+    ChunkStore store(options.length, options.width, options.height);
+    fill_for_mode(store, mode);
+    auto usage = store.memory_usage();
+    std::cout << name << " storage: " << usage.uniform_bricks << " uniform, " << usage.palette_bricks
+              << " palette, " << usage.dense_bricks << " dense bricks, " << usage.bytes << " bytes ("
+              << double(usage.bytes) / cell_count << " bytes/cell)\n";
+
+    long long checksum = 0;
+    auto start = Clock::now();
+    for (unsigned z = 0; z < store.height(); ++z)
+      for (unsigned y = 0; y < store.width(); ++y)
+        for (unsigned x = 0; x < store.length(); ++x)
+          checksum += store.cell_index_at_unchecked(x, y, z);
+    report(name + " read (cell)  ", cell_count, Clock::now() - start);
+
+    start = Clock::now();
+    for (unsigned z = 0; z < store.height(); ++z)
+      for (unsigned y = 0; y < store.width(); ++y)
+        for (ConstCellSpan segment: static_cast<ChunkStore const&>(store).row(y, z))
+          for (int index: segment)
+            checksum -= index;
+    report(name + " read (rows)  ", cell_count, Clock::now() - start);
+
+    // Rewrite every cell with its own value so the brick keeps its mode.
+    start = Clock::now();
+    for (unsigned z = 0; z < store.height(); ++z)
+      for (unsigned y = 0; y < store.width(); ++y)
+        for (unsigned x = 0; x < store.length(); ++x)
+          store.set_cell_index_at_unchecked(x, y, z, store.cell_index_at_unchecked(x, y, z));
+    report(name + " write (cell) ", cell_count, Clock::now() - start);
+
+    if (checksum != 0 || store.memory_usage().bytes != usage.bytes)
+      throw std::logic_error("brick storage changed while rewriting the same values");
+  }
+}
+
+
+static void
+print_help(char const* argv0)
+{
+  std::cerr << "Usage: " << argv0 << " [ options ]\n"
+            << "Options:\n"
+            << "  -h, --help                  Prints this message and exits\n"
+            << "  -l, --length=N              Sets the map length (default 512)\n"
+            << "  -w, --width=N               Sets the map width (default 512)\n"
+            << "  -z, --height=N              Sets the map height (default 64)\n"
+            << "  -s, --seed=N                Sets the map generator seed (default 1)\n"
+            << "  -t, --threads=N             Sets the most threads to build with\n"
+            << "                              (default one per hardware thread)\n";
+}
+
+
+int
+main(int argc, char* argv[])
+{
+  BenchOptions bench_options;
+
+  static const option options[] = {
+    { "help",       no_argument,       0,    'h' },
+    { "length",     required_argument, 0,    'l' },
+    { "width",      required_argument, 0,    'w' },
+    { "height",     required_argument, 0,    'z' },
+    { "seed",       required_argument, 0,    's' },
+    { "threads",    required_argument, 0,    't' },
+    { NULL,         no_argument,       NULL,  0  }
+  };
+
+  while (1)
+  {
+    int option_index;
+    int c = getopt_long(argc, argv, "hl:w:z:s:t:", options, &option_index);
+    if (c < 0)
+      break;
+
+    switch (c)
+    {
+      case 'h':
+        print_help(argv[0]);
+        std::exit(0);
+        break;
+
+      case 'l':
+        bench_options.length = std::strtoul(::optarg, nullptr, 10);
+        break;
+
+      case 'w':
+        bench_options.width = std::strtoul(::optarg, nullptr, 10);
+        break;
+
+      case 'z':
+        bench_options.height = std::strtoul(::optarg, nullptr, 10);
+        break;
+
+      case 's':
+        bench_options.seed = std::strtoul(::optarg, nullptr, 10);
+        break;
+
+      case 't':
+        bench_options.threads = std::strtoul(::optarg, nullptr, 10);
+        break;
+
+      case '?':
+        print_help(argv[0]);
+        std::exit(1);
+        break;
+    }
+  }
+
+  try
+  {
+    std::cout << "map is " << bench_options.length << "x" << bench_options.width
+              << "x" << bench_options.height << "\n";
+    bench_fill(bench_options);
+    bench_compare(bench_options);
+    bench_surface(bench_options);
+    bench_queries(bench_options);
+    bench_noise(bench_options);
+    bench_build(bench_options);
+    bench_pipeline(bench_options);
+    bench_caves(bench_options);
+    bench_mapped(bench_options);
+    bench_delta(bench_options);
+    bench_lazy(bench_options);
+    bench_cells(bench_options);
+    bench_scaling(bench_options);
+    bench_modes(bench_options);
+  }
+  catch (std::exception const& ex)
+  {
+    std::cerr << "exception caught: " << ex.what() << "\nexiting...\n";
+    return -1;
+  }
+  return 0;
+}
@@ -26,7 +26,9 @@
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include "legacy/core/posix_filesystem.h"
 #include "legacy/world/map.h"
+#include "legacy/world/mapbuilderbinary.h"
 #include "legacy/world/mapbuildersimple.h"
 #include "legacy/world/mapbuilderstream.h"
 #include <sstream>
@@ -43,9 +45,12 @@ dump_map(Legacy::World::Map const& map)
     std::cout << "layer " << i << "\n";
     for (unsigned y = 0; y < layer.width(); ++y)
     {
-      for (unsigned x = 0; x < layer.length(); ++x)
+      for (Legacy::World::ConstCellSpan segment: layer.row(y))
       {
-        std::cout << layer.cell_index_at(x, y) << " ";
+        for (int index: segment)
+        {
+          std::cout << index << " ";
+        }
       }
       std::cout << "\n";
     }
@@ -65,7 +70,7 @@ dump_static_map()
 void
 dump_savefile_map(std::string const& savefile_name)
 {
-  std::ifstream istr(savefile_name);
+  std::ifstream istr(savefile_name, std::ios::binary);
   if (!istr)
   {
     std::ostringstream ostr;
@@ -73,9 +78,24 @@ dump_savefile_map(std::string const& savefile_name)
     throw std::runtime_error(ostr.str());
   }
 
-  Legacy::World::MapBuilderStream map_builder(istr);
-  Legacy::World::Map map(map_builder);
-  dump_map(map);
+  // Binary saves start with their magic, anything else is taken to be text.
+  char magic[sizeof(Legacy::World::BinaryMap::magic)] = { };
+  istr.read(magic, sizeof(magic));
+  istr.clear();
+  istr.seekg(0);
+  if (std::memcmp(magic, Legacy::World::BinaryMap::magic, sizeof(magic)) == 0)
+  {
+    Legacy::Core::PosixFileSystem fs;
+    Legacy::World::MapBuilderMapped map_builder(fs.map_for_input(Legacy::Core::Path(savefile_name)));
+    Legacy::World::Map map(map_builder);
+    dump_map(map);
+  }
+  else
+  {
+    Legacy::World::MapBuilderStream map_builder(istr);
+    Legacy::World::Map map(map_builder);
+    dump_map(map);
+  }
 }
 
 
@@ -85,7 +105,7 @@ print_help(char const* argv0)
   std::cerr << "Usage: " << argv0 << " [ options ]\n"
             << "Options:\n"
             << "  -h, --help                  Prints this message and exits\n"
-            << "  -f, --save-file=FILENAME    Dumps a map from a named savefile.\n";
+            << "  -f, --save-file=FILENAME    Dumps a map from a named text or binary savefile.\n";
 }
 
 